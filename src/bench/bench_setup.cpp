@@ -0,0 +1,85 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench_setup.h"
+
+#include "chainparams.h"
+#include "evo/deterministicmns.h"
+#include "evo/evodb.h"
+#include "random.h"
+#include "sapling/sapling_proofcache.h"
+#include "script/sigcache.h"
+#include "sporkdb.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "util/system.h"
+#include "validation.h"
+#include "validationinterface.h"
+
+BasicBenchSetup::BasicBenchSetup() :
+    m_path(fs::temp_directory_path() / "bench_pivx" / strprintf("%lu_%i", (unsigned long)GetTime(), (int)GetRandInt(1 << 30)))
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    fs::create_directories(m_path);
+    gArgs.ForceSetArg("-datadir", m_path.string());
+    ClearDatadirCache();
+}
+
+BasicBenchSetup::~BasicBenchSetup()
+{
+    ClearDatadirCache();
+    fs::remove_all(m_path);
+    SelectParams(CBaseChainParams::REGTEST);
+}
+
+ChainstateBenchSetup::ChainstateBenchSetup(const std::vector<std::pair<Consensus::UpgradeIndex, int>>& vUpgrades,
+                                           bool fCheckThreads)
+{
+    for (const auto& upgrade : vUpgrades) {
+        UpdateNetworkUpgradeParameters(upgrade.first, upgrade.second);
+    }
+    InitSignatureCache();
+    InitShieldedProofsCache();
+
+    m_scheduler_thread = std::thread(std::bind(&CScheduler::serviceQueue, &m_scheduler));
+    GetMainSignals().RegisterBackgroundSignalScheduler(m_scheduler);
+
+    evoDb.reset(new CEvoDB(1 << 20, true, true));
+    deterministicMNManager.reset(new CDeterministicMNManager(*evoDb));
+    zerocoinDB = new CZerocoinDB(0, true);
+    pSporkDB = new CSporkDB(0, true);
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    m_coins_db_view.reset(new CCoinsViewDB(1 << 23, true));
+    pcoinsTip = new CCoinsViewCache(m_coins_db_view.get());
+    assert(LoadGenesisBlock());
+    CValidationState state;
+    assert(ActivateBestChain(state));
+
+    if (fCheckThreads) {
+        nScriptCheckThreads = std::max(2, GetNumCores());
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) {
+            m_check_threads.create_thread(&ThreadScriptCheck);
+        }
+    }
+}
+
+ChainstateBenchSetup::~ChainstateBenchSetup()
+{
+    mempool.clear();
+    m_check_threads.interrupt_all();
+    m_check_threads.join_all();
+    nScriptCheckThreads = 0;
+    m_scheduler.stop(false);
+    m_scheduler_thread.join();
+    GetMainSignals().FlushBackgroundCallbacks();
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
+    UnloadBlockIndex();
+    delete pcoinsTip;
+    m_coins_db_view.reset();
+    delete pblocktree;
+    delete zerocoinDB;
+    delete pSporkDB;
+    deterministicMNManager.reset();
+    evoDb.reset();
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_BENCH_BENCH_SETUP_H
+#define PIVX_BENCH_BENCH_SETUP_H
+
+#include "consensus/params.h"
+#include "fs.h"
+#include "scheduler.h"
+
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+class CCoinsViewDB;
+
+/** A temporary data directory, removed at the end, with the regtest params
+ *  selected. The regtest params are selected again at the end, to drop the
+ *  network upgrades set by the benchmark. */
+class BasicBenchSetup
+{
+public:
+    BasicBenchSetup();
+    ~BasicBenchSetup();
+
+protected:
+    const fs::path m_path;
+};
+
+/** A regtest chainstate, with the databases in memory, on top of a temporary
+ *  data directory, and the scheduler thread of the validation interface.
+ *  The chainstate is global: build it in the benchmark function, so that it
+ *  is torn down before the next benchmark runs. */
+class ChainstateBenchSetup : public BasicBenchSetup
+{
+public:
+    /** @param[in] vUpgrades       activation heights set before the genesis block is loaded
+     *  @param[in] fCheckThreads   whether to start the script check threads (one per core) */
+    explicit ChainstateBenchSetup(const std::vector<std::pair<Consensus::UpgradeIndex, int>>& vUpgrades = {},
+                                  bool fCheckThreads = false);
+    ~ChainstateBenchSetup();
+
+private:
+    std::unique_ptr<CCoinsViewDB> m_coins_db_view;
+    CScheduler m_scheduler;
+    std::thread m_scheduler_thread;
+    boost::thread_group m_check_threads;
+};
+
+#endif // PIVX_BENCH_BENCH_SETUP_H
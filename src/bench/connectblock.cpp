@@ -0,0 +1,246 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench/bench_setup.h"
+
+#include "blockassembler.h"
+#include "chainparams.h"
+#include "evo/providertx.h"
+#include "evo/specialtx.h"
+#include "keystore.h"
+#include "miner.h"
+#include "netbase.h"
+#include "sapling/transaction_builder.h"
+#include "script/sign.h"
+#include "util/system.h"
+#include "validation.h"
+
+// This benchmark measures the connection and disconnection of a sequence of
+// BENCH_BLOCKS blocks through the real validation path (ActivateBestChain /
+// InvalidateBlock, as done by the reconsiderblock / invalidateblock RPCs),
+// on top of a regtest chainstate kept in a temporary data directory.
+// Each block holds P2PKH spends (fanned out to P2PKH and P2CS outputs),
+// a transaction spending all the P2PKH outputs of the previous block,
+// transactions shielding a coinbase to a Sapling output, and a ProRegTx
+// registering a masternode with its collateral.
+// When the blocks are disconnected, their transactions go back to the
+// mempool, so (as on a live node) the signature and proof caches are warm
+// when they are connected again.
+// Once measured, the blocks are connected once more with the bench log
+// category printed to the console: the time spent in each phase of
+// ConnectBlock (connect, verify, special txes, index), and the totals.
+static const int BENCH_BLOCKS = 10;
+static const int SPENDS_PER_BLOCK = 20;
+static const int SHIELDED_PER_BLOCK = 2;
+static const int COINBASE_BLOCKS = 400;
+static const CAmount BENCH_FEE = 100000;
+static const CAmount SHIELDED_FEE = COIN / 10;
+
+class ConnectBlockBenchSetup : public ChainstateBenchSetup
+{
+public:
+    CBlockIndex* pindexBase{nullptr};
+    CBlockIndex* pindexFirst{nullptr};
+    CBlockIndex* pindexLast{nullptr};
+
+    ConnectBlockBenchSetup() :
+        // Keep the chain in the PoW phase, with the Sapling and v6.0 (deterministic masternodes) rules enforced
+        ChainstateBenchSetup({{Consensus::UPGRADE_POS, COINBASE_BLOCKS + 100},
+                              {Consensus::UPGRADE_V3_4, COINBASE_BLOCKS + 101},
+                              {Consensus::UPGRADE_V5_0, COINBASE_BLOCKS + 1},
+                              {Consensus::UPGRADE_V6_0, COINBASE_BLOCKS + 1}},
+                             true /* fCheckThreads */)
+    {
+        initZKSNARKS();
+        m_coinbase_key.MakeNewKey(true);
+        m_keystore.AddKey(m_coinbase_key);
+        m_script_coinbase = GetScriptForDestination(m_coinbase_key.GetPubKey().GetID());
+        std::vector<COutPoint> vCoinbases;
+        for (int i = 0; i < COINBASE_BLOCKS; i++) {
+            const CBlock& block = CreateAndProcessBlock({});
+            vCoinbases.emplace_back(block.vtx[0]->GetHash(), 0);
+        }
+        pindexBase = WITH_LOCK(cs_main, return chainActive.Tip());
+
+        // Build the sequence of blocks on top of the base chain
+        std::vector<COutPoint> vPrevOutputs;
+        size_t nextCoinbase = 0;
+        for (int i = 0; i < BENCH_BLOCKS; i++) {
+            std::vector<CMutableTransaction> vtx;
+            std::vector<COutPoint> vOutputs;
+            for (int j = 0; j < SPENDS_PER_BLOCK; j++) {
+                CMutableTransaction tx = CreateSpend({vCoinbases[nextCoinbase++]});
+                const CAmount nValue = tx.vout[0].nValue / 4;
+                tx.vout[0].nValue -= 3 * nValue;
+                tx.vout.emplace_back(nValue, m_script_coinbase);
+                tx.vout.emplace_back(nValue, GetScriptForStakeDelegation(GetRandomKey().GetPubKey().GetID(),
+                                                                         m_coinbase_key.GetPubKey().GetID()));
+                tx.vout.emplace_back(nValue, m_script_coinbase);
+                Sign(tx);
+                for (int k : {0, 1, 3}) vOutputs.emplace_back(tx.GetHash(), k);
+                vtx.emplace_back(tx);
+            }
+            if (!vPrevOutputs.empty()) {
+                CMutableTransaction tx = CreateSpend(vPrevOutputs);
+                Sign(tx);
+                vtx.emplace_back(tx);
+            }
+            for (int j = 0; j < SHIELDED_PER_BLOCK; j++) {
+                vtx.emplace_back(CreateShieldingTx(vCoinbases[nextCoinbase++], pindexBase->nHeight + i + 1));
+            }
+            vtx.emplace_back(CreateProRegTx(vCoinbases[nextCoinbase++], i + 1));
+            vPrevOutputs = vOutputs;
+
+            CreateAndProcessBlock(vtx);
+            CBlockIndex* pindex = WITH_LOCK(cs_main, return chainActive.Tip());
+            assert(pindex->nHeight == pindexBase->nHeight + i + 1);
+            if (i == 0) pindexFirst = pindex;
+            pindexLast = pindex;
+        }
+    }
+
+private:
+    CKey m_coinbase_key;
+    CBasicKeyStore m_keystore;
+    CScript m_script_coinbase;
+    const libzcash::SaplingSpendingKey m_sapling_key{libzcash::SaplingSpendingKey::random()};
+    // Outputs of the transactions created so far, to sign their spends
+    std::map<COutPoint, CTxOut> m_outputs;
+
+    static CKey GetRandomKey()
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        return key;
+    }
+
+    void AddOutputs(const CTransaction& tx)
+    {
+        for (size_t i = 0; i < tx.vout.size(); i++) {
+            m_outputs.emplace(COutPoint(tx.GetHash(), i), tx.vout[i]);
+        }
+    }
+
+    CBlock CreateAndProcessBlock(const std::vector<CMutableTransaction>& vtx)
+    {
+        std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(
+                Params(), DEFAULT_PRINTPRIORITY).CreateNewBlock(m_script_coinbase, nullptr, false, nullptr, true);
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(pblocktemplate->block);
+        for (const CMutableTransaction& tx : vtx) {
+            pblock->vtx.emplace_back(MakeTransactionRef(tx));
+        }
+        const int nHeight = WITH_LOCK(cs_main, return chainActive.Height()) + 1;
+        pblock->hashFinalSaplingRoot = CalculateSaplingTreeRoot(pblock.get(), nHeight, Params());
+        assert(SolveBlock(pblock, nHeight));
+
+        CValidationState state;
+        assert(ProcessNewBlock(state, pblock, nullptr));
+        assert(WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash()) == pblock->GetHash());
+        for (const auto& tx : pblock->vtx) {
+            AddOutputs(*tx);
+        }
+        return *pblock;
+    }
+
+    // Spend the given outputs to a single P2PKH output (unsigned)
+    CMutableTransaction CreateSpend(const std::vector<COutPoint>& vInputs)
+    {
+        CMutableTransaction tx;
+        tx.nVersion = CTransaction::TxVersion::SAPLING;
+        CAmount nValue = -BENCH_FEE;
+        for (const COutPoint& out : vInputs) {
+            tx.vin.emplace_back(out);
+            nValue += m_outputs.at(out).nValue;
+        }
+        tx.vout.emplace_back(nValue, m_script_coinbase);
+        return tx;
+    }
+
+    void Sign(CMutableTransaction& tx)
+    {
+        for (size_t i = 0; i < tx.vin.size(); i++) {
+            const CTxOut& prevOut = m_outputs.at(tx.vin[i].prevout);
+            assert(SignSignature(m_keystore, prevOut.scriptPubKey, tx, i, prevOut.nValue, SIGHASH_ALL));
+        }
+    }
+
+    // Spend the given output to a single Sapling output
+    CMutableTransaction CreateShieldingTx(const COutPoint& input, int nHeight)
+    {
+        const CTxOut& prevOut = m_outputs.at(input);
+        TransactionBuilder builder(Params().GetConsensus(), nHeight, &m_keystore);
+        builder.AddTransparentInput(input, prevOut.scriptPubKey, prevOut.nValue);
+        builder.AddSaplingOutput(m_sapling_key.full_viewing_key().ovk, m_sapling_key.default_address(), prevOut.nValue - SHIELDED_FEE);
+        builder.SetFee(SHIELDED_FEE);
+        return CMutableTransaction(builder.Build().GetTxOrThrow());
+    }
+
+    // ProRegTx with the collateral in its first output
+    CMutableTransaction CreateProRegTx(const COutPoint& input, int port)
+    {
+        const CKey& ownerKey = GetRandomKey();
+        const CKey& operatorKey = GetRandomKey();
+        ProRegPL pl;
+        pl.collateralOutpoint = COutPoint(UINT256_ZERO, 0);
+        pl.addr = LookupNumeric("1.1.1.1", port);
+        pl.keyIDOwner = ownerKey.GetPubKey().GetID();
+        pl.keyIDOperator = operatorKey.GetPubKey().GetID();
+        pl.keyIDVoting = ownerKey.GetPubKey().GetID();
+        pl.scriptPayout = GetScriptForDestination(GetRandomKey().GetPubKey().GetID());
+
+        CMutableTransaction tx = CreateSpend({input});
+        tx.nType = CTransaction::TxType::PROREG;
+        const CAmount nCollateral = Params().GetConsensus().nMNCollateralAmt;
+        tx.vout[0].nValue -= nCollateral;
+        tx.vout.insert(tx.vout.begin(), CTxOut(nCollateral, pl.scriptPayout));
+        pl.inputsHash = CalcTxInputsHash(tx);
+        SetTxPayload(tx, pl);
+        Sign(tx);
+        return tx;
+    }
+};
+
+static void ConnectDisconnectBlocks(benchmark::State& state)
+{
+    // The chainstate is global: build it for this benchmark only
+    ConnectBlockBenchSetup setup;
+    {
+        LOCK(cs_main);
+        CValidationState valState;
+        assert(InvalidateBlock(valState, Params(), setup.pindexFirst));
+    }
+
+    while (state.KeepRunning()) {
+        CValidationState valState;
+        {
+            LOCK(cs_main);
+            assert(ReconsiderBlock(valState, setup.pindexFirst));
+        }
+        assert(ActivateBestChain(valState));
+        {
+            LOCK(cs_main);
+            assert(chainActive.Tip() == setup.pindexLast);
+            assert(InvalidateBlock(valState, Params(), setup.pindexFirst));
+            assert(chainActive.Tip() == setup.pindexBase);
+        }
+    }
+
+    // Report the ConnectBlock phases (they are only logged in the bench category)
+    g_logger->m_print_to_console = true;
+    g_logger->EnableCategory(BCLog::BENCH);
+    {
+        CValidationState valState;
+        {
+            LOCK(cs_main);
+            assert(ReconsiderBlock(valState, setup.pindexFirst));
+        }
+        assert(ActivateBestChain(valState));
+        assert(WITH_LOCK(cs_main, return chainActive.Tip()) == setup.pindexLast);
+    }
+    g_logger->DisableCategory(BCLog::BENCH);
+    g_logger->m_print_to_console = false;
+}
+
+BENCHMARK(ConnectDisconnectBlocks);
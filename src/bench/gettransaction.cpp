@@ -0,0 +1,100 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench/bench_setup.h"
+
+#include "chain.h"
+#include "index/txindex.h"
+#include "streams.h"
+#include "validation.h"
+
+#include <thread>
+
+namespace block_bench {
+#include "bench/data/block2680960.raw.h"
+}
+
+// These benchmarks measure the lookup of confirmed transactions through the
+// transaction index (getrawtransaction), from one thread and from one thread
+// per core. Each iteration does LOOKUPS_PER_ITERATION lookups in total: as
+// the disk reads are done without cs_main, the multi-threaded case should
+// run faster with the number of cores.
+static const int MIN_CORES = 2;
+static const int LOOKUPS_PER_ITERATION = 1000;
+
+/** A block stored in a temporary blocks directory, with its transactions in
+ *  an in-memory transaction index. */
+class TxIndexBenchSetup : public BasicBenchSetup
+{
+public:
+    std::vector<uint256> vTxids;
+
+    TxIndexBenchSetup()
+    {
+        CDataStream stream((const char*)block_bench::block2680960,
+                (const char*)&block_bench::block2680960[sizeof(block_bench::block2680960)],
+                SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        stream >> block;
+
+        FlatFilePos blockPos(0, 0);
+        {
+            CAutoFile fileout(OpenBlockFile(blockPos), SER_DISK, CLIENT_VERSION);
+            assert(!fileout.IsNull());
+            fileout << block;
+        }
+
+        // Index the transactions as the txindex does for a connected block
+        CBlockIndex index(block);
+        index.nStatus |= BLOCK_HAVE_DATA;
+        index.nFile = blockPos.nFile;
+        index.nDataPos = blockPos.nPos;
+        g_txindex.reset(new TxIndex(1 << 20, true));
+        assert(g_txindex->WriteBlock(block, &index));
+        for (const auto& tx : block.vtx) {
+            vTxids.emplace_back(tx->GetHash());
+        }
+    }
+
+    ~TxIndexBenchSetup()
+    {
+        g_txindex.reset();
+    }
+};
+
+static void LookupTransactions(const std::vector<uint256>& vTxids, int nLookups)
+{
+    for (int i = 0; i < nLookups; i++) {
+        CTransactionRef tx;
+        uint256 hashBlock;
+        assert(GetTransaction(vTxids[i % vTxids.size()], tx, hashBlock, true));
+    }
+}
+
+static void GetTransactionTxIndex(benchmark::State& state, int nThreads)
+{
+    TxIndexBenchSetup setup;
+    const std::vector<uint256>& vTxids = setup.vTxids;
+    while (state.KeepRunning()) {
+        std::vector<std::thread> threads;
+        for (int j = 0; j < nThreads; j++) {
+            threads.emplace_back(LookupTransactions, std::cref(vTxids), LOOKUPS_PER_ITERATION / nThreads);
+        }
+        for (auto& t : threads) t.join();
+    }
+}
+
+static void GetTransactionTxIndexSingleThread(benchmark::State& state)
+{
+    GetTransactionTxIndex(state, 1);
+}
+
+static void GetTransactionTxIndexMultiThread(benchmark::State& state)
+{
+    GetTransactionTxIndex(state, std::max(MIN_CORES, GetNumCores()));
+}
+
+BENCHMARK(GetTransactionTxIndexSingleThread);
+BENCHMARK(GetTransactionTxIndexMultiThread);
@@ -0,0 +1,142 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench/bench_setup.h"
+
+#include "blockassembler.h"
+#include "chainparams.h"
+#include "keystore.h"
+#include "miner.h"
+#include "sapling/sapling_proofcache.h"
+#include "sapling/transaction_builder.h"
+#include "script/sigcache.h"
+#include "script/sign.h"
+#include "txmempool.h"
+#include "util/system.h"
+#include "validation.h"
+
+#include <atomic>
+#include <thread>
+
+// These benchmarks measure the acceptance to the mempool of MEMPOOL_TXES
+// signed transactions (P2PKH spends, and SHIELDED_TXES of them shielding the
+// coins to a Sapling output), submitted concurrently by SUBMIT_THREADS threads
+// (as the message handler and the RPC workers do), on top of a regtest
+// chainstate kept in a temporary data directory. Each iteration starts with
+// an empty mempool and empty signature/proof caches, so the tx/s accepted are
+// MEMPOOL_TXES divided by the reported time.
+// MempoolAcceptPreVerified verifies each transaction with PreVerifyMempoolTx
+// before taking cs_main, MempoolAcceptLocked does everything under cs_main.
+static const int MEMPOOL_TXES = 200;
+static const int SHIELDED_TXES = 20;
+static const int SUBMIT_THREADS = 4;
+static const int COINBASE_BLOCKS = MEMPOOL_TXES + 101;
+static const CAmount BENCH_FEE = 100000;
+static const CAmount SHIELDED_FEE = COIN / 10;
+
+class MempoolAcceptBenchSetup : public ChainstateBenchSetup
+{
+public:
+    std::vector<CTransactionRef> vtx;
+
+    MempoolAcceptBenchSetup() :
+        // Keep the chain in the PoW phase, with the Sapling rules enforced in the mempool
+        ChainstateBenchSetup({{Consensus::UPGRADE_POS, COINBASE_BLOCKS + 100},
+                              {Consensus::UPGRADE_V3_4, COINBASE_BLOCKS + 101},
+                              {Consensus::UPGRADE_V5_0, COINBASE_BLOCKS + 1}})
+    {
+        initZKSNARKS();
+        CKey key;
+        key.MakeNewKey(true);
+        m_keystore.AddKey(key);
+        m_script = GetScriptForDestination(key.GetPubKey().GetID());
+        std::vector<CTransactionRef> vCoinbases;
+        for (int i = 0; i < COINBASE_BLOCKS; i++) {
+            vCoinbases.emplace_back(CreateAndProcessBlock());
+        }
+
+        // Spend the mature coinbases, each to a single Sapling output for the
+        // first SHIELDED_TXES, and to a single P2PKH output for the others
+        const libzcash::SaplingSpendingKey sk = libzcash::SaplingSpendingKey::random();
+        for (int i = 0; i < MEMPOOL_TXES; i++) {
+            const CTxOut& prevOut = vCoinbases[i]->vout[0];
+            if (i < SHIELDED_TXES) {
+                TransactionBuilder builder(Params().GetConsensus(), COINBASE_BLOCKS + 1, &m_keystore);
+                builder.AddTransparentInput(COutPoint(vCoinbases[i]->GetHash(), 0), prevOut.scriptPubKey, prevOut.nValue);
+                builder.AddSaplingOutput(sk.full_viewing_key().ovk, sk.default_address(), prevOut.nValue - SHIELDED_FEE);
+                builder.SetFee(SHIELDED_FEE);
+                vtx.emplace_back(MakeTransactionRef(builder.Build().GetTxOrThrow()));
+                continue;
+            }
+            CMutableTransaction tx;
+            tx.nVersion = CTransaction::TxVersion::SAPLING;
+            tx.vin.emplace_back(vCoinbases[i]->GetHash(), 0);
+            tx.vout.emplace_back(prevOut.nValue - BENCH_FEE, m_script);
+            assert(SignSignature(m_keystore, prevOut.scriptPubKey, tx, 0, prevOut.nValue, SIGHASH_ALL));
+            vtx.emplace_back(MakeTransactionRef(tx));
+        }
+    }
+
+private:
+    CBasicKeyStore m_keystore;
+    CScript m_script;
+
+    CTransactionRef CreateAndProcessBlock()
+    {
+        std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(
+                Params(), DEFAULT_PRINTPRIORITY).CreateNewBlock(m_script, nullptr, false, nullptr, true);
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(pblocktemplate->block);
+        const int nHeight = WITH_LOCK(cs_main, return chainActive.Height()) + 1;
+        assert(SolveBlock(pblock, nHeight));
+
+        CValidationState state;
+        assert(ProcessNewBlock(state, pblock, nullptr));
+        assert(WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash()) == pblock->GetHash());
+        return pblock->vtx[0];
+    }
+};
+
+static void MempoolAccept(benchmark::State& state, bool fPreVerify)
+{
+    // The chainstate is global: build it for this benchmark only
+    MempoolAcceptBenchSetup setup;
+    const std::vector<CTransactionRef>& vtx = setup.vtx;
+    while (state.KeepRunning()) {
+        mempool.clear();
+        InitSignatureCache();
+        InitShieldedProofsCache();
+
+        std::atomic<int> nextTx{0};
+        std::atomic<int> nAccepted{0};
+        std::vector<std::thread> threads;
+        for (int i = 0; i < SUBMIT_THREADS; i++) {
+            threads.emplace_back([&]() {
+                for (int j = nextTx++; j < (int)vtx.size(); j = nextTx++) {
+                    CValidationState valState;
+                    if (fPreVerify && !PreVerifyMempoolTx(mempool, valState, vtx[j])) continue;
+                    LOCK(cs_main);
+                    if (AcceptToMemoryPool(mempool, valState, vtx[j], false, nullptr, false, false, true)) {
+                        nAccepted++;
+                    }
+                }
+            });
+        }
+        for (std::thread& t : threads) t.join();
+        assert(nAccepted == MEMPOOL_TXES);
+    }
+}
+
+static void MempoolAcceptPreVerified(benchmark::State& state)
+{
+    MempoolAccept(state, true);
+}
+
+static void MempoolAcceptLocked(benchmark::State& state)
+{
+    MempoolAccept(state, false);
+}
+
+BENCHMARK(MempoolAcceptPreVerified);
+BENCHMARK(MempoolAcceptLocked);
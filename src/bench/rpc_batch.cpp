@@ -0,0 +1,90 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "core_io.h"
+#include "primitives/block.h"
+#include "rpc/register.h"
+#include "rpc/server.h"
+#include "scheduler.h"
+#include "streams.h"
+#include "util/system.h"
+#include "version.h"
+
+#include <thread>
+
+namespace block_bench {
+#include "bench/data/block2680960.raw.h"
+}
+
+// These benchmarks measure the latency of a JSON-RPC batch request made of
+// a decoderawtransaction call for every transaction of a block (repeated
+// BATCH_REPEAT times), executed sequentially or spread over one thread per
+// core, as the HTTP server does with -rpcbatchthreads.
+static const int MIN_CORES = 2;
+static const int BATCH_REPEAT = 10;
+
+static UniValue BuildDecodeBatch()
+{
+    static bool fRegistered = false;
+    if (!fRegistered) {
+        RegisterRawTransactionRPCCommands(tableRPC);
+        SetRPCWarmupFinished();
+        fRegistered = true;
+    }
+
+    CDataStream stream((const char*)block_bench::block2680960,
+            (const char*)&block_bench::block2680960[sizeof(block_bench::block2680960)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+
+    UniValue batch(UniValue::VARR);
+    for (int i = 0; i < BATCH_REPEAT; i++) {
+        for (const auto& tx : block.vtx) {
+            UniValue params(UniValue::VARR);
+            params.push_back(EncodeHexTx(*tx));
+            batch.push_back(JSONRPCRequestObj("decoderawtransaction", params, (int)batch.size()));
+        }
+    }
+    return batch;
+}
+
+static void RPCBatch(benchmark::State& state, int nThreads)
+{
+    const UniValue batch = BuildDecodeBatch();
+
+    // The calling thread executes calls too, so it gets nThreads - 1 helpers
+    CScheduler scheduler;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads - 1; i++) {
+        threads.emplace_back(std::bind(&CScheduler::serviceQueue, &scheduler));
+    }
+    RPCTaskRunner runner = [&scheduler](const std::function<void()>& task) {
+        scheduler.schedule(task);
+        return true;
+    };
+
+    while (state.KeepRunning()) {
+        std::string strReply = JSONRPCExecBatch(batch, runner, nThreads);
+        assert(!strReply.empty());
+    }
+
+    scheduler.stop(false);
+    for (auto& t : threads) t.join();
+}
+
+static void RPCBatchSingleThread(benchmark::State& state)
+{
+    RPCBatch(state, 1);
+}
+
+static void RPCBatchMultiThread(benchmark::State& state)
+{
+    RPCBatch(state, std::max(MIN_CORES, GetNumCores()));
+}
+
+BENCHMARK(RPCBatchSingleThread);
+BENCHMARK(RPCBatchMultiThread);
@@ -0,0 +1,108 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "checkqueue.h"
+#include "consensus/validation.h"
+#include "sapling/sapling_validation.h"
+#include "sapling/transaction_builder.h"
+#include "util/system.h"
+
+#include <boost/thread/thread.hpp>
+
+// These benchmarks measure the verification of the shielded data of a
+// block full of Sapling transactions (one spend, two outputs each).
+// Each iteration checks a whole block, so the reported time is the
+// inverse of the number of shielded-heavy blocks verified per second.
+static const int MIN_CORES = 2;
+static const size_t SHIELDED_TXES_PER_BLOCK = 20;
+
+static const std::vector<CTransactionRef>& GetShieldedBlockTxes()
+{
+    static std::vector<CTransactionRef> vtx;
+    if (!vtx.empty()) return vtx;
+
+    SelectParams(CBaseChainParams::REGTEST);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V5_0, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    initZKSNARKS();
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+
+    auto sk = libzcash::SaplingSpendingKey::random();
+    auto expsk = sk.expanded_spending_key();
+    auto fvk = sk.full_viewing_key();
+    auto pa = sk.default_address();
+
+    vtx.reserve(SHIELDED_TXES_PER_BLOCK);
+    for (size_t i = 0; i < SHIELDED_TXES_PER_BLOCK; i++) {
+        libzcash::SaplingNote note(pa, 100000000);
+        SaplingMerkleTree tree;
+        tree.append(note.cmu().get());
+        auto builder = TransactionBuilder(consensusParams, 2);
+        builder.AddSaplingSpend(expsk, note, tree.root(), tree.witness());
+        builder.SetFee(10000000);
+        builder.AddSaplingOutput(fvk.ovk, pa, 50000000);
+        vtx.emplace_back(MakeTransactionRef(builder.Build().GetTxOrThrow()));
+    }
+    return vtx;
+}
+
+static std::vector<const CTransaction*> GetShieldedBlockTxPtrs()
+{
+    std::vector<const CTransaction*> vtx;
+    for (const auto& tx : GetShieldedBlockTxes()) {
+        vtx.emplace_back(tx.get());
+    }
+    return vtx;
+}
+
+static void SaplingBlockProofsSerial(benchmark::State& state)
+{
+    const std::vector<const CTransaction*>& vtx = GetShieldedBlockTxPtrs();
+    while (state.KeepRunning()) {
+        for (const CTransaction* ptx : vtx) {
+            CValidationState valState;
+            assert(SaplingValidation::CheckShieldedProofs(*ptx, valState, 100));
+        }
+    }
+}
+
+static void SaplingBlockProofsBatch(benchmark::State& state)
+{
+    const std::vector<const CTransaction*>& vtx = GetShieldedBlockTxPtrs();
+    while (state.KeepRunning()) {
+        CValidationState valState;
+        assert(SaplingValidation::CheckShieldedProofsBatch(vtx, valState, 100, false));
+    }
+}
+
+static void SaplingBlockProofsCheckQueue(benchmark::State& state)
+{
+    const std::vector<const CTransaction*>& vtx = GetShieldedBlockTxPtrs();
+    const int nThreads = std::max(MIN_CORES, GetNumCores());
+    CCheckQueue<CSaplingCheck> queue {1};
+    boost::thread_group tg;
+    for (auto x = 0; x < nThreads - 1; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<CSaplingCheck> control(&queue);
+        // Split the transactions in one batch per thread, as ConnectBlock does
+        std::vector<CSaplingCheck> vChecks;
+        for (int j = 0; j < nThreads; j++) {
+            std::vector<const CTransaction*> vtxJob(vtx.begin() + vtx.size() * j / nThreads,
+                                                    vtx.begin() + vtx.size() * (j + 1) / nThreads);
+            if (!vtxJob.empty()) vChecks.emplace_back(std::move(vtxJob), 100, false);
+        }
+        control.Add(vChecks);
+        assert(control.Wait());
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+BENCHMARK(SaplingBlockProofsSerial);
+BENCHMARK(SaplingBlockProofsBatch);
+BENCHMARK(SaplingBlockProofsCheckQueue);
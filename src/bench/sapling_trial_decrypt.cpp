@@ -0,0 +1,100 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "primitives/transaction.h"
+#include "sapling/saplingscriptpubkeyman.h"
+#include "util/system.h"
+
+#include <boost/thread.hpp>
+
+// These benchmarks measure the note detection of the wallet over a block
+// with SHIELDED_OUTPUTS_PER_BLOCK shielded outputs (none of them ours, so
+// every key is tried on every output), for wallets with 1, 10 and 100
+// incoming viewing keys. Each iteration scans the whole block, so the
+// outputs scanned per second are SHIELDED_OUTPUTS_PER_BLOCK divided by the
+// reported time.
+static const int MIN_CORES = 2;
+static const size_t SHIELDED_TXES_PER_BLOCK = 50;
+static const size_t SHIELDED_OUTPUTS_PER_TX = 2;
+static const size_t SHIELDED_OUTPUTS_PER_BLOCK = SHIELDED_TXES_PER_BLOCK * SHIELDED_OUTPUTS_PER_TX;
+
+static const std::vector<const CTransaction*>& GetShieldedBlockTxes()
+{
+    static std::vector<CTransactionRef> vtx;
+    static std::vector<const CTransaction*> vtxPtrs;
+    if (!vtxPtrs.empty()) return vtxPtrs;
+
+    // Trial decryption doesn't need the proofs: only encrypt the notes
+    std::array<unsigned char, ZC_MEMO_SIZE> memo = {{0xF6}};
+    for (size_t i = 0; i < SHIELDED_TXES_PER_BLOCK; i++) {
+        CMutableTransaction mtx;
+        mtx.nVersion = CTransaction::TxVersion::SAPLING;
+        for (size_t j = 0; j < SHIELDED_OUTPUTS_PER_TX; j++) {
+            libzcash::SaplingNote note(libzcash::SaplingSpendingKey::random().default_address(), 100000000);
+            auto enc = libzcash::SaplingNotePlaintext(note, memo).encrypt(note.pk_d);
+            assert(enc);
+            OutputDescription output;
+            output.cmu = note.cmu().get();
+            output.ephemeralKey = enc->second.get_epk();
+            output.encCiphertext = enc->first;
+            mtx.sapData->vShieldedOutput.emplace_back(output);
+        }
+        vtx.emplace_back(MakeTransactionRef(mtx));
+        vtxPtrs.emplace_back(vtx.back().get());
+    }
+    assert(vtxPtrs.size() * SHIELDED_OUTPUTS_PER_TX == SHIELDED_OUTPUTS_PER_BLOCK);
+    return vtxPtrs;
+}
+
+static std::vector<libzcash::SaplingIncomingViewingKey> GetIvks(size_t nKeys)
+{
+    std::vector<libzcash::SaplingIncomingViewingKey> vIvks;
+    for (size_t i = 0; i < nKeys; i++) {
+        vIvks.emplace_back(libzcash::SaplingSpendingKey::random().full_viewing_key().in_viewing_key());
+    }
+    return vIvks;
+}
+
+static void SaplingTrialDecrypt(benchmark::State& state, size_t nKeys, int nThreads)
+{
+    const std::vector<const CTransaction*>& vtx = GetShieldedBlockTxes();
+    const std::vector<libzcash::SaplingIncomingViewingKey> vIvks = GetIvks(nKeys);
+    CCheckQueue<CSaplingTrialDecryptCheck> queue(128);
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads - 1; i++) {
+        threads.create_thread([&queue]() { queue.Thread(); });
+    }
+    while (state.KeepRunning()) {
+        assert(TrialDecryptSaplingOutputs(vtx, vIvks, nThreads > 1 ? &queue : nullptr).size() == SHIELDED_OUTPUTS_PER_BLOCK);
+    }
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+static void SaplingTrialDecrypt1Ivk(benchmark::State& state)
+{
+    SaplingTrialDecrypt(state, 1, std::max(MIN_CORES, GetNumCores()));
+}
+
+static void SaplingTrialDecrypt10Ivks(benchmark::State& state)
+{
+    SaplingTrialDecrypt(state, 10, std::max(MIN_CORES, GetNumCores()));
+}
+
+static void SaplingTrialDecrypt100Ivks(benchmark::State& state)
+{
+    SaplingTrialDecrypt(state, 100, std::max(MIN_CORES, GetNumCores()));
+}
+
+static void SaplingTrialDecrypt100IvksSingleThread(benchmark::State& state)
+{
+    SaplingTrialDecrypt(state, 100, 1);
+}
+
+BENCHMARK(SaplingTrialDecrypt1Ivk);
+BENCHMARK(SaplingTrialDecrypt10Ivks);
+BENCHMARK(SaplingTrialDecrypt100Ivks);
+BENCHMARK(SaplingTrialDecrypt100IvksSingleThread);
@@ -0,0 +1,88 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "checkqueue.h"
+#include "kernel.h"
+#include "random.h"
+#include "util/system.h"
+
+#include <boost/thread.hpp>
+
+// These benchmarks measure the stake kernel search of a time slot over a
+// wallet of STAKEABLE_COINS coins (as done by CreateCoinStake), from one
+// thread and from one thread per core (the caller, and the threads serving
+// the kernel check queue, started once like the ones of the stake minter).
+// Each iteration checks every coin once, so the coins checked per second are
+// STAKEABLE_COINS divided by the reported time. The kernels are built once,
+// as they are kept for a tip.
+static const int MIN_CORES = 2;
+static const size_t STAKEABLE_COINS = 20000;
+
+struct StakeKernelBenchSetup
+{
+    CBlockIndex indexPrev;
+    CBlockIndex indexFrom;
+    std::vector<CStakeKernel> vKernels;
+
+    StakeKernelBenchSetup()
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V3_4, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+
+        indexFrom.nHeight = 1000;
+        indexFrom.nTime = 1600000000;
+        indexPrev.nHeight = 2000;
+        indexPrev.nTime = 1600060000;
+        indexPrev.SetStakeModifier(GetRandHash());
+
+        vKernels.reserve(STAKEABLE_COINS);
+        for (size_t i = 0; i < STAKEABLE_COINS; i++) {
+            CTxOut out(10000 * COIN, CScript());
+            CPivStake stakeInput(out, COutPoint(GetRandHash(), i % 4), &indexFrom);
+            // Hard target: (almost) no kernel found, the whole set is checked
+            vKernels.emplace_back(&indexPrev, &stakeInput, 0x1a00ffff, indexPrev.nTime + 15);
+        }
+    }
+};
+
+static std::vector<const CStakeKernel*> GetStakeKernels()
+{
+    static StakeKernelBenchSetup setup;
+    std::vector<const CStakeKernel*> ret;
+    for (const CStakeKernel& kernel : setup.vKernels) {
+        ret.emplace_back(&kernel);
+    }
+    return ret;
+}
+
+static void StakeKernelSearch(benchmark::State& state, int nThreads)
+{
+    const std::vector<const CStakeKernel*> vKernels = GetStakeKernels();
+    CCheckQueue<CStakeKernelCheck> queue(128);
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads - 1; i++) {
+        threads.create_thread([&queue]() { queue.Thread(); });
+    }
+    while (state.KeepRunning()) {
+        FindStakeKernels(vKernels, queue);
+    }
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+static void StakeKernelSearchSingleThread(benchmark::State& state)
+{
+    StakeKernelSearch(state, 1);
+}
+
+static void StakeKernelSearchMultiThread(benchmark::State& state)
+{
+    StakeKernelSearch(state, std::max(MIN_CORES, GetNumCores()));
+}
+
+BENCHMARK(StakeKernelSearchSingleThread);
+BENCHMARK(StakeKernelSearchMultiThread);
@@ -227,6 +227,7 @@ public:
         pchMessageStart[2] = 0xfd;
         pchMessageStart[3] = 0xe9;
         nDefaultPort = 51472;
+        nPruneAfterHeight = 100000;
 
         // Note that of those with the service bits flag, most only support a subset of possible options
         vSeeds.emplace_back("pivx.seed.fuzzbawls.pw", true);     // Primary DNS Seeder from Fuzzbawls
@@ -353,6 +354,7 @@ public:
         pchMessageStart[2] = 0xd5;
         pchMessageStart[3] = 0xca;
         nDefaultPort = 51474;
+        nPruneAfterHeight = 1000;
 
         // nodes with support for servicebits filtering should be at the top
         vSeeds.emplace_back("pivx-testnet.seed.fuzzbawls.pw", true);
@@ -485,6 +487,7 @@ public:
         pchMessageStart[2] = 0x7e;
         pchMessageStart[3] = 0xac;
         nDefaultPort = 51476;
+        nPruneAfterHeight = 1000;
 
         base58Prefixes[PUBKEY_ADDRESS] = std::vector<unsigned char>(1, 139); // Testnet pivx addresses start with 'x' or 'y'
         base58Prefixes[SCRIPT_ADDRESS] = std::vector<unsigned char>(1, 19);  // Testnet pivx script addresses start with '8' or '9'
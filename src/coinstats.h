@@ -0,0 +1,55 @@
+// Copyright (c) 2010 Satoshi Nakamoto
+// Copyright (c) 2009-2020 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_COINSTATS_H
+#define PIVX_COINSTATS_H
+
+#include "amount.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+class CCoinsView;
+class COutPoint;
+class Coin;
+class CScript;
+class MuHash3072;
+
+enum class CoinStatsHashType {
+    HASH_SERIALIZED,
+    MUHASH,
+    NONE,
+};
+
+struct CCoinsStats
+{
+    CoinStatsHashType m_hash_type;
+    int nHeight{0};
+    uint256 hashBlock{UINT256_ZERO};
+    uint64_t nTransactions{0};
+    uint64_t nTransactionOutputs{0};
+    uint64_t nBogoSize{0};
+    uint256 hashSerialized{UINT256_ZERO};
+    uint64_t nDiskSize{0};
+    CAmount nTotalAmount{0};
+
+    //! Whether the stats were read from the coinstats index (no nTransactions and nDiskSize)
+    bool from_index{false};
+
+    explicit CCoinsStats(CoinStatsHashType hash_type) : m_hash_type(hash_type) {}
+};
+
+//! Calculate statistics about the unspent transaction output set, walking the whole view
+bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats);
+
+//! Approximate size of an unspent output in the chainstate (independent of the database encoding)
+uint64_t GetBogoSize(const CScript& scriptPubKey);
+
+//! Add/remove an unspent output to/from the MuHash of the UTXO set
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+
+#endif // PIVX_COINSTATS_H
@@ -499,9 +499,13 @@ void CDeterministicMNList::RemoveMN(const uint256& proTxHash)
     mnInternalIdMap = mnInternalIdMap.erase(dmn->GetInternalId());
 }
 
-CDeterministicMNManager::CDeterministicMNManager(CEvoDB& _evoDb) :
-    evoDb(_evoDb)
+CDeterministicMNManager::CDeterministicMNManager(CEvoDB& _evoDb, int _nSnapshotPeriod, size_t _nHistoricalListsCacheBytes) :
+    evoDb(_evoDb),
+    nSnapshotPeriod(_nSnapshotPeriod),
+    nListDiffsCacheSize(_nSnapshotPeriod * DISK_SNAPSHOTS),
+    nHistoricalListsCacheBytes(_nHistoricalListsCacheBytes)
 {
+    assert(nSnapshotPeriod > 0);
 }
 
 bool CDeterministicMNManager::ProcessBlock(const CBlock& block, const CBlockIndex* pindex, CValidationState& _state, bool fJustCheck)
@@ -537,7 +541,7 @@ bool CDeterministicMNManager::ProcessBlock(const CBlock& block, const CBlockInde
         diff = oldList.BuildDiff(newList);
 
         evoDb.Write(std::make_pair(DB_LIST_DIFF, newList.GetBlockHash()), diff);
-        if ((nHeight % DISK_SNAPSHOT_PERIOD) == 0 || oldList.GetHeight() == -1) {
+        if ((nHeight % nSnapshotPeriod) == 0 || oldList.GetHeight() == -1) {
             evoDb.Write(std::make_pair(DB_LIST_SNAPSHOT, newList.GetBlockHash()), newList);
             mnListsCache.emplace(newList.GetBlockHash(), newList);
             LogPrintf("CDeterministicMNManager::%s -- Wrote snapshot. nHeight=%d, mapCurMNs.allMNsCount=%d\n",
@@ -871,6 +875,12 @@ CDeterministicMNList CDeterministicMNManager::GetListForBlock(const CBlockIndex*
             snapshot = itLists->second;
             break;
         }
+        auto itHistorical = historicalListsIndex.find(pindex->GetBlockHash());
+        if (itHistorical != historicalListsIndex.end()) {
+            historicalLists.splice(historicalLists.begin(), historicalLists, itHistorical->second);
+            snapshot = *itHistorical->second;
+            break;
+        }
 
         if (evoDb.Read(std::make_pair(DB_LIST_SNAPSHOT, pindex->GetBlockHash()), snapshot)) {
             mnListsCache.emplace(pindex->GetBlockHash(), snapshot);
@@ -919,6 +929,9 @@ CDeterministicMNList CDeterministicMNManager::GetListForBlock(const CBlockIndex*
         // always keep a snapshot for the tip
         if (snapshot.GetBlockHash() == tipIndex->GetBlockHash()) {
             mnListsCache.emplace(snapshot.GetBlockHash(), snapshot);
+        } else if (!listDiffIndexes.empty() && snapshot.GetHeight() + nListDiffsCacheSize < tipIndex->nHeight) {
+            // the diffs of old blocks are not kept in cache: keep the list instead
+            AddHistoricalList(snapshot);
         } else {
             // !TODO: keep snapshots for yet alive quorums
         }
@@ -958,6 +971,67 @@ bool CDeterministicMNManager::LegacyMNObsolete() const
     return LegacyMNObsolete(tipHeight);
 }
 
+bool CDeterministicMNManager::CompactSnapshots()
+{
+    // No block can be connected (in its own evoDb transaction) while the snapshots are written
+    LOCK2(cs_main, cs);
+
+    if (nCompactHeight < 0) {
+        nCompactHeight = nSnapshotPeriod;
+    }
+
+    // Check the snapshots in order, so the previous one is always on disk
+    // and each list is built with less than nSnapshotPeriod diffs
+    for (int nChecks = 0; nChecks < 100; nChecks++) {
+        if (nCompactHeight > chainActive.Height()) {
+            return false;
+        }
+        const CBlockIndex* pindex = chainActive[nCompactHeight];
+        nCompactHeight += nSnapshotPeriod;
+        if (!IsDIP3Enforced(pindex->nHeight) ||
+            evoDb.Exists(std::make_pair(DB_LIST_SNAPSHOT, pindex->GetBlockHash()))) {
+            continue;
+        }
+
+        const CDeterministicMNList& snapshot = GetListForBlock(pindex);
+        auto dbTx = evoDb.BeginTransaction();
+        evoDb.Write(std::make_pair(DB_LIST_SNAPSHOT, pindex->GetBlockHash()), snapshot);
+        dbTx->Commit();
+        LogPrintf("CDeterministicMNManager::%s -- Wrote snapshot. nHeight=%d, mapCurMNs.allMNsCount=%d\n",
+            __func__, pindex->nHeight, snapshot.GetAllMNsCount());
+        CleanupCache(chainActive.Height());
+        break;
+    }
+    return nCompactHeight <= chainActive.Height();
+}
+
+// Rough estimate of the memory used by a list, as it shares its entries
+// with the other lists
+static size_t GetListMemoryUsage(const CDeterministicMNList& mnList)
+{
+    return mnList.GetAllMNsCount() * (sizeof(CDeterministicMN) + 256);
+}
+
+void CDeterministicMNManager::AddHistoricalList(const CDeterministicMNList& mnList)
+{
+    AssertLockHeld(cs);
+
+    if (historicalListsIndex.count(mnList.GetBlockHash())) {
+        return;
+    }
+    historicalLists.emplace_front(mnList);
+    historicalListsIndex.emplace(mnList.GetBlockHash(), historicalLists.begin());
+    nHistoricalListsCacheUsage += GetListMemoryUsage(mnList);
+
+    // evict the least recently used lists
+    while (nHistoricalListsCacheUsage > nHistoricalListsCacheBytes && !historicalLists.empty()) {
+        const CDeterministicMNList& lruList = historicalLists.back();
+        nHistoricalListsCacheUsage -= GetListMemoryUsage(lruList);
+        historicalListsIndex.erase(lruList.GetBlockHash());
+        historicalLists.pop_back();
+    }
+}
+
 void CDeterministicMNManager::CleanupCache(int nHeight)
 {
     AssertLockHeld(cs);
@@ -965,7 +1039,7 @@ void CDeterministicMNManager::CleanupCache(int nHeight)
     std::vector<uint256> toDeleteLists;
     std::vector<uint256> toDeleteDiffs;
     for (const auto& p : mnListsCache) {
-        if (p.second.GetHeight() + LIST_DIFFS_CACHE_SIZE < nHeight) {
+        if (p.second.GetHeight() + nListDiffsCacheSize < nHeight) {
             toDeleteLists.emplace_back(p.first);
             continue;
         }
@@ -975,7 +1049,7 @@ void CDeterministicMNManager::CleanupCache(int nHeight)
         mnListsCache.erase(h);
     }
     for (const auto& p : mnListDiffsCache) {
-        if (p.second.nHeight + LIST_DIFFS_CACHE_SIZE < nHeight) {
+        if (p.second.nHeight + nListDiffsCacheSize < nHeight) {
             toDeleteDiffs.emplace_back(p.first);
         }
     }
@@ -16,8 +16,14 @@
 #include <immer/map.hpp>
 #include <immer/map_transient.hpp>
 
+#include <list>
 #include <unordered_map>
 
+/** Default for -dmnsnapshotperiod, blocks between two masternode list snapshots on disk */
+static const int DEFAULT_DMN_SNAPSHOT_PERIOD = 1440; // once per day
+/** Default for -dmnlistcache, MiB of historical masternode lists kept in memory */
+static const int64_t DEFAULT_DMN_LIST_CACHE = 16;
+
 class CBlock;
 class CBlockIndex;
 class CValidationState;
@@ -552,9 +558,7 @@ public:
 
 class CDeterministicMNManager
 {
-    static const int DISK_SNAPSHOT_PERIOD = 1440; // once per day
     static const int DISK_SNAPSHOTS = 3; // keep cache for 3 disk snapshots to have 2 full days covered
-    static const int LIST_DIFFS_CACHE_SIZE = DISK_SNAPSHOT_PERIOD * DISK_SNAPSHOTS;
 
 public:
     mutable RecursiveMutex cs;
@@ -562,12 +566,28 @@ public:
 private:
     CEvoDB& evoDb;
 
+    // blocks between two snapshots on disk, and blocks below the tip with cached lists/diffs
+    const int nSnapshotPeriod;
+    const int nListDiffsCacheSize;
+
     std::unordered_map<uint256, CDeterministicMNList, StaticSaltedHasher> mnListsCache;
     std::unordered_map<uint256, CDeterministicMNListDiff, StaticSaltedHasher> mnListDiffsCache;
     const CBlockIndex* tipIndex{nullptr};
 
+    // LRU cache of the lists built for blocks older than the ones in mnListsCache
+    // (most recently used first), limited to nHistoricalListsCacheBytes
+    typedef std::list<CDeterministicMNList> HistoricalLists;
+    HistoricalLists historicalLists;
+    std::unordered_map<uint256, HistoricalLists::iterator, StaticSaltedHasher> historicalListsIndex;
+    const size_t nHistoricalListsCacheBytes;
+    size_t nHistoricalListsCacheUsage{0};
+
+    // next height checked by CompactSnapshots
+    int nCompactHeight{-1};
+
 public:
-    explicit CDeterministicMNManager(CEvoDB& _evoDb);
+    explicit CDeterministicMNManager(CEvoDB& _evoDb, int _nSnapshotPeriod = DEFAULT_DMN_SNAPSHOT_PERIOD,
+                                     size_t _nHistoricalListsCacheBytes = DEFAULT_DMN_LIST_CACHE << 20);
 
     bool ProcessBlock(const CBlock& block, const CBlockIndex* pindex, CValidationState& state, bool fJustCheck);
     bool UndoBlock(const CBlock& block, const CBlockIndex* pindex);
@@ -590,8 +610,14 @@ public:
     bool LegacyMNObsolete(int nHeight) const;
     bool LegacyMNObsolete() const;
 
+    // Write the missing snapshots of the active chain (every nSnapshotPeriod blocks), e.g. after
+    // the period was lowered, so that any list is built with less than nSnapshotPeriod diffs.
+    // Writes at most one snapshot per call, returns true if there is more work to do.
+    bool CompactSnapshots();
+
 private:
     void CleanupCache(int nHeight);
+    void AddHistoricalList(const CDeterministicMNList& mnList);
 };
 
 extern std::unique_ptr<CDeterministicMNManager> deterministicMNManager;
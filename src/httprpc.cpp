@@ -60,6 +60,8 @@ private:
 static std::string strRPCUserColonPass;
 /* Stored RPC timer interface (for unregistration) */
 static HTTPRPCTimerInterface* httpRPCTimerInterface = 0;
+/* Maximum number of worker threads executing the calls of a batch request */
+static int nRPCBatchThreads = DEFAULT_HTTP_BATCH_THREADS;
 
 static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const UniValue& id)
 {
@@ -187,7 +189,7 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
+            strReply = JSONRPCExecBatch(valRequest.get_array(), EnqueueHTTPTask, nRPCBatchThreads);
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
@@ -227,6 +229,7 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
+    nRPCBatchThreads = std::max((int)gArgs.GetArg("-rpcbatchthreads", DEFAULT_HTTP_BATCH_THREADS), 1);
     RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
 #ifdef ENABLE_WALLET
     // ifdef can be removed once we switch to better endpoint support and API versioning
@@ -60,6 +60,20 @@ private:
     HTTPRequestHandler func;
 };
 
+/** Generic task executed by the HTTP worker threads */
+class HTTPTaskItem : public HTTPClosure
+{
+public:
+    explicit HTTPTaskItem(const std::function<void()>& _task) : task(_task) {}
+    void operator()() override
+    {
+        task();
+    }
+
+private:
+    std::function<void()> task;
+};
+
 /** Simple work queue for distributing work over multiple threads.
  * Work items are simply callable objects.
  */
@@ -280,6 +294,17 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
     }
 }
 
+bool EnqueueHTTPTask(const std::function<void()>& task)
+{
+    if (!workQueue)
+        return false;
+    std::unique_ptr<HTTPTaskItem> item(new HTTPTaskItem(task));
+    if (!workQueue->Enqueue(item.get()))
+        return false;
+    item.release(); /* queue took ownership */
+    return true;
+}
+
 /** Callback to reject HTTP requests after shutdown. */
 static void http_reject_request_cb(struct evhttp_request* req, void*)
 {
@@ -13,6 +13,7 @@
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+static const int DEFAULT_HTTP_BATCH_THREADS=4;
 
 struct evhttp_request;
 struct event_base;
@@ -47,6 +48,11 @@ void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPR
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** Queue a task to be executed by one of the HTTP worker threads.
+ * Returns false if the work queue is full (or the server isn't running).
+ */
+bool EnqueueHTTPTask(const std::function<void()>& task);
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
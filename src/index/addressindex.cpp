@@ -0,0 +1,273 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "index/addressindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "hash.h"
+#include "invalid.h"
+#include "script/standard.h"
+#include "undo.h"
+#include "util/system.h"
+#include "validation.h"
+
+static const char DB_ADDRESS_HISTORY = 'h';
+static const char DB_ADDRESS_UNSPENT = 'u';
+static const char DB_ADDRESS_BALANCE = 'b';
+
+std::unique_ptr<AddressIndex> g_address_index;
+
+/** Whether an output created at nHeight is indexed: the outputs banned up to
+ *  height_last_invalid_UTXO are not in the UTXO set (as in the coinstats index) */
+static bool IsIndexedOutPoint(const COutPoint& outpoint, int nHeight)
+{
+    return !(Params().NetworkIDString() == CBaseChainParams::MAIN &&
+             nHeight <= Params().GetConsensus().height_last_invalid_UTXO &&
+             invalid_out::ContainsOutPoint(outpoint));
+}
+
+uint160 GetAddressIndexScriptHash(const CScript& script)
+{
+    return Hash160(script.begin(), script.end());
+}
+
+std::vector<uint160> GetAddressIndexScripts(const CScript& scriptPubKey)
+{
+    std::vector<uint160> vScripts;
+    if (scriptPubKey.empty() || scriptPubKey.IsUnspendable() || scriptPubKey.IsZerocoinMint()) {
+        return vScripts;
+    }
+    vScripts.emplace_back(GetAddressIndexScriptHash(scriptPubKey));
+
+    txnouttype type;
+    std::vector<CTxDestination> vDests;
+    int nRequired;
+    if (scriptPubKey.IsPayToColdStaking() && ExtractDestinations(scriptPubKey, type, vDests, nRequired)) {
+        for (const CTxDestination& dest : vDests) {
+            vScripts.emplace_back(GetAddressIndexScriptHash(GetScriptForDestination(dest)));
+        }
+    }
+    return vScripts;
+}
+
+/** Access to the address index database (indexes/addressindex/) */
+class AddressIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false) :
+        BaseIndex::DB(GetDataDir() / "indexes" / "addressindex", n_cache_size, f_memory, f_wipe)
+    {}
+};
+
+AddressIndex::AddressIndex(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    m_db(new AddressIndex::DB(n_cache_size, f_memory, f_wipe))
+{}
+
+AddressIndex::~AddressIndex() {}
+
+BaseIndex::DB& AddressIndex::GetDB() const { return *m_db; }
+
+bool AddressIndex::UpdateBlock(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo, bool fConnect)
+{
+    // The genesis block outputs are not spendable
+    if (!pindex->pprev) {
+        return true;
+    }
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: block and undo data inconsistent", __func__);
+    }
+
+    CDBBatch batch;
+    const int nHeight = pindex->nHeight;
+    const int nSign = fConnect ? 1 : -1;
+    // Changes to the balances of the scripts, applied once the whole block is processed
+    std::map<uint160, AddressBalance> mapBalanceDeltas;
+
+    auto addOutputs = [&](const CTransaction& tx) {
+        for (uint32_t j = 0; j < tx.vout.size(); j++) {
+            const CTxOut& out = tx.vout[j];
+            const COutPoint outpoint(tx.GetHash(), j);
+            if (!IsIndexedOutPoint(outpoint, nHeight)) continue;
+            for (const uint160& scriptHash : GetAddressIndexScripts(out.scriptPubKey)) {
+                AddressBalance& delta = mapBalanceDeltas[scriptHash];
+                delta.nBalance += nSign * out.nValue;
+                delta.nReceived += nSign * out.nValue;
+                delta.nTxOuts += nSign;
+                delta.nUnspent += nSign;
+                const auto historyKey = std::make_pair(DB_ADDRESS_HISTORY, AddressHistoryKey(scriptHash, nHeight, tx.GetHash(), j, false));
+                const auto unspentKey = std::make_pair(DB_ADDRESS_UNSPENT, AddressUnspentKey(scriptHash, outpoint));
+                if (fConnect) {
+                    AddressHistoryValue history;
+                    history.nValue = out.nValue;
+                    AddressUnspentValue unspent;
+                    unspent.nValue = out.nValue;
+                    unspent.nHeight = nHeight;
+                    unspent.scriptPubKey = out.scriptPubKey;
+                    batch.Write(historyKey, history);
+                    batch.Write(unspentKey, unspent);
+                } else {
+                    batch.Erase(historyKey);
+                    batch.Erase(unspentKey);
+                }
+            }
+        }
+    };
+
+    // The spends also link the history entry of the spent output to the input
+    auto addSpends = [&](const CTransaction& tx, const CTxUndo& txundo) {
+        for (uint32_t j = 0; j < txundo.vprevout.size(); j++) {
+            const Coin& coin = txundo.vprevout[j];
+            const COutPoint& prevout = tx.vin[j].prevout;
+            if (!IsIndexedOutPoint(prevout, coin.nHeight)) continue;
+            for (const uint160& scriptHash : GetAddressIndexScripts(coin.out.scriptPubKey)) {
+                AddressBalance& delta = mapBalanceDeltas[scriptHash];
+                delta.nBalance -= nSign * coin.out.nValue;
+                delta.nUnspent -= nSign;
+                const auto spendKey = std::make_pair(DB_ADDRESS_HISTORY, AddressHistoryKey(scriptHash, nHeight, tx.GetHash(), j, true));
+                const auto prevKey = std::make_pair(DB_ADDRESS_HISTORY, AddressHistoryKey(scriptHash, coin.nHeight, prevout.hash, prevout.n, false));
+                const auto unspentKey = std::make_pair(DB_ADDRESS_UNSPENT, AddressUnspentKey(scriptHash, prevout));
+                AddressHistoryValue prev;
+                prev.nValue = coin.out.nValue;
+                if (fConnect) {
+                    AddressHistoryValue spend;
+                    spend.nValue = coin.out.nValue;
+                    spend.linked = prevout;
+                    spend.nLinkedHeight = coin.nHeight;
+                    prev.linked = COutPoint(tx.GetHash(), j);
+                    prev.nLinkedHeight = nHeight;
+                    batch.Write(spendKey, spend);
+                    batch.Write(prevKey, prev);
+                    batch.Erase(unspentKey);
+                } else {
+                    AddressUnspentValue unspent;
+                    unspent.nValue = coin.out.nValue;
+                    unspent.nHeight = coin.nHeight;
+                    unspent.scriptPubKey = coin.out.scriptPubKey;
+                    batch.Erase(spendKey);
+                    batch.Write(prevKey, prev);
+                    batch.Write(unspentKey, unspent);
+                }
+            }
+        }
+    };
+
+    // The batch is applied in order: a block may spend the outputs it creates,
+    // so when disconnecting, the transactions are undone in reverse order.
+    if (fConnect) {
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            addOutputs(*block.vtx[i]);
+            if (i > 0) addSpends(*block.vtx[i], blockundo.vtxundo[i - 1]);
+        }
+    } else {
+        for (size_t i = block.vtx.size(); i-- > 0;) {
+            if (i > 0) addSpends(*block.vtx[i], blockundo.vtxundo[i - 1]);
+            addOutputs(*block.vtx[i]);
+        }
+    }
+
+    for (const auto& it : mapBalanceDeltas) {
+        const auto balanceKey = std::make_pair(DB_ADDRESS_BALANCE, it.first);
+        AddressBalance balance;
+        if (!GetBalance(it.first, balance)) {
+            return false;
+        }
+        balance.nBalance += it.second.nBalance;
+        balance.nReceived += it.second.nReceived;
+        balance.nTxOuts += it.second.nTxOuts;
+        balance.nUnspent += it.second.nUnspent;
+        if (balance.nTxOuts == 0) {
+            batch.Erase(balanceKey);
+        } else {
+            batch.Write(balanceKey, balance);
+        }
+    }
+
+    return m_db->WriteBatch(batch);
+}
+
+bool AddressIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo blockundo;
+    if (pindex->pprev && !UndoReadFromDisk(blockundo, pindex)) {
+        return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    return UpdateBlock(block, pindex, blockundo, true);
+}
+
+bool AddressIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockFromDisk(block, pindex) || (pindex->pprev && !UndoReadFromDisk(blockundo, pindex))) {
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+        if (!UpdateBlock(block, pindex, blockundo, false)) {
+            return error("%s: failed to rewind block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+    }
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool AddressIndex::GetHistory(const uint160& scriptHash, int nStart, int nEnd, const AddressHistoryKey* pAfter, size_t nCount,
+                              std::vector<std::pair<AddressHistoryKey, AddressHistoryValue>>& vEntries) const
+{
+    // Resume right at the entry returned last, instead of iterating over the previous pages
+    const bool fResume = pAfter && pAfter->nHeight >= nStart;
+    std::unique_ptr<CDBIterator> pcursor(m_db->NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESS_HISTORY, fResume ? *pAfter : AddressHistoryKey(scriptHash, nStart, UINT256_ZERO, 0, false)));
+    for (; pcursor->Valid() && vEntries.size() < nCount; pcursor->Next()) {
+        std::pair<char, AddressHistoryKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESS_HISTORY ||
+                key.second.scriptHash != scriptHash || key.second.nHeight > nEnd) {
+            break;
+        }
+        if (fResume && key.second.nHeight == pAfter->nHeight && key.second.txid == pAfter->txid &&
+                key.second.nIndex == pAfter->nIndex && key.second.fSpending == pAfter->fSpending) {
+            continue;
+        }
+        AddressHistoryValue value;
+        if (!pcursor->GetValue(value)) {
+            return error("%s: failed to read address history entry", __func__);
+        }
+        vEntries.emplace_back(key.second, value);
+    }
+    return true;
+}
+
+bool AddressIndex::GetBalance(const uint160& scriptHash, AddressBalance& balance) const
+{
+    const auto balanceKey = std::make_pair(DB_ADDRESS_BALANCE, scriptHash);
+    balance = AddressBalance();
+    if (m_db->Exists(balanceKey) && !m_db->Read(balanceKey, balance)) {
+        return error("%s: failed to read address balance", __func__);
+    }
+    return true;
+}
+
+bool AddressIndex::GetUnspent(const uint160& scriptHash, const COutPoint* pAfter, size_t nCount,
+                              std::vector<std::pair<AddressUnspentKey, AddressUnspentValue>>& vEntries) const
+{
+    std::unique_ptr<CDBIterator> pcursor(m_db->NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESS_UNSPENT, AddressUnspentKey(scriptHash, pAfter ? *pAfter : COutPoint(UINT256_ZERO, 0))));
+    for (; pcursor->Valid() && vEntries.size() < nCount; pcursor->Next()) {
+        std::pair<char, AddressUnspentKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESS_UNSPENT || key.second.scriptHash != scriptHash) {
+            break;
+        }
+        if (pAfter && key.second.outpoint == *pAfter) {
+            continue;
+        }
+        AddressUnspentValue value;
+        if (!pcursor->GetValue(value)) {
+            return error("%s: failed to read address unspent entry", __func__);
+        }
+        vEntries.emplace_back(key.second, value);
+    }
+    return true;
+}
@@ -0,0 +1,158 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_INDEX_ADDRESSINDEX_H
+#define PIVX_INDEX_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "index/base.h"
+#include "primitives/transaction.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <memory>
+
+class CBlockUndo;
+
+/** Hash of a script, the key of its entries in the address index */
+uint160 GetAddressIndexScriptHash(const CScript& script);
+
+/** Scripts (hashes) under which an output is indexed: its own scriptPubKey, and
+ *  the P2PKH scripts of the staker and owner keys of a P2CS output */
+std::vector<uint160> GetAddressIndexScripts(const CScript& scriptPubKey);
+
+/** Entry of the history of a script: an output paying to it, or an input spending such an output */
+struct AddressHistoryKey
+{
+    uint160 scriptHash;
+    int nHeight{0};
+    uint256 txid;
+    uint32_t nIndex{0};
+    bool fSpending{false};
+
+    AddressHistoryKey() {}
+    AddressHistoryKey(const uint160& _scriptHash, int _nHeight, const uint256& _txid, uint32_t _nIndex, bool _fSpending) :
+        scriptHash(_scriptHash), nHeight(_nHeight), txid(_txid), nIndex(_nIndex), fSpending(_fSpending) {}
+
+    // The height is big endian, so that the entries of a script are sorted by height
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << scriptHash;
+        ser_writedata32be(s, (uint32_t)nHeight);
+        s << txid;
+        ser_writedata32(s, nIndex);
+        ser_writedata8(s, fSpending ? 1 : 0);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        s >> scriptHash;
+        nHeight = (int)ser_readdata32be(s);
+        s >> txid;
+        nIndex = ser_readdata32(s);
+        fSpending = ser_readdata8(s) != 0;
+    }
+};
+
+struct AddressHistoryValue
+{
+    CAmount nValue{0};
+    //! Outputs: the input spending it (null if unspent). Inputs: the output spent.
+    COutPoint linked;
+    //! Height of the linked input/output
+    int nLinkedHeight{-1};
+
+    SERIALIZE_METHODS(AddressHistoryValue, obj) { READWRITE(obj.nValue, obj.linked, obj.nLinkedHeight); }
+};
+
+/** Unspent output paying to a script */
+struct AddressUnspentKey
+{
+    uint160 scriptHash;
+    COutPoint outpoint;
+
+    AddressUnspentKey() {}
+    AddressUnspentKey(const uint160& _scriptHash, const COutPoint& _outpoint) : scriptHash(_scriptHash), outpoint(_outpoint) {}
+
+    SERIALIZE_METHODS(AddressUnspentKey, obj) { READWRITE(obj.scriptHash, obj.outpoint); }
+};
+
+struct AddressUnspentValue
+{
+    CAmount nValue{0};
+    int nHeight{0};
+    CScript scriptPubKey;
+
+    SERIALIZE_METHODS(AddressUnspentValue, obj) { READWRITE(obj.nValue, obj.nHeight, obj.scriptPubKey); }
+};
+
+/** Running totals of the outputs paying to a script */
+struct AddressBalance
+{
+    //! Amount of the unspent outputs
+    CAmount nBalance{0};
+    //! Amount of all the outputs
+    CAmount nReceived{0};
+    int64_t nTxOuts{0};
+    int64_t nUnspent{0};
+
+    SERIALIZE_METHODS(AddressBalance, obj) { READWRITE(obj.nBalance, obj.nReceived, obj.nTxOuts, obj.nUnspent); }
+};
+
+/**
+ * Address index (indexes/addressindex/).
+ * Records, for every script, the outputs paying to it and the inputs spending
+ * them (with the output spending each of them), and its unspent outputs, so
+ * that the history and the balance of an address are looked up without
+ * scanning the chain. The balance of every script is kept up to date with
+ * each block. The P2CS outputs are also indexed under the addresses of their
+ * staker and owner.
+ */
+class AddressIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+    /** Add (or remove, when fConnect is false) the entries of a block */
+    bool UpdateBlock(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo, bool fConnect);
+
+protected:
+    const char* GetName() const override { return "addressindex"; }
+
+    BaseIndex::DB& GetDB() const override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+public:
+    explicit AddressIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~AddressIndex() override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    /** History of a script between heights nStart and nEnd (included), returning up to
+     *  nCount entries. When pAfter is set, starts after that entry (the last one of the previous page). */
+    bool GetHistory(const uint160& scriptHash, int nStart, int nEnd, const AddressHistoryKey* pAfter, size_t nCount,
+                    std::vector<std::pair<AddressHistoryKey, AddressHistoryValue>>& vEntries) const;
+
+    /** Balance of a script (zero if it never received anything) */
+    bool GetBalance(const uint160& scriptHash, AddressBalance& balance) const;
+
+    /** Unspent outputs of a script, returning up to nCount of them. When pAfter is set,
+     *  starts after that output (the last one of the previous page). */
+    bool GetUnspent(const uint160& scriptHash, const COutPoint* pAfter, size_t nCount,
+                    std::vector<std::pair<AddressUnspentKey, AddressUnspentValue>>& vEntries) const;
+};
+
+/** The global address index, used by the getaddress* RPCs. May be null. */
+extern std::unique_ptr<AddressIndex> g_address_index;
+
+#endif // PIVX_INDEX_ADDRESSINDEX_H
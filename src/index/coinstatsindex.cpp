@@ -0,0 +1,259 @@
+// Copyright (c) 2020-2021 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "index/coinstatsindex.h"
+
+#include "chainparams.h"
+#include "coinstats.h"
+#include "guiinterface.h"
+#include "init.h"
+#include "invalid.h"
+#include "undo.h"
+#include "util/system.h"
+#include "validation.h"
+
+static const char DB_BLOCK_STATS = 's';
+static const char DB_MUHASH = 'M';
+static const char DB_BEST_BLOCK = 'B';
+
+std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+/**
+ * Whether an output created at nHeight is in the UTXO set (see AddCoin and AddCoins).
+ * The outputs banned up to height_last_invalid_UTXO are never added to the chainstate,
+ * or are pruned from it at startup (see PruneInvalidEntries).
+ */
+static bool IsIndexedCoin(const COutPoint& outpoint, const CTxOut& out, int nHeight)
+{
+    if (out.scriptPubKey.IsUnspendable() || out.IsZerocoinMint()) {
+        return false;
+    }
+    return !(Params().NetworkIDString() == CBaseChainParams::MAIN &&
+             nHeight <= Params().GetConsensus().height_last_invalid_UTXO &&
+             invalid_out::ContainsOutPoint(outpoint));
+}
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    m_db(new CDBWrapper(GetDataDir() / "indexes" / "coinstats", n_cache_size, f_memory, f_wipe)),
+    m_best_block(UINT256_ZERO)
+{
+    CBlockLocator locator;
+    if (m_db->Read(DB_BEST_BLOCK, locator) && !locator.IsNull()) {
+        m_best_block = locator.vHave.front();
+        if (!m_db->Read(DB_MUHASH, m_muhash) || !m_db->Read(std::make_pair(DB_BLOCK_STATS, m_best_block), m_best_entry)) {
+            LogPrintf("%s: coinstats index inconsistent, rebuilding it\n", __func__);
+            m_muhash = MuHash3072();
+            m_best_block.SetNull();
+            m_best_entry = CoinStatsIndexEntry();
+        }
+    }
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo, bool fConnect)
+{
+    LOCK(m_cs);
+    const uint256& hashExpected = fConnect ? (pindex->pprev ? pindex->pprev->GetBlockHash() : UINT256_ZERO) : pindex->GetBlockHash();
+    if (m_best_block != hashExpected) {
+        return error("%s: block %s does not follow the best block of the index %s", __func__,
+                     pindex->GetBlockHash().ToString(), m_best_block.ToString());
+    }
+    if (pindex->pprev && blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: block and undo data inconsistent", __func__);
+    }
+
+    // Outputs created by the block are added when connecting, and removed when
+    // disconnecting. The outputs it spent (from the undo data) the other way around.
+    CoinStatsIndexEntry entry = m_best_entry;
+    auto update = [&](const COutPoint& outpoint, const Coin& coin, bool fAdd) {
+        if (fAdd) {
+            ApplyCoinHash(m_muhash, outpoint, coin);
+        } else {
+            RemoveCoinHash(m_muhash, outpoint, coin);
+        }
+        const int64_t nDelta = fAdd ? 1 : -1;
+        entry.nTransactionOutputs += nDelta;
+        entry.nBogoSize += nDelta * (int64_t) GetBogoSize(coin.out.scriptPubKey);
+        entry.nTotalAmount += nDelta * coin.out.nValue;
+    };
+
+    // The genesis block doesn't add anything to the UTXO set
+    for (size_t i = 0; pindex->pprev && i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        for (size_t j = 0; j < tx.vout.size(); j++) {
+            const COutPoint outpoint(tx.GetHash(), j);
+            if (IsIndexedCoin(outpoint, tx.vout[j], pindex->nHeight)) {
+                update(outpoint, Coin(tx.vout[j], pindex->nHeight, tx.IsCoinBase(), tx.IsCoinStake()), fConnect);
+            }
+        }
+        if (i == 0) continue;
+        // Zerocoin spends have no undo data
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        for (size_t j = 0; j < txundo.vprevout.size(); j++) {
+            const Coin& coin = txundo.vprevout[j];
+            if (IsIndexedCoin(tx.vin[j].prevout, coin.out, coin.nHeight)) {
+                update(tx.vin[j].prevout, coin, !fConnect);
+            }
+        }
+    }
+
+    const uint256 hashBest = fConnect ? pindex->GetBlockHash() : (pindex->pprev ? pindex->pprev->GetBlockHash() : UINT256_ZERO);
+    entry.nHeight = fConnect ? pindex->nHeight : pindex->nHeight - 1;
+    m_muhash.Finalize(entry.muhash);
+
+    // The entry of a block only depends on the chain up to it: the entries of the
+    // disconnected blocks are still valid, and are kept.
+    if (fConnect) {
+        m_pending_entries[hashBest] = entry;
+    }
+    m_best_block = hashBest;
+    m_best_entry = entry;
+    m_dirty = true;
+    return true;
+}
+
+bool CoinStatsIndex::BlockConnected(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo)
+{
+    return WriteBlock(block, pindex, blockundo, true);
+}
+
+bool CoinStatsIndex::BlockDisconnected(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo)
+{
+    return WriteBlock(block, pindex, blockundo, false);
+}
+
+bool CoinStatsIndex::Commit()
+{
+    AssertLockHeld(cs_main);
+    LOCK(m_cs);
+    if (!m_dirty) {
+        return true;
+    }
+
+    CDBBatch batch;
+    for (const auto& it : m_pending_entries) {
+        batch.Write(std::make_pair(DB_BLOCK_STATS, it.first), it.second);
+    }
+    CBlockLocator locator;
+    if (!m_best_block.IsNull()) {
+        BlockMap::const_iterator it = mapBlockIndex.find(m_best_block);
+        if (it == mapBlockIndex.end()) {
+            return error("%s: best block %s of the coinstats index not found", __func__, m_best_block.ToString());
+        }
+        locator = chainActive.GetLocator(it->second);
+    }
+    batch.Write(DB_MUHASH, m_muhash);
+    batch.Write(DB_BEST_BLOCK, locator);
+    if (!m_db->WriteBatch(batch)) {
+        return error("%s: failed to write the coinstats index", __func__);
+    }
+    m_pending_entries.clear();
+    m_dirty = false;
+    return true;
+}
+
+/** Read a block of the active chain (or one being rewound) and its undo data */
+static bool ReadBlockAndUndo(const CBlockIndex* pindex, CBlock& block, CBlockUndo& blockundo)
+{
+    if (!ReadBlockFromDisk(block, pindex)) {
+        return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    if (pindex->pprev && !UndoReadFromDisk(blockundo, pindex)) {
+        return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    return true;
+}
+
+bool CoinStatsIndex::Sync()
+{
+    AssertLockHeld(cs_main);
+
+    const CBlockIndex* pindex = nullptr;
+    {
+        LOCK(m_cs);
+        if (!m_best_block.IsNull()) {
+            BlockMap::const_iterator it = mapBlockIndex.find(m_best_block);
+            if (it == mapBlockIndex.end()) {
+                // The index is committed after the block index, when the chainstate
+                // is flushed: its best block can only be missing if the block index
+                // was replaced.
+                return error("%s: best block %s of the coinstats index not found", __func__, m_best_block.ToString());
+            }
+            pindex = it->second;
+        }
+    }
+
+    // Rewind, one entry at a time, the blocks disconnected after the last commit
+    // (unclean shutdown) or while the index was disabled.
+    while (pindex && !chainActive.Contains(pindex)) {
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockAndUndo(pindex, block, blockundo) || !BlockDisconnected(block, pindex, blockundo)) {
+            return error("%s: failed to rewind block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+        pindex = pindex->pprev;
+    }
+
+    const CBlockIndex* pindexNext = pindex ? chainActive.Next(pindex) : chainActive.Genesis();
+    if (!pindexNext) {
+        return Commit();
+    }
+
+    // The outputs banned up to the last invalid UTXO are no longer loaded when the chain is past it
+    const Consensus::Params& consensus = Params().GetConsensus();
+    if (Params().NetworkIDString() == CBaseChainParams::MAIN &&
+            pindexNext->nHeight <= consensus.height_last_invalid_UTXO &&
+            invalid_out::setInvalidOutPoints.empty() && !invalid_out::LoadOutpoints()) {
+        return error("%s: failed to load the invalid outpoints", __func__);
+    }
+
+    LogPrintf("%s: syncing coinstats index from height %d to %d\n", __func__, pindexNext->nHeight, chainActive.Height());
+    uiInterface.InitMessage(_("Building coin statistics index..."));
+    for (; pindexNext; pindexNext = chainActive.Next(pindexNext)) {
+        if (ShutdownRequested()) {
+            return Commit();
+        }
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockAndUndo(pindexNext, block, blockundo) || !BlockConnected(block, pindexNext, blockundo)) {
+            return error("%s: failed to connect block %s", __func__, pindexNext->GetBlockHash().ToString());
+        }
+        if (pindexNext->nHeight % 10000 == 0) {
+            if (!Commit()) {
+                return false;
+            }
+            LogPrintf("%s: coinstats index synced to height %d\n", __func__, pindexNext->nHeight);
+        }
+    }
+    return Commit();
+}
+
+bool CoinStatsIndex::LookUpStats(const CBlockIndex* pindex, CCoinsStats& stats) const
+{
+    CoinStatsIndexEntry entry;
+    {
+        LOCK(m_cs);
+        auto it = m_pending_entries.find(pindex->GetBlockHash());
+        if (it != m_pending_entries.end()) {
+            entry = it->second;
+        } else if (!m_db->Read(std::make_pair(DB_BLOCK_STATS, pindex->GetBlockHash()), entry)) {
+            return false;
+        }
+    }
+    stats.nHeight = entry.nHeight;
+    stats.hashBlock = pindex->GetBlockHash();
+    stats.hashSerialized = entry.muhash;
+    stats.nTransactionOutputs = entry.nTransactionOutputs;
+    stats.nBogoSize = entry.nBogoSize;
+    stats.nTotalAmount = entry.nTotalAmount;
+    stats.from_index = true;
+    return true;
+}
+
+CAmount CoinStatsIndex::GetTotalAmount(int& nHeightRet) const
+{
+    LOCK(m_cs);
+    nHeightRet = m_best_entry.nHeight;
+    return m_best_entry.nTotalAmount;
+}
@@ -0,0 +1,90 @@
+// Copyright (c) 2020-2021 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_INDEX_COINSTATSINDEX_H
+#define PIVX_INDEX_COINSTATSINDEX_H
+
+#include "amount.h"
+#include "crypto/muhash.h"
+#include "dbwrapper.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <memory>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+struct CCoinsStats;
+
+/** Statistics of the UTXO set after a block, as stored in the index */
+struct CoinStatsIndexEntry
+{
+    int nHeight{0};
+    uint256 muhash{UINT256_ZERO};
+    uint64_t nTransactionOutputs{0};
+    uint64_t nBogoSize{0};
+    CAmount nTotalAmount{0};
+
+    SERIALIZE_METHODS(CoinStatsIndexEntry, obj) { READWRITE(obj.nHeight, obj.muhash, obj.nTransactionOutputs, obj.nBogoSize, obj.nTotalAmount); }
+};
+
+/**
+ * Coin statistics index (indexes/coinstats/).
+ * Keeps a rolling MuHash of the UTXO set, along with the number, size and
+ * total amount of the unspent outputs, updated with every block connected to
+ * or disconnected from the active chain, and stores them for every block.
+ * This way the UTXO set statistics of any block are returned without walking
+ * the whole chainstate.
+ * The entries are kept in memory, and written to the database (along with the
+ * MuHash and the locator of the best block) when the chainstate is flushed,
+ * so the index is never ahead of the block index on disk.
+ */
+class CoinStatsIndex
+{
+private:
+    std::unique_ptr<CDBWrapper> m_db;
+
+    mutable RecursiveMutex m_cs;
+    //! Hash of the UTXO set of the best block (as numerator/denominator)
+    MuHash3072 m_muhash;
+    //! Best block of the index, and its statistics
+    uint256 m_best_block;
+    CoinStatsIndexEntry m_best_entry;
+    //! Entries of the blocks connected since the last commit
+    std::map<uint256, CoinStatsIndexEntry> m_pending_entries;
+    //! Whether the best block changed since the last commit
+    bool m_dirty{false};
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo, bool fConnect);
+
+public:
+    CoinStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /** Update the index with a block connected to (disconnected from) the tip
+     *  of the active chain, and its undo data. Called with cs_main held. */
+    bool BlockConnected(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo);
+    bool BlockDisconnected(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo);
+
+    /** Write the pending entries, the MuHash and the locator of the best block
+     *  to the database. Called with cs_main held, when the chainstate is flushed. */
+    bool Commit();
+
+    /** Catch up with the active chain: rewind, block by block, the ones that
+     *  are no longer in it, and connect the missing ones. Called at startup. */
+    bool Sync();
+
+    /** Look up the UTXO set statistics after a block of the active chain */
+    bool LookUpStats(const CBlockIndex* pindex, CCoinsStats& stats) const;
+
+    /** Total amount of the unspent outputs at the best block, and its height */
+    CAmount GetTotalAmount(int& nHeightRet) const;
+};
+
+/** The global coin statistics index, used by gettxoutsetinfo and getsupplyinfo. May be null. */
+extern std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+#endif // PIVX_INDEX_COINSTATSINDEX_H
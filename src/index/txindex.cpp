@@ -0,0 +1,279 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "index/txindex.h"
+
+#include "chain.h"
+#include "guiinterface.h"
+#include "init.h"
+#include "txdb.h"
+#include "util/system.h"
+#include "validation.h"
+
+static const char DB_TXINDEX = 't';
+static const char DB_TXINDEX_BLOCK = 'T';
+
+/** Size of the batches written while moving the transaction index entries */
+static const size_t MIGRATION_BATCH_SIZE = 1 << 24; // 16 MiB
+
+std::unique_ptr<TxIndex> g_txindex;
+
+/** Access to the txindex database (indexes/txindex/) */
+class TxIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Read the disk location of the transaction data with the given hash. Returns false if the
+    /// transaction hash is not indexed.
+    bool ReadTxPos(const uint256& txid, CDiskTxPos& pos) const;
+
+    /// Write a batch of transaction positions to the DB.
+    bool WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos>>& v_pos);
+
+    /// Migrate the txindex data of the block tree DB, written by the older
+    /// versions, to this database (erasing it from the block tree DB).
+    bool MigrateData(CBlockTreeDB& block_tree_db, const CBlockLocator& best_locator);
+};
+
+TxIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "txindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool TxIndex::DB::ReadTxPos(const uint256& txid, CDiskTxPos& pos) const
+{
+    return Read(std::make_pair(DB_TXINDEX, txid), pos);
+}
+
+bool TxIndex::DB::WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos>>& v_pos)
+{
+    CDBBatch batch;
+    for (const auto& tuple : v_pos) {
+        batch.Write(std::make_pair(DB_TXINDEX, tuple.first), tuple.second);
+    }
+    return WriteBatch(batch);
+}
+
+/*
+ * Safely persist a transfer of data from the old txindex database to the new one (if any), and
+ * compact the range of keys updated.
+ */
+static void WriteTxIndexMigrationBatches(CDBWrapper* newdb, CDBWrapper& olddb,
+                                         CDBBatch& batch_newdb, CDBBatch& batch_olddb,
+                                         const std::pair<char, uint256>& begin_key,
+                                         const std::pair<char, uint256>& end_key)
+{
+    // Sync new DB changes to disk before deleting from old DB.
+    if (newdb) newdb->WriteBatch(batch_newdb, true);
+    olddb.WriteBatch(batch_olddb);
+    olddb.CompactRange(begin_key, end_key);
+
+    batch_newdb.Clear();
+    batch_olddb.Clear();
+}
+
+/*
+ * Move the txindex entries of the block tree database to newdb, or just erase them if newdb is
+ * null. Returns false if interrupted by a shutdown, or on a database error.
+ */
+static bool MoveTxIndexEntries(CDBWrapper* newdb, CBlockTreeDB& block_tree_db, CDBBatch& batch_newdb,
+                               CDBBatch& batch_olddb, const std::string& strTitle)
+{
+    int64_t count = 0;
+    LogPrintf("%s... [0%%]\n", strTitle);
+    uiInterface.ShowProgress(strTitle, 0);
+    int report_done = 0;
+
+    std::pair<char, uint256> begin_key{DB_TXINDEX, uint256()};
+    std::pair<char, uint256> key = begin_key;
+    std::pair<char, uint256> prev_key = begin_key;
+
+    std::unique_ptr<CDBIterator> cursor(block_tree_db.NewIterator());
+    for (cursor->Seek(begin_key); cursor->Valid(); cursor->Next()) {
+        if (ShutdownRequested()) {
+            WriteTxIndexMigrationBatches(newdb, block_tree_db, batch_newdb, batch_olddb, prev_key, key);
+            LogPrintf("[CANCELLED].\n");
+            return false;
+        }
+
+        if (!cursor->GetKey(key) || key.first != DB_TXINDEX) {
+            break;
+        }
+
+        // Log progress every 10%.
+        if (++count % 256 == 0) {
+            // Since txids are uniformly random and traversed in increasing order, the high 16 bits
+            // of the hash can be used to estimate the current progress.
+            const uint256& txid = key.second;
+            uint32_t high_nibble =
+                (static_cast<uint32_t>(*(txid.begin() + 0)) << 8) +
+                (static_cast<uint32_t>(*(txid.begin() + 1)) << 0);
+            int percentage_done = (int)(high_nibble * 100.0 / 65536.0 + 0.5);
+
+            uiInterface.ShowProgress(strTitle, percentage_done);
+            if (report_done < percentage_done / 10) {
+                LogPrintf("%s... [%d%%]\n", strTitle, percentage_done);
+                report_done = percentage_done / 10;
+            }
+        }
+
+        if (newdb) {
+            CDiskTxPos value;
+            if (!cursor->GetValue(value)) {
+                return error("%s: cannot parse txindex record", __func__);
+            }
+            batch_newdb.Write(key, value);
+        }
+        batch_olddb.Erase(key);
+
+        if (batch_newdb.SizeEstimate() > MIGRATION_BATCH_SIZE || batch_olddb.SizeEstimate() > MIGRATION_BATCH_SIZE) {
+            // NOTE: it's OK to delete the key pointed at by the current DB cursor while iterating
+            // because LevelDB iterators are guaranteed to provide a consistent view of the
+            // underlying data, like a lightweight snapshot.
+            WriteTxIndexMigrationBatches(newdb, block_tree_db, batch_newdb, batch_olddb, prev_key, key);
+            prev_key = key;
+        }
+    }
+
+    uiInterface.ShowProgress("", 100);
+    return true;
+}
+
+bool TxIndex::DB::MigrateData(CBlockTreeDB& block_tree_db, const CBlockLocator& best_locator)
+{
+    // The prior implementation of txindex was always in sync with block index
+    // and presence was indicated with a boolean DB flag. If the flag is set,
+    // this means the txindex from a previous version is valid and in sync with
+    // the chain tip. The first step of the migration is to unset the flag and
+    // write the chain locator to a separate key, DB_TXINDEX_BLOCK. After that, the
+    // index entries are moved over in batches to the new database. Finally,
+    // DB_TXINDEX_BLOCK is erased from the old database and the locator is
+    // written to the new database.
+    //
+    // Unsetting the boolean flag ensures that if the node is downgraded to a
+    // previous version, it will not see a corrupted, partially migrated index
+    // -- it will see that the txindex is disabled. When the node is upgraded
+    // again, the migration will pick up where it left off and sync to the block
+    // with locator DB_TXINDEX_BLOCK.
+    bool f_legacy_flag = false;
+    block_tree_db.ReadFlag("txindex", f_legacy_flag);
+    if (f_legacy_flag) {
+        if (!block_tree_db.Write(DB_TXINDEX_BLOCK, best_locator)) {
+            return error("%s: cannot write block indicator", __func__);
+        }
+        if (!block_tree_db.WriteFlag("txindex", false)) {
+            return error("%s: cannot write block index db flag", __func__);
+        }
+    }
+
+    CBlockLocator locator;
+    if (!block_tree_db.Read(DB_TXINDEX_BLOCK, locator)) {
+        return true;
+    }
+
+    CDBBatch batch_newdb;
+    CDBBatch batch_olddb;
+    if (!MoveTxIndexEntries(this, block_tree_db, batch_newdb, batch_olddb, _("Upgrading txindex database"))) {
+        return false;
+    }
+
+    // These final DB batches complete the migration: write the best block
+    // locator to the new database and delete it from the old one. This signals
+    // that the former is fully caught up to that point in the blockchain and
+    // that all txindex entries have been removed from the latter.
+    batch_olddb.Erase(DB_TXINDEX_BLOCK);
+    WriteBestBlock(batch_newdb, locator);
+    WriteTxIndexMigrationBatches(this, block_tree_db, batch_newdb, batch_olddb,
+                                 {DB_TXINDEX, uint256()}, {DB_TXINDEX, UINT256_MAX});
+    LogPrintf("[DONE].\n");
+    return true;
+}
+
+bool EraseLegacyTxIndex(CBlockTreeDB& block_tree_db)
+{
+    // Without the flag (or the block indicator of an interrupted migration),
+    // there is nothing to erase.
+    bool f_legacy_flag = false;
+    block_tree_db.ReadFlag("txindex", f_legacy_flag);
+    if (!f_legacy_flag && !block_tree_db.Exists(DB_TXINDEX_BLOCK)) {
+        return true;
+    }
+    if (!block_tree_db.WriteFlag("txindex", false)) {
+        return error("%s: cannot write block index db flag", __func__);
+    }
+
+    CDBBatch batch_newdb;
+    CDBBatch batch_olddb;
+    if (!MoveTxIndexEntries(nullptr, block_tree_db, batch_newdb, batch_olddb, _("Erasing the old txindex database"))) {
+        return false;
+    }
+    batch_olddb.Erase(DB_TXINDEX_BLOCK);
+    WriteTxIndexMigrationBatches(nullptr, block_tree_db, batch_newdb, batch_olddb,
+                                 {DB_TXINDEX, uint256()}, {DB_TXINDEX, UINT256_MAX});
+    LogPrintf("[DONE].\n");
+    return true;
+}
+
+TxIndex::TxIndex(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    m_db(new TxIndex::DB(n_cache_size, f_memory, f_wipe))
+{}
+
+TxIndex::~TxIndex() {}
+
+bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+    vPos.reserve(block.vtx.size());
+    for (const auto& tx : block.vtx) {
+        vPos.emplace_back(tx->GetHash(), pos);
+        pos.nTxOffset += ::GetSerializeSize(*tx, CLIENT_VERSION);
+    }
+    return m_db->WriteTxs(vPos);
+}
+
+bool TxIndex::Init()
+{
+    {
+        LOCK(cs_main);
+        // Attempt to migrate txindex from the old database to the new one. Even if
+        // the chain tip is null, the node could be reindexing and we still want to
+        // delete txindex records in the old database.
+        if (!m_db->MigrateData(*pblocktree, chainActive.GetLocator())) {
+            return false;
+        }
+    }
+    return BaseIndex::Init();
+}
+
+BaseIndex::DB& TxIndex::GetDB() const { return *m_db; }
+
+bool TxIndex::FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx) const
+{
+    CDiskTxPos postx;
+    if (!m_db->ReadTxPos(tx_hash, postx)) {
+        return false;
+    }
+
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return error("%s: OpenBlockFile failed", __func__);
+    }
+    CBlockHeader header;
+    try {
+        file >> header;
+        if (fseek(file.Get(), postx.nTxOffset, SEEK_CUR)) {
+            return error("%s: fseek(...) failed", __func__);
+        }
+        file >> tx;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    if (tx->GetHash() != tx_hash) {
+        return error("%s: txid mismatch", __func__);
+    }
+    block_hash = header.GetHash();
+    return true;
+}
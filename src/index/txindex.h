@@ -0,0 +1,64 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_INDEX_TXINDEX_H
+#define PIVX_INDEX_TXINDEX_H
+
+#include "index/base.h"
+#include "primitives/transaction.h"
+
+#include <memory>
+
+/**
+ * TxIndex is used to look up transactions included in the blockchain by hash.
+ * The index is written to a LevelDB database (indexes/txindex/) and records
+ * the filesystem location of each transaction by transaction hash.
+ */
+class CBlockTreeDB;
+
+class TxIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    /// Migrate the transaction index of the block tree database (written by the
+    /// older versions) to the index database, then initialize the index.
+    bool Init() override;
+
+    const char* GetName() const override { return "txindex"; }
+
+    BaseIndex::DB& GetDB() const override;
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit TxIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~TxIndex() override;
+
+    /// Write the positions of the transactions of a block to the index.
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    /// Look up a transaction by hash.
+    ///
+    /// @param[in]   tx_hash  The hash of the transaction to be returned.
+    /// @param[out]  block_hash  The hash of the block the transaction is found in.
+    /// @param[out]  tx  The transaction itself.
+    /// @return  true if transaction is found, false otherwise
+    bool FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx) const;
+};
+
+/// The global transaction index, used in GetTransaction. May be null.
+extern std::unique_ptr<TxIndex> g_txindex;
+
+/// Erase the transaction index of the block tree database, written by the
+/// older versions, when the index is disabled.
+bool EraseLegacyTxIndex(CBlockTreeDB& block_tree_db);
+
+#endif // PIVX_INDEX_TXINDEX_H
@@ -27,7 +27,12 @@
 #include "fs.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "index/addressindex.h"
+#include "index/blockfilterindex.h"
+#include "index/coinstatsindex.h"
+#include "index/txindex.h"
 #include "invalid.h"
+#include "kernel.h"
 #include "key.h"
 #include "mapport.h"
 #include "masternode-payments.h"
@@ -41,6 +46,7 @@
 #include "policy/policy.h"
 #include "rpc/register.h"
 #include "rpc/server.h"
+#include "sapling/sapling_proofcache.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
 #include "scheduler.h"
@@ -48,6 +54,7 @@
 #include "sporkdb.h"
 #include "evo/deterministicmns.h"
 #include "evo/evodb.h"
+#include "tiertwo_sigverify.h"
 #include "txdb.h"
 #include "torcontrol.h"
 #include "guiinterface.h"
@@ -189,6 +196,13 @@ static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 
 static boost::thread_group threadGroup;
 static CScheduler scheduler;
+static void CompactMNListSnapshots(CScheduler& s)
+{
+    if (!ShutdownRequested() && deterministicMNManager->CompactSnapshots()) {
+        s.scheduleFromNow(std::bind(&CompactMNListSnapshots, std::ref(s)), 10);
+    }
+}
+
 void Interrupt()
 {
     InterruptHTTPServer();
@@ -199,6 +213,15 @@ void Interrupt()
     InterruptMapPort();
     if (g_connman)
         g_connman->Interrupt();
+    if (g_txindex) {
+        g_txindex->Interrupt();
+    }
+    if (g_address_index) {
+        g_address_index->Interrupt();
+    }
+    if (g_block_filter_index) {
+        g_block_filter_index->Interrupt();
+    }
 }
 
 /** Preparing steps before shutting down or restarting the wallet */
@@ -246,6 +269,9 @@ void PrepareShutdown()
     // destruct and reset all to nullptr.
     g_connman.reset();
     peerLogic.reset();
+    g_txindex.reset();
+    g_address_index.reset();
+    g_block_filter_index.reset();
 
     DumpMasternodes();
     DumpBudgets(g_budgetman);
@@ -301,6 +327,7 @@ void PrepareShutdown()
         pSporkDB = NULL;
         deterministicMNManager.reset();
         evoDb.reset();
+        g_coin_stats_index.reset();
     }
 #ifdef ENABLE_WALLET
     for (CWalletRef pwallet : vpwallets) {
@@ -468,13 +495,19 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), PIVX_PID_FILENAME));
 #endif
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode is incompatible with -txindex, -coinstatsindex, -addressindex, -blockfilterindex, -rescan and masternode mode. "
+            "Warning: Reverting this setting requires re-downloading the entire blockchain. "
+            "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks"));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-resync", _("Delete blockchain folders and resync from scratch") + " " + _("on startup"));
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
-    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call. It is built in the background, and can be enabled without reindexing (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain the history and the unspent outputs of every address, used by the getaddressbalance, getaddresshistory and getaddressutxos rpc calls. It is built in the background (default: %u)"), DEFAULT_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain the compact filters of the blocks (BIP 158), used by the getblockfilter rpc call and served to the peers with -peerblockfilters. It is built in the background (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
+    strUsage += HelpMessageOpt("-coinstatsindex", strprintf(_("Maintain the UTXO set statistics of every block (MuHash, amount), used by the gettxoutsetinfo and getsupplyinfo rpc calls (default: %u)"), DEFAULT_COINSTATSINDEX));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -493,10 +526,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
+    strUsage += HelpMessageOpt("-msghandlerthreads=<n>", strprintf(_("Number of threads processing the messages of the peers, each one serving its own set of peers (1 to %d, default: %d)"), MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(_("Support filtering of blocks and transaction with bloom filters (default: %u)"), DEFAULT_PEERBLOOMFILTERS));
+    strUsage += HelpMessageOpt("-peerblockfilters", strprintf(_("Serve compact block filters to peers per BIP 157 (requires -blockfilterindex, default: %u)"), DEFAULT_PEERBLOCKFILTERS));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), defaultChainParams->GetDefaultPort(), testnetChainParams->GetDefaultPort()));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
@@ -561,6 +596,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> MiB (default: %u)"), DEFAULT_MAX_SIG_CACHE_SIZE));
     }
+    strUsage += HelpMessageOpt("-shieldedcachesize=<n>", strprintf(_("Limit size of the cache of verified shielded transactions to <n> MiB (default: %u)"), DEFAULT_MAX_SHIELDED_CACHE_SIZE));
     strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/Kb) smaller than this are considered zero fee for relaying, mining and transaction creation (default: %s)"), CURRENCY_UNIT, FormatMoney(::minRelayTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-printtoconsole", strprintf(_("Send trace/debug info to console instead of debug.log file (default: %u)"), 0));
@@ -580,6 +616,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-masternodeaddr=<n>", strprintf(_("Set external address:port to get to this masternode (example: %s)"), "128.127.106.235:51472"));
     strUsage += HelpMessageOpt("-budgetvotemode=<mode>", _("Change automatic finalized budget voting behavior. mode=auto: Vote for only exact finalized budget match to my generated budget. (string, default: auto)"));
     strUsage += HelpMessageOpt("-mnoperatorprivatekey=<WIF>", _("Set the masternode operator private key. Only valid with -masternode=1. When set, the masternode acts as a deterministic masternode."));
+    if (showDebug) {
+        strUsage += HelpMessageOpt("-dmnsnapshotperiod=<n>", strprintf("Write a snapshot of the deterministic masternode list every <n> blocks, and the missing ones in the background (default: %u)", DEFAULT_DMN_SNAPSHOT_PERIOD));
+        strUsage += HelpMessageOpt("-dmnlistcache=<n>", strprintf("Limit the cache of historical deterministic masternode lists to <n> MiB (default: %u)", DEFAULT_DMN_LIST_CACHE));
+    }
 
     strUsage += HelpMessageGroup(_("Node relay options:"));
     if (showDebug) {
@@ -609,6 +649,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcauth=<userpw>", _("Username and hashed password for JSON-RPC connections. The field <userpw> comes in the format: <USERNAME>:<SALT>$<HASH>. A canonical python script is included in share/rpcuser. The client then connects normally using the rpcuser=<USERNAME>/rpcpassword=<PASSWORD> pair of arguments. This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), defaultBaseParams->RPCPort(), testnetBaseParams->RPCPort()));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
+    strUsage += HelpMessageOpt("-rpcbatchthreads=<n>", strprintf(_("Set the maximum number of RPC threads executing the calls of a single batch request, 1 to execute them sequentially (default: %d)"), DEFAULT_HTTP_BATCH_THREADS));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
@@ -687,6 +728,47 @@ struct CImportingNow {
     }
 };
 
+// If we're using -prune with -reindex, then delete block files that will be ignored by the
+// reindex. Since reindexing works by starting at block file 0 and looping until a blockfile
+// is missing, do the same here to delete any later block files after a gap. Also delete all
+// rev files since they'll be rewritten by the reindex anyway. This ensures that vinfoBlockFile
+// is in sync with what's actually on disk by the time we start downloading, so that pruning
+// works correctly.
+static void CleanupBlockRevFiles()
+{
+    std::map<std::string, fs::path> mapBlockFiles;
+
+    // Glob all blk?????.dat and rev?????.dat files from the blocks directory.
+    // Remove the rev files immediately and insert the blk file paths into an
+    // ordered map keyed by block file index.
+    LogPrintf("Removing unusable blk?????.dat and rev?????.dat files for -reindex with -prune\n");
+    const fs::path& blocksdir = GetBlocksDir();
+    for (fs::directory_iterator it(blocksdir); it != fs::directory_iterator(); it++) {
+        const std::string strFileName = it->path().filename().string();
+        if (fs::is_regular_file(*it) &&
+            strFileName.length() == 12 &&
+            strFileName.substr(8, 4) == ".dat") {
+            if (strFileName.substr(0, 3) == "blk")
+                mapBlockFiles[strFileName.substr(3, 5)] = it->path();
+            else if (strFileName.substr(0, 3) == "rev")
+                fs::remove(it->path());
+        }
+    }
+
+    // Remove all block files that aren't part of a contiguous set starting at
+    // zero by walking the ordered map (keys are block file indices) by
+    // keeping a separate counter. Once we hit a gap (or if 0 doesn't exist)
+    // start removing block files.
+    int nContigCounter = 0;
+    for (const std::pair<const std::string, fs::path>& item : mapBlockFiles) {
+        if (atoi(item.first) == nContigCounter) {
+            nContigCounter++;
+            continue;
+        }
+        fs::remove(item.second);
+    }
+}
+
 void ThreadImport(const std::vector<fs::path>& vImportFiles)
 {
     util::ThreadRename("pivx-loadblk");
@@ -953,6 +1035,19 @@ void InitParameterInteraction()
         if (gArgs.SoftSetBoolArg("-discover", false))
             LogPrintf("%s : parameter interaction: -externalip set -> setting -discover=0\n", __func__);
     }
+
+    if (gArgs.GetArg("-prune", 0) > 0) {
+        // pruned nodes cannot keep a full transaction index
+        if (gArgs.SoftSetBoolArg("-txindex", false))
+            LogPrintf("%s : parameter interaction: -prune set -> setting -txindex=0\n", __func__);
+        // nor rewind the coin statistics index
+        if (gArgs.SoftSetBoolArg("-coinstatsindex", false))
+            LogPrintf("%s : parameter interaction: -prune set -> setting -coinstatsindex=0\n", __func__);
+        if (gArgs.SoftSetBoolArg("-addressindex", false))
+            LogPrintf("%s : parameter interaction: -prune set -> setting -addressindex=0\n", __func__);
+        if (gArgs.SoftSetBoolArg("-blockfilterindex", false))
+            LogPrintf("%s : parameter interaction: -prune set -> setting -blockfilterindex=0\n", __func__);
+    }
 }
 
 bool InitNUParams()
@@ -1049,12 +1144,14 @@ bool AppInitParameterInteraction()
         return UIError(strprintf(_("Cannot set %s or %s together with %s"), "-bind", "-whitebind", "-listen=0"));
     }
 
-    int nBind = std::max(nUserBind, size_t(1));
     nUserMaxConnections = gArgs.GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
+#ifndef USE_POLL
+    int nBind = std::max(nUserBind, size_t(1));
     // Trim requested connection counts, to fit into system limitations
     nMaxConnections = std::max(std::min(nMaxConnections, (int) (FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+#endif
     nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return UIError(_("Not enough file descriptors available."));
@@ -1189,6 +1286,47 @@ bool AppInitParameterInteraction()
     if (gArgs.GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+    // Signal NODE_COMPACT_FILTERS if peerblockfilters and basic filters index are both enabled.
+    if (gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (!gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+            return UIError(_("Cannot set -peerblockfilters without -blockfilterindex."));
+        }
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
+    // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
+    int64_t nSignedPruneTarget = gArgs.GetArg("-prune", 0) * 1024 * 1024;
+    if (nSignedPruneTarget < 0) {
+        return UIError(_("Prune cannot be configured with a negative value."));
+    }
+    nPruneTarget = (uint64_t) nSignedPruneTarget;
+    if (nPruneTarget) {
+        if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES) {
+            return UIError(strprintf(_("Prune configured below the minimum of %d MiB.  Please use a higher number."), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+        }
+        if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+            return UIError(strprintf(_("Prune mode is incompatible with %s."), "-txindex"));
+        }
+        if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+            return UIError(strprintf(_("Prune mode is incompatible with %s."), "-coinstatsindex"));
+        }
+        if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+            return UIError(strprintf(_("Prune mode is incompatible with %s."), "-addressindex"));
+        }
+        if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+            return UIError(strprintf(_("Prune mode is incompatible with %s."), "-blockfilterindex"));
+        }
+        if (gArgs.GetBoolArg("-masternode", DEFAULT_MASTERNODE)) {
+            return UIError(strprintf(_("Prune mode is incompatible with %s."), "-masternode"));
+        }
+        if (gArgs.GetBoolArg("-reindex-chainstate", false)) {
+            return UIError(_("Prune mode is incompatible with -reindex-chainstate. Use full -reindex instead."));
+        }
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files (keeping at least the last %u blocks).\n",
+                  nPruneTarget / 1024 / 1024, GetMinBlocksToKeep());
+        fPruneMode = true;
+    }
+
     nMaxTipAge = gArgs.GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
     if (!InitNUParams())
@@ -1273,11 +1411,19 @@ bool AppInitMain()
     std::ostringstream strErrors;
 
     InitSignatureCache();
+    InitShieldedProofsCache();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+        }
+    }
+
+    const int nTierTwoSigVerifyThreads = std::max(1, std::min(GetNumCores() - 1, MAX_TIERTWO_SIGVERIFY_THREADS));
+    LogPrintf("Using %d threads for tier two signature verification\n", nTierTwoSigVerifyThreads);
+    for (int i = 0; i < nTierTwoSigVerifyThreads; i++) {
+        threadGroup.create_thread(&ThreadTierTwoSigVerify);
     }
 
     if (gArgs.IsArgSet("-sporkkey")) // spork priv key
@@ -1517,16 +1663,33 @@ bool AppInitMain()
     int64_t nTotalCache = (gArgs.GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greater than nMaxDbcache
-    int64_t nBlockTreeDBCache = nTotalCache / 8;
-    nBlockTreeDBCache = std::min(nBlockTreeDBCache, (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
+    int64_t nBlockTreeDBCache = std::min(nTotalCache / 8, nMaxBlockDBCache << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nTxIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxTxIndexCache << 20 : 0);
+    nTotalCache -= nTxIndexCache;
+    int64_t nAddressIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) ? nMaxAddressIndexCache << 20 : 0);
+    nTotalCache -= nAddressIndexCache;
+    int64_t nBlockFilterIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX) ? nMaxBlockFilterIndexCache << 20 : 0);
+    nTotalCache -= nBlockFilterIndexCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     int64_t nEvoDbCache = 1024 * 1024 * 16; // TODO
+    const int nDMNSnapshotPeriod = std::max(1, (int)gArgs.GetArg("-dmnsnapshotperiod", DEFAULT_DMN_SNAPSHOT_PERIOD));
+    const size_t nDMNListCache = std::max((int64_t)0, gArgs.GetArg("-dmnlistcache", DEFAULT_DMN_LIST_CACHE)) << 20;
+    int64_t nCoinStatsIndexCache = 1024 * 1024 * 8;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+        LogPrintf("* Using %.1fMiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        LogPrintf("* Using %.1fMiB for address index database\n", nAddressIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        LogPrintf("* Using %.1fMiB for block filter index database\n", nBlockFilterIndexCache * (1.0 / 1024 / 1024));
+    }
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
 
@@ -1557,12 +1720,20 @@ bool AppInitMain()
                 deterministicMNManager.reset();
                 evoDb.reset();
                 evoDb.reset(new CEvoDB(nEvoDbCache, false, fReindex));
-                deterministicMNManager.reset(new CDeterministicMNManager(*evoDb));
+                deterministicMNManager.reset(new CDeterministicMNManager(*evoDb, nDMNSnapshotPeriod, nDMNListCache));
+
+                g_coin_stats_index.reset();
+                if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+                    g_coin_stats_index.reset(new CoinStatsIndex(nCoinStatsIndexCache, false, fReindex || fReindexChainState));
+                }
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReset);
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
+                    //If we're reindexing in prune mode, wipe away unusable block files and all undo data files
+                    if (fPruneMode)
+                        CleanupBlockRevFiles();
                 }
 
                 // End loop if shutdown was requested
@@ -1572,9 +1743,8 @@ bool AppInitMain()
                 uiInterface.InitMessage(_("Loading sporks..."));
                 sporkManager.LoadSporksFromDB();
 
-                // LoadBlockIndex will load fTxIndex from the db, or set it if
-                // we're reindexing. It will also load fHavePruned if we've
-                // ever removed a block file from disk.
+                // LoadBlockIndex will load fHavePruned if we've ever removed a
+                // block file from disk.
                 // Note that it also sets fReindex based on the disk flag!
                 // From here on out fReindex and fReset mean something different!
                 uiInterface.InitMessage(_("Loading block index..."));
@@ -1591,9 +1761,10 @@ bool AppInitMain()
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(consensus.hashGenesisBlock) == 0)
                     return UIError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
 
-                // Check for changed -txindex state
-                if (fTxIndex != gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = strprintf(_("You need to rebuild the database using %s to change %s"), "-reindex-chainstate", "-txindex");
+                // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
+                // in the past, but is now trying to run unpruned.
+                if (fHavePruned && !fPruneMode) {
+                    strLoadError = strprintf(_("You need to rebuild the database using %s to go back to unpruned mode.  This will redownload the entire blockchain"), "-reindex");
                     break;
                 }
 
@@ -1665,6 +1836,10 @@ bool AppInitMain()
 
                 if (!is_coinsview_empty) {
                     uiInterface.InitMessage(_("Verifying blocks..."));
+                    if (fHavePruned && gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS) > GetMinBlocksToKeep()) {
+                        LogPrintf("Prune: pruned datadir may not have more than %d blocks; only checking available blocks\n",
+                                  GetMinBlocksToKeep());
+                    }
                     {
                         LOCK(cs_main);
                         CBlockIndex *tip = chainActive.Tip();
@@ -1712,6 +1887,12 @@ bool AppInitMain()
         }
     }
 
+    // Catch up the coin statistics index with the loaded chain (this builds
+    // the whole index the first time it is enabled).
+    if (g_coin_stats_index && !WITH_LOCK(cs_main, return g_coin_stats_index->Sync(); )) {
+        return UIError(strprintf(_("Failed to sync the coin statistics index. Restart with %s to rebuild it."), "-reindex-chainstate"));
+    }
+
     // As LoadBlockIndex can take several minutes, it's possible the user
     // requested to kill the GUI during the last operation. If so, exit.
     // As the program has not fully started yet, Shutdown() is possibly overkill.
@@ -1720,6 +1901,28 @@ bool AppInitMain()
         return false;
     }
 
+    // The transaction, address and block filter indexes are built (and then kept in sync) in the background
+    if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+        g_txindex.reset(new TxIndex(nTxIndexCache, false, fReindex));
+        if (!g_txindex->Start()) {
+            return false;
+        }
+    } else if (!EraseLegacyTxIndex(*pblocktree)) {
+        return false;
+    }
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        g_address_index.reset(new AddressIndex(nAddressIndexCache, false, fReindex));
+        if (!g_address_index->Start()) {
+            return false;
+        }
+    }
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        g_block_filter_index.reset(new BlockFilterIndex(BlockFilterType::BASIC, nBlockFilterIndexCache, false, fReindex));
+        if (!g_block_filter_index->Start()) {
+            return false;
+        }
+    }
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1731,9 +1934,30 @@ bool AppInitMain()
 #ifdef ENABLE_WALLET
     if (!InitLoadWallet())
         return false;
+    // The shielded outputs of the connected blocks are trial-decrypted by the
+    // wallet along with one thread per other core
+    if (!vpwallets.empty()) {
+        for (int i = 0; i < GetNumCores() - 1; i++) {
+            threadGroup.create_thread(&ThreadSaplingTrialDecrypt);
+        }
+    }
 #else
     LogPrintf("No wallet compiled in!\n");
 #endif
+
+    // ********************************************************* Step 8a: data directory maintenance
+
+    // if pruning, unset the service bit and perform the initial blockstore prune
+    // after any wallet rescanning has taken place.
+    if (fPruneMode) {
+        LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
+        nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
+        if (!fReindex) {
+            uiInterface.InitMessage(_("Pruning blockstore..."));
+            PruneAndFlush();
+        }
+    }
+
     // ********************************************************* Step 9: import blocks
 
     if (!CheckDiskSpace(GetDataDir())) {
@@ -1786,7 +2010,11 @@ bool AppInitMain()
     int nChainHeight = WITH_LOCK(cs_main, return chainActive.Height(); );
 
     // Update money supply
-    if (!fReindex && !fReindexChainState) {
+    if (g_coin_stats_index) {
+        int nIndexHeight;
+        const CAmount nSupply = g_coin_stats_index->GetTotalAmount(nIndexHeight);
+        MoneySupply.Update(nSupply, nIndexHeight);
+    } else if (!fReindex && !fReindexChainState) {
         uiInterface.InitMessage(_("Calculating money supply..."));
         MoneySupply.Update(pcoinsTip->GetTotalAmount(), nChainHeight);
     }
@@ -1836,9 +2064,9 @@ bool AppInitMain()
 
     fMasterNode = gArgs.GetBoolArg("-masternode", DEFAULT_MASTERNODE);
 
-    if ((fMasterNode || masternodeConfig.getCount() > -1) && fTxIndex == false) {
+    if ((fMasterNode || masternodeConfig.getCount() > -1) && !g_txindex) {
         return UIError(strprintf(_("Enabling Masternode support requires turning on transaction indexing."
-                                   "Please add %s to your configuration and start with %s"), "txindex=1", "-reindex"));
+                                   "Please add %s to your configuration"), "txindex=1"));
     }
 
     if (fMasterNode) {
@@ -1911,6 +2139,9 @@ bool AppInitMain()
 
     threadGroup.create_thread(std::bind(&ThreadCheckMasternodes));
 
+    // Write the missing snapshots of the deterministic masternode lists in the background
+    scheduler.scheduleFromNow(std::bind(&CompactMNListSnapshots, std::ref(scheduler)), 1000);
+
     if (ShutdownRequested()) {
         LogPrintf("Shutdown requested. Exiting.\n");
         return false;
@@ -1958,6 +2189,7 @@ bool AppInitMain()
     connOptions.m_msgproc = peerLogic.get();
     connOptions.nSendBufferMaxSize = 1000*gArgs.GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.nMsgHandlerThreads = gArgs.GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS);
 
     if (!connman.Start(scheduler, strNodeError, connOptions))
         return UIError(strNodeError);
@@ -1978,6 +2210,10 @@ bool AppInitMain()
     // StakeMiner thread disabled by default on regtest
     if (!vpwallets.empty() && gArgs.GetBoolArg("-staking", !Params().IsRegTestNet() && DEFAULT_STAKING)) {
         threadGroup.create_thread(std::bind(&ThreadStakeMinter));
+        // The stake minter checks the kernels along with one thread per other core
+        for (int i = 0; i < GetNumCores() - 1; i++) {
+            threadGroup.create_thread(&ThreadStakeKernelCheck);
+        }
     }
 #endif
 
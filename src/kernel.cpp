@@ -7,6 +7,8 @@
 
 #include "kernel.h"
 
+#include "checkqueue.h"
+#include "crypto/common.h"
 #include "db.h"
 #include "legacy/stakemodifier.h"
 #include "policy/policy.h"
@@ -18,6 +20,12 @@
 #include "zpivchain.h"
 #include "zpiv/zpos.h"
 
+// Below this many kernels, they are checked by the caller alone
+static const size_t MIN_KERNELS_PER_THREAD = 500;
+
+// A kernel check is a single double-SHA256: the workers take them in batches
+static CCheckQueue<CStakeKernelCheck> kernelcheckqueue(128);
+
 /**
  * CStakeKernel Constructor
  *
@@ -45,14 +53,21 @@ CStakeKernel::CStakeKernel(const CBlockIndex* const pindexPrev, CStakeInput* sta
     }
     const CBlockIndex* pindexFrom = stakeInput->GetIndexFrom();
     nTimeBlockFrom = pindexFrom->nTime;
+
+    // Only nTime changes between the time slots: hash the rest of the message once
+    CDataStream ss(stakeModifier);
+    ss << nTimeBlockFrom << stakeUniqueness;
+    kernelPrefix.Write((const unsigned char*)ss.data(), ss.size());
 }
 
 // Return stake kernel hash
 uint256 CStakeKernel::GetHash() const
 {
-    CDataStream ss(stakeModifier);
-    ss << nTimeBlockFrom << stakeUniqueness << nTime;
-    return Hash(ss.begin(), ss.end());
+    unsigned char time[4];
+    WriteLE32(time, (uint32_t)nTime);
+    uint256 hash;
+    CHash256(kernelPrefix).Write(time, sizeof(time)).Finalize(hash.begin());
+    return hash;
 }
 
 // Check that the kernel hash meets the target required
@@ -104,29 +119,56 @@ static bool LoadStakeInput(const CBlock& block, std::unique_ptr<CStakeInput>& st
     return stake && stake->InitFromTxIn(txin);
 }
 
+bool CStakeKernelCheck::operator()()
+{
+    *pfFound = pkernel->CheckKernelHash(true);
+    return true;
+}
+
+void ThreadStakeKernelCheck()
+{
+    util::ThreadRename("pivx-kernelch");
+    kernelcheckqueue.Thread();
+}
+
+std::vector<size_t> FindStakeKernels(const std::vector<const CStakeKernel*>& vKernels)
+{
+    return FindStakeKernels(vKernels, kernelcheckqueue);
+}
+
 /*
- * Stake                Check if stakeInput can stake a block on top of pindexPrev
+ * FindStakeKernels     Check a set of stake kernels, on the threads serving a check queue
  *
- * @param[in]   pindexPrev      index of the parent block of the block being staked
- * @param[in]   stakeInput      input for the coinstake
- * @param[in]   nBits           target difficulty bits
- * @param[in]   nTimeTx         new blocktime
- * @return      bool            true if stake kernel hash meets target protocol
+ * @param[in]   vKernels        kernels to check (with the time of the new block already set)
+ * @param[in]   queue           the check queue
+ * @return      std::vector     positions in vKernels, in order, of the kernels meeting the target
  */
-bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int64_t& nTimeTx)
+std::vector<size_t> FindStakeKernels(const std::vector<const CStakeKernel*>& vKernels, CCheckQueue<CStakeKernelCheck>& queue)
 {
-    // Double check stake input contextual checks
-    const int nHeightTx = pindexPrev->nHeight + 1;
-    if (!stakeInput || !stakeInput->ContextCheck(nHeightTx, nTimeTx)) return false;
-
-    // Get the new time slot (and verify it's not the same as previous block)
-    const bool fRegTest = Params().IsRegTestNet();
-    nTimeTx = (fRegTest ? GetAdjustedTime() : GetCurrentTimeSlot());
-    if (nTimeTx <= pindexPrev->nTime && !fRegTest) return false;
+    const size_t nKernels = vKernels.size();
+
+    // Each check writes only the slot of its kernel
+    std::vector<char> vFound(nKernels, false);
+    if (nKernels < MIN_KERNELS_PER_THREAD) {
+        for (size_t i = 0; i < nKernels; i++) {
+            vFound[i] = vKernels[i]->CheckKernelHash(true);
+        }
+    } else {
+        std::vector<CStakeKernelCheck> vChecks;
+        vChecks.reserve(nKernels);
+        for (size_t i = 0; i < nKernels; i++) {
+            vChecks.emplace_back(vKernels[i], &vFound[i]);
+        }
+        CCheckQueueControl<CStakeKernelCheck> control(&queue);
+        control.Add(vChecks);
+        control.Wait();
+    }
 
-    // Verify Proof Of Stake
-    CStakeKernel stakeKernel(pindexPrev, stakeInput, nBits, nTimeTx);
-    return stakeKernel.CheckKernelHash(true);
+    std::vector<size_t> ret;
+    for (size_t i = 0; i < nKernels; i++) {
+        if (vFound[i]) ret.emplace_back(i);
+    }
+    return ret;
 }
 
 
@@ -8,8 +8,12 @@
 #ifndef PIVX_KERNEL_H
 #define PIVX_KERNEL_H
 
+#include "hash.h"
 #include "stakeinput.h"
 
+template <typename T>
+class CCheckQueue;
+
 class CStakeKernel {
 public:
     /**
@@ -28,29 +32,60 @@ public:
     // Check that the kernel hash meets the target required
     bool CheckKernelHash(bool fSkipLog = false) const;
 
+    // Move the kernel to another block time (the rest of the message is already hashed)
+    void SetTime(int nTimeTx) { nTime = nTimeTx; }
+
 private:
     // kernel message hashed
     CDataStream stakeModifier{CDataStream(SER_GETHASH, 0)};
     int nTimeBlockFrom{0};
     CDataStream stakeUniqueness{CDataStream(SER_GETHASH, 0)};
     int nTime{0};
+    // hasher fed with the part of the message before nTime
+    CHash256 kernelPrefix;
     // hash target
     unsigned int nBits{0};     // difficulty for the target
     CAmount stakeValue{0};     // target multiplier
 };
 
+/**
+ * Closure representing the check of a stake kernel against its target, handed to a
+ * CCheckQueue by FindStakeKernels. The result is written to the slot of the kernel.
+ */
+class CStakeKernelCheck
+{
+private:
+    const CStakeKernel* pkernel{nullptr};
+    char* pfFound{nullptr};
+
+public:
+    CStakeKernelCheck() {}
+    CStakeKernelCheck(const CStakeKernel* pkernelIn, char* pfFoundIn) : pkernel(pkernelIn), pfFound(pfFoundIn) {}
+
+    bool operator()();
+
+    void swap(CStakeKernelCheck& check)
+    {
+        std::swap(pkernel, check.pkernel);
+        std::swap(pfFound, check.pfFound);
+    }
+};
+
+/** Run an instance of the stake kernel checking thread (serving the queue of the stake minter) */
+void ThreadStakeKernelCheck();
+
 /* PoS Validation */
 
 /*
- * Stake                Check if stakeInput can stake a block on top of pindexPrev
+ * FindStakeKernels     Check a set of stake kernels, on the threads serving a check queue
+ *                      (if no thread serves it, the caller checks them all)
  *
- * @param[in]   pindexPrev      index of the parent block of the block being staked
- * @param[in]   stakeInput      input for the coinstake
- * @param[in]   nBits           target difficulty bits
- * @param[in]   nTimeTx         new blocktime
- * @return      bool            true if stake kernel hash meets target protocol
+ * @param[in]   vKernels        kernels to check (with the time of the new block already set)
+ * @param[in]   queue           the check queue (by default, the one of ThreadStakeKernelCheck)
+ * @return      std::vector     positions in vKernels, in order, of the kernels meeting the target
  */
-bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int64_t& nTimeTx);
+std::vector<size_t> FindStakeKernels(const std::vector<const CStakeKernel*>& vKernels);
+std::vector<size_t> FindStakeKernels(const std::vector<const CStakeKernel*>& vKernels, CCheckQueue<CStakeKernelCheck>& queue);
 
 /*
  * CheckProofOfStake    Check if block has valid proof of stake
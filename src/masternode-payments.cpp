@@ -558,11 +558,59 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
     CTxDestination addr;
     ExtractDestination(winnerIn.payee, addr);
     LogPrint(BCLog::MASTERNODE, "mnw - Adding winner %s for block %d\n", EncodeDestination(addr), winnerIn.nBlockHeight);
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+    {
+        LOCK(cs_mapMasternodeBlocks);
+        CMasternodeBlockPayees& blockPayees = mapMasternodeBlocks[winnerIn.nBlockHeight];
+        blockPayees.AddPayee(winnerIn.payee, 1);
+        AddPayeeVotedHeight(blockPayees, winnerIn.payee);
+    }
 
     return true;
 }
 
+void CMasternodePayments::AddPayeeVotedHeight(const CMasternodeBlockPayees& blockPayees, const CScript& payee)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+    if (blockPayees.HasPayeeWithVotes(payee, MNPAYMENTS_PAID_VOTES_REQUIRED)) {
+        mapPayeeVotedHeights[payee].insert(blockPayees.nBlockHeight);
+    }
+}
+
+void CMasternodePayments::EraseVotedHeights(const CMasternodeBlockPayees& blockPayees)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+    LOCK(cs_vecPayments);
+    for (const CMasternodePayee& p : blockPayees.vecPayments) {
+        auto it = mapPayeeVotedHeights.find(p.scriptPubKey);
+        if (it == mapPayeeVotedHeights.end()) continue;
+        it->second.erase(blockPayees.nBlockHeight);
+        if (it->second.empty()) mapPayeeVotedHeights.erase(it);
+    }
+}
+
+void CMasternodePayments::RebuildPayeeVotedHeights()
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_vecPayments);
+    mapPayeeVotedHeights.clear();
+    for (const auto& it : mapMasternodeBlocks) {
+        for (const CMasternodePayee& p : it.second.vecPayments) {
+            AddPayeeVotedHeight(it.second, p.scriptPubKey);
+        }
+    }
+}
+
+int CMasternodePayments::GetLastPaidHeight(const CScript& payee, int nHeight, int nDepth) const
+{
+    LOCK(cs_mapMasternodeBlocks);
+    const auto it = mapPayeeVotedHeights.find(payee);
+    if (it == mapPayeeVotedHeights.end()) return -1;
+    // last height <= nHeight
+    auto itHeight = it->second.upper_bound(nHeight);
+    if (itHeight == it->second.begin()) return -1;
+    --itHeight;
+    return *itHeight > nHeight - nDepth ? *itHeight : -1;
+}
+
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK(cs_vecPayments);
@@ -686,7 +734,11 @@ void CMasternodePayments::CleanPaymentList(int mnCount, int nHeight)
             LogPrint(BCLog::MASTERNODE, "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
             masternodeSync.mapSeenSyncMNW.erase((*it).first);
             mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
+            auto itBlock = mapMasternodeBlocks.find(winner.nBlockHeight);
+            if (itBlock != mapMasternodeBlocks.end()) {
+                EraseVotedHeights(itBlock->second);
+                mapMasternodeBlocks.erase(itBlock);
+            }
         } else {
             ++it;
         }
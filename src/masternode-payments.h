@@ -9,6 +9,8 @@
 #include "key.h"
 #include "masternode.h"
 
+#include <set>
+
 
 extern RecursiveMutex cs_vecPayments;
 extern RecursiveMutex cs_mapMasternodeBlocks;
@@ -23,6 +25,8 @@ extern CMasternodePayments masternodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
+// a legacy masternode is considered paid in the blocks where it has this many votes
+#define MNPAYMENTS_PAID_VOTES_REQUIRED 2
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsBlockPayeeValid(const CBlock& block, const CBlockIndex* pindexPrev);
@@ -131,11 +135,11 @@ public:
         return (nVotes > -1);
     }
 
-    bool HasPayeeWithVotes(const CScript& payee, int nVotesReq)
+    bool HasPayeeWithVotes(const CScript& payee, int nVotesReq) const
     {
         LOCK(cs_vecPayments);
 
-        for (CMasternodePayee& p : vecPayments) {
+        for (const CMasternodePayee& p : vecPayments) {
             if (p.nVotes >= nVotesReq && p.scriptPubKey == payee) return true;
         }
 
@@ -208,6 +212,12 @@ class CMasternodePayments
 private:
     int nLastBlockHeight;
 
+    // Heights of the blocks where each payee has at least MNPAYMENTS_PAID_VOTES_REQUIRED
+    // votes, maintained with mapMasternodeBlocks. Protected by cs_mapMasternodeBlocks.
+    std::map<CScript, std::set<int>> mapPayeeVotedHeights;
+    void AddPayeeVotedHeight(const CMasternodeBlockPayees& blockPayees, const CScript& payee);
+    void EraseVotedHeights(const CMasternodeBlockPayees& blockPayees);
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
@@ -223,8 +233,15 @@ public:
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
+        mapPayeeVotedHeights.clear();
     }
 
+    // Rebuild the index of the heights where payees have enough votes (after loading mapMasternodeBlocks)
+    void RebuildPayeeVotedHeights();
+    // Height of the last block in (nHeight - nDepth, nHeight] where the payee
+    // has at least MNPAYMENTS_PAID_VOTES_REQUIRED votes, or -1 if none.
+    int GetLastPaidHeight(const CScript& payee, int nHeight, int nDepth) const;
+
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
     void ProcessBlock(int nBlockHeight);
 
@@ -261,7 +278,11 @@ public:
     void FillBlockPayee(CMutableTransaction& txCoinbase, CMutableTransaction& txCoinstake, const CBlockIndex* pindexPrev, bool fProofOfStake) const;
     std::string ToString() const;
 
-    SERIALIZE_METHODS(CMasternodePayments, obj) { READWRITE(obj.mapMasternodePayeeVotes, obj.mapMasternodeBlocks); }
+    SERIALIZE_METHODS(CMasternodePayments, obj)
+    {
+        READWRITE(obj.mapMasternodePayeeVotes, obj.mapMasternodeBlocks);
+        SER_READ(obj, obj.RebuildPayeeVotedHeights());
+    }
 };
 
 
@@ -208,17 +208,11 @@ bool CMasternode::IsInputAssociatedWithPubkey() const
     CScript payee;
     payee = GetScriptForDestination(pubKeyCollateralAddress.GetID());
 
-    CTransactionRef txVin;
-    uint256 hash;
-    if(GetTransaction(vin.prevout.hash, txVin, hash, true)) {
-        for (const CTxOut& out : txVin->vout) {
-            if (out.nValue == Params().GetConsensus().nMNCollateralAmt &&
-                out.scriptPubKey == payee)
-                return true;
-        }
-    }
-
-    return false;
+    // The collateral is unspent: read it from the coins view (its block may be pruned)
+    Coin coin;
+    return GetUTXOCoin(vin.prevout, coin) &&
+           coin.out.nValue == Params().GetConsensus().nMNCollateralAmt &&
+           coin.out.scriptPubKey == payee;
 }
 
 CMasternodeBroadcast::CMasternodeBroadcast() :
@@ -365,16 +359,20 @@ bool CMasternodeBroadcast::Sign(const std::string strSignKey)
     return Sign(key, pubkey);
 }
 
-bool CMasternodeBroadcast::CheckSignature() const
+uint256 CMasternodeBroadcast::GetSignedHash() const
 {
-    std::string strError = "";
-    std::string strMessage = (
+    // The broadcast signs the message of its hash (hex string)
+    return CMessageSigner::GetMessageHash(
                             nMessVersion == MessageVersion::MESS_VER_HASH ?
                             GetSignatureHash().GetHex() :
                             GetStrMessage()
                             );
+}
 
-    if(!CMessageSigner::VerifyMessage(pubKeyCollateralAddress, vchSig, strMessage, strError))
+bool CMasternodeBroadcast::CheckSignature() const
+{
+    std::string strError = "";
+    if(!CHashSigner::VerifyHash(GetSignedHash(), pubKeyCollateralAddress.GetID(), vchSig, strError))
         return error("%s : VerifyMessage (nMessVersion=%d) failed: %s", __func__, nMessVersion, strError);
 
     return true;
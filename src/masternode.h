@@ -254,6 +254,7 @@ public:
     bool Sign(const CKey& key, const CPubKey& pubKey);
     bool Sign(const std::string strSignKey);
     bool CheckSignature() const;
+    uint256 GetSignedHash() const override;
 
     SERIALIZE_METHODS(CMasternodeBroadcast, obj)
     {
@@ -196,6 +196,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (it == mapMasternodes.end()) {
         LogPrint(BCLog::MASTERNODE, "Adding new Masternode %s\n", mn.vin.prevout.ToString());
         mapMasternodes.emplace(mn.vin.prevout, std::make_shared<CMasternode>(mn));
+        nListVersion++;
         LogPrint(BCLog::MASTERNODE, "Masternode added. New total count: %d\n", mapMasternodes.size());
         return true;
     }
@@ -269,6 +270,7 @@ int CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = mapMasternodes.erase(it);
+            nListVersion++;
             LogPrint(BCLog::MASTERNODE, "Masternode removed.\n");
         } else {
             ++it;
@@ -334,6 +336,7 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     mapMasternodes.clear();
+    nListVersion++;
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -523,13 +526,16 @@ MasternodeRef CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeigh
     */
     int minProtocol = ActiveProtocol();
     int nMnCount = mnList.GetValidMNsCount();
+    // Legacy masternodes count, for the last paid lookups
+    int nEnabled;
     {
         LOCK(cs);
-        nMnCount += CountEnabled();
+        nEnabled = CountEnabled();
+        nMnCount += nEnabled;
         for (const auto& it : mapMasternodes) {
             if (!it.second->IsEnabled()) continue;
             if (canScheduleMN(fFilterSigTime, it.second, minProtocol, nMnCount, nBlockHeight)) {
-                vecMasternodeLastPaid.emplace_back(SecondsSincePayment(it.second, BlockReading), it.second);
+                vecMasternodeLastPaid.emplace_back(SecondsSincePayment(it.second, nEnabled, BlockReading), it.second);
             }
         }
     }
@@ -537,7 +543,7 @@ MasternodeRef CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeigh
     mnList.ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
         const MasternodeRef mn = MakeMasternodeRefForDMN(dmn);
         if (canScheduleMN(fFilterSigTime, mn, minProtocol, nMnCount, nBlockHeight)) {
-            vecMasternodeLastPaid.emplace_back(SecondsSincePayment(mn, BlockReading), mn);
+            vecMasternodeLastPaid.emplace_back(SecondsSincePayment(mn, nEnabled, BlockReading), mn);
         }
     });
 
@@ -572,41 +578,97 @@ MasternodeRef CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeigh
     return pBestMasternode;
 }
 
-MasternodeRef CMasternodeMan::GetCurrentMasterNode(const uint256& hash) const
+CMasternodeMan::MasternodeScoresRef CMasternodeMan::GetScores(const uint256& hash) const
 {
-    int minProtocol = ActiveProtocol();
-    int64_t score = 0;
-    MasternodeRef winner = nullptr;
+    // The deterministic list at the tip is fetched before taking any of our locks
+    const bool fDIP3Enforced = deterministicMNManager->IsDIP3Enforced();
+    const CDeterministicMNList mnList = fDIP3Enforced ? deterministicMNManager->GetListAtChainTip() : CDeterministicMNList();
+    const std::pair<uint256, uint256> key(hash, mnList.GetBlockHash());
 
-    // scan for winner
-    for (const auto& it : mapMasternodes) {
-        const MasternodeRef& mn = it.second;
-        if (mn->protocolVersion < minProtocol || !mn->IsEnabled()) continue;
-        // calculate the score of the masternode
-        const int64_t n = mn->CalculateScore(hash).GetCompact(false);
-        // determine the winner
-        if (n > score) {
-            score = n;
-            winner = mn;
+    // Reuse the legacy objects of the DMNs that didn't change since they were made
+    std::vector<std::pair<CDeterministicMNCPtr, MasternodeRef>> dmns;
+    {
+        LOCK(cs_scores);
+        const auto it = mapScoresCache.find(key);
+        if (it != mapScoresCache.end() && it->second.nLegacyListVersion == nListVersion) {
+            return it->second.scores;
+        }
+        mnList.ForEachMN(false, [&](const CDeterministicMNCPtr& dmn) {
+            const auto itRef = mapDmnRefs.find(dmn->proTxHash);
+            dmns.emplace_back(dmn, itRef != mapDmnRefs.end() && itRef->second.first == dmn ? itRef->second.second : nullptr);
+        });
+    }
+    bool fNewRefs = false;
+    for (auto& p : dmns) {
+        // MakeMasternodeRefForDMN locks cs_main: never called with cs_scores held.
+        if (!p.second) {
+            p.second = MakeMasternodeRefForDMN(p.first);
+            fNewRefs = true;
         }
     }
 
-    // scan also dmns
-    if (deterministicMNManager->IsDIP3Enforced()) {
-        auto mnList = deterministicMNManager->GetListAtChainTip();
-        mnList.ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
-            const MasternodeRef mn = MakeMasternodeRefForDMN(dmn);
-            // calculate the score of the masternode
-            const int64_t n = mn->CalculateScore(hash).GetCompact(false);
-            // determine the winner
-            if (n > score) {
-                score = n;
-                winner = mn;
-            }
-        });
+    auto scores = std::make_shared<std::vector<MasternodeScore>>();
+    uint64_t nLegacyListVersion;
+    {
+        LOCK(cs);
+        nLegacyListVersion = nListVersion;
+        scores->reserve(mapMasternodes.size() + dmns.size());
+        for (const auto& it : mapMasternodes) {
+            const MasternodeRef& mn = it.second;
+            scores->push_back({mn->CalculateScore(hash).GetCompact(false), mn, false, false});
+        }
+    }
+    for (const auto& p : dmns) {
+        scores->push_back({p.second->CalculateScore(hash).GetCompact(false), p.second, true, mnList.IsMNValid(p.first)});
+    }
+    // Keep the scan order (legacy first) between equal scores
+    std::stable_sort(scores->begin(), scores->end(), [](const MasternodeScore& a, const MasternodeScore& b) {
+        return a.nScore > b.nScore;
+    });
+
+    LOCK(cs_scores);
+    if (fNewRefs) {
+        // Drop the masternodes no longer in the list, once they are as many as the ones in it
+        if (mapDmnRefs.size() >= 2 * dmns.size()) mapDmnRefs.clear();
+        for (const auto& p : dmns) {
+            mapDmnRefs[p.first->proTxHash] = p;
+        }
+    }
+    if (!mapScoresCache.count(key)) {
+        if (dqScoresCacheOrder.size() >= MAX_CACHED_SCORES) {
+            mapScoresCache.erase(dqScoresCacheOrder.front());
+            dqScoresCacheOrder.pop_front();
+        }
+        dqScoresCacheOrder.push_back(key);
+    }
+    mapScoresCache[key] = {nLegacyListVersion, scores};
+    return scores;
+}
+
+bool CMasternodeMan::HasCachedScores(const uint256& hash) const
+{
+    const uint256 dmnListBlockHash = deterministicMNManager->IsDIP3Enforced() ?
+                                     deterministicMNManager->GetListAtChainTip().GetBlockHash() : UINT256_ZERO;
+    LOCK(cs_scores);
+    const auto it = mapScoresCache.find(std::make_pair(hash, dmnListBlockHash));
+    return it != mapScoresCache.end() && it->second.nLegacyListVersion == nListVersion;
+}
+
+MasternodeRef CMasternodeMan::GetCurrentMasterNode(const uint256& hash) const
+{
+    const MasternodeScoresRef scores = GetScores(hash);
+    int minProtocol = ActiveProtocol();
+
+    // the winner is the first eligible masternode with a positive score
+    LOCK(cs);
+    for (const MasternodeScore& s : *scores) {
+        if (s.nScore <= 0) break;
+        if (s.fDeterministic ? s.fValid : (s.mn->protocolVersion >= minProtocol && s.mn->IsEnabled())) {
+            return s.mn;
+        }
     }
 
-    return winner;
+    return nullptr;
 }
 
 std::vector<std::pair<MasternodeRef, int>> CMasternodeMan::GetMnScores(int nLast) const
@@ -631,13 +693,18 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight) co
     // height outside range
     if (hash == UINT256_ZERO) return -1;
 
+    const MasternodeScoresRef scores = GetScores(hash);
+
     // scan for winner
     int minProtocol = ActiveProtocol();
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
-    {
-        LOCK(cs);
-        for (const auto& it : mapMasternodes) {
-            const MasternodeRef& mn = it.second;
+    const bool fCheckAge = sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+    int rank = 0;
+    LOCK(cs);
+    for (const MasternodeScore& s : *scores) {
+        const MasternodeRef& mn = s.mn;
+        if (s.fDeterministic) {
+            if (!s.fValid) continue;
+        } else {
             if (!mn->IsEnabled()) {
                 continue; // Skip not enabled
             }
@@ -645,29 +712,12 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight) co
                 LogPrint(BCLog::MASTERNODE,"Skipping Masternode with obsolete version %d\n", mn->protocolVersion);
                 continue; // Skip obsolete versions
             }
-            if (sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) &&
-                    GetAdjustedTime() - mn->sigTime < MN_WINNER_MINIMUM_AGE) {
+            if (fCheckAge && GetAdjustedTime() - mn->sigTime < MN_WINNER_MINIMUM_AGE) {
                 continue; // Skip masternodes younger than (default) 1 hour
             }
-            vecMasternodeScores.emplace_back(mn->CalculateScore(hash).GetCompact(false), mn->vin);
         }
-    }
-
-    // scan also dmns
-    if (deterministicMNManager->IsDIP3Enforced()) {
-        auto mnList = deterministicMNManager->GetListAtChainTip();
-        mnList.ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
-            const MasternodeRef mn = MakeMasternodeRefForDMN(dmn);
-            vecMasternodeScores.emplace_back(mn->CalculateScore(hash).GetCompact(false), mn->vin);
-        });
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
-
-    int rank = 0;
-    for (std::pair<int64_t, CTxIn> & s : vecMasternodeScores) {
         rank++;
-        if (s.second.prevout == vin.prevout) {
+        if (mn->vin.prevout == vin.prevout) {
             return rank;
         }
     }
@@ -681,26 +731,17 @@ std::vector<std::pair<int64_t, MasternodeRef>> CMasternodeMan::GetMasternodeRank
     const uint256& hash = GetHashAtHeight(nBlockHeight - 1);
     // height outside range
     if (hash == UINT256_ZERO) return vecMasternodeScores;
+
+    const MasternodeScoresRef scores = GetScores(hash);
+    vecMasternodeScores.reserve(scores->size());
     {
         LOCK(cs);
-        // scan for winner
-        for (const auto& it : mapMasternodes) {
-            const MasternodeRef mn = it.second;
-            const uint32_t score = mn->IsEnabled() ? mn->CalculateScore(hash).GetCompact(false) : 9999;
-
-            vecMasternodeScores.emplace_back(score, mn);
+        for (const MasternodeScore& s : *scores) {
+            const bool fValid = s.fDeterministic ? s.fValid : s.mn->IsEnabled();
+            vecMasternodeScores.emplace_back(fValid ? s.nScore : 9999, s.mn);
         }
     }
-    // scan also dmns
-    if (deterministicMNManager->IsDIP3Enforced()) {
-        auto mnList = deterministicMNManager->GetListAtChainTip();
-        mnList.ForEachMN(false, [&](const CDeterministicMNCPtr& dmn) {
-            const MasternodeRef mn = MakeMasternodeRefForDMN(dmn);
-            const uint32_t score = mnList.IsMNValid(dmn) ? mn->CalculateScore(hash).GetCompact(false) : 9999;
-
-            vecMasternodeScores.emplace_back(score, mn);
-        });
-    }
+    // move the disabled/invalid masternodes down
     sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
     return vecMasternodeScores;
 }
@@ -873,6 +914,7 @@ void CMasternodeMan::Remove(const COutPoint& collateralOut)
     const auto it = mapMasternodes.find(collateralOut);
     if (it != mapMasternodes.end()) {
         mapMasternodes.erase(it);
+        nListVersion++;
     }
 }
 
@@ -899,9 +941,9 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast& mnb)
     }
 }
 
-int64_t CMasternodeMan::SecondsSincePayment(const MasternodeRef& mn, const CBlockIndex* BlockReading) const
+int64_t CMasternodeMan::SecondsSincePayment(const MasternodeRef& mn, int nMnCount, const CBlockIndex* BlockReading) const
 {
-    int64_t sec = (GetAdjustedTime() - GetLastPaid(mn, BlockReading));
+    int64_t sec = (GetAdjustedTime() - GetLastPaid(mn, nMnCount, BlockReading));
     int64_t month = 60 * 60 * 24 * 30;
     if (sec < month) return sec; //if it's less than 30 days, give seconds
 
@@ -915,6 +957,11 @@ int64_t CMasternodeMan::SecondsSincePayment(const MasternodeRef& mn, const CBloc
 }
 
 int64_t CMasternodeMan::GetLastPaid(const MasternodeRef& mn, const CBlockIndex* BlockReading) const
+{
+    return GetLastPaid(mn, CountEnabled(), BlockReading);
+}
+
+int64_t CMasternodeMan::GetLastPaid(const MasternodeRef& mn, int nMnCount, const CBlockIndex* BlockReading) const
 {
     if (BlockReading == nullptr) return false;
 
@@ -928,23 +975,15 @@ int64_t CMasternodeMan::GetLastPaid(const MasternodeRef& mn, const CBlockIndex*
     // use a deterministic offset to break a tie -- 2.5 minutes
     int64_t nOffset = UintToArith256(hash).GetCompact(false) % 150;
 
-    int nMnCount = CountEnabled() * 1.25;
-    for (int n = 0; n < nMnCount; n++) {
-        const auto& it = masternodePayments.mapMasternodeBlocks.find(BlockReading->nHeight);
-        if (it != masternodePayments.mapMasternodeBlocks.end()) {
-            // Search for this payee, with at least 2 votes. This will aid in consensus
-            // allowing the network to converge on the same payees quickly, then keep the same schedule.
-            if (it->second.HasPayeeWithVotes(mnpayee, 2))
-                return BlockReading->nTime + nOffset;
-        }
-        BlockReading = BlockReading->pprev;
-
-        if (BlockReading == nullptr || BlockReading->nHeight <= 0) {
-            break;
-        }
-    }
+    // Search for this payee, with at least 2 votes, in the last CountEnabled() * 1.25 blocks.
+    // This will aid in consensus allowing the network to converge on the same payees quickly,
+    // then keep the same schedule.
+    const int nDepth = nMnCount * 1.25;
+    const int nPaidHeight = masternodePayments.GetLastPaidHeight(mnpayee, BlockReading->nHeight, nDepth);
+    if (nPaidHeight < 0)
+        return 0;
 
-    return 0;
+    return BlockReading->GetAncestor(nPaidHeight)->nTime + nOffset;
 }
 
 std::string CMasternodeMan::ToString() const
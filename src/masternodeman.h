@@ -15,12 +15,17 @@
 #include "sync.h"
 #include "util/system.h"
 
+#include <deque>
+
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
 
 /** Maximum number of block hashes to cache */
 static const unsigned int CACHED_BLOCK_HASHES = 200;
 
+/** Maximum number of block hashes with cached masternode scores */
+static const unsigned int MAX_CACHED_SCORES = 50;
+
 class CMasternodeMan;
 class CActiveMasternode;
 
@@ -78,6 +83,36 @@ private:
     // Memory Only. Cache last block hashes. Used to verify mn pings and winners.
     CyclingVector<uint256> cvLastBlockHashes;
 
+    // Score of a masternode for a block hash (CalculateScore in compact form)
+    struct MasternodeScore {
+        int64_t nScore;
+        MasternodeRef mn;
+        bool fDeterministic;
+        // Deterministic masternodes only: valid in the list used for the scoring
+        bool fValid;
+    };
+    typedef std::shared_ptr<const std::vector<MasternodeScore>> MasternodeScoresRef;
+
+    // Scores of every legacy and deterministic masternode, sorted from the highest
+    struct CachedScores {
+        uint64_t nLegacyListVersion;
+        MasternodeScoresRef scores;
+    };
+
+    // Memory Only. Bumped whenever a masternode is added to, or removed from, mapMasternodes.
+    std::atomic<uint64_t> nListVersion{0};
+
+    // Memory Only. Score tables per (block hash, block hash of the deterministic list at the tip),
+    // for the ranking queries. An entry is stale once the legacy list changes.
+    mutable RecursiveMutex cs_scores;
+    mutable std::map<std::pair<uint256, uint256>, CachedScores> mapScoresCache;
+    mutable std::deque<std::pair<uint256, uint256>> dqScoresCacheOrder;
+    // Legacy objects for the deterministic masternodes (by proTxHash), with the DMN they were made from
+    mutable std::map<uint256, std::pair<CDeterministicMNCPtr, MasternodeRef>> mapDmnRefs;
+
+    // Return the score table for the given block hash (from the cache when still valid)
+    MasternodeScoresRef GetScores(const uint256& hash) const;
+
     // Return the banning score (0 if no ban score increase is needed).
     int ProcessMNBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb);
     int ProcessMNPing(CNode* pfrom, CMasternodePing& mnp);
@@ -104,6 +139,7 @@ public:
 
         READWRITE(obj.mapSeenMasternodeBroadcast);
         READWRITE(obj.mapSeenMasternodePing);
+        SER_READ(obj, obj.nListVersion++);
     }
 
     CMasternodeMan();
@@ -150,6 +186,8 @@ public:
     // Retrieve the known masternodes ordered by scoring without checking them. (Only used for listmasternodes RPC call)
     std::vector<std::pair<int64_t, MasternodeRef>> GetMasternodeRanks(int nBlockHeight) const;
     int GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight) const;
+    // Visible for testing purposes only: whether a valid score table is cached for the block hash (and the list at the tip)
+    bool HasCachedScores(const uint256& hash) const;
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
@@ -168,7 +206,9 @@ public:
 
     /// Get the time a masternode was last paid
     int64_t GetLastPaid(const MasternodeRef& mn, const CBlockIndex* BlockReading) const;
-    int64_t SecondsSincePayment(const MasternodeRef& mn, const CBlockIndex* BlockReading) const;
+    // nMnCount: number of enabled legacy masternodes (CountEnabled()), to look up many masternodes in a row
+    int64_t GetLastPaid(const MasternodeRef& mn, int nMnCount, const CBlockIndex* BlockReading) const;
+    int64_t SecondsSincePayment(const MasternodeRef& mn, int nMnCount, const CBlockIndex* BlockReading) const;
 
     // Block hashes cycling vector management
     void CacheBlockHash(const CBlockIndex* pindex);
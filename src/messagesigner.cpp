@@ -3,15 +3,64 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "messagesigner.h"
+
+#include "cuckoocache.h"
 #include "hash.h"
 #include "key_io.h"
-#include "messagesigner.h"
+#include "random.h"
+#include "script/sigcache.h"
 #include "tinyformat.h"
 #include "util/system.h"
 #include "utilstrencodings.h"
 
+#include <boost/thread/shared_mutex.hpp>
+
 const std::string strMessageMagic = "DarkNet Signed Message:\n";
 
+namespace {
+/**
+ * Valid message signature cache, to avoid recovering the signer of the tier
+ * two messages relayed by several peers more than once. It's also filled
+ * ahead by the tier two signature verification threads.
+ */
+class CMessageSignatureCache
+{
+private:
+    //! Entries are SHA256(nonce || signed hash || key id || signature):
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_sigcache;
+
+public:
+    CMessageSignatureCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+        setValid.setup_bytes(MESSAGE_SIG_CACHE_BYTES);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(keyID.begin(), keyID.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        setValid.insert(entry);
+    }
+};
+
+static CMessageSignatureCache messageSignatureCache;
+}
+
 bool CMessageSigner::GetKeysFromSecret(const std::string& strSecret, CKey& keyRet, CPubKey& pubkeyRet)
 {
     keyRet = KeyIO::DecodeSecret(strSecret);
@@ -67,6 +116,12 @@ bool CHashSigner::VerifyHash(const uint256& hash, const CPubKey& pubkey, const s
 
 bool CHashSigner::VerifyHash(const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig, std::string& strErrorRet)
 {
+    uint256 entry;
+    messageSignatureCache.ComputeEntry(entry, hash, keyID, vchSig);
+    if (messageSignatureCache.Get(entry)) {
+        return true;
+    }
+
     CPubKey pubkeyFromSig;
     if(!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
         strErrorRet = "Error recovering public key.";
@@ -80,6 +135,20 @@ bool CHashSigner::VerifyHash(const uint256& hash, const CKeyID& keyID, const std
         return false;
     }
 
+    messageSignatureCache.Set(entry);
+    return true;
+}
+
+bool CHashSigner::CacheHashSignature(const uint256& hash, const std::vector<unsigned char>& vchSig)
+{
+    CPubKey pubkeyFromSig;
+    if (!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
+        return false;
+    }
+
+    uint256 entry;
+    messageSignatureCache.ComputeEntry(entry, hash, pubkeyFromSig.GetID(), vchSig);
+    messageSignatureCache.Set(entry);
     return true;
 }
 
@@ -116,17 +185,23 @@ bool CSignedMessage::Sign(const std::string strSignKey)
     return Sign(key, pubkey.GetID());
 }
 
-bool CSignedMessage::CheckSignature(const CKeyID& keyID) const
+uint256 CSignedMessage::GetSignedHash() const
 {
-    std::string strError = "";
-
     if (nMessVersion == MessageVersion::MESS_VER_HASH) {
-        uint256 hash = GetSignatureHash();
-        return CHashSigner::VerifyHash(hash, keyID, vchSig, strError);
+        return GetSignatureHash();
     }
+    return CMessageSigner::GetMessageHash(GetStrMessage());
+}
 
-    std::string strMessage = GetStrMessage();
-    return CMessageSigner::VerifyMessage(keyID, vchSig, strMessage, strError);
+bool CSignedMessage::CheckSignature(const CKeyID& keyID) const
+{
+    std::string strError = "";
+    return CHashSigner::VerifyHash(GetSignedHash(), keyID, vchSig, strError);
+}
+
+bool CSignedMessage::CacheSignature() const
+{
+    return CHashSigner::CacheHashSignature(GetSignedHash(), vchSig);
 }
 
 std::string CSignedMessage::GetSignatureBase64() const
@@ -11,6 +11,9 @@
 
 extern const std::string strMessageMagic;
 
+/** Size of the cache of valid message signatures (see CHashSigner::VerifyHash) */
+static const size_t MESSAGE_SIG_CACHE_BYTES = 4 << 20;
+
 enum MessageVersion {
         MESS_VER_STRMESS    = 0, // old format
         MESS_VER_HASH       = 1,
@@ -45,6 +48,8 @@ public:
     static bool VerifyHash(const uint256& hash, const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
     /// Verify the hash signature, returns true if successful
     static bool VerifyHash(const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
+    /// Recover the signer of the hash, and cache the signature as verified, returns true if successful
+    static bool CacheHashSignature(const uint256& hash, const std::vector<unsigned char>& vchSig);
 };
 
 /** Base Class for all signed messages on the network
@@ -67,11 +72,15 @@ public:
     bool Sign(const CKey& key, const CKeyID& keyID);
     bool Sign(const std::string strSignKey);
     bool CheckSignature(const CKeyID& keyID) const;
+    // Verify the signature ahead, without knowing the signer (see CHashSigner::CacheHashSignature)
+    bool CacheSignature() const;
 
     // Pure virtual functions (used in Sign-Verify functions)
     // Must be implemented in child classes
     virtual uint256 GetSignatureHash() const = 0;
     virtual std::string GetStrMessage() const = 0;
+    // Hash signed by vchSig, depending on nMessVersion
+    virtual uint256 GetSignedHash() const;
 
     // Setters and getters
     void SetVchSig(const std::vector<unsigned char>& vchSigIn) { vchSig = vchSigIn; }
@@ -35,6 +35,15 @@
 #include <ifaddrs.h>
 #endif
 
+#ifdef USE_POLL
+#include <poll.h>
+#include <unordered_map>
+#endif
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #include <math.h>
 
 // Dump addresses to peers.dat and banlist.dat every 15 minutes (900s)
@@ -47,6 +56,19 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+// Maximum time to wait for socket events. With poll/epoll the socket handler
+// is woken up when there is new data to send, so it can wait for longer.
+#ifdef USE_POLL
+static const int SELECT_TIMEOUT_MILLISECONDS = 500;
+#else
+static const int SELECT_TIMEOUT_MILLISECONDS = 50;
+#endif
+
+#ifdef USE_EPOLL
+// Maximum number of socket events returned by a single epoll_wait
+static const int EPOLL_MAX_EVENTS = 1024;
+#endif
+
 // Fix for ancient MinGW versions, that don't have defined these in ws2tcpip.h.
 // Todo: Can be removed when our pull-tester is upgraded to a modern MinGW version.
 #ifdef WIN32
@@ -654,6 +676,10 @@ void CNode::copyStats(CNodeStats& stats)
         X(mapRecvBytesPerMsgCmd);
         X(nRecvBytes);
     }
+    {
+        LOCK(cs_vProcessMsg);
+        X(mapProcTimePerMsgCmd);
+    }
     X(fWhitelisted);
 
     // It is common for nodes with good ping times to suddenly become lagged,
@@ -677,6 +703,24 @@ void CNode::copyStats(CNodeStats& stats)
 }
 #undef X
 
+bool CNode::HasPriorityMessage()
+{
+    LOCK(cs_vProcessMsg);
+    if (vProcessMsg.empty()) return false;
+    const CNetMessage& msg = vProcessMsg.front();
+    return msg.hdr.GetCommand() == NetMsgType::BLOCK || msg.hdr.GetCommand() == NetMsgType::HEADERS;
+}
+
+void CNode::AccountForProcessTime(const std::string& strCommand, int64_t nTimeMicros)
+{
+    LOCK(cs_vProcessMsg);
+    mapMsgCmdSize::iterator i = mapProcTimePerMsgCmd.find(strCommand);
+    if (i == mapProcTimePerMsgCmd.end())
+        i = mapProcTimePerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(i != mapProcTimePerMsgCmd.end());
+    i->second += nTimeMicros;
+}
+
 bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes, bool& complete)
 {
     complete = false;
@@ -1074,6 +1118,264 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     RandAddEvent((uint32_t)id);
 }
 
+bool CConnman::GenerateSelectSet(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        recv_set.insert(hListenSocket.socket);
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes) {
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is space left in the receive buffer, select() for
+            //   receiving data.
+            // * Hand off all complete messages to the processor, to be handled without
+            //   blocking here.
+
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+#ifdef USE_EPOLL
+            if (epollfd != -1) {
+                // The socket stays registered (until it's closed), only update
+                // the registration when the events waited for change.
+                uint32_t nEvents = EPOLLERR;
+                if (select_send)
+                    nEvents |= EPOLLOUT;
+                else if (select_recv)
+                    nEvents |= EPOLLIN;
+                if (pnode->nEpollEvents != nEvents) {
+                    struct epoll_event event = {};
+                    event.events = nEvents;
+                    event.data.fd = pnode->hSocket;
+                    if (epoll_ctl(epollfd, pnode->nEpollEvents == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, pnode->hSocket, &event) == 0) {
+                        pnode->nEpollEvents = nEvents;
+                    } else {
+                        LogPrintf("socket epoll_ctl error %s, peer=%d\n", NetworkErrorString(WSAGetLastError()), pnode->GetId());
+                        pnode->fDisconnect = true;
+                        continue;
+                    }
+                }
+            }
+#endif
+
+            error_set.insert(pnode->hSocket);
+            if (select_send) {
+                send_set.insert(pnode->hSocket);
+                continue;
+            }
+            if (select_recv) {
+                recv_set.insert(pnode->hSocket);
+            }
+        }
+    }
+
+    return !recv_set.empty() || !send_set.empty() || !error_set.empty();
+}
+
+#ifdef USE_POLL
+void CConnman::DrainWakeupPipe()
+{
+    char buf[128];
+    while (read(wakeupPipe[0], buf, sizeof(buf)) > 0) {}
+}
+#endif
+
+#ifdef USE_EPOLL
+void CConnman::SocketEventsEpoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    // The listening sockets and the wakeup pipe are registered by Start(),
+    // the sockets of the peers by GenerateSelectSet.
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+    GenerateSelectSet(recv_select_set, send_select_set, error_select_set);
+
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int nEvents = epoll_wait(epollfd, events, EPOLL_MAX_EVENTS, SELECT_TIMEOUT_MILLISECONDS);
+    if (interruptNet)
+        return;
+
+    if (nEvents < 0) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        const SOCKET hSocket = events[i].data.fd;
+        if ((int)hSocket == wakeupPipe[0]) {
+            DrainWakeupPipe();
+            continue;
+        }
+        if (events[i].events & EPOLLIN)
+            recv_set.insert(hSocket);
+        if (events[i].events & EPOLLOUT)
+            send_set.insert(hSocket);
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+            error_set.insert(hSocket);
+    }
+}
+#endif
+
+#ifdef USE_POLL
+void CConnman::SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+#ifdef USE_EPOLL
+    if (epollfd != -1) {
+        SocketEventsEpoll(recv_set, send_set, error_set);
+        return;
+    }
+#endif
+
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+    GenerateSelectSet(recv_select_set, send_select_set, error_select_set);
+
+    std::unordered_map<SOCKET, struct pollfd> pollfds;
+    for (SOCKET hSocket : recv_select_set) {
+        pollfds[hSocket].fd = hSocket;
+        pollfds[hSocket].events |= POLLIN;
+    }
+    for (SOCKET hSocket : send_select_set) {
+        pollfds[hSocket].fd = hSocket;
+        pollfds[hSocket].events |= POLLOUT;
+    }
+    for (SOCKET hSocket : error_select_set) {
+        pollfds[hSocket].fd = hSocket;
+        // These flags are ignored, but we set them for clarity
+        pollfds[hSocket].events |= POLLERR | POLLHUP;
+    }
+
+    std::vector<struct pollfd> vpollfds;
+    vpollfds.reserve(pollfds.size() + 1);
+    for (const auto& it : pollfds) {
+        vpollfds.push_back(it.second);
+    }
+    if (wakeupPipe[0] != -1) {
+        struct pollfd pollfd = {};
+        pollfd.fd = wakeupPipe[0];
+        pollfd.events = POLLIN;
+        vpollfds.push_back(pollfd);
+    }
+
+    int nRet = poll(vpollfds.data(), vpollfds.size(), SELECT_TIMEOUT_MILLISECONDS);
+    if (interruptNet)
+        return;
+
+    if (nRet < 0) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket poll error %s\n", NetworkErrorString(nErr));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+
+    for (const struct pollfd& pollfd : vpollfds) {
+        if (pollfd.fd == wakeupPipe[0]) {
+            if (pollfd.revents & POLLIN)
+                DrainWakeupPipe();
+            continue;
+        }
+        if (pollfd.revents & POLLIN)
+            recv_set.insert(pollfd.fd);
+        if (pollfd.revents & POLLOUT)
+            send_set.insert(pollfd.fd);
+        if (pollfd.revents & (POLLERR | POLLHUP))
+            error_set.insert(pollfd.fd);
+    }
+}
+#else
+void CConnman::SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+    if (!GenerateSelectSet(recv_select_set, send_select_set, error_select_set)) {
+        interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        return;
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = SELECT_TIMEOUT_MILLISECONDS * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+
+    for (SOCKET hSocket : recv_select_set) {
+        FD_SET(hSocket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+    for (SOCKET hSocket : send_select_set) {
+        FD_SET(hSocket, &fdsetSend);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+    for (SOCKET hSocket : error_select_set) {
+        FD_SET(hSocket, &fdsetError);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+
+    int nSelect = select(hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return;
+
+    if (nSelect == SOCKET_ERROR) {
+        int nErr = WSAGetLastError();
+        LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+        for (unsigned int i = 0; i <= hSocketMax; i++)
+            FD_SET(i, &fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS)))
+            return;
+    }
+
+    for (SOCKET hSocket : recv_select_set) {
+        if (FD_ISSET(hSocket, &fdsetRecv))
+            recv_set.insert(hSocket);
+    }
+    for (SOCKET hSocket : send_select_set) {
+        if (FD_ISSET(hSocket, &fdsetSend))
+            send_set.insert(hSocket);
+    }
+    for (SOCKET hSocket : error_select_set) {
+        if (FD_ISSET(hSocket, &fdsetError))
+            error_set.insert(hSocket);
+    }
+}
+#endif
+
+void CConnman::WakeSocketHandler()
+{
+#ifdef USE_POLL
+    if (wakeupPipe[1] == -1)
+        return;
+    char buf{0};
+    if (write(wakeupPipe[1], &buf, sizeof(buf)) != 1) {
+        // The pipe is full: the socket handler has a wakeup pending already
+    }
+#endif
+}
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
@@ -1140,87 +1442,17 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+        std::set<SOCKET> recv_set, send_set, error_set;
+        SocketEvents(recv_set, send_set, error_set);
 
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes) {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
-        }
-
         //
         // Accept new connections
         //
         for (const ListenSocket& hListenSocket : vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+            if (hListenSocket.socket != INVALID_SOCKET && recv_set.count(hListenSocket.socket) > 0) {
                 AcceptConnection(hListenSocket);
             }
         }
@@ -1249,9 +1481,9 @@ void CConnman::ThreadSocketHandler()
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                recvSet = recv_set.count(pnode->hSocket) > 0;
+                sendSet = send_set.count(pnode->hSocket) > 0;
+                errorSet = error_set.count(pnode->hSocket) > 0;
             }
             if (recvSet || errorSet) {
                 {
@@ -1277,6 +1509,7 @@ void CConnman::ThreadSocketHandler()
                                     if (!it->complete())
                                         break;
                                     nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+                                    m_msgproc->ReceivedMessage(pnode, *it);
                                 }
                                 {
                                     LOCK(pnode->cs_vProcessMsg);
@@ -1346,9 +1579,9 @@ void CConnman::WakeMessageHandler()
 {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        vMsgProcWake.assign(vMsgProcWake.size(), true);
     }
-    condMsgProc.notify_one();
+    condMsgProc.notify_all();
 }
 
 
@@ -1723,22 +1956,33 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
+    // Have the socket handler wait for the answer of the peer
+    WakeSocketHandler();
 
     return true;
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int nThread)
 {
     while (!flagInterruptMsgProc) {
+        // Each thread serves its own set of peers, so the messages of a
+        // peer are still processed one at a time and in order.
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy) {
+            for (CNode* pnode : vNodes) {
+                if (pnode->GetId() % nMsgHandlerThreads != nThread)
+                    continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
         }
 
+        // Serve first the peers whose next message is a block (or headers),
+        // so they are not queued behind the tx and tier two traffic of the
+        // other peers.
+        std::stable_partition(vNodesCopy.begin(), vNodesCopy.end(), [](CNode* pnode) { return pnode->HasPriorityMessage(); });
+
         bool fMoreWork = false;
 
         for (CNode* pnode : vNodesCopy) {
@@ -1770,9 +2014,9 @@ void CConnman::ThreadMessageHandler()
 
         std::unique_lock<std::mutex> lock(mutexMsgProc);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this, nThread] { return vMsgProcWake[nThread]; });
         }
-        fMsgProcWake = false;
+        vMsgProcWake[nThread] = false;
     }
 }
 
@@ -1920,6 +2164,31 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nBestHeight = 0;
     clientInterface = NULL;
     flagInterruptMsgProc = false;
+
+#ifdef USE_POLL
+    if (pipe(wakeupPipe) == 0) {
+        for (int fd : wakeupPipe) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    } else {
+        LogPrintf("Cannot create the socket handler wakeup pipe: %s\n", NetworkErrorString(WSAGetLastError()));
+        wakeupPipe[0] = wakeupPipe[1] = -1;
+    }
+#endif
+#ifdef USE_EPOLL
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd == -1) {
+        LogPrintf("Cannot create the epoll instance: %s, using poll\n", NetworkErrorString(WSAGetLastError()));
+    } else if (wakeupPipe[0] != -1) {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = wakeupPipe[0];
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, wakeupPipe[0], &event) != 0) {
+            LogPrintf("Cannot register the socket handler wakeup pipe: %s\n", NetworkErrorString(WSAGetLastError()));
+        }
+    }
+#endif
 }
 
 NodeId CConnman::GetNewNodeId()
@@ -1940,6 +2209,7 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
 
     nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
     nReceiveFloodSize = connOptions.nReceiveFloodSize;
+    nMsgHandlerThreads = std::max(1, std::min(connOptions.nMsgHandlerThreads, MAX_MSGHANDLER_THREADS));
 
     SetBestHeight(connOptions.nBestHeight);
 
@@ -2010,9 +2280,24 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
 
     {
         std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+        vMsgProcWake.assign(nMsgHandlerThreads, false);
     }
 
+#ifdef USE_EPOLL
+    if (epollfd != -1) {
+        for (const ListenSocket& hListenSocket : vhListenSocket) {
+            struct epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.fd = hListenSocket.socket;
+            if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+                strNodeError = strprintf("Cannot register the listening socket for events: %s", NetworkErrorString(WSAGetLastError()));
+                LogPrintf("%s\n", strNodeError);
+                return false;
+            }
+        }
+    }
+#endif
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2029,7 +2314,10 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMsgHandlerThreads; i++) {
+        const std::string strName = i == 0 ? "msghand" : strprintf("msghand.%i", i);
+        threadMessageHandlers.emplace_back([this, i, strName] { TraceThread(strName.c_str(), std::bind(&CConnman::ThreadMessageHandler, this, i)); });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
@@ -2069,6 +2357,7 @@ void CConnman::Interrupt()
     condMsgProc.notify_all();
 
     interruptNet();
+    WakeSocketHandler();
     InterruptSocks5(true);
 
     if (semOutbound)
@@ -2078,8 +2367,11 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& threadMessageHandler : threadMessageHandlers) {
+        if (threadMessageHandler.joinable())
+            threadMessageHandler.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2135,6 +2427,18 @@ CConnman::~CConnman()
 {
     Interrupt();
     Stop();
+
+#ifdef USE_EPOLL
+    if (epollfd != -1)
+        close(epollfd);
+#endif
+#ifdef USE_POLL
+    for (int& fd : wakeupPipe) {
+        if (fd != -1)
+            close(fd);
+        fd = -1;
+    }
+#endif
 }
 
 size_t CConnman::GetAddressCount() const
@@ -2348,6 +2652,9 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     for (const std::string &msg : getAllNetMessageTypes())
         mapRecvBytesPerMsgCmd[msg] = 0;
     mapRecvBytesPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    for (const std::string &msg : getAllNetMessageTypes())
+        mapProcTimePerMsgCmd[msg] = 0;
+    mapProcTimePerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
 
     if (fLogIPs)
         LogPrint(BCLog::NET, "Added connection to %s peer=%d\n", addrName, id);
@@ -2416,6 +2723,7 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
     size_t nBytesSent = 0;
+    bool fWakeSocketHandler = false;
     {
         LOCK(pnode->cs_vSend);
         bool optimisticSend(pnode->vSendMsg.empty());
@@ -2433,9 +2741,13 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
             nBytesSent = SocketSendData(pnode);
+        // If the write queue is left non-empty, the socket handler sends the rest
+        fWakeSocketHandler = optimisticSend && !pnode->vSendMsg.empty();
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
+    if (fWakeSocketHandler)
+        WakeSocketHandler();
 }
 
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
@@ -75,6 +75,10 @@ static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Default number of message handler threads (each one serving its own set of peers) */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHANDLER_THREADS = 16;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
@@ -137,6 +141,7 @@ public:
         NetEventsInterface* m_msgproc = nullptr;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
+        int nMsgHandlerThreads = DEFAULT_MSGHANDLER_THREADS;
     };
     CConnman(uint64_t seed0, uint64_t seed1);
     ~CConnman();
@@ -269,6 +274,9 @@ public:
     CSipHasher GetDeterministicRandomizer(uint64_t id);
 
     unsigned int GetReceiveFloodSize() const;
+
+    /** Wake the socket handler up from its wait for socket events */
+    void WakeSocketHandler();
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -280,8 +288,16 @@ private:
     void ThreadOpenAddedConnections();
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nThread);
     void AcceptConnection(const ListenSocket& hListenSocket);
+    bool GenerateSelectSet(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+#ifdef USE_POLL
+    void DrainWakeupPipe();
+#endif
+#ifdef USE_EPOLL
+    void SocketEventsEpoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+#endif
+    void SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -366,8 +382,9 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0{0}, nSeed1{0};
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake{false};
+    /** flags for waking the message processors, one per thread. */
+    std::vector<bool> vMsgProcWake;
+    int nMsgHandlerThreads{DEFAULT_MSGHANDLER_THREADS};
 
     std::condition_variable condMsgProc;
     std::mutex mutexMsgProc;
@@ -375,11 +392,20 @@ private:
 
     CThreadInterrupt interruptNet;
 
+#ifdef USE_POLL
+    /** pipe written to wake the socket handler up, before its wait for socket events times out */
+    int wakeupPipe[2]{-1, -1};
+#endif
+#ifdef USE_EPOLL
+    /** epoll instance the sockets are registered in, -1 when falling back to poll */
+    int epollfd{-1};
+#endif
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 };
 extern std::unique_ptr<CConnman> g_connman;
 void Discover();
@@ -464,6 +490,7 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdSize mapProcTimePerMsgCmd;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -525,6 +552,9 @@ public:
     std::atomic<ServiceFlags> nServices;
     ServiceFlags nServicesExpected;
     SOCKET hSocket;
+#ifdef USE_EPOLL
+    uint32_t nEpollEvents{0}; // events hSocket is registered for in the epoll instance, protected by cs_hSocket
+#endif
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
@@ -536,6 +566,7 @@ public:
     RecursiveMutex cs_vProcessMsg;
     std::list<CNetMessage> vProcessMsg;
     size_t nProcessQueueSize;
+    mapMsgCmdSize mapProcTimePerMsgCmd; // protected by cs_vProcessMsg, microseconds
 
     RecursiveMutex cs_sendProcessing;
 
@@ -679,6 +710,11 @@ public:
 
     bool ReceiveMsgBytes(const char* pch, unsigned int nBytes, bool& complete);
 
+    //! Whether the next message to process is a block (or headers) announcement
+    bool HasPriorityMessage();
+    //! Account for the time spent processing a message, in microseconds
+    void AccountForProcessTime(const std::string& strCommand, int64_t nTimeMicros);
+
     void SetRecvVersion(int nVersionIn)
     {
         nRecvVersion = nVersionIn;
@@ -804,6 +840,8 @@ class NetEventsInterface
 {
 public:
     virtual bool ProcessMessages(CNode* pnode, std::atomic<bool>& interrupt) = 0;
+    //! Called by the socket handler thread for each message received, before it's queued for processing
+    virtual void ReceivedMessage(CNode* pnode, const CNetMessage& msg) = 0;
     virtual bool SendMessages(CNode* pnode, std::atomic<bool>& interrupt) EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_sendProcessing) = 0;
     virtual void InitializeNode(CNode* pnode) = 0;
     virtual void FinalizeNode(NodeId id, bool& update_connection_time) = 0;
@@ -6,9 +6,13 @@
 
 #include "net_processing.h"
 
+#include "blockencodings.h"
+#include "blocksignature.h"
 #include "budget/budgetmanager.h"
 #include "chain.h"
 #include "evo/deterministicmns.h"
+#include "index/blockfilterindex.h"
+#include "kernel.h"
 #include "masternodeman.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
@@ -18,6 +22,7 @@
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "sporkdb.h"
+#include "tiertwo_sigverify.h"
 
 int64_t nTimeBestReceived = 0;  // Used only to inform the wallet of when we last received a block
 
@@ -44,7 +49,12 @@ std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
 std::map<COutPoint, std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>> mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
 std::vector<std::map<uint256, COrphanTx>::iterator> g_orphan_list GUARDED_BY(g_cs_orphans); //! For random eviction
 
+/** Serializes the tier two message handlers, when the messages are processed by more than one thread.
+ *  Must not be taken while holding cs_main (the handlers lock it internally). */
+static Mutex g_cs_tiertwo_msgproc;
+
 void EraseOrphansFor(NodeId peer);
+static void EraseBlocksAwaitingParentFor(NodeId nodeid) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 // Internal stuff
 namespace {
@@ -58,6 +68,21 @@ int nSyncStarted = 0;
  */
 std::map<uint256, NodeId> mapBlockSource;
 
+/**
+ * Blocks downloaded ahead of their parent during headers-first sync. Blocks
+ * are accepted in order (the stake modifier and the proof of stake depend on
+ * the previous block), so these wait here, keyed by the hash of their parent,
+ * until the parent is accepted. Protected by cs_main.
+ */
+struct BlockAwaitingParent {
+    std::shared_ptr<const CBlock> pblock;
+    NodeId nodeid;
+    size_t nSize;
+};
+std::multimap<uint256, BlockAwaitingParent> mapBlocksAwaitingParent;
+std::set<uint256> setBlocksAwaitingParent;
+size_t nBlocksAwaitingParentSize = 0;
+
 /**
  * Filter for transactions that were recently rejected by
  * AcceptToMemoryPool. These are not rerequested until the chain tip
@@ -88,9 +113,13 @@ struct QueuedBlock {
     int64_t nTime;              //! Time of "getdata" request in microseconds.
     int nValidatedQueuedBefore; //! Number of blocks queued with validated headers (globally) at the time this one is requested.
     bool fValidatedHeaders;     //! Whether this block has validated headers at the time of request.
+    std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //! Optional, used for CMPCTBLOCK downloads
 };
 std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
+/** Stack of nodes which we have set to announce using compact blocks */
+std::list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
 /** Number of blocks in flight with validated headers. */
 int nQueuedValidatedHeaders = 0;
 
@@ -211,12 +240,22 @@ struct CNodeState {
     const CBlockIndex* pindexLastCommonBlock;
     //! Whether we've started headers synchronization with this peer.
     bool fSyncStarted;
+    //! Whether the headers of this peer were skipped, too far ahead of the active chain.
+    bool fHeadersPaused;
+    //! The unverified proof of stake headers accepted from this peer (see ProcessNewBlockHeaders).
+    std::vector<const CBlockIndex*> vUnverifiedPoSHeaders;
+    //! Total size of the blocks downloaded from this peer waiting for their parent.
+    size_t nBlocksAwaitingParentSize;
     //! Since when we're stalling block download progress (in microseconds), or 0.
     int64_t nStallingSince;
     std::list<QueuedBlock> vBlocksInFlight;
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether this peer wants new blocks pushed as cmpctblocks rather than announced with invs.
+    bool fPreferHeaderAndIDs;
+    //! Whether this peer will send us cmpctblocks if we request them.
+    bool fProvidesHeaderAndIDs;
 
     CNodeBlocks nodeBlocks;
 
@@ -228,9 +267,13 @@ struct CNodeState {
         hashLastUnknownBlock.SetNull();
         pindexLastCommonBlock = NULL;
         fSyncStarted = false;
+        fHeadersPaused = false;
+        nBlocksAwaitingParentSize = 0;
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
+        fPreferHeaderAndIDs = false;
+        fProvidesHeaderAndIDs = false;
     }
 };
 
@@ -291,7 +334,8 @@ void MarkBlockAsReceived(const uint256& hash)
 }
 
 // Requires cs_main.
-void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr)
+// Returns the new in-flight entry, so that the caller can attach a partially downloaded block to it.
+QueuedBlock* MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr)
 {
     CNodeState* state = State(nodeid);
     assert(state != NULL);
@@ -299,11 +343,64 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     // Make sure it's not listed somewhere already.
     MarkBlockAsReceived(hash);
 
-    QueuedBlock newentry = {hash, pindex, GetTimeMicros(), nQueuedValidatedHeaders, pindex != NULL};
-    nQueuedValidatedHeaders += newentry.fValidatedHeaders;
-    std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
+    std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
+            {hash, pindex, GetTimeMicros(), nQueuedValidatedHeaders, pindex != NULL, nullptr});
+    nQueuedValidatedHeaders += it->fValidatedHeaders;
     state->nBlocksInFlight++;
     mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
+    return &(*it);
+}
+
+// Requires cs_main.
+// Checks the proof of stake of a compact block, with the prefilled coinstake and
+// the block signature, and accepts its header (checking the proof of work and the
+// difficulty), before the block is reconstructed. The parent must be known.
+static bool AcceptCompactBlockHeader(const CBlockHeaderAndShortTxIDs& cmpctblock, CValidationState& state)
+{
+    const CBlock block = cmpctblock.GetHeaderBlock();
+    const CBlockIndex* pindexPrev = mapBlockIndex.at(block.hashPrevBlock);
+    if (Params().GetConsensus().NetworkUpgradeActive(pindexPrev->nHeight + 1, Consensus::UPGRADE_POS)) {
+        std::string strError;
+        if (!block.IsProofOfStake())
+            return state.DoS(100, error("%s: coinstake not prefilled", __func__), REJECT_INVALID, "bad-cs-missing");
+        if (!CheckProofOfStake(block, strError, pindexPrev))
+            return state.DoS(100, error("%s: proof of stake check failed (%s)", __func__, strError));
+        if (!CheckBlockSignature(block))
+            return state.DoS(100, error("%s: bad block signature", __func__), REJECT_INVALID, "bad-blk-sig");
+    }
+    return ProcessNewBlockHeaders({cmpctblock.header}, state);
+}
+
+// Requires cs_main.
+void MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid, CConnman* connman)
+{
+    CNodeState* nodestate = State(nodeid);
+    if (!nodestate || !nodestate->fProvidesHeaderAndIDs) {
+        // Never ask from peers who can't provide compact blocks.
+        return;
+    }
+    for (std::list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
+        if (*it == nodeid) {
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+            return;
+        }
+    }
+    connman->ForNode(nodeid, [connman](CNode* pfrom) {
+        uint64_t nCMPCTBLOCKVersion = CMPCTBLOCKS_VERSION;
+        if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_CMPCT_HB_PEERS) {
+            // Only a few of our peers are asked to push new blocks to us
+            // using compact encodings: the oldest one goes back to invs.
+            connman->ForNode(lNodesAnnouncingHeaderAndIDs.front(), [connman, nCMPCTBLOCKVersion](CNode* pnodeStop) {
+                connman->PushMessage(pnodeStop, CNetMsgMaker(pnodeStop->GetSendVersion()).Make(NetMsgType::SENDCMPCT, false, nCMPCTBLOCKVersion));
+                return true;
+            });
+            lNodesAnnouncingHeaderAndIDs.pop_front();
+        }
+        connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::SENDCMPCT, true, nCMPCTBLOCKVersion));
+        lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+        return true;
+    });
 }
 
 /** Check whether the last unknown block a peer advertised is not yet known. */
@@ -400,9 +497,13 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
                 // We consider the chain that this peer is on invalid.
                 return;
             }
-            if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            if (pindex->nStatus & BLOCK_HAVE_DATA || chainActive.Contains(pindex)) {
+                // Blocks of the active chain may have been pruned, don't download them again.
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
+            } else if (setBlocksAwaitingParent.count(pindex->GetBlockHash())) {
+                // Already downloaded, waiting for its parent.
+                continue;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
                 // The block is not already downloaded, and not yet in flight.
                 if (pindex->nHeight > nWindowEnd) {
@@ -454,6 +555,7 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
 
     for (const QueuedBlock& entry : state->vBlocksInFlight)
         mapBlocksInFlight.erase(entry.hash);
+    EraseBlocksAwaitingParentFor(nodeid);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
 
@@ -628,6 +730,8 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn) :
 
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex)
 {
+    WITH_LOCK(cs_most_recent_block, most_recent_block = pblock;);
+
     LOCK(g_cs_orphans);
 
     std::vector<uint256> vOrphanErase;
@@ -664,11 +768,32 @@ void PeerLogicValidation::UpdatedBlockTip(const CBlockIndex* pindexNew, const CB
 
     if (!fInitialDownload) {
         const uint256& hashNewTip = pindexNew->GetBlockHash();
+        // Peers in high-bandwidth compact block mode get the new tip pushed straight
+        // away as a cmpctblock, saving the inv/getdata round-trip. The compact block
+        // is built (once) from the last connected block, only if at least one of
+        // them is connected.
+        std::shared_ptr<const CBlock> pblock = WITH_LOCK(cs_most_recent_block, return most_recent_block;);
+        if (pblock && pblock->GetHash() != hashNewTip) pblock.reset();
+        std::unique_ptr<CBlockHeaderAndShortTxIDs> pcmpctblock;
+        LOCK(cs_main);
         // Relay inventory, but don't relay old inventory during initial block download.
-        connman->ForEachNode([nNewHeight, hashNewTip](CNode* pnode) {
-            if (nNewHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : 0)) {
-                pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+        connman->ForEachNode([this, nNewHeight, &hashNewTip, &pblock, &pcmpctblock](CNode* pnode) {
+            if (nNewHeight <= (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : 0)) {
+                return;
             }
+            CNodeState* state = State(pnode->GetId());
+            if (state && state->fPreferHeaderAndIDs) {
+                if (!pcmpctblock && pblock) {
+                    pcmpctblock.reset(new CBlockHeaderAndShortTxIDs(*pblock));
+                }
+                if (pcmpctblock) {
+                    LogPrint(BCLog::NET, "sending cmpctblock %s to peer=%d\n", hashNewTip.ToString(), pnode->GetId());
+                    pnode->AddInventoryKnown(CInv(MSG_BLOCK, hashNewTip));
+                    connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+                    return;
+                }
+            }
+            pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
         });
     }
 
@@ -692,6 +817,13 @@ void PeerLogicValidation::BlockChecked(const CBlock& block, const CValidationSta
                 Misbehaving(it->second, nDoS);
             }
         }
+    } else if (state.IsValid() && !IsInitialBlockDownload() &&
+               mapBlocksInFlight.count(hash) == mapBlocksInFlight.size()) {
+        // The peer that gave us a new valid block is likely to be fast at
+        // relaying the next ones: ask it to push them as compact blocks.
+        if (it != mapBlockSource.end()) {
+            MaybeSetPeerAsAnnouncingHeaderAndIDs(it->second, connman);
+        }
     }
 
     if (it != mapBlockSource.end())
@@ -703,6 +835,7 @@ void PeerLogicValidation::BlockChecked(const CBlock& block, const CValidationSta
 // Messages
 //
 
+/** Whether the (non tier two) inventory is already known */
 bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     switch (inv.type) {
@@ -736,6 +869,28 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     case MSG_TXLOCK_VOTE:
         // deprecated
         return true;
+    }
+    // Don't know what it is, just say we already got one
+    return true;
+}
+
+// Only return true if the inv type can be answered, not supported types return false.
+bool static IsTierTwoInventoryTypeKnown(int type)
+{
+    return type == MSG_SPORK ||
+           type == MSG_MASTERNODE_WINNER ||
+           type == MSG_BUDGET_VOTE ||
+           type == MSG_BUDGET_PROPOSAL ||
+           type == MSG_BUDGET_FINALIZED ||
+           type == MSG_BUDGET_FINALIZED_VOTE ||
+           type == MSG_MASTERNODE_ANNOUNCE ||
+           type == MSG_MASTERNODE_PING;
+}
+
+/** Whether the tier two inventory is already known (see FindKnownTierTwoInventory) */
+bool static AlreadyHaveTierTwo(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(g_cs_tiertwo_msgproc)
+{
+    switch (inv.type) {
     case MSG_SPORK:
         return mapSporks.count(inv.hash);
     case MSG_MASTERNODE_WINNER:
@@ -777,8 +932,25 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     case MSG_MASTERNODE_PING:
         return mnodeman.mapSeenMasternodePing.count(inv.hash);
     }
-    // Don't know what it is, just say we already got one
-    return true;
+    return false;
+}
+
+/** The tier two inventory of vInv that is already known. The tier two maps are only
+ *  accessed under g_cs_tiertwo_msgproc, so this is called before locking cs_main. */
+static std::set<CInv> FindKnownTierTwoInventory(const std::vector<CInv>& vInv) LOCKS_EXCLUDED(cs_main)
+{
+    AssertLockNotHeld(cs_main);
+    std::set<CInv> setKnown;
+    if (std::none_of(vInv.begin(), vInv.end(), [](const CInv& inv) { return IsTierTwoInventoryTypeKnown(inv.type); })) {
+        return setKnown;
+    }
+    LOCK(g_cs_tiertwo_msgproc);
+    for (const CInv& inv : vInv) {
+        if (IsTierTwoInventoryTypeKnown(inv.type) && AlreadyHaveTierTwo(inv)) {
+            setKnown.insert(inv);
+        }
+    }
+    return setKnown;
 }
 
 static void RelayTransaction(const CTransaction& tx, CConnman* connman)
@@ -820,7 +992,7 @@ static void RelayAddress(const CAddress& addr, bool fReachable, CConnman* connma
 bool static PushTierTwoGetDataRequest(const CInv& inv,
                                       CNode* pfrom,
                                       CConnman* connman,
-                                      CNetMsgMaker& msgMaker)
+                                      CNetMsgMaker& msgMaker) EXCLUSIVE_LOCKS_REQUIRED(g_cs_tiertwo_msgproc)
 {
     if (inv.type == MSG_SPORK) {
         if (mapSporks.count(inv.hash)) {
@@ -897,6 +1069,18 @@ bool static PushTierTwoGetDataRequest(const CInv& inv,
     return false;
 }
 
+/** Whether the data of a block (or derived from it) can be served to the peers */
+static bool BlockRequestAllowed(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    if (chainActive.Contains(pindex)) return true;
+    // To prevent fingerprinting attacks, only send blocks outside of the active
+    // chain if they are valid, and no more than a max reorg depth than the best header
+    // chain we know about.
+    return pindex->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+           (chainActive.Height() - pindex->nHeight < gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH));
+}
+
 void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     LOCK(cs_main);
@@ -905,17 +1089,9 @@ void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman* connman
     bool send = false;
     BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
     if (mi != mapBlockIndex.end()) {
-        if (chainActive.Contains(mi->second)) {
-            send = true;
-        } else {
-            // To prevent fingerprinting attacks, only send blocks outside of the active
-            // chain if they are valid, and no more than a max reorg depth than the best header
-            // chain we know about.
-            send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                   (chainActive.Height() - mi->second->nHeight < gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH));
-            if (!send) {
-                LogPrint(BCLog::NET, "ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
-            }
+        send = BlockRequestAllowed(mi->second);
+        if (!send) {
+            LogPrint(BCLog::NET, "ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
         }
     }
     // Don't send not-validated blocks
@@ -926,6 +1102,14 @@ void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman* connman
             assert(!"cannot load block from disk");
         if (inv.type == MSG_BLOCK)
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
+        else if (inv.type == MSG_CMPCT_BLOCK) {
+            // Older blocks are unlikely to be reconstructed from the peer's
+            // mempool: send them in full.
+            if (mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH)
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(block)));
+            else
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
+        }
         else // MSG_FILTERED_BLOCK)
         {
             bool send_ = false;
@@ -965,19 +1149,6 @@ void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman* connman
     }
 }
 
-// Only return true if the inv type can be answered, not supported types return false.
-bool static IsTierTwoInventoryTypeKnown(int type)
-{
-    return type == MSG_SPORK ||
-           type == MSG_MASTERNODE_WINNER ||
-           type == MSG_BUDGET_VOTE ||
-           type == MSG_BUDGET_PROPOSAL ||
-           type == MSG_BUDGET_FINALIZED ||
-           type == MSG_BUDGET_FINALIZED_VOTE ||
-           type == MSG_MASTERNODE_ANNOUNCE ||
-           type == MSG_MASTERNODE_PING;
-}
-
 void static ProcessGetData(CNode* pfrom, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     AssertLockNotHeld(cs_main);
@@ -985,49 +1156,46 @@ void static ProcessGetData(CNode* pfrom, CConnman* connman, const std::atomic<bo
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     std::vector<CInv> vNotFound;
     CNetMsgMaker msgMaker(pfrom->GetSendVersion());
-    {
-        LOCK(cs_main);
-
-        while (it != pfrom->vRecvGetData.end() && (it->type == MSG_TX || IsTierTwoInventoryTypeKnown(it->type))) {
-            if (interruptMsgProc)
-                return;
-            // Don't bother if send buffer is too full to respond anyway
-            if (pfrom->fPauseSend)
-                break;
 
-            const CInv &inv = *it;
-            it++;
-
-            // Send stream from relay memory
-            bool pushed = false;
-            if (inv.type == MSG_TX) {
-                auto txinfo = mempool.info(inv.hash);
-                if (txinfo.tx) { // future: add timeLastMempoolReq check
-                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                    ss.reserve(1000);
-                    ss << *txinfo.tx;
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::TX, ss));
-                    pushed = true;
-                }
-            }
+    while (it != pfrom->vRecvGetData.end() && (it->type == MSG_TX || IsTierTwoInventoryTypeKnown(it->type))) {
+        if (interruptMsgProc)
+            return;
+        // Don't bother if send buffer is too full to respond anyway
+        if (pfrom->fPauseSend)
+            break;
 
-            if (!pushed) {
-                // Now check if it's a tier two data request and push it.
-                pushed = PushTierTwoGetDataRequest(inv, pfrom, connman, msgMaker);
-            }
+        const CInv &inv = *it;
+        it++;
 
-            if (!pushed) {
-                vNotFound.push_back(inv);
+        // Send stream from relay memory
+        bool pushed = false;
+        if (inv.type == MSG_TX) {
+            auto txinfo = mempool.info(inv.hash);
+            if (txinfo.tx) { // future: add timeLastMempoolReq check
+                CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                ss.reserve(1000);
+                ss << *txinfo.tx;
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::TX, ss));
+                pushed = true;
             }
+        } else {
+            // Now check if it's a tier two data request and push it.
+            // The tier two maps are shared with the handlers of the other threads.
+            LOCK(g_cs_tiertwo_msgproc);
+            pushed = PushTierTwoGetDataRequest(inv, pfrom, connman, msgMaker);
+        }
 
-            // todo: inventory signal
+        if (!pushed) {
+            vNotFound.push_back(inv);
         }
-    } // release cs_main
+
+        // todo: inventory signal
+    }
 
     if (it != pfrom->vRecvGetData.end()) {
         const CInv &inv = *it;
         it++;
-        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
             ProcessGetBlockData(pfrom, inv, connman, interruptMsgProc);
         }
     }
@@ -1080,7 +1248,347 @@ static void CheckBlockSpam(CValidationState& state, CNode* pfrom, const uint256&
     }
 }
 
-bool fRequestedSporksIDB = false;
+/** Keep a block whose parent is known only by its header (its body is still
+ *  being downloaded). Only the blocks requested from the peer sending them are
+ *  kept, the others are dropped. Returns false if the block can be processed
+ *  right away. */
+static bool BufferBlockAwaitingParent(const std::shared_ptr<const CBlock>& pblock, NodeId nodeid, bool fRequested) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    BlockMap::iterator miPrev = mapBlockIndex.find(pblock->hashPrevBlock);
+    if (miPrev == mapBlockIndex.end() || miPrev->second->nTx != 0 || (miPrev->second->nStatus & BLOCK_FAILED_MASK))
+        return false;
+
+    const uint256& hashBlock = pblock->GetHash();
+    if (setBlocksAwaitingParent.count(hashBlock))
+        return true;
+    if (!fRequested) {
+        LogPrint(BCLog::NET, "%s : unrequested block %s, dropping it peer=%d\n", __func__, hashBlock.ToString(), nodeid);
+        return true;
+    }
+    CNodeState* nodestate = State(nodeid);
+    const size_t nSize = GetSerializeSize(*pblock, PROTOCOL_VERSION);
+    if (nBlocksAwaitingParentSize + nSize > MAX_BLOCKS_AWAITING_PARENT_SIZE ||
+            nodestate->nBlocksAwaitingParentSize + nSize > MAX_BLOCKS_AWAITING_PARENT_SIZE_PER_PEER) {
+        // Drop it: it is requested again once the download window moves.
+        LogPrint(BCLog::NET, "%s : buffer full, dropping block %s peer=%d\n", __func__, hashBlock.ToString(), nodeid);
+        return true;
+    }
+    mapBlocksAwaitingParent.emplace(pblock->hashPrevBlock, BlockAwaitingParent{pblock, nodeid, nSize});
+    setBlocksAwaitingParent.insert(hashBlock);
+    nBlocksAwaitingParentSize += nSize;
+    nodestate->nBlocksAwaitingParentSize += nSize;
+    LogPrint(BCLog::NET, "%s : block %s waiting for its parent peer=%d\n", __func__, hashBlock.ToString(), nodeid);
+    return true;
+}
+
+/** Process the blocks that were waiting for hashParent to be accepted, and
+ *  then, recursively, the blocks waiting for them. */
+static void ProcessBlocksAwaitingParent(const uint256& hashParent)
+{
+    std::deque<uint256> vParents = {hashParent};
+    while (!vParents.empty()) {
+        std::vector<BlockAwaitingParent> vChildren;
+        {
+            LOCK(cs_main);
+            auto range = mapBlocksAwaitingParent.equal_range(vParents.front());
+            // If the parent was not accepted, the children are requested again later.
+            BlockMap::iterator mi = mapBlockIndex.find(vParents.front());
+            const bool fParentAccepted = mi != mapBlockIndex.end() && mi->second->nTx != 0;
+            for (auto it = range.first; it != range.second; ++it) {
+                const uint256& hashBlock = it->second.pblock->GetHash();
+                setBlocksAwaitingParent.erase(hashBlock);
+                nBlocksAwaitingParentSize -= it->second.nSize;
+                CNodeState* nodestate = State(it->second.nodeid);
+                if (nodestate) nodestate->nBlocksAwaitingParentSize -= it->second.nSize;
+                if (fParentAccepted) {
+                    mapBlockSource.emplace(hashBlock, it->second.nodeid);
+                    vChildren.push_back(it->second);
+                }
+            }
+            mapBlocksAwaitingParent.erase(range.first, range.second);
+        }
+        vParents.pop_front();
+
+        for (const BlockAwaitingParent& child : vChildren) {
+            CValidationState state;
+            ProcessNewBlock(state, child.pblock, nullptr);
+            int nDoS;
+            if (state.IsInvalid(nDoS) && nDoS > 0) {
+                LOCK(cs_main);
+                Misbehaving(child.nodeid, nDoS);
+            }
+            vParents.push_back(child.pblock->GetHash());
+        }
+    }
+}
+
+/** Drop the blocks waiting for their parent downloaded from a peer (disconnected):
+ *  they are requested again from another peer. */
+static void EraseBlocksAwaitingParentFor(NodeId nodeid)
+{
+    for (auto it = mapBlocksAwaitingParent.begin(); it != mapBlocksAwaitingParent.end(); ) {
+        if (it->second.nodeid == nodeid) {
+            setBlocksAwaitingParent.erase(it->second.pblock->GetHash());
+            nBlocksAwaitingParentSize -= it->second.nSize;
+            it = mapBlocksAwaitingParent.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/** Process a block received from a peer (as a full block, or reconstructed
+ *  from a compact block), whose parent we already know. */
+static void ProcessBlockFromPeer(CNode* pfrom, CConnman* connman, CNetMsgMaker& msgMaker,
+                                 const std::shared_ptr<const CBlock>& pblock, const std::string& strCommand)
+{
+    const uint256& hashBlock = pblock->GetHash();
+    CInv inv(MSG_BLOCK, hashBlock);
+    pfrom->AddInventoryKnown(inv);
+    CValidationState state;
+    bool fNewBlock;
+    bool fRequested;
+    {
+        LOCK(cs_main);
+        auto itInFlight = mapBlocksInFlight.find(hashBlock);
+        fRequested = itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId();
+        MarkBlockAsReceived(hashBlock);
+        // The header may be known already (headers-first sync): the block is
+        // new as long as it has never been processed (or it was pruned, and
+        // requested again).
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        fNewBlock = mi == mapBlockIndex.end() ||
+                    ((mi->second->nTx == 0 || fRequested) && !(mi->second->nStatus & (BLOCK_HAVE_DATA | BLOCK_FAILED_MASK)));
+        if (fNewBlock && BufferBlockAwaitingParent(pblock, pfrom->GetId(), fRequested))
+            return;
+        if (fNewBlock) mapBlockSource.emplace(hashBlock, pfrom->GetId());
+    }
+    if (fNewBlock) {
+        bool fAccepted = true;
+        ProcessNewBlock(state, pblock, nullptr, &fAccepted, fRequested);
+        if (!fAccepted) {
+            CheckBlockSpam(state, pfrom, hashBlock);
+        }
+        int nDoS;
+        if(state.IsInvalid(nDoS)) {
+            assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand, state.GetRejectCode(),
+                state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
+            if(nDoS > 0) {
+                TRY_LOCK(cs_main, lockMain);
+                if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
+            }
+        }
+        ProcessBlocksAwaitingParent(hashBlock);
+        //disconnect this node if its old protocol version
+        pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol(), strCommand);
+    } else {
+        LogPrint(BCLog::NET, "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, hashBlock.GetHex());
+    }
+}
+
+/**
+ * Validation logic for compact filters request handling.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   filter_type     The filter type the request is for. Must be basic filters.
+ * @param[in]   start_height    The start height for the request
+ * @param[in]   stop_hash       The stop_hash for the request
+ * @param[in]   max_height_diff The maximum number of items permitted to request, as specified in BIP 157
+ * @param[out]  stop_index      The CBlockIndex for the stop_hash block, if the request can be serviced.
+ * @return                      True if the request can be serviced.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, BlockFilterType filter_type, uint32_t start_height,
+                                      const uint256& stop_hash, uint32_t max_height_diff,
+                                      const CBlockIndex*& stop_index)
+{
+    const bool supported_filter_type =
+        (filter_type == BlockFilterType::BASIC &&
+         (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS));
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(stop_hash);
+        stop_index = it != mapBlockIndex.end() ? it->second : nullptr;
+
+        // Check that the stop block exists and the peer would be allowed to fetch it.
+        if (!stop_index || !BlockRequestAllowed(stop_index)) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with " /* Continued */
+                 "start height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1, max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    if (!g_block_filter_index) {
+        LogPrint(BCLog::NET, "Filter index for supported type %s not found\n", BlockFilterTypeName(filter_type));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handle a cfilters request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFilters(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index)) {
+        return;
+    }
+
+    std::vector<BlockFilter> filters;
+    if (!g_block_filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET, "Failed to find block filter in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    for (const auto& filter : filters) {
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER, filter));
+    }
+}
+
+/**
+ * Handle a cfheaders request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFHeaders(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex* const prev_block =
+            stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!g_block_filter_index->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!g_block_filter_index->LookupFilterHashRange(start_height, stop_index, filter_hashes)) {
+        LogPrint(BCLog::NET, "Failed to find block filter hashes in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFHEADERS,
+                                              filter_type_ser,
+                                              stop_index->GetBlockHash(),
+                                              prev_header,
+                                              filter_hashes));
+}
+
+/**
+ * Handle a getcfcheckpt request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFCheckPt(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, /*start_height=*/0, stop_hash,
+                                   /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+                                   stop_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex* block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!g_block_filter_index->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), block_index->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFCHECKPT,
+                                              filter_type_ser,
+                                              stop_index->GetBlockHash(),
+                                              headers));
+}
+
+// Shared by the message handler threads: set once the sporks were requested from a peer
+std::atomic<bool> fRequestedSporksIDB{false};
 bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived, CConnman* connman, std::atomic<bool>& interruptMsgProc)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
@@ -1276,6 +1784,28 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         LogPrintf("New outbound peer connected: version: %d, blocks=%d, peer=%d%s\n",
                   pfrom->nVersion.load(), pfrom->nStartingHeight, pfrom->GetId(),
                   (fLogIPs ? strprintf(", peeraddr=%s", pfrom->addr.ToString()) : ""));
+
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // Tell our peer we are willing to provide compact blocks, but don't
+            // ask for them to be pushed to us (yet): new blocks are still
+            // announced with an inv, and we request them as cmpctblocks.
+            bool fAnnounceUsingCMPCTBLOCK = false;
+            uint64_t nCMPCTBLOCKVersion = CMPCTBLOCKS_VERSION;
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion));
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::SENDCMPCT) {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION) {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            nodestate->fProvidesHeaderAndIDs = true;
+            nodestate->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
     }
 
 
@@ -1332,9 +1862,17 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             return error("peer=%d message inv size() = %u", pfrom->GetId(), vInv.size());
         }
 
+        const std::set<CInv> setKnownTierTwo = FindKnownTierTwoInventory(vInv);
         LOCK(cs_main);
 
         std::vector<CInv> vToFetch;
+        // Out of initial block download, new blocks are (most likely) made of
+        // transactions we already have in the mempool: ask for a compact block.
+        const bool fFetchCompact = !IsInitialBlockDownload() && State(pfrom->GetId())->fProvidesHeaderAndIDs;
+        // During initial block download, block announcements of peers that
+        // serve headers only extend the header chain.
+        const bool fHeadersFirst = IsInitialBlockDownload() && pfrom->nVersion >= HEADERS_FIRST_VERSION;
+        uint256 hashHeadersStop;
 
         for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
             const CInv& inv = vInv[nInv];
@@ -1350,7 +1888,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
             pfrom->AddInventoryKnown(inv);
 
-            bool fAlreadyHave = AlreadyHave(inv);
+            bool fAlreadyHave = IsTierTwoInventoryTypeKnown(inv.type) ? setKnownTierTwo.count(inv) > 0 : AlreadyHave(inv);
             LogPrint(BCLog::NET, "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom->id);
 
             if (!fAlreadyHave && !fImporting && !fReindex && inv.type != MSG_BLOCK)
@@ -1359,15 +1897,26 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
-                if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
+                if (!fAlreadyHave && !fImporting && !fReindex && fHeadersFirst) {
+                    hashHeadersStop = inv.hash;
+                } else if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
                     // Add this to the list of blocks to request
-                    vToFetch.push_back(inv);
+                    vToFetch.emplace_back(fFetchCompact ? MSG_CMPCT_BLOCK : MSG_BLOCK, inv.hash);
+                    // Only solicited compact blocks are processed
+                    if (fFetchCompact)
+                        MarkBlockAsInFlight(pfrom->GetId(), inv.hash);
                     LogPrint(BCLog::NET, "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
                 }
             }
 
         }
 
+        if (!hashHeadersStop.IsNull()) {
+            // Get the headers leading to the announced block: the block itself
+            // is then downloaded with the others, from any peer.
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), hashHeadersStop));
+            LogPrint(BCLog::NET, "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, hashHeadersStop.ToString(), pfrom->id);
+        }
         if (!vToFetch.empty())
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vToFetch));
     }
@@ -1393,7 +1942,9 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == NetMsgType::GETBLOCKS || strCommand == NetMsgType::GETHEADERS) {
+    // Older peers send getheaders expecting block invs, as for getblocks
+    else if (strCommand == NetMsgType::GETBLOCKS ||
+             (strCommand == NetMsgType::GETHEADERS && pfrom->nVersion < HEADERS_FIRST_VERSION)) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -1431,13 +1982,13 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == NetMsgType::HEADERS && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == NetMsgType::GETHEADERS) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
         if (locator.vHave.size() > MAX_LOCATOR_SZ) {
-            LogPrint(BCLog::NET, "getblocks locator size %lld > %d, disconnect peer=%d\n", locator.vHave.size(), MAX_LOCATOR_SZ, pfrom->GetId());
+            LogPrint(BCLog::NET, "getheaders locator size %lld > %d, disconnect peer=%d\n", locator.vHave.size(), MAX_LOCATOR_SZ, pfrom->GetId());
             pfrom->fDisconnect = true;
             return true;
         }
@@ -1464,7 +2015,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
         std::vector<CBlock> vHeaders;
         int nLimit = MAX_HEADERS_RESULTS;
-        LogPrintf("getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
+        LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
         for (; pindex; pindex = chainActive.Next(pindex)) {
             vHeaders.push_back(pindex->GetBlockHeader());
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
@@ -1483,11 +2034,16 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
+        // Verify the shielded proofs and the scripts before locking cs_main
+        // (not for the transactions already known or recently rejected)
+        CValidationState state;
+        const bool fAlreadyHave = WITH_LOCK(cs_main, return AlreadyHave(inv););
+        const bool fPreVerified = fAlreadyHave || PreVerifyMempoolTx(mempool, state, ptx);
+
         LOCK2(cs_main, g_cs_orphans);
 
         bool ignoreFees = false;
         bool fMissingInputs = false;
-        CValidationState state;
 
         pfrom->setAskFor.erase(inv.hash);
         mapAlreadyAskedFor.erase(inv);
@@ -1498,7 +2054,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             LogPrint(BCLog::NET, "   misbehaving peer, received a zc transaction, peer: %s\n", pfrom->GetAddrName());
         }
 
-        if (AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, false, ignoreFees)) {
+        if (fPreVerified && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, false, ignoreFees)) {
             mempool.check(pcoinsTip);
             RelayTransaction(tx, connman);
             for (unsigned int i = 0; i < tx.vout.size(); i++) {
@@ -1627,7 +2183,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         }
     }
 
-    else if (strCommand == NetMsgType::HEADERS && Params().HeadersFirstSyncingActive() && !fImporting && !fReindex) // Ignore headers received while importing
+    else if (strCommand == NetMsgType::HEADERS && !fImporting && !fReindex) // Ignore headers received while importing
     {
         std::vector<CBlockHeader> headers;
 
@@ -1644,42 +2200,56 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        LOCK(cs_main);
-
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
-        CBlockIndex* pindexLast = NULL;
-        for (const CBlockHeader& header : headers) {
-            CValidationState state;
-            if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
+        {
+            LOCK(cs_main);
+            if (!mapBlockIndex.count(headers[0].hashPrevBlock)) {
+                // The headers don't connect to our tree: ask for the ones in between.
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), UINT256_ZERO));
+                return true;
+            }
+        }
+        for (unsigned int n = 1; n < nCount; n++) {
+            if (headers[n].hashPrevBlock != headers[n - 1].GetHash()) {
+                LOCK(cs_main);
                 Misbehaving(pfrom->GetId(), 20);
                 return error("non-continuous headers sequence");
             }
+        }
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
-            if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
-                int nDoS;
-                if (state.IsInvalid(nDoS)) {
-                    if (nDoS > 0)
-                        Misbehaving(pfrom->GetId(), nDoS);
-                    std::string strError = "invalid header received " + header.GetHash().ToString();
-                    return error(strError.c_str());
-                }
+        CValidationState state;
+        CBlockIndex* pindexLast = nullptr;
+        bool fValidHeaders;
+        {
+            LOCK(cs_main);
+            fValidHeaders = ProcessNewBlockHeaders(headers, state, &pindexLast, &State(pfrom->GetId())->vUnverifiedPoSHeaders);
+        }
+        if (!fValidHeaders) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                LOCK(cs_main);
+                if (nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                return error("invalid header received from peer=%d: %s", pfrom->GetId(), FormatStateMessage(state));
             }
         }
 
+        LOCK(cs_main);
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
+        if (!pindexLast || pindexLast->GetBlockHash() != headers.back().GetHash()) {
+            // Proof of stake headers too far ahead of the active chain were skipped:
+            // ask for them again once the blocks are connected (see SendMessages).
+            State(pfrom->GetId())->fHeadersPaused = true;
+        } else if (nCount == MAX_HEADERS_RESULTS) {
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
             // from there instead.
-            LogPrintf("more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
+            LogPrint(BCLog::NET, "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexLast), UINT256_ZERO));
         }
     }
@@ -1693,7 +2263,11 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         LogPrint(BCLog::NET, "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
 
         // sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
-        if (!mapBlockIndex.count(pblock->hashPrevBlock)) {
+        if (!mapBlockIndex.count(pblock->hashPrevBlock) && pfrom->nVersion >= HEADERS_FIRST_VERSION) {
+            // get the headers up to this block, the missing blocks are then downloaded from any peer
+            CBlockLocator locator = WITH_LOCK(cs_main, return chainActive.GetLocator(pindexBestHeader););
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, locator, hashBlock));
+        } else if (!mapBlockIndex.count(pblock->hashPrevBlock)) {
             CBlockLocator locator = WITH_LOCK(cs_main, return chainActive.GetLocator(););
             if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 // we already asked for this block, so lets work backwards and ask for the previous block
@@ -1705,35 +2279,193 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 pfrom->vBlockRequested.emplace_back(hashBlock);
             }
         } else {
-            pfrom->AddInventoryKnown(inv);
+            ProcessBlockFromPeer(pfrom, connman, msgMaker, pblock, strCommand);
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        const uint256& hashBlock = cmpctblock.header.GetHash();
+        LogPrint(BCLog::NET, "received cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->GetId());
+
+        const std::vector<CInv> vFullBlock = {CInv(MSG_BLOCK, hashBlock)};
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                // Nothing to do here
+                return true;
+            }
+            auto itInFlight = mapBlocksInFlight.find(hashBlock);
+            if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.second->partialBlock) {
+                // Already being reconstructed, from this or from another peer
+                return true;
+            }
+            // Only reconstruct the compact blocks we asked for, or that a peer we
+            // selected for high-bandwidth mode pushed to us.
+            const bool fRequested = itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId();
+            if (!fRequested && std::find(lNodesAnnouncingHeaderAndIDs.begin(), lNodesAnnouncingHeaderAndIDs.end(), pfrom->GetId()) == lNodesAnnouncingHeaderAndIDs.end()) {
+                LogPrint(BCLog::NET, "Peer %d sent us an unsolicited compact block %s\n", pfrom->GetId(), hashBlock.ToString());
+                return true;
+            }
+
+            if (!mapBlockIndex.count(cmpctblock.header.hashPrevBlock)) {
+                // We can't validate the block without its parent: get the full block,
+                // so that the missing ancestors are requested as for any other block.
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vFullBlock));
+                return true;
+            }
+
+            // Check the header before looking the transactions up in the mempool
             CValidationState state;
-            if (!mapBlockIndex.count(hashBlock)) {
-                {
-                    LOCK(cs_main);
+            if (!AcceptCompactBlockHeader(cmpctblock, state)) {
+                if (fRequested)
                     MarkBlockAsReceived(hashBlock);
-                    mapBlockSource.emplace(hashBlock, pfrom->GetId());
-                }
-                bool fAccepted = true;
-                ProcessNewBlock(state, pblock, nullptr, &fAccepted);
-                if (!fAccepted) {
-                    CheckBlockSpam(state, pfrom, hashBlock);
-                }
                 int nDoS;
-                if(state.IsInvalid(nDoS)) {
-                    assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand, state.GetRejectCode(),
-                        state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
-                    if(nDoS > 0) {
-                        TRY_LOCK(cs_main, lockMain);
-                        if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
+                if (state.IsInvalid(nDoS) && nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                return error("Peer %d sent us a compact block %s with an invalid header: %s", pfrom->GetId(),
+                             hashBlock.ToString(), FormatStateMessage(state));
+            }
+        }
+
+        // The mempool is scanned without holding cs_main
+        PartiallyDownloadedBlock partialBlock(&mempool);
+        ReadStatus status = partialBlock.InitData(cmpctblock);
+        if (status == READ_STATUS_INVALID) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
+            return error("Peer %d sent us invalid compact block", pfrom->GetId());
+        } else if (status == READ_STATUS_FAILED) {
+            // Duplicate txindexes, just request the full block
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vFullBlock));
+            return true;
+        }
+
+        BlockTransactionsRequest req;
+        for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+            if (!partialBlock.IsTxAvailable(i))
+                req.indexes.push_back(i);
+        }
+        if (!req.indexes.empty()) {
+            LOCK(cs_main);
+            auto itInFlight = mapBlocksInFlight.find(hashBlock);
+            if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.second->partialBlock) {
+                // Another peer got to reconstruct it meanwhile
+                return true;
+            }
+            // Keep the partial block until the missing transactions arrive
+            req.blockhash = hashBlock;
+            QueuedBlock* queuedBlock = MarkBlockAsInFlight(pfrom->GetId(), hashBlock);
+            queuedBlock->partialBlock.reset(new PartiallyDownloadedBlock(std::move(partialBlock)));
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
+            return true;
+        }
+
+        // Every transaction was prefilled or found in the mempool
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        status = partialBlock.FillBlock(*pblock, std::vector<CTransactionRef>());
+        if (status != READ_STATUS_OK) {
+            // Short id collision: fall back to the full block
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vFullBlock));
+            return true;
+        }
+        ProcessBlockFromPeer(pfrom, connman, msgMaker, pblock, strCommand);
+    }
+
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        {
+            LOCK(cs_main);
+            auto it = mapBlocksInFlight.find(resp.blockhash);
+            if (it == mapBlocksInFlight.end() || !it->second.second->partialBlock ||
+                    it->second.first != pfrom->GetId()) {
+                LogPrint(BCLog::NET, "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->GetId());
+                return true;
+            }
+
+            PartiallyDownloadedBlock& partialBlock = *it->second.second->partialBlock;
+            ReadStatus status = partialBlock.FillBlock(*pblock, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100);
+                return error("Peer %d sent us invalid compact block/non-matching block transactions", pfrom->GetId());
+            } else if (status == READ_STATUS_FAILED) {
+                // Might have collided, fall back to getdata now :(
+                MarkBlockAsReceived(resp.blockhash);
+                std::vector<CInv> invs;
+                invs.emplace_back(MSG_BLOCK, resp.blockhash);
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, invs));
+                return true;
+            }
+        } // Don't hold cs_main when we call into ProcessNewBlock
+        ProcessBlockFromPeer(pfrom, connman, msgMaker, pblock, strCommand);
+    }
+
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN) {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        {
+            LOCK(cs_main);
+            BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+            if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->GetId());
+                return true;
+            }
+
+            if (it->second->nHeight >= chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+                CBlock block;
+                if (!ReadBlockFromDisk(block, it->second))
+                    assert(!"cannot load block from disk");
+
+                BlockTransactions resp(req);
+                for (size_t i = 0; i < req.indexes.size(); i++) {
+                    if (req.indexes[i] >= block.vtx.size()) {
+                        Misbehaving(pfrom->GetId(), 100);
+                        return error("Peer %d sent us a getblocktxn with out-of-bounds tx indices", pfrom->GetId());
                     }
+                    resp.txn[i] = block.vtx[req.indexes[i]];
                 }
-                //disconnect this node if its old protocol version
-                pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol(), strCommand);
-            } else {
-                LogPrint(BCLog::NET, "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, pblock->GetHash().GetHex());
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCKTXN, resp));
+                return true;
             }
         }
+
+        // If an older block is requested (should never happen in practice,
+        // but can happen in tests) send a block response instead of a
+        // blocktxn response. Sending a full block response instead of a
+        // small blocktxn response is preferable in the case where a peer
+        // might maliciously send lots of getblocktxn requests to trigger
+        // expensive disk reads, because it will require the peer to
+        // actually receive all the data read from disk over the network.
+        LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->GetId(), MAX_BLOCKTXN_DEPTH);
+        pfrom->vRecvGetData.emplace_back(MSG_BLOCK, req.blockhash);
+        ProcessGetData(pfrom, connman, interruptMsgProc);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, connman);
     }
 
     // This asymmetric behavior for inbound and outbound connections was introduced
@@ -1931,6 +2663,8 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         }
 
         if (found) {
+            AssertLockNotHeld(cs_main);
+            LOCK(g_cs_tiertwo_msgproc);
             // Check if the dispatcher can process this message first. If not, try going with the old flow.
             if (!masternodeSync.MessageDispatcher(pfrom, strCommand, vRecv)) {
                 //probably one the extensions
@@ -1950,6 +2684,14 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 }
 
 
+void PeerLogicValidation::ReceivedMessage(CNode* pfrom, const CNetMessage& msg)
+{
+    const std::string strCommand = msg.hdr.GetCommand();
+    if (CTierTwoSigVerifyQueue::IsSignedMessage(strCommand)) {
+        tiertwoSigVerifyQueue.Add(strCommand, CDataStream(msg.vRecv.begin(), msg.vRecv.end(), SER_NETWORK, pfrom->GetRecvVersion()));
+    }
+}
+
 bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
 {
     // Message format
@@ -1975,6 +2717,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         return false;
 
     std::list<CNetMessage> msgs;
+    bool fResumeRecv = false;
     {
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty())
@@ -1982,9 +2725,12 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
+        fResumeRecv = pfrom->fPauseRecv && pfrom->nProcessQueueSize <= connman->GetReceiveFloodSize();
         pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
+    if (fResumeRecv)
+        connman->WakeSocketHandler();
     CNetMessage& msg(msgs.front());
 
     msg.SetVersion(pfrom->GetRecvVersion());
@@ -2020,6 +2766,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
 
     // Process message
     bool fRet = false;
+    const int64_t nTimeStart = GetTimeMicros();
     try {
         fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, connman, interruptMsgProc);
         if (interruptMsgProc)
@@ -2042,6 +2789,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     } catch (...) {
         PrintExceptionContinue(NULL, "ProcessMessages()");
     }
+    pfrom->AccountForProcessTime(strCommand, GetTimeMicros() - nTimeStart);
 
     if (!fRet)
         LogPrint(BCLog::NET, "ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
@@ -2105,6 +2853,14 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             }
         }
 
+        // The tier two inventory to request is looked up before cs_main
+        const int64_t nAskForTime = GetTimeMicros();
+        std::vector<CInv> vAskFor;
+        for (auto mi = pto->mapAskFor.begin(); mi != pto->mapAskFor.end() && mi->first <= nAskForTime; ++mi) {
+            vAskFor.push_back(mi->second);
+        }
+        const std::set<CInv> setKnownTierTwo = FindKnownTierTwoInventory(vAskFor);
+
         TRY_LOCK(cs_main, lockMain); // Acquire cs_main for IsInitialBlockDownload() and CNodeState()
         if (!lockMain)
             return true;
@@ -2171,13 +2927,27 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             if ((nSyncStarted == 0 && fFetch) || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                //pto->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO);
-                connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                if (pto->nVersion >= HEADERS_FIRST_VERSION) {
+                    // Headers-first: the block bodies are then downloaded from all the
+                    // peers that have them, within the block download window.
+                    // Start one block back, so that the answer is never empty and tells
+                    // us the peer has our best header.
+                    const CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO));
+                } else {
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                }
             }
         }
 
+        // Resume the headers sync paused by MAX_UNVERIFIED_POS_HEADERS
+        if (state.fHeadersPaused && pindexBestHeader->nHeight - chainActive.Height() < MAX_UNVERIFIED_POS_HEADERS / 2) {
+            state.fHeadersPaused = false;
+            LogPrint(BCLog::NET, "resume getheaders (%d) to peer=%d\n", pindexBestHeader->nHeight, pto->id);
+            connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), UINT256_ZERO));
+        }
+
         // Resend wallet transactions that haven't gotten in a block yet
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
@@ -2349,9 +3119,10 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         //
         // Message: getdata (non-blocks)
         //
-        while (!pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow) {
+        while (!pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nAskForTime) {
             const CInv& inv = (*pto->mapAskFor.begin()).second;
-            if (!AlreadyHave(inv)) {
+            const bool fAlreadyHave = IsTierTwoInventoryTypeKnown(inv.type) ? setKnownTierTwo.count(inv) > 0 : AlreadyHave(inv);
+            if (!fAlreadyHave) {
                 LogPrint(BCLog::NET, "Requesting %s peer=%d\n", inv.ToString(), pto->id);
                 vGetData.push_back(inv);
                 if (vGetData.size() >= 1000) {
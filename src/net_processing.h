@@ -31,11 +31,34 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum number of inventory items to send per transmission.
  *  Limits the impact of low-fee transaction floods. */
 static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** Version of the compact block encoding, negotiated with "sendcmpct". */
+static const uint64_t CMPCTBLOCKS_VERSION = 1;
+/** Maximum number of peers asked to push new blocks to us as compact blocks (high-bandwidth mode). */
+static const unsigned int MAX_CMPCT_HB_PEERS = 3;
+/** Maximum depth of blocks we're willing to serve as compact blocks to peers
+ *  when requested. For older blocks, a regular BLOCK response will be sent. */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum total size of the blocks downloaded ahead of their parent during
+ *  headers-first sync, waiting for the parent to be accepted. */
+static const size_t MAX_BLOCKS_AWAITING_PARENT_SIZE = 64 * 1024 * 1024;
+/** Maximum total size of the blocks waiting for their parent downloaded from a single peer. */
+static const size_t MAX_BLOCKS_AWAITING_PARENT_SIZE_PER_PEER = 16 * 1024 * 1024;
+/** Maximum depth of blocks we're willing to respond to GETBLOCKTXN requests for. */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Maximum number of compact filters that may be requested with one getcfilters. See BIP 157. */
+static const uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders. See BIP 157. */
+static const uint32_t MAX_GETCFHEADERS_SIZE = 2000;
 
 class PeerLogicValidation : public CValidationInterface, public NetEventsInterface {
 private:
     CConnman* connman;
 
+    /** The last connected block, to push the new tip to the high-bandwidth
+     *  compact block peers without reading it back from disk. */
+    Mutex cs_most_recent_block;
+    std::shared_ptr<const CBlock> most_recent_block GUARDED_BY(cs_most_recent_block);
+
 public:
     PeerLogicValidation(CConnman* connman);
     ~PeerLogicValidation() = default;
@@ -49,6 +72,8 @@ public:
     void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) override;
     /** Process protocol messages received from a given node */
     bool ProcessMessages(CNode* pfrom, std::atomic<bool>& interrupt) override;
+    /** Queue the signed tier two messages for the signature verification threads */
+    void ReceivedMessage(CNode* pfrom, const CNetMessage& msg) override;
     /**
     * Send queued protocol messages to be sent to a give node.
     *
@@ -47,6 +47,8 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     { "generate", 0, "nblocks" },
     { "generatetoaddress", 0, "nblocks" },
     { "getaddednodeinfo", 0, "dummy" },
+    { "getaddresshistory", 1, "options" },
+    { "getaddressutxos", 1, "options" },
     { "getbalance", 0, "minconf" },
     { "getbalance", 1, "include_watchonly" },
     { "getbalance", 2, "include_delegated" },
@@ -71,6 +73,8 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     { "gettransaction", 1, "include_watchonly" },
     { "gettxout", 1, "n" },
     { "gettxout", 2, "include_mempool" },
+    { "gettxoutsetinfo", 1, "hash_or_height" },
+    { "gettxoutsetinfo", 2, "use_index" },
     { "importaddress", 2, "rescan" },
     { "importaddress", 3, "p2sh" },
     { "importmulti", 0, "requests" },
@@ -7,12 +7,14 @@
 
 #include "clientversion.h"
 #include "httpserver.h"
+#include "index/addressindex.h"
 #include "init.h"
 #include "key_io.h"
 #include "sapling/key_io_sapling.h"
 #include "masternode-sync.h"
 #include "net.h"
 #include "netbase.h"
+#include "optional.h"
 #include "rpc/server.h"
 #include "spork.h"
 #include "timedata.h"
@@ -103,6 +105,9 @@ UniValue getinfo(const JSONRPCRequest& request)
                 case NODE_BLOOM_WITHOUT_MN:
                     services+= "BLOOM/";
                     break;
+                case NODE_COMPACT_FILTERS:
+                    services+= "COMPACT_FILTERS/";
+                    break;
                 default:
                     services+= "UNKNOWN/";
             }
@@ -760,6 +765,256 @@ UniValue echo(const JSONRPCRequest& request)
     return request.params;
 }
 
+/** Default number of entries returned by getaddressutxos and getaddresshistory */
+static const int DEFAULT_ADDRESSINDEX_RPC_COUNT = 1000;
+
+/** Hash of the script of an address, the key of its entries in the address index */
+static uint160 GetAddressIndexKey(const UniValue& param)
+{
+    bool isStaking = false;
+    CTxDestination dest = DecodeDestination(param.get_str(), isStaking);
+    if (!IsValidDestination(dest)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+    return GetAddressIndexScriptHash(GetScriptForDestination(dest));
+}
+
+static void EnsureAddressIndexReady()
+{
+    if (!g_address_index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled. Restart with -addressindex");
+    }
+    if (!g_address_index->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index is still being built");
+    }
+}
+
+/** Read the count pagination option */
+static size_t ParseCountOption(const UniValue& options)
+{
+    if (options.isNull()) {
+        return DEFAULT_ADDRESSINDEX_RPC_COUNT;
+    }
+    const UniValue& count = find_value(options.get_obj(), "count");
+    if (count.isNull()) {
+        return DEFAULT_ADDRESSINDEX_RPC_COUNT;
+    }
+    if (count.get_int() <= 0) throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count, must be positive");
+    return count.get_int();
+}
+
+/** Read the "after" pagination option: the last entry of the previous page (null if not set) */
+static const UniValue& GetAfterOption(const UniValue& options)
+{
+    if (options.isNull()) {
+        return NullUniValue;
+    }
+    const UniValue& after = find_value(options.get_obj(), "after");
+    if (!after.isNull() && !after.isObject()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid after, must be an entry of the previous page");
+    }
+    return after;
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getaddressutxos \"address\" ( options )\n"
+            "\nReturns the unspent outputs of an address (requires -addressindex).\n"
+            "The P2CS outputs are returned for both their staker and owner addresses.\n"
+
+            "\nArguments:\n"
+            "1. \"address\"      (string, required) The pivx address.\n"
+            "2. options        (json object, optional)\n"
+            "     {\n"
+            "       \"after\": {...}, (json object, optional) Return the outputs after this one: the last output of the previous page,\n"
+            "                         or just its {\"txid\": \"hash\", \"vout\": n}\n"
+            "       \"count\": n      (numeric, optional, default=" + std::to_string(DEFAULT_ADDRESSINDEX_RPC_COUNT) + ") Maximum number of outputs to return\n"
+            "     }\n"
+
+            "\nResult:\n"
+            "[                        (array of json objects, sorted by txid and vout)\n"
+            "  {\n"
+            "    \"txid\": \"hash\",        (string) The transaction id\n"
+            "    \"vout\": n,             (numeric) The output index\n"
+            "    \"scriptPubKey\": \"hex\", (string) The script of the output\n"
+            "    \"amount\": x.xxx,       (numeric) The amount in " + CURRENCY_UNIT + "\n"
+            "    \"satoshis\": n,         (numeric) The amount in satoshis\n"
+            "    \"height\": n            (numeric) The height of the block containing the transaction\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\"") +
+            HelpExampleCli("getaddressutxos", "\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\" '{\"after\": {\"txid\": \"mytxid\", \"vout\": 0}, \"count\": 100}'") +
+            HelpExampleRpc("getaddressutxos", "\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\""));
+
+    RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VOBJ});
+    const uint160 scriptHash = GetAddressIndexKey(request.params[0]);
+    const size_t nCount = ParseCountOption(request.params[1]);
+    const UniValue& after = GetAfterOption(request.params[1]);
+    Optional<COutPoint> afterOutpoint;
+    if (!after.isNull()) {
+        afterOutpoint = COutPoint(ParseHashO(after, "txid"), find_value(after.get_obj(), "vout").get_int());
+    }
+    EnsureAddressIndexReady();
+
+    std::vector<std::pair<AddressUnspentKey, AddressUnspentValue>> vEntries;
+    if (!g_address_index->GetUnspent(scriptHash, afterOutpoint ? afterOutpoint.get_ptr() : nullptr, nCount, vEntries)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read the address index");
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (const auto& entry : vEntries) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("txid", entry.first.outpoint.hash.GetHex());
+        obj.pushKV("vout", (int64_t)entry.first.outpoint.n);
+        obj.pushKV("scriptPubKey", HexStr(entry.second.scriptPubKey.begin(), entry.second.scriptPubKey.end()));
+        obj.pushKV("amount", ValueFromAmount(entry.second.nValue));
+        obj.pushKV("satoshis", entry.second.nValue);
+        obj.pushKV("height", entry.second.nHeight);
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+UniValue getaddresshistory(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getaddresshistory \"address\" ( options )\n"
+            "\nReturns the outputs paying to an address, and the inputs spending them, sorted by height (requires -addressindex).\n"
+            "The P2CS outputs are returned for both their staker and owner addresses.\n"
+
+            "\nArguments:\n"
+            "1. \"address\"      (string, required) The pivx address.\n"
+            "2. options        (json object, optional)\n"
+            "     {\n"
+            "       \"start\": n,  (numeric, optional, default=0) The first block height\n"
+            "       \"end\": n,    (numeric, optional, default=tip) The last block height\n"
+            "       \"after\": {...}, (json object, optional) Return the entries after this one: the last entry of the previous page,\n"
+            "                         or just its {\"type\": \"output\"|\"input\", \"txid\": \"hash\", \"index\": n, \"height\": n}\n"
+            "       \"count\": n      (numeric, optional, default=" + std::to_string(DEFAULT_ADDRESSINDEX_RPC_COUNT) + ") Maximum number of entries to return\n"
+            "     }\n"
+
+            "\nResult:\n"
+            "[                        (array of json objects)\n"
+            "  {\n"
+            "    \"type\": \"output\"|\"input\", (string) An output paying to the address, or an input spending one\n"
+            "    \"txid\": \"hash\",        (string) The transaction id\n"
+            "    \"index\": n,            (numeric) The index of the output (or input) in the transaction\n"
+            "    \"height\": n,           (numeric) The height of the block containing the transaction\n"
+            "    \"amount\": x.xxx,       (numeric) The amount of the output (spent) in " + CURRENCY_UNIT + "\n"
+            "    \"satoshis\": n,         (numeric) The amount in satoshis\n"
+            "    \"spent_txid\": \"hash\",  (string, outputs only) The transaction spending the output, if spent\n"
+            "    \"spent_index\": n,      (numeric, outputs only) The input spending the output\n"
+            "    \"spent_height\": n,     (numeric, outputs only) The height of the spending transaction\n"
+            "    \"prev_txid\": \"hash\",   (string, inputs only) The transaction of the output spent\n"
+            "    \"prev_vout\": n,        (numeric, inputs only) The index of the output spent\n"
+            "    \"prev_height\": n       (numeric, inputs only) The height of the output spent\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresshistory", "\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\"") +
+            HelpExampleCli("getaddresshistory", "\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\" '{\"start\": 100000, \"count\": 100}'") +
+            HelpExampleRpc("getaddresshistory", "\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\""));
+
+    RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VOBJ});
+    const uint160 scriptHash = GetAddressIndexKey(request.params[0]);
+    const size_t nCount = ParseCountOption(request.params[1]);
+    const UniValue& after = GetAfterOption(request.params[1]);
+    Optional<AddressHistoryKey> afterKey;
+    if (!after.isNull()) {
+        const std::string& type = find_value(after.get_obj(), "type").get_str();
+        if (type != "output" && type != "input") {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid after type, must be output or input");
+        }
+        afterKey = AddressHistoryKey(scriptHash, find_value(after.get_obj(), "height").get_int(), ParseHashO(after, "txid"),
+                                     find_value(after.get_obj(), "index").get_int(), type == "input");
+    }
+    int nStart = 0;
+    int nEnd = std::numeric_limits<int>::max();
+    if (!request.params[1].isNull()) {
+        const UniValue& start = find_value(request.params[1].get_obj(), "start");
+        if (!start.isNull()) nStart = std::max(start.get_int(), 0);
+        const UniValue& end = find_value(request.params[1].get_obj(), "end");
+        if (!end.isNull()) nEnd = end.get_int();
+    }
+    EnsureAddressIndexReady();
+
+    std::vector<std::pair<AddressHistoryKey, AddressHistoryValue>> vEntries;
+    if (nStart <= nEnd && !g_address_index->GetHistory(scriptHash, nStart, nEnd, afterKey ? afterKey.get_ptr() : nullptr, nCount, vEntries)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read the address index");
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (const auto& entry : vEntries) {
+        const AddressHistoryKey& key = entry.first;
+        const AddressHistoryValue& value = entry.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("type", key.fSpending ? "input" : "output");
+        obj.pushKV("txid", key.txid.GetHex());
+        obj.pushKV("index", (int64_t)key.nIndex);
+        obj.pushKV("height", key.nHeight);
+        obj.pushKV("amount", ValueFromAmount(value.nValue));
+        obj.pushKV("satoshis", value.nValue);
+        if (key.fSpending) {
+            obj.pushKV("prev_txid", value.linked.hash.GetHex());
+            obj.pushKV("prev_vout", (int64_t)value.linked.n);
+            obj.pushKV("prev_height", value.nLinkedHeight);
+        } else if (!value.linked.IsNull()) {
+            obj.pushKV("spent_txid", value.linked.hash.GetHex());
+            obj.pushKV("spent_index", (int64_t)value.linked.n);
+            obj.pushKV("spent_height", value.nLinkedHeight);
+        }
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressbalance \"address\"\n"
+            "\nReturns the balance of an address (requires -addressindex).\n"
+            "The P2CS outputs are counted for both their staker and owner addresses.\n"
+
+            "\nArguments:\n"
+            "1. \"address\"      (string, required) The pivx address.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": x.xxx,   (numeric) The amount of the unspent outputs in " + CURRENCY_UNIT + "\n"
+            "  \"received\": x.xxx,  (numeric) The amount of all the outputs in " + CURRENCY_UNIT + "\n"
+            "  \"txouts\": n,        (numeric) The number of outputs\n"
+            "  \"unspent\": n        (numeric) The number of unspent outputs\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\"") +
+            HelpExampleRpc("getaddressbalance", "\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\""));
+
+    const uint160 scriptHash = GetAddressIndexKey(request.params[0]);
+    EnsureAddressIndexReady();
+
+    AddressBalance balance;
+    if (!g_address_index->GetBalance(scriptHash, balance)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read the address index");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("balance", ValueFromAmount(balance.nBalance));
+    ret.pushKV("received", ValueFromAmount(balance.nReceived));
+    ret.pushKV("txouts", balance.nTxOuts);
+    ret.pushKV("unspent", balance.nUnspent);
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafe argNames
   //  --------------------- ------------------------  -----------------------  ------ --------
@@ -773,6 +1028,10 @@ static const CRPCCommand commands[] =
     { "util",               "validateaddress",        &validateaddress,        true,  {"pivxaddress"} }, /* uses wallet if enabled */
     { "util",               "verifymessage",          &verifymessage,          true,  {"pivxaddress","signature","message"} },
 
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      true,  {"address"} },
+    { "addressindex",       "getaddresshistory",      &getaddresshistory,      true,  {"address","options"} },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        true,  {"address","options"} },
+
     /* Not shown in help */
     { "hidden",             "echo",                   &echo,                   true,  {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}},
     { "hidden",             "echojson",               &echo,                   true,  {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}},
@@ -104,6 +104,10 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       \"addr\": n,             (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
             "    }\n"
+            "    \"proctime_per_msg\": {\n"
+            "       \"addr\": n,             (numeric) The total time spent processing the received messages, in microseconds, aggregated by message type\n"
+            "       ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -170,6 +174,13 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
         }
         obj.pushKV("bytesrecv_per_msg", recvPerMsgCmd);
 
+        UniValue procTimePerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdSize::value_type &i : stats.mapProcTimePerMsgCmd) {
+            if (i.second > 0)
+                procTimePerMsgCmd.pushKV(i.first, i.second);
+        }
+        obj.pushKV("proctime_per_msg", procTimePerMsgCmd);
+
         ret.push_back(obj);
     }
 
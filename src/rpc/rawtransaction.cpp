@@ -8,6 +8,7 @@
 #include "core_io.h"
 #include "evo/specialtx.h"
 #include "evo/providertx.h"
+#include "index/txindex.h"
 #include "init.h"
 #include "keystore.h"
 #include "key_io.h"
@@ -100,6 +101,7 @@ void TxToJSON(CWallet* const pwallet, const CTransaction& tx, const uint256 hash
     }
 
     if (!hashBlock.IsNull()) {
+        LOCK(cs_main);
         entry.pushKV("blockhash", hashBlock.GetHex());
         BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end() && (*mi).second) {
@@ -225,8 +227,6 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
             + HelpExampleCli("getrawtransaction", "\"mytxid\" true \"myblockhash\"")
         );
 
-    LOCK(cs_main);
-
     bool in_active_chain = true;
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
     CBlockIndex* blockindex = nullptr;
@@ -237,6 +237,7 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
     }
 
     if (!request.params[2].isNull()) {
+        LOCK(cs_main);
         uint256 blockhash = ParseHashV(request.params[2], "parameter 3");
         BlockMap::iterator it = mapBlockIndex.find(blockhash);
         if (it == mapBlockIndex.end()) {
@@ -246,19 +247,29 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
         in_active_chain = chainActive.Contains(blockindex);
     }
 
+    bool f_txindex_ready = false;
+    if (g_txindex && !blockindex) {
+        f_txindex_ready = g_txindex->BlockUntilSyncedToCurrentChain();
+    }
+
+    // GetTransaction reads the disk without holding cs_main
     CTransactionRef tx;
     uint256 hash_block;
     if (!GetTransaction(hash, tx, hash_block, true, blockindex)) {
         std::string errmsg;
         if (blockindex) {
-            if (!(blockindex->nStatus & BLOCK_HAVE_DATA)) {
+            if (!WITH_LOCK(cs_main, return blockindex->nStatus & BLOCK_HAVE_DATA)) {
                 throw JSONRPCError(RPC_MISC_ERROR, "Block not available");
             }
             errmsg = "No such transaction found in the provided block";
         } else {
-            errmsg = fTxIndex
-              ? "No such mempool or blockchain transaction"
-              : "No such mempool transaction. Use -txindex to enable blockchain transaction queries";
+            if (!g_txindex) {
+                errmsg = "No such mempool transaction. Use -txindex to enable blockchain transaction queries";
+            } else if (!f_txindex_ready) {
+                errmsg = "No such mempool transaction. Blockchain transactions are still in the process of being indexed";
+            } else {
+                errmsg = "No such mempool or blockchain transaction";
+            }
         }
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, errmsg + ". Use gettransaction for wallet transactions.");
     }
@@ -429,7 +440,6 @@ UniValue decoderawtransaction(const JSONRPCRequest& request)
             "\nExamples:\n" +
             HelpExampleCli("decoderawtransaction", "\"hexstring\"") + HelpExampleRpc("decoderawtransaction", "\"hexstring\""));
 
-    LOCK(cs_main);
     RPCTypeCheck(request.params, {UniValue::VSTR});
 
     CMutableTransaction mtx;
@@ -797,6 +807,11 @@ void TryATMP(const CMutableTransaction& mtx, bool fOverrideFees)
     std::promise<void> promise;
     bool fLimitFree = true;
 
+    // Verify the shielded proofs and the scripts before locking cs_main
+    const CTransactionRef tx = MakeTransactionRef(mtx);
+    CValidationState state;
+    const bool fPreVerified = PreVerifyMempoolTx(mempool, state, tx);
+
     { // cs_main scope
         LOCK(cs_main);
         CCoinsViewCache& view = *pcoinsTip;
@@ -807,9 +822,8 @@ void TryATMP(const CMutableTransaction& mtx, bool fOverrideFees)
         }
         bool fHaveMempool = mempool.exists(hashTx);
         if (!fHaveMempool && !fHaveChain) {
-            CValidationState state;
-            bool fMissingInputs;
-            if (!AcceptToMemoryPool(mempool, state, MakeTransactionRef(std::move(mtx)), fLimitFree, &fMissingInputs, false, !fOverrideFees)) {
+            bool fMissingInputs = false;
+            if (!fPreVerified || !AcceptToMemoryPool(mempool, state, tx, fLimitFree, &fMissingInputs, false, !fOverrideFees)) {
                 if (state.IsInvalid()) {
                     throw JSONRPCError(RPC_TRANSACTION_REJECTED, strprintf("%s: %s", state.GetRejectReason(), state.GetDebugMessage()));
                 } else {
@@ -23,7 +23,11 @@
 #include <boost/signals2/signal.hpp>
 #include <boost/thread.hpp>
 
+#include <atomic>
+#include <condition_variable>
 #include <memory> // for unique_ptr
+#include <mutex>
+#include <set>
 #include <univalue.h>
 #include <unordered_map>
 
@@ -418,11 +422,102 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+/**
+ * Read-only commands, which can run concurrently with each other within a batch.
+ * Any other call of a batch is executed alone, after the calls preceding it and
+ * before the ones following it, as in a sequential execution.
+ */
+static const std::set<std::string> setParallelBatchCommands = {
+    "decoderawtransaction",
+    "decodescript",
+    "echo",
+    "echojson",
+    "getaddressbalance",
+    "getaddresshistory",
+    "getaddressutxos",
+    "getbestblockhash",
+    "getbestsaplinganchor",
+    "getblock",
+    "getblockchaininfo",
+    "getblockcount",
+    "getblockfilter",
+    "getblockhash",
+    "getblockheader",
+    "getdifficulty",
+    "getmempoolinfo",
+    "getrawmempool",
+    "getrawtransaction",
+    "gettxout",
+    "validateaddress",
+    "verifymessage",
+};
+
+static bool IsParallelBatchCall(const UniValue& req)
 {
+    if (!req.isObject())
+        return false;
+    const UniValue& method = find_value(req.get_obj(), "method");
+    return method.isStr() && setParallelBatchCommands.count(method.get_str());
+}
+
+/** Calls [begin, end) of a batch being executed by several threads */
+struct BatchJob
+{
+    std::atomic<size_t> next;
+    const size_t end;
+    std::mutex cs;
+    std::condition_variable cond;
+    size_t nPending;
+
+    BatchJob(size_t begin, size_t _end) : next(begin), end(_end), nPending(_end - begin) {}
+};
+
+static void JSONRPCExecParallel(const UniValue& vReq, size_t begin, size_t end, std::vector<UniValue>& vReplies,
+                                const RPCTaskRunner& runner, int nMaxThreads)
+{
+    auto job = std::make_shared<BatchJob>(begin, end);
+    // vReq and vReplies are only accessed after claiming a call: the queued tasks
+    // starting after all the calls were claimed return without touching them.
+    auto work = [job, &vReq, &vReplies]() {
+        size_t i;
+        while ((i = job->next++) < job->end) {
+            vReplies[i] = JSONRPCExecOne(vReq[i]);
+            std::unique_lock<std::mutex> lock(job->cs);
+            if (--job->nPending == 0)
+                job->cond.notify_all();
+        }
+    };
+
+    // If the work queue is full, this thread executes the calls on its own
+    const size_t nTasks = std::min(end - begin, (size_t)nMaxThreads) - 1;
+    for (size_t i = 0; i < nTasks && runner(work); i++) {}
+    work();
+
+    std::unique_lock<std::mutex> lock(job->cs);
+    job->cond.wait(lock, [&job] { return job->nPending == 0; });
+}
+
+std::string JSONRPCExecBatch(const UniValue& vReq, const RPCTaskRunner& runner, int nMaxThreads)
+{
+    std::vector<UniValue> vReplies(vReq.size());
+    size_t begin = 0;
+    while (begin < vReq.size()) {
+        size_t end = begin;
+        while (end < vReq.size() && IsParallelBatchCall(vReq[end]))
+            end++;
+        if (end - begin > 1 && runner && nMaxThreads > 1) {
+            JSONRPCExecParallel(vReq, begin, end, vReplies, runner, nMaxThreads);
+        } else {
+            end = std::max(end, begin + 1);
+            for (size_t i = begin; i < end; i++)
+                vReplies[i] = JSONRPCExecOne(vReq[i]);
+        }
+        begin = end;
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    for (UniValue& reply : vReplies)
+        ret.push_back(std::move(reply));
 
     return ret.write() + "\n";
 }
@@ -200,7 +200,12 @@ extern std::string HelpExampleRpc(std::string methodname, std::string args);
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+/** Queues a task to be run by another RPC thread. Returns false if it can't be queued. */
+typedef std::function<bool(const std::function<void()>&)> RPCTaskRunner;
+/** Execute a batch of requests, and return the array of the replies (in the same order).
+ *  Consecutive read-only calls are spread over up to nMaxThreads threads: the
+ *  calling one, and the ones running the tasks queued with runner. */
+std::string JSONRPCExecBatch(const UniValue& vReq, const RPCTaskRunner& runner = RPCTaskRunner(), int nMaxThreads = 1);
 void RPCNotifyBlockChange(bool fInitialDownload, const CBlockIndex* pindex);
 
 #endif // BITCOIN_RPCSERVER_H
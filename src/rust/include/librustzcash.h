@@ -173,6 +173,53 @@ extern "C" {
     /// `librustzcash_sapling_verification_ctx_init`.
     void librustzcash_sapling_verification_ctx_free(void *);
 
+    /// Creates a Sapling batch validator, used to verify the proofs
+    /// and signatures of many transactions at once. Please free this
+    /// when you're done.
+    void * librustzcash_sapling_batch_validator_init();
+
+    /// Frees a Sapling batch validator returned from
+    /// `librustzcash_sapling_batch_validator_init`.
+    void librustzcash_sapling_batch_validator_free(void *);
+
+    /// Perform the cheap checks of a Sapling Spend description
+    /// (of the current transaction), accumulating the value commitment
+    /// and queueing the proof and the spendAuthSig in the batch.
+    bool librustzcash_sapling_batch_check_spend(
+        void *batch,
+        const unsigned char *cv,
+        const unsigned char *anchor,
+        const unsigned char *nullifier,
+        const unsigned char *rk,
+        const unsigned char *zkproof,
+        const unsigned char *spendAuthSig,
+        const unsigned char *sighashValue
+    );
+
+    /// Perform the cheap checks of a Sapling Output description
+    /// (of the current transaction), accumulating the value commitment
+    /// and queueing the proof in the batch.
+    bool librustzcash_sapling_batch_check_output(
+        void *batch,
+        const unsigned char *cv,
+        const unsigned char *cm,
+        const unsigned char *ephemeralKey,
+        const unsigned char *zkproof
+    );
+
+    /// Close the current transaction, given valueBalance,
+    /// queueing its binding signature in the batch.
+    bool librustzcash_sapling_batch_final_check(
+        void *batch,
+        int64_t valueBalance,
+        const unsigned char *bindingSig,
+        const unsigned char *sighashValue
+    );
+
+    /// Verify all the queued proofs and signatures with a single
+    /// randomized batch check.
+    bool librustzcash_sapling_batch_validate(const void *batch);
+
     /// Compute a Sapling nullifier.
     ///
     /// The `diversifier` parameter must be 11 bytes in length.
@@ -3,8 +3,10 @@
 
 use lazy_static;
 
-use ff::{PrimeField, PrimeFieldRepr};
-use pairing::bls12_381::{Bls12, Fr, FrRepr};
+use ff::{Field, PrimeField, PrimeFieldRepr};
+use group::{CurveAffine, CurveProjective};
+use pairing::bls12_381::{Bls12, Fr, FrRepr, G1};
+use pairing::{Engine, PairingCurveAffine};
 
 use zcash_primitives::{
     constants::CRH_IVK_PERSONALIZATION,
@@ -20,9 +22,10 @@ use zcash_proofs::circuit::sprout::{self, TREE_DEPTH as SPROUT_TREE_DEPTH};
 
 use bellman::gadgets::multipack;
 use bellman::groth16::{
-    create_random_proof, verify_proof, Parameters, PreparedVerifyingKey, Proof,
+    create_random_proof, verify_proof, Parameters, PreparedVerifyingKey, Proof, VerifyingKey,
 };
 
+use blake2b_simd::Params as Blake2bParams;
 use blake2s_simd::Params as Blake2sParams;
 
 use byteorder::{LittleEndian, ReadBytesExt, WriteBytesExt};
@@ -727,6 +730,363 @@ pub extern "system" fn librustzcash_sapling_final_check(
     )
 }
 
+/// BLAKE2b personalization of the RedJubjub H* hash
+const REDJUBJUB_H_PERSONALIZATION: &[u8; 16] = b"Zcash_RedJubjubH";
+
+/// A RedJubjub signature, deserialized and ready to be verified in a batch
+struct QueuedSignature {
+    vk: edwards::Point<Bls12, Unknown>,
+    r: edwards::Point<Bls12, Unknown>,
+    s: Fs,
+    c: Fs,
+}
+
+impl QueuedSignature {
+    /// Deserializes the signature over `msg`, computing the challenge
+    /// c = H*(Rbar || M). Returns None if the encoding is invalid.
+    fn new(
+        vk: edwards::Point<Bls12, Unknown>,
+        sig: &[u8; 64],
+        msg: &[u8],
+    ) -> Option<QueuedSignature> {
+        let r = match edwards::Point::<Bls12, Unknown>::read(&sig[0..32], &JUBJUB) {
+            Ok(r) => r,
+            Err(_) => return None,
+        };
+        // S < order(G)
+        let s = match Fs::from_repr(read_fs(&sig[32..64])) {
+            Ok(s) => s,
+            Err(_) => return None,
+        };
+        let mut h = Blake2bParams::new()
+            .hash_length(64)
+            .personal(REDJUBJUB_H_PERSONALIZATION)
+            .to_state();
+        h.update(&sig[0..32]);
+        h.update(msg);
+        let c = Fs::to_uniform(h.finalize().as_ref());
+
+        Some(QueuedSignature { vk, r, s, c })
+    }
+}
+
+/// Checks 0 = h_G(sum_i z_i * (-S_i . P_G + R_i + c_i . vk_i)) for random z_i.
+fn batch_verify_signatures<R: RngCore>(
+    rng: &mut R,
+    sigs: &[QueuedSignature],
+    p_g: FixedGenerators,
+) -> bool {
+    let mut acc = edwards::Point::<Bls12, Unknown>::zero();
+    let mut s_sum = Fs::zero();
+
+    for sig in sigs {
+        let z = Fs::random(rng);
+
+        let mut zs = sig.s;
+        zs.mul_assign(&z);
+        s_sum.add_assign(&zs);
+
+        let mut zc = sig.c;
+        zc.mul_assign(&z);
+        acc = acc
+            .add(&sig.vk.mul(zc.into_repr(), &JUBJUB), &JUBJUB)
+            .add(&sig.r.mul(z.into_repr(), &JUBJUB), &JUBJUB);
+    }
+
+    let s_g: edwards::Point<Bls12, Unknown> =
+        JUBJUB.generator(p_g).mul(s_sum.into_repr(), &JUBJUB).into();
+    acc.add(&s_g.negate(), &JUBJUB).mul_by_cofactor(&JUBJUB) == edwards::Point::zero()
+}
+
+/// Checks prod_i e(z_i . A_i, B_i) = e(sum_i z_i . alpha, beta) * e(sum_i z_i . acc_i, gamma) *
+/// e(sum_i z_i . C_i, delta) for random z_i, with a single multi-Miller loop
+/// and a single final exponentiation.
+fn batch_verify_proofs<R: RngCore>(
+    rng: &mut R,
+    vk: &VerifyingKey<Bls12>,
+    proofs: &[(Proof<Bls12>, Vec<Fr>)],
+) -> bool {
+    if proofs.is_empty() {
+        return true;
+    }
+
+    let mut z_sum = Fr::zero();
+    let mut acc_inputs = G1::zero();
+    let mut acc_c = G1::zero();
+    let mut prepared = Vec::with_capacity(proofs.len() + 3);
+
+    for (proof, public_input) in proofs {
+        if public_input.len() + 1 != vk.ic.len() {
+            return false;
+        }
+        let z = Fr::random(rng);
+        z_sum.add_assign(&z);
+
+        let mut acc = vk.ic[0].into_projective();
+        for (x, b) in public_input.iter().zip(vk.ic.iter().skip(1)) {
+            acc.add_assign(&b.mul(x.into_repr()));
+        }
+        acc.mul_assign(z.into_repr());
+        acc_inputs.add_assign(&acc);
+
+        acc_c.add_assign(&proof.c.mul(z.into_repr()));
+
+        let za = proof.a.mul(z.into_repr()).into_affine();
+        prepared.push((za.prepare(), proof.b.prepare()));
+    }
+
+    let mut neg_beta = vk.beta_g2;
+    neg_beta.negate();
+    let mut neg_gamma = vk.gamma_g2;
+    neg_gamma.negate();
+    let mut neg_delta = vk.delta_g2;
+    neg_delta.negate();
+
+    prepared.push((
+        vk.alpha_g1.mul(z_sum.into_repr()).into_affine().prepare(),
+        neg_beta.prepare(),
+    ));
+    prepared.push((acc_inputs.into_affine().prepare(), neg_gamma.prepare()));
+    prepared.push((acc_c.into_affine().prepare(), neg_delta.prepare()));
+
+    let terms: Vec<_> = prepared.iter().map(|(a, b)| (a, b)).collect();
+    match Bls12::final_exponentiation(&Bls12::miller_loop(&terms)) {
+        Some(result) => result == <Bls12 as Engine>::Fqk::one(),
+        None => false,
+    }
+}
+
+fn is_small_order<Order>(p: &edwards::Point<Bls12, Order>) -> bool {
+    p.double(&JUBJUB).double(&JUBJUB).double(&JUBJUB) == edwards::Point::zero()
+}
+
+/// Accumulates the Groth16 proofs and the RedJubjub signatures of the
+/// Sapling descriptions of many transactions, so that they can be
+/// verified together with a single randomized batch check.
+pub struct SaplingBatchValidator {
+    /// Sum of the value commitments of the transaction being queued
+    bvk: edwards::Point<Bls12, Unknown>,
+    spend_proofs: Vec<(Proof<Bls12>, Vec<Fr>)>,
+    output_proofs: Vec<(Proof<Bls12>, Vec<Fr>)>,
+    spend_auth_sigs: Vec<QueuedSignature>,
+    binding_sigs: Vec<QueuedSignature>,
+}
+
+impl SaplingBatchValidator {
+    fn new() -> Self {
+        SaplingBatchValidator {
+            bvk: edwards::Point::zero(),
+            spend_proofs: vec![],
+            output_proofs: vec![],
+            spend_auth_sigs: vec![],
+            binding_sigs: vec![],
+        }
+    }
+}
+
+#[no_mangle]
+pub extern "system" fn librustzcash_sapling_batch_validator_init() -> *mut SaplingBatchValidator {
+    let batch = Box::new(SaplingBatchValidator::new());
+
+    Box::into_raw(batch)
+}
+
+#[no_mangle]
+pub extern "system" fn librustzcash_sapling_batch_validator_free(batch: *mut SaplingBatchValidator) {
+    drop(unsafe { Box::from_raw(batch) });
+}
+
+#[no_mangle]
+pub extern "system" fn librustzcash_sapling_batch_check_spend(
+    batch: *mut SaplingBatchValidator,
+    cv: *const [c_uchar; 32],
+    anchor: *const [c_uchar; 32],
+    nullifier: *const [c_uchar; 32],
+    rk: *const [c_uchar; 32],
+    zkproof: *const [c_uchar; GROTH_PROOF_SIZE],
+    spend_auth_sig: *const [c_uchar; 64],
+    sighash_value: *const [c_uchar; 32],
+) -> bool {
+    let batch = unsafe { &mut *batch };
+
+    // Deserialize the value commitment
+    let cv = match edwards::Point::<Bls12, Unknown>::read(&(unsafe { &*cv })[..], &JUBJUB) {
+        Ok(p) => p,
+        Err(_) => return false,
+    };
+
+    // Deserialize the anchor, which should be an element
+    // of Fr.
+    let anchor = match Fr::from_repr(read_le(&(unsafe { &*anchor })[..])) {
+        Ok(a) => a,
+        Err(_) => return false,
+    };
+
+    // Deserialize rk
+    let rk = match edwards::Point::<Bls12, Unknown>::read(&(unsafe { &*rk })[..], &JUBJUB) {
+        Ok(p) => p,
+        Err(_) => return false,
+    };
+
+    // Deserialize the proof
+    let zkproof = match Proof::<Bls12>::read(&(unsafe { &*zkproof })[..]) {
+        Ok(p) => p,
+        Err(_) => return false,
+    };
+
+    if is_small_order(&cv) || is_small_order(&rk) {
+        return false;
+    }
+
+    // Accumulate the value commitment
+    batch.bvk = batch.bvk.add(&cv, &JUBJUB);
+
+    // Queue the spend_auth_sig over rk || sighash
+    let mut data_to_be_signed = [0u8; 64];
+    rk.write(&mut data_to_be_signed[0..32])
+        .expect("message buffer should be 32 bytes");
+    (&mut data_to_be_signed[32..64]).copy_from_slice(&(unsafe { &*sighash_value })[..]);
+
+    let (rk_x, rk_y) = rk.into_xy();
+    let (cv_x, cv_y) = cv.into_xy();
+
+    match QueuedSignature::new(rk, unsafe { &*spend_auth_sig }, &data_to_be_signed) {
+        Some(sig) => batch.spend_auth_sigs.push(sig),
+        None => return false,
+    }
+
+    // Construct the public input for the circuit
+    let nullifier = multipack::bytes_to_bits_le(&(unsafe { &*nullifier })[..]);
+    let nullifier = multipack::compute_multipacking::<Bls12>(&nullifier);
+    assert_eq!(nullifier.len(), 2);
+
+    batch.spend_proofs.push((
+        zkproof,
+        vec![rk_x, rk_y, cv_x, cv_y, anchor, nullifier[0], nullifier[1]],
+    ));
+
+    true
+}
+
+#[no_mangle]
+pub extern "system" fn librustzcash_sapling_batch_check_output(
+    batch: *mut SaplingBatchValidator,
+    cv: *const [c_uchar; 32],
+    cm: *const [c_uchar; 32],
+    epk: *const [c_uchar; 32],
+    zkproof: *const [c_uchar; GROTH_PROOF_SIZE],
+) -> bool {
+    let batch = unsafe { &mut *batch };
+
+    // Deserialize the value commitment
+    let cv = match edwards::Point::<Bls12, Unknown>::read(&(unsafe { &*cv })[..], &JUBJUB) {
+        Ok(p) => p,
+        Err(_) => return false,
+    };
+
+    // Deserialize the commitment, which should be an element
+    // of Fr.
+    let cm = match Fr::from_repr(read_le(&(unsafe { &*cm })[..])) {
+        Ok(a) => a,
+        Err(_) => return false,
+    };
+
+    // Deserialize the ephemeral key
+    let epk = match edwards::Point::<Bls12, Unknown>::read(&(unsafe { &*epk })[..], &JUBJUB) {
+        Ok(p) => p,
+        Err(_) => return false,
+    };
+
+    // Deserialize the proof
+    let zkproof = match Proof::<Bls12>::read(&(unsafe { &*zkproof })[..]) {
+        Ok(p) => p,
+        Err(_) => return false,
+    };
+
+    if is_small_order(&cv) || is_small_order(&epk) {
+        return false;
+    }
+
+    // Accumulate the (negated) value commitment
+    batch.bvk = batch.bvk.add(&cv.negate(), &JUBJUB);
+
+    let (cv_x, cv_y) = cv.into_xy();
+    let (epk_x, epk_y) = epk.into_xy();
+    batch
+        .output_proofs
+        .push((zkproof, vec![cv_x, cv_y, epk_x, epk_y, cm]));
+
+    true
+}
+
+#[no_mangle]
+pub extern "system" fn librustzcash_sapling_batch_final_check(
+    batch: *mut SaplingBatchValidator,
+    value_balance: i64,
+    binding_sig: *const [c_uchar; 64],
+    sighash_value: *const [c_uchar; 32],
+) -> bool {
+    let batch = unsafe { &mut *batch };
+
+    // Take the value commitments of this transaction, resetting the
+    // accumulator for the next one.
+    let bvk = std::mem::replace(&mut batch.bvk, edwards::Point::zero());
+
+    if Amount::from_i64(value_balance).is_err() {
+        return false;
+    }
+
+    // Compute valueBalance in the exponent of the value commitment base,
+    // and subtract it from the value commitments sum.
+    let mut value_balance_point = JUBJUB
+        .generator(FixedGenerators::ValueCommitmentValue)
+        .mul(FsRepr::from(value_balance.abs() as u64), &JUBJUB);
+    if value_balance < 0 {
+        value_balance_point = value_balance_point.negate();
+    }
+    let value_balance_point: edwards::Point<Bls12, Unknown> = value_balance_point.into();
+    let bvk = bvk.add(&value_balance_point.negate(), &JUBJUB);
+
+    // Queue the binding signature over bvk || sighash
+    let mut data_to_be_signed = [0u8; 64];
+    bvk.write(&mut data_to_be_signed[0..32])
+        .expect("bvk is 32 bytes");
+    (&mut data_to_be_signed[32..64]).copy_from_slice(&(unsafe { &*sighash_value })[..]);
+
+    match QueuedSignature::new(bvk, unsafe { &*binding_sig }, &data_to_be_signed) {
+        Some(sig) => batch.binding_sigs.push(sig),
+        None => return false,
+    }
+
+    true
+}
+
+#[no_mangle]
+pub extern "system" fn librustzcash_sapling_batch_validate(
+    batch: *const SaplingBatchValidator,
+) -> bool {
+    let batch = unsafe { &*batch };
+    let mut rng = OsRng;
+
+    batch_verify_signatures(
+        &mut rng,
+        &batch.spend_auth_sigs,
+        FixedGenerators::SpendingKeyGenerator,
+    ) && batch_verify_signatures(
+        &mut rng,
+        &batch.binding_sigs,
+        FixedGenerators::ValueCommitmentRandomness,
+    ) && batch_verify_proofs(
+        &mut rng,
+        &unsafe { SAPLING_SPEND_PARAMS.as_ref() }.unwrap().vk,
+        &batch.spend_proofs,
+    ) && batch_verify_proofs(
+        &mut rng,
+        &unsafe { SAPLING_OUTPUT_PARAMS.as_ref() }.unwrap().vk,
+        &batch.output_proofs,
+    )
+}
+
 #[no_mangle]
 pub extern "system" fn librustzcash_sprout_prove(
     proof_out: *mut [c_uchar; GROTH_PROOF_SIZE],
@@ -0,0 +1,91 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "sapling/sapling_proofcache.h"
+
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
+#include "random.h"
+#include "script/sigcache.h" // for SignatureCacheHasher
+#include "uint256.h"
+#include "util/system.h"
+
+#include <boost/thread/shared_mutex.hpp>
+
+namespace {
+/**
+ * Valid shielded data cache, to avoid doing the expensive zk-SNARK proofs
+ * checking twice for every shielded transaction (once when accepted into
+ * memory pool, and again when accepted into the block chain)
+ */
+class CShieldedProofsCache
+{
+private:
+    //! Entries are SHA256(nonce || txid):
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_proofscache;
+
+public:
+    CShieldedProofsCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& txid)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(txid.begin(), 32).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry, const bool erase)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_proofscache);
+        return setValid.contains(entry, erase);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_proofscache);
+        setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
+};
+
+static CShieldedProofsCache shieldedProofsCache;
+}
+
+// To be called once in AppInitMain/BasicTestingSetup to initialize the
+// shieldedProofsCache.
+void InitShieldedProofsCache()
+{
+    // nMaxCacheSize is unsigned. If -shieldedcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-shieldedcachesize", DEFAULT_MAX_SHIELDED_CACHE_SIZE)), MAX_MAX_SHIELDED_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = shieldedProofsCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for shielded proofs cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+namespace SaplingProofsCache {
+
+bool Contains(const uint256& txid, bool erase)
+{
+    uint256 entry;
+    shieldedProofsCache.ComputeEntry(entry, txid);
+    return shieldedProofsCache.Get(entry, erase);
+}
+
+void Insert(const uint256& txid)
+{
+    uint256 entry;
+    shieldedProofsCache.ComputeEntry(entry, txid);
+    shieldedProofsCache.Set(entry);
+}
+
+} // End SaplingProofsCache namespace
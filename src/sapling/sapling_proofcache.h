@@ -0,0 +1,34 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_SAPLING_PROOFCACHE_H
+#define PIVX_SAPLING_PROOFCACHE_H
+
+#include <stdint.h>
+
+class uint256;
+
+// Default size of the shielded proofs cache (-shieldedcachesize), in MiB.
+// Each entry is 32 bytes, so 8MiB hold over 250000 transactions.
+static const unsigned int DEFAULT_MAX_SHIELDED_CACHE_SIZE = 8;
+// Maximum shielded proofs cache size allowed
+static const int64_t MAX_MAX_SHIELDED_CACHE_SIZE = 16384;
+
+/**
+ * Cache of the transactions whose shielded data (spend/output proofs,
+ * spendAuth and binding signatures) has already been verified.
+ * The txid commits to the whole transaction (Sapling data included),
+ * so it is used as key. Populated at mempool acceptance, consulted
+ * (and erased) when the transaction is connected in a block.
+ */
+namespace SaplingProofsCache {
+
+bool Contains(const uint256& txid, bool erase);
+void Insert(const uint256& txid);
+
+} // End SaplingProofsCache namespace
+
+void InitShieldedProofsCache();
+
+#endif // PIVX_SAPLING_PROOFCACHE_H
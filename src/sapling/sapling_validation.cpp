@@ -10,6 +10,7 @@
 #include "consensus/validation.h" // for CValidationState
 #include "util/system.h" // for error()
 #include "consensus/upgrades.h" // for CurrentEpochBranchId()
+#include "sapling/sapling_proofcache.h"
 
 #include <librustzcash.h>
 
@@ -116,7 +117,8 @@ bool ContextualCheckTransaction(
         const CChainParams& chainparams,
         const int nHeight,
         const bool isMined,
-        bool isInitBlockDownload)
+        bool isInitBlockDownload,
+        bool fCheckProofs)
 {
     const int DOS_LEVEL_BLOCK = 100;
     // DoS level set to 10 to be more forgiving.
@@ -158,72 +160,192 @@ bool ContextualCheckTransaction(
                     REJECT_INVALID, "bad-cs-has-shielded-data");
     }
 
-    if (hasShieldedData) {
-        uint256 dataToBeSigned;
-        // Empty output script.
-        CScript scriptCode;
-        try {
-            dataToBeSigned = SignatureHash(scriptCode, tx, NOT_AN_INPUT, SIGHASH_ALL, 0, SIGVERSION_SAPLING);
-        } catch (const std::logic_error& ex) {
-            // A logic error should never occur because we pass NOT_AN_INPUT and
-            // SIGHASH_ALL to SignatureHash().
-            return state.DoS(100, error("%s: error computing signature hash", __func__ ),
-                             REJECT_INVALID, "error-computing-signature-hash");
-        }
+    if (hasShieldedData && fCheckProofs) {
+        // Cache the result for mempool transactions, so that the proofs
+        // are not verified again when the transaction is connected in a block.
+        std::vector<const CTransaction*> vtx{&tx};
+        return CheckShieldedProofsBatch(vtx, state, dosLevelPotentiallyRelaxing, !isMined);
+    }
+    return true;
+}
 
-        // Sapling verification process
-        auto ctx = librustzcash_sapling_verification_ctx_init();
-
-        for (const SpendDescription &spend : tx.sapData->vShieldedSpend) {
-            if (!librustzcash_sapling_check_spend(
-                    ctx,
-                    spend.cv.begin(),
-                    spend.anchor.begin(),
-                    spend.nullifier.begin(),
-                    spend.rk.begin(),
-                    spend.zkproof.begin(),
-                    spend.spendAuthSig.begin(),
-                    dataToBeSigned.begin())) {
-                librustzcash_sapling_verification_ctx_free(ctx);
-                return state.DoS(
-                        dosLevelPotentiallyRelaxing,
-                        error("%s: Sapling spend description invalid", __func__ ),
-                        REJECT_INVALID, "bad-txns-sapling-spend-description-invalid");
-            }
-        }
+static bool GetShieldedSigHash(const CTransaction& tx, uint256& dataToBeSignedRet)
+{
+    // Empty output script.
+    CScript scriptCode;
+    try {
+        dataToBeSignedRet = SignatureHash(scriptCode, tx, NOT_AN_INPUT, SIGHASH_ALL, 0, SIGVERSION_SAPLING);
+    } catch (const std::logic_error& ex) {
+        // A logic error should never occur because we pass NOT_AN_INPUT and
+        // SIGHASH_ALL to SignatureHash().
+        return false;
+    }
+    return true;
+}
 
-        for (const OutputDescription &output : tx.sapData->vShieldedOutput) {
-            if (!librustzcash_sapling_check_output(
-                    ctx,
-                    output.cv.begin(),
-                    output.cmu.begin(),
-                    output.ephemeralKey.begin(),
-                    output.zkproof.begin())) {
-                librustzcash_sapling_verification_ctx_free(ctx);
-                // This should be a non-contextual check, but we check it here
-                // as we need to pass over the outputs anyway in order to then
-                // call librustzcash_sapling_final_check().
-                return state.DoS(100, error("%s: Sapling output description invalid", __func__ ),
-                                 REJECT_INVALID, "bad-txns-sapling-output-description-invalid");
-            }
-        }
+bool CheckShieldedProofs(const CTransaction& tx, CValidationState& state, int dosLevelPotentiallyRelaxing)
+{
+    assert(tx.hasSaplingData());
 
-        if (!librustzcash_sapling_final_check(
+    uint256 dataToBeSigned;
+    if (!GetShieldedSigHash(tx, dataToBeSigned)) {
+        return state.DoS(100, error("%s: error computing signature hash", __func__ ),
+                         REJECT_INVALID, "error-computing-signature-hash");
+    }
+
+    // Sapling verification process
+    auto ctx = librustzcash_sapling_verification_ctx_init();
+
+    for (const SpendDescription &spend : tx.sapData->vShieldedSpend) {
+        if (!librustzcash_sapling_check_spend(
                 ctx,
-                tx.sapData->valueBalance,
-                tx.sapData->bindingSig.begin(),
+                spend.cv.begin(),
+                spend.anchor.begin(),
+                spend.nullifier.begin(),
+                spend.rk.begin(),
+                spend.zkproof.begin(),
+                spend.spendAuthSig.begin(),
                 dataToBeSigned.begin())) {
             librustzcash_sapling_verification_ctx_free(ctx);
             return state.DoS(
                     dosLevelPotentiallyRelaxing,
-                    error("%s: Sapling binding signature invalid", __func__ ),
-                    REJECT_INVALID, "bad-txns-sapling-binding-signature-invalid");
+                    error("%s: Sapling spend description invalid", __func__ ),
+                    REJECT_INVALID, "bad-txns-sapling-spend-description-invalid");
+        }
+    }
+
+    for (const OutputDescription &output : tx.sapData->vShieldedOutput) {
+        if (!librustzcash_sapling_check_output(
+                ctx,
+                output.cv.begin(),
+                output.cmu.begin(),
+                output.ephemeralKey.begin(),
+                output.zkproof.begin())) {
+            librustzcash_sapling_verification_ctx_free(ctx);
+            // This should be a non-contextual check, but we check it here
+            // as we need to pass over the outputs anyway in order to then
+            // call librustzcash_sapling_final_check().
+            return state.DoS(100, error("%s: Sapling output description invalid", __func__ ),
+                             REJECT_INVALID, "bad-txns-sapling-output-description-invalid");
         }
+    }
 
+    if (!librustzcash_sapling_final_check(
+            ctx,
+            tx.sapData->valueBalance,
+            tx.sapData->bindingSig.begin(),
+            dataToBeSigned.begin())) {
         librustzcash_sapling_verification_ctx_free(ctx);
+        return state.DoS(
+                dosLevelPotentiallyRelaxing,
+                error("%s: Sapling binding signature invalid", __func__ ),
+                REJECT_INVALID, "bad-txns-sapling-binding-signature-invalid");
     }
+
+    librustzcash_sapling_verification_ctx_free(ctx);
     return true;
 }
 
+// Queue the shielded data of the transaction in the batch validator,
+// performing only the cheap (deserialization and small order) checks.
+static bool QueueShieldedProofs(void* batch, const CTransaction& tx)
+{
+    assert(tx.hasSaplingData());
+
+    uint256 dataToBeSigned;
+    if (!GetShieldedSigHash(tx, dataToBeSigned)) {
+        return false;
+    }
+
+    for (const SpendDescription &spend : tx.sapData->vShieldedSpend) {
+        if (!librustzcash_sapling_batch_check_spend(
+                batch,
+                spend.cv.begin(),
+                spend.anchor.begin(),
+                spend.nullifier.begin(),
+                spend.rk.begin(),
+                spend.zkproof.begin(),
+                spend.spendAuthSig.begin(),
+                dataToBeSigned.begin())) {
+            return false;
+        }
+    }
+
+    for (const OutputDescription &output : tx.sapData->vShieldedOutput) {
+        if (!librustzcash_sapling_batch_check_output(
+                batch,
+                output.cv.begin(),
+                output.cmu.begin(),
+                output.ephemeralKey.begin(),
+                output.zkproof.begin())) {
+            return false;
+        }
+    }
+
+    return librustzcash_sapling_batch_final_check(
+            batch,
+            tx.sapData->valueBalance,
+            tx.sapData->bindingSig.begin(),
+            dataToBeSigned.begin());
+}
+
+bool CheckShieldedProofsBatch(const std::vector<const CTransaction*>& vtxIn, CValidationState& state, int dosLevelPotentiallyRelaxing, bool cacheStore)
+{
+    // Skip the transactions already verified (e.g. at mempool acceptance).
+    // If we are not going to store the results, erase the cache entries.
+    std::vector<const CTransaction*> vtx;
+    vtx.reserve(vtxIn.size());
+    for (const CTransaction* ptx : vtxIn) {
+        if (!SaplingProofsCache::Contains(ptx->GetHash(), !cacheStore)) {
+            vtx.emplace_back(ptx);
+        }
+    }
+
+    if (vtx.empty()) {
+        return true;
+    }
+
+    if (vtx.size() == 1) {
+        // Nothing to gain from batching
+        if (!CheckShieldedProofs(*vtx[0], state, dosLevelPotentiallyRelaxing)) {
+            return false;
+        }
+        if (cacheStore) SaplingProofsCache::Insert(vtx[0]->GetHash());
+        return true;
+    }
+
+    auto batch = librustzcash_sapling_batch_validator_init();
+    bool fBatchValid = true;
+    for (const CTransaction* ptx : vtx) {
+        if (!QueueShieldedProofs(batch, *ptx)) {
+            fBatchValid = false;
+            break;
+        }
+    }
+    fBatchValid = fBatchValid && librustzcash_sapling_batch_validate(batch);
+    librustzcash_sapling_batch_validator_free(batch);
+
+    if (fBatchValid) {
+        if (cacheStore) {
+            for (const CTransaction* ptx : vtx) SaplingProofsCache::Insert(ptx->GetHash());
+        }
+        return true;
+    }
+
+    // The batch check failed: verify each transaction separately
+    // in order to find the culprit and set the rejection reason.
+    for (const CTransaction* ptx : vtx) {
+        if (!CheckShieldedProofs(*ptx, state, dosLevelPotentiallyRelaxing)) {
+            return false;
+        }
+    }
+    LogPrintf("%s: batch verification failed, but all the %d transactions are valid\n", __func__, vtx.size());
+    return true;
+}
 
 } // End SaplingValidation namespace
+
+bool CSaplingCheck::operator()()
+{
+    return SaplingValidation::CheckShieldedProofsBatch(vtx, state, nDoSLevel, cacheStore);
+}
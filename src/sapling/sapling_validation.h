@@ -7,9 +7,11 @@
 #define PIVX_SAPLING_VALIDATION_H
 
 #include "chainparams.h"
+#include "consensus/validation.h"
+
+#include <vector>
 
 class CTransaction;
-class CValidationState;
 
 namespace SaplingValidation {
 
@@ -21,10 +23,54 @@ bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidatio
 
 /** Check a transaction contextually against a set of consensus rules */
 // Note: if v5 upgrade wasn't enforced, this method returns true without performing any check.
+// Note2: with fCheckProofs=false, the spend/output proofs and the signatures are NOT verified (see CSaplingCheck).
 bool ContextualCheckTransaction(const CTransaction &tx, CValidationState &state,
                                 const CChainParams &chainparams, int nHeight, bool isMined,
-                                bool sInitBlockDownload);
+                                bool sInitBlockDownload, bool fCheckProofs = true);
+
+/** Verify the Groth16 proofs of spends/outputs, the spendAuth signatures and the binding signature */
+bool CheckShieldedProofs(const CTransaction& tx, CValidationState& state, int dosLevelPotentiallyRelaxing);
+
+/** Verify the proofs and signatures of several transactions with a single randomized batch check.
+ *  Only if the batch fails, each transaction is checked with CheckShieldedProofs, to identify the invalid one.
+ *  Transactions found in the shielded proofs cache are skipped (and their entry erased, unless cacheStore is set).
+ *  With cacheStore, the valid transactions are added to the cache. */
+bool CheckShieldedProofsBatch(const std::vector<const CTransaction*>& vtx, CValidationState& state, int dosLevelPotentiallyRelaxing, bool cacheStore);
 
 }; // End SaplingValidation namespace
 
+/**
+ * Closure representing the verification of the Sapling proofs and signatures of a
+ * set of transactions (see SaplingValidation::CheckShieldedProofsBatch).
+ * Like CScriptCheck, it is handed to the script check queue by ConnectBlock so that the
+ * shielded data of the block transactions is verified in parallel by the -par threads.
+ */
+class CSaplingCheck
+{
+private:
+    std::vector<const CTransaction*> vtx;
+    int nDoSLevel;
+    bool cacheStore;
+    CValidationState state;
+
+public:
+    CSaplingCheck() : nDoSLevel(0), cacheStore(false) {}
+    CSaplingCheck(std::vector<const CTransaction*> vtxIn, int nDoSLevelIn, bool cacheIn) :
+        vtx(std::move(vtxIn)),
+        nDoSLevel(nDoSLevelIn),
+        cacheStore(cacheIn) {}
+
+    bool operator()();
+
+    void swap(CSaplingCheck& check)
+    {
+        vtx.swap(check.vtx);
+        std::swap(nDoSLevel, check.nDoSLevel);
+        std::swap(cacheStore, check.cacheStore);
+        std::swap(state, check.state);
+    }
+
+    const CValidationState& GetState() const { return state; }
+};
+
 #endif //PIVX_SAPLING_VALIDATION_H
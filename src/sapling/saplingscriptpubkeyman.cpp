@@ -7,6 +7,14 @@
 #include "chain.h" // for CBlockIndex
 #include "validation.h" // for ReadBlockFromDisk()
 
+#include "util/system.h"
+
+// Keys tried on an output by a single check, and trial decryptions below which the caller
+// doesn't use the queue
+static const size_t TRIAL_DECRYPTIONS_PER_CHECK = 64;
+
+static CCheckQueue<CSaplingTrialDecryptCheck> saplingdecryptqueue(128);
+
 void SaplingScriptPubKeyMan::AddToSaplingSpends(const uint256& nullifier, const uint256& wtxid)
 {
     AssertLockHeld(wallet->cs_wallet);
@@ -326,22 +334,57 @@ std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> SaplingScriptPubKe
     if (!tx.IsShieldedTx()) {
         return {};
     }
+    return FindMySaplingNotesInternal({&tx}, false)[0];
+}
 
-    LOCK(wallet->cs_KeyStore);
-    const uint256& hash = tx.GetHash();
+std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>> SaplingScriptPubKeyMan::FindMySaplingNotes(const std::vector<CTransactionRef>& vtx,
+                                                                                                                     bool fParallel) const
+{
+    std::vector<const CTransaction*> vtxPtrs;
+    vtxPtrs.reserve(vtx.size());
+    for (const CTransactionRef& tx : vtx) {
+        vtxPtrs.emplace_back(tx.get());
+    }
+    return FindMySaplingNotesInternal(vtxPtrs, fParallel);
+}
 
-    mapSaplingNoteData_t noteData;
-    SaplingIncomingViewingKeyMap viewingKeysToAdd;
+std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>> SaplingScriptPubKeyMan::FindMySaplingNotesInternal(const std::vector<const CTransaction*>& vtx,
+                                                                                                                             bool fParallel) const
+{
+    std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>> ret(vtx.size());
+
+    // Copy the keys, so the trial decryptions don't hold cs_KeyStore
+    std::vector<libzcash::SaplingIncomingViewingKey> vIvks;
+    {
+        LOCK(wallet->cs_KeyStore);
+        vIvks.reserve(wallet->mapSaplingFullViewingKeys.size());
+        for (const auto& it : wallet->mapSaplingFullViewingKeys) {
+            vIvks.emplace_back(it.first);
+        }
+    }
+    if (vIvks.empty()) {
+        return ret;
+    }
 
     // Protocol Spec: 4.19 Block Chain Scanning (Sapling)
-    for (uint32_t i = 0; i < tx.sapData->vShieldedOutput.size(); ++i) {
-        const OutputDescription output = tx.sapData->vShieldedOutput[i];
-        for (auto it = wallet->mapSaplingFullViewingKeys.begin(); it != wallet->mapSaplingFullViewingKeys.end(); ++it) {
-            libzcash::SaplingIncomingViewingKey ivk = it->first;
+    const std::vector<int> vKeyPos = TrialDecryptSaplingOutputs(vtx, vIvks, fParallel ? &saplingdecryptqueue : nullptr);
+
+    // Merge the results in order. Only the outputs that are ours are decrypted again here.
+    LOCK(wallet->cs_KeyStore);
+    size_t nOutput = 0;
+    for (size_t t = 0; t < vtx.size(); t++) {
+        const CTransaction& tx = *vtx[t];
+        if (!tx.IsShieldedTx()) continue;
+        const uint256& hash = tx.GetHash();
+        mapSaplingNoteData_t& noteData = ret[t].first;
+        SaplingIncomingViewingKeyMap& viewingKeysToAdd = ret[t].second;
+
+        for (uint32_t i = 0; i < tx.sapData->vShieldedOutput.size(); ++i, ++nOutput) {
+            if (vKeyPos[nOutput] < 0) continue;
+            const OutputDescription& output = tx.sapData->vShieldedOutput[i];
+            const libzcash::SaplingIncomingViewingKey& ivk = vIvks[vKeyPos[nOutput]];
             auto result = libzcash::SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cmu);
-            if (!result) {
-                continue;
-            }
+            assert(result);
 
             // Check if we already have it.
             Optional<libzcash::SaplingPaymentAddress> address = ivk.address(result.get().d);
@@ -361,11 +404,79 @@ std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> SaplingScriptPubKe
                 nd.memo = memo;
             }
             noteData.insert(std::make_pair(op, nd));
+        }
+    }
+
+    return ret;
+}
+
+bool CSaplingTrialDecryptCheck::operator()()
+{
+    for (size_t k = nBegin; k < nEnd; k++) {
+        if (libzcash::SaplingNotePlaintext::decrypt(output->encCiphertext, (*pvIvks)[k], output->ephemeralKey, output->cmu)) {
+            *pnKeyPos = (int) k;
             break;
         }
     }
+    return true;
+}
 
-    return std::make_pair(noteData, viewingKeysToAdd);
+void ThreadSaplingTrialDecrypt()
+{
+    util::ThreadRename("pivx-saplingdec");
+    saplingdecryptqueue.Thread();
+}
+
+std::vector<int> TrialDecryptSaplingOutputs(const std::vector<const CTransaction*>& vtx,
+                                            const std::vector<libzcash::SaplingIncomingViewingKey>& vIvks,
+                                            CCheckQueue<CSaplingTrialDecryptCheck>* pqueue)
+{
+    // The shielded outputs to check, in transaction and output order
+    std::vector<const OutputDescription*> vOutputs;
+    for (const CTransaction* tx : vtx) {
+        if (!tx->IsShieldedTx()) continue;
+        for (const OutputDescription& output : tx->sapData->vShieldedOutput) {
+            vOutputs.emplace_back(&output);
+        }
+    }
+    std::vector<int> ret(vOutputs.size(), -1);
+    const size_t nKeys = vIvks.size();
+    if (vOutputs.empty() || nKeys == 0) {
+        return ret;
+    }
+
+    // One check per output and range of keys, writing only its own slot.
+    // Once an output is decrypted, the next keys of the range are skipped.
+    const size_t nChecksPerOutput = (nKeys + TRIAL_DECRYPTIONS_PER_CHECK - 1) / TRIAL_DECRYPTIONS_PER_CHECK;
+    std::vector<int> vKeyPos(vOutputs.size() * nChecksPerOutput, -1);
+    std::vector<CSaplingTrialDecryptCheck> vChecks;
+    vChecks.reserve(vKeyPos.size());
+    for (size_t i = 0; i < vOutputs.size(); i++) {
+        for (size_t c = 0; c < nChecksPerOutput; c++) {
+            vChecks.emplace_back(vOutputs[i], &vIvks, c * TRIAL_DECRYPTIONS_PER_CHECK,
+                                 std::min(nKeys, (c + 1) * TRIAL_DECRYPTIONS_PER_CHECK), &vKeyPos[i * nChecksPerOutput + c]);
+        }
+    }
+    if (!pqueue || vOutputs.size() * nKeys < TRIAL_DECRYPTIONS_PER_CHECK) {
+        for (CSaplingTrialDecryptCheck& check : vChecks) {
+            check();
+        }
+    } else {
+        CCheckQueueControl<CSaplingTrialDecryptCheck> control(pqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    // Each output goes to the first key decrypting it, as when the keys are tried serially
+    for (size_t i = 0; i < vOutputs.size(); i++) {
+        for (size_t c = 0; c < nChecksPerOutput; c++) {
+            if (vKeyPos[i * nChecksPerOutput + c] >= 0) {
+                ret[i] = vKeyPos[i * nChecksPerOutput + c];
+                break;
+            }
+        }
+    }
+    return ret;
 }
 
 std::vector<libzcash::SaplingPaymentAddress> SaplingScriptPubKeyMan::FindMySaplingAddresses(const CTransaction& tx) const
@@ -5,6 +5,7 @@
 #ifndef PIVX_SAPLINGSCRIPTPUBKEYMAN_H
 #define PIVX_SAPLINGSCRIPTPUBKEYMAN_H
 
+#include "checkqueue.h"
 #include "consensus/consensus.h"
 #include "sapling/note.h"
 #include "wallet/hdchain.h"
@@ -131,6 +132,52 @@ enum KeyAddResult {
 
 typedef std::map<SaplingOutPoint, SaplingNoteData> mapSaplingNoteData_t;
 
+/**
+ * Closure representing the trial decryption of a shielded output with a range of incoming viewing
+ * keys, handed to a CCheckQueue by TrialDecryptSaplingOutputs. The position of the first key of
+ * the range decrypting the output (or -1) is written to the slot of the check.
+ */
+class CSaplingTrialDecryptCheck
+{
+private:
+    const OutputDescription* output{nullptr};
+    const std::vector<libzcash::SaplingIncomingViewingKey>* pvIvks{nullptr};
+    size_t nBegin{0};
+    size_t nEnd{0};
+    int* pnKeyPos{nullptr};
+
+public:
+    CSaplingTrialDecryptCheck() {}
+    CSaplingTrialDecryptCheck(const OutputDescription* outputIn, const std::vector<libzcash::SaplingIncomingViewingKey>* pvIvksIn,
+                              size_t nBeginIn, size_t nEndIn, int* pnKeyPosIn) :
+        output(outputIn), pvIvks(pvIvksIn), nBegin(nBeginIn), nEnd(nEndIn), pnKeyPos(pnKeyPosIn) {}
+
+    bool operator()();
+
+    void swap(CSaplingTrialDecryptCheck& check)
+    {
+        std::swap(output, check.output);
+        std::swap(pvIvks, check.pvIvks);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(pnKeyPos, check.pnKeyPos);
+    }
+};
+
+/** Run an instance of the Sapling trial decryption thread (serving the queue of the wallet) */
+void ThreadSaplingTrialDecrypt();
+
+/**
+ * Trial-decrypt the shielded outputs of a set of transactions with a set of incoming viewing keys.
+ * The (output, key range) checks are handed to the threads serving the queue, or, without a queue
+ * or with only a few pairs to try, run serially by the caller.
+ * Returns, for each shielded output (in transaction and output order), the position in vIvks
+ * of the first key decrypting it, or -1 if no key does.
+ */
+std::vector<int> TrialDecryptSaplingOutputs(const std::vector<const CTransaction*>& vtx,
+                                            const std::vector<libzcash::SaplingIncomingViewingKey>& vIvks,
+                                            CCheckQueue<CSaplingTrialDecryptCheck>* pqueue);
+
 /*
  * Sapling keys manager
  * A class implementing SaplingScriptPubKeyMan manages all sapling keys and Notes used in a wallet.
@@ -270,6 +317,11 @@ public:
     //! SaplingPaymentAddress in this wallet
     std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> FindMySaplingNotes(const CTransaction& tx) const;
 
+    //! Same as above, for all the transactions of a block at once (one result per transaction).
+    //! If fParallel, the trial decryptions of the whole block are handed to the ThreadSaplingTrialDecrypt threads.
+    std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>> FindMySaplingNotes(const std::vector<CTransactionRef>& vtx,
+                                                                                                  bool fParallel) const;
+
     //! Find all of the addresses in the given tx that have been sent to a SaplingPaymentAddress in this wallet.
     std::vector<libzcash::SaplingPaymentAddress> FindMySaplingAddresses(const CTransaction& tx) const;
 
@@ -413,6 +465,9 @@ private:
     Optional<uint256> commonOVK;
     uint256 getCommonOVKFromSeed() const;
 
+    /* Find the notes of the transactions, with the trial decryptions on the ThreadSaplingTrialDecrypt threads if fParallel */
+    std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>> FindMySaplingNotesInternal(const std::vector<const CTransaction*>& vtx,
+                                                                                                          bool fParallel) const;
 
     /**
      * Used to keep track of spent Notes, and
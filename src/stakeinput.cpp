@@ -15,12 +15,34 @@ CPivStake* CPivStake::NewPivStake(const CTxIn& txin)
         return nullptr;
     }
 
-    // Find the previous transaction in database
+    // Find the previous output in the coins view (its block may be pruned)
+    Coin coin;
+    if (GetUTXOCoin(txin.prevout, coin)) {
+        const CBlockIndex* pindexFrom = chainActive[coin.nHeight];
+        if (!pindexFrom) {
+            error("%s : Failed to find the block index for stake origin", __func__);
+            return nullptr;
+        }
+        return new CPivStake(coin.out, txin.prevout, pindexFrom);
+    }
+
+    // Already spent in the active chain (stake of a fork block): find the
+    // previous transaction in database
     uint256 hashBlock;
     CTransactionRef txPrev;
-    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true)) {
-        error("%s : INFO: read txPrev failed, tx id prev: %s", __func__, txin.prevout.hash.GetHex());
-        return nullptr;
+    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true) || txin.prevout.n >= txPrev->vout.size()) {
+        // Without the transaction index (or with pruning), read the output from the undo
+        // data of the block spending it: a fork block can't be deeper than the max reorg depth.
+        if (!GetSpentCoin(txin.prevout, coin, gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH))) {
+            error("%s : INFO: read txPrev failed, tx id prev: %s", __func__, txin.prevout.hash.GetHex());
+            return nullptr;
+        }
+        const CBlockIndex* pindexFrom = chainActive[coin.nHeight];
+        if (!pindexFrom) {
+            error("%s : Failed to find the block index for stake origin", __func__);
+            return nullptr;
+        }
+        return new CPivStake(coin.out, txin.prevout, pindexFrom);
     }
 
     const CBlockIndex* pindexFrom = nullptr;
@@ -0,0 +1,70 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "index/addressindex.h"
+#include "key.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "test/test_pivx.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, BasicTestingSetup)
+
+static CKeyID NewKeyID()
+{
+    CKey key;
+    key.MakeNewKey(true);
+    return key.GetPubKey().GetID();
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_scripts)
+{
+    const CKeyID ownerId = NewKeyID();
+    const CKeyID stakerId = NewKeyID();
+
+    // P2PKH outputs are indexed under their script only
+    const CScript p2pkh = GetScriptForDestination(ownerId);
+    std::vector<uint160> vScripts = GetAddressIndexScripts(p2pkh);
+    BOOST_CHECK_EQUAL(vScripts.size(), 1);
+    BOOST_CHECK(vScripts[0] == GetAddressIndexScriptHash(p2pkh));
+
+    // P2CS outputs are also indexed under the P2PKH scripts of the staker and the owner
+    const CScript p2cs = GetScriptForStakeDelegation(stakerId, ownerId);
+    vScripts = GetAddressIndexScripts(p2cs);
+    BOOST_CHECK_EQUAL(vScripts.size(), 3);
+    BOOST_CHECK(vScripts[0] == GetAddressIndexScriptHash(p2cs));
+    BOOST_CHECK(std::count(vScripts.begin(), vScripts.end(), GetAddressIndexScriptHash(GetScriptForDestination(stakerId))) == 1);
+    BOOST_CHECK(std::count(vScripts.begin(), vScripts.end(), GetAddressIndexScriptHash(p2pkh)) == 1);
+
+    // Unspendable outputs are not indexed
+    BOOST_CHECK(GetAddressIndexScripts(CScript() << OP_RETURN << ToByteVector(ownerId)).empty());
+    BOOST_CHECK(GetAddressIndexScripts(CScript()).empty());
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_history_key_order)
+{
+    const uint160 scriptHash = GetAddressIndexScriptHash(GetScriptForDestination(NewKeyID()));
+    const uint256 txid = GetRandHash();
+
+    // The serialized keys of a script are sorted by height
+    std::vector<int> vHeights = {0, 1, 255, 256, 65535, 65536, 2000000};
+    std::vector<std::vector<unsigned char>> vKeys;
+    for (int nHeight : vHeights) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << AddressHistoryKey(scriptHash, nHeight, txid, 1, true);
+        vKeys.emplace_back(ss.begin(), ss.end());
+
+        AddressHistoryKey key;
+        ss >> key;
+        BOOST_CHECK(key.scriptHash == scriptHash);
+        BOOST_CHECK_EQUAL(key.nHeight, nHeight);
+        BOOST_CHECK(key.txid == txid);
+        BOOST_CHECK_EQUAL(key.nIndex, 1);
+        BOOST_CHECK(key.fSpending);
+    }
+    BOOST_CHECK(std::is_sorted(vKeys.begin(), vKeys.end()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
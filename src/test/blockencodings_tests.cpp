@@ -0,0 +1,247 @@
+// Copyright (c) 2011-2020 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "blockencodings.h"
+#include "consensus/merkle.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockencodings_tests, RegTestingSetup)
+
+static CMutableTransaction SpendingTx(const uint256& prevHash, uint32_t n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vin[0].prevout = COutPoint(prevHash, n);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+    return tx;
+}
+
+static CBlock BuildBlockTestCase(bool fProofOfStake)
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig.resize(10);
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = fProofOfStake ? 0 : 42;
+    if (fProofOfStake) coinbase.vout[0].SetEmpty();
+    block.vtx.emplace_back(MakeTransactionRef(coinbase));
+
+    if (fProofOfStake) {
+        CMutableTransaction coinstake = SpendingTx(InsecureRand256(), 0);
+        coinstake.vout.resize(2);
+        coinstake.vout[0].SetEmpty();
+        coinstake.vout[1].nValue = 42;
+        block.vtx.emplace_back(MakeTransactionRef(coinstake));
+        block.vchBlockSig = std::vector<unsigned char>(72, 0x5a);
+    }
+
+    CMutableTransaction tx = SpendingTx(InsecureRand256(), 0);
+    block.vtx.emplace_back(MakeTransactionRef(tx));
+    tx = SpendingTx(block.vtx.back()->GetHash(), 0);
+    block.vtx.emplace_back(MakeTransactionRef(tx));
+    tx = SpendingTx(InsecureRand256(), 1);
+    block.vtx.emplace_back(MakeTransactionRef(tx));
+
+    block.nVersion = 10;
+    block.hashPrevBlock = InsecureRand256();
+    block.nBits = 0x207fffff;
+    block.nTime = 1600000000;
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+    return block;
+}
+
+static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs ret;
+    stream >> ret;
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE(SimpleRoundTripTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase(false));
+    const size_t firstTx = 1;
+
+    LOCK(pool.cs);
+    pool.addUnchecked(block.vtx[firstTx + 1]->GetHash(), entry.FromTx(*block.vtx[firstTx + 1]));
+
+    // Do a simple ShortTxIDs RT
+    {
+        CBlockHeaderAndShortTxIDs shortIDs = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+
+        PartiallyDownloadedBlock partialBlock(&pool);
+        BOOST_CHECK(partialBlock.InitData(shortIDs) == READ_STATUS_OK);
+        BOOST_CHECK(partialBlock.IsTxAvailable(0));
+        BOOST_CHECK(!partialBlock.IsTxAvailable(firstTx));
+        BOOST_CHECK(partialBlock.IsTxAvailable(firstTx + 1));
+        BOOST_CHECK(!partialBlock.IsTxAvailable(firstTx + 2));
+        BOOST_CHECK_EQUAL(partialBlock.GetPrefilledCount(), 1U);
+        BOOST_CHECK_EQUAL(partialBlock.GetMempoolCount(), 1U);
+
+        size_t poolSize = pool.size();
+        pool.removeRecursive(*block.vtx[firstTx + 1]);
+        BOOST_CHECK_EQUAL(pool.size(), poolSize - 1);
+
+        // A partial block keeps its own reference to the mempool txes
+        CBlock block2;
+        {
+            PartiallyDownloadedBlock tmp = partialBlock;
+            BOOST_CHECK(partialBlock.FillBlock(block2, {}) == READ_STATUS_INVALID); // No transactions
+            partialBlock = tmp;
+        }
+
+        // Wrong transaction: the merkle root doesn't match
+        {
+            PartiallyDownloadedBlock tmp = partialBlock;
+            BOOST_CHECK(partialBlock.FillBlock(block2, {block.vtx[firstTx + 2], block.vtx[firstTx]}) == READ_STATUS_FAILED);
+            partialBlock = tmp;
+        }
+
+        CBlock block3;
+        BOOST_CHECK(partialBlock.FillBlock(block3, {block.vtx[firstTx], block.vtx[firstTx + 2]}) == READ_STATUS_OK);
+        BOOST_CHECK_EQUAL(block.GetHash().ToString(), block3.GetHash().ToString());
+        BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(), BlockMerkleRoot(block3).ToString());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ProofOfStakeRoundTripTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase(true));
+    BOOST_CHECK(block.IsProofOfStake());
+    const size_t firstTx = 2;
+
+    LOCK(pool.cs);
+    for (size_t i = firstTx; i < block.vtx.size(); i++) {
+        pool.addUnchecked(block.vtx[i]->GetHash(), entry.FromTx(*block.vtx[i]));
+    }
+
+    CBlockHeaderAndShortTxIDs shortIDs = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    BOOST_CHECK_EQUAL(shortIDs.BlockTxCount(), block.vtx.size());
+    BOOST_CHECK(shortIDs.vchBlockSig == block.vchBlockSig);
+
+    // Both the coinbase and the coinstake are prefilled, everything else
+    // comes from the mempool: no round-trip needed.
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs) == READ_STATUS_OK);
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        BOOST_CHECK(partialBlock.IsTxAvailable(i));
+    }
+    BOOST_CHECK_EQUAL(partialBlock.GetPrefilledCount(), 2U);
+    BOOST_CHECK_EQUAL(partialBlock.GetMempoolCount(), block.vtx.size() - 2);
+
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, {}) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+    BOOST_CHECK(block2.IsProofOfStake());
+    BOOST_CHECK(block2.vchBlockSig == block.vchBlockSig);
+
+    // The reconstructed block serializes exactly as the original one
+    CDataStream ss1(SER_NETWORK, PROTOCOL_VERSION), ss2(SER_NETWORK, PROTOCOL_VERSION);
+    ss1 << block;
+    ss2 << block2;
+    BOOST_CHECK(ss1.str() == ss2.str());
+    // ... and the compact announcement is much smaller
+    BOOST_CHECK(GetSerializeSize(shortIDs, PROTOCOL_VERSION) < ss1.size());
+}
+
+BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig.resize(10);
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 42;
+
+    CBlock block;
+    block.vtx.emplace_back(MakeTransactionRef(coinbase));
+    block.nVersion = 10;
+    block.hashPrevBlock = InsecureRand256();
+    block.nBits = 0x207fffff;
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+
+    CBlockHeaderAndShortTxIDs shortIDs = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+
+    CBlock block2;
+    std::vector<CTransactionRef> vtx_missing;
+    BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+    BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(), BlockMerkleRoot(block2).ToString());
+}
+
+BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
+    BlockTransactionsRequest req1;
+    req1.blockhash = InsecureRand256();
+    req1.indexes.resize(4);
+    req1.indexes[0] = 0;
+    req1.indexes[1] = 1;
+    req1.indexes[2] = 3;
+    req1.indexes[3] = 4;
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req1;
+
+    BlockTransactionsRequest req2;
+    stream >> req2;
+
+    BOOST_CHECK_EQUAL(req1.blockhash.ToString(), req2.blockhash.ToString());
+    BOOST_CHECK_EQUAL(req1.indexes.size(), req2.indexes.size());
+    BOOST_CHECK_EQUAL(req1.indexes[0], req2.indexes[0]);
+    BOOST_CHECK_EQUAL(req1.indexes[1], req2.indexes[1]);
+    BOOST_CHECK_EQUAL(req1.indexes[2], req2.indexes[2]);
+    BOOST_CHECK_EQUAL(req1.indexes[3], req2.indexes[3]);
+}
+
+BOOST_AUTO_TEST_CASE(TransactionsRequestDeserializationOverflowTest) {
+    // Check that the highest legal index is decoded correctly
+    BlockTransactionsRequest req0;
+    req0.blockhash = InsecureRand256();
+    req0.indexes.resize(1);
+    req0.indexes[0] = 0xffff;
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req0;
+
+    BlockTransactionsRequest req1;
+    stream >> req1;
+    BOOST_CHECK_EQUAL(req1.indexes.size(), 1U);
+    BOOST_CHECK_EQUAL(req1.indexes[0], 0xffff);
+
+    // Check that a differential index overflowing 16 bits is rejected
+    stream.clear();
+    req0.indexes.resize(2);
+    req0.indexes[0] = 0x8000;
+    req0.indexes[1] = 0x8000;
+    stream << req0.blockhash;
+    WriteCompactSize(stream, 2);
+    WriteCompactSize(stream, 0x8000);
+    WriteCompactSize(stream, 0x8000);
+    BlockTransactionsRequest req2;
+    BOOST_CHECK_THROW(stream >> req2, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
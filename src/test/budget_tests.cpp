@@ -9,11 +9,13 @@
 #include "masternode-payments.h"
 #include "masternode-sync.h"
 #include "spork.h"
+#include "tiertwo_sigverify.h"
 #include "tinyformat.h"
 #include "utilmoneystr.h"
 #include "validation.h"
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
 
 BOOST_AUTO_TEST_SUITE(budget_tests)
 
@@ -290,4 +292,49 @@ BOOST_FIXTURE_TEST_CASE(IsCoinbaseValueValid_test, TestingSetup)
 
 }
 
+BOOST_FIXTURE_TEST_CASE(vote_signature_cache_test, BasicTestingSetup)
+{
+    CKey key, otherKey;
+    key.MakeNewKey(true);
+    otherKey.MakeNewKey(true);
+    const CKeyID& keyID = key.GetPubKey().GetID();
+
+    // Verified signature: the cache doesn't validate it for other signers
+    CBudgetVote vote(CTxIn(GetRandHash(), 0), GetRandHash(), CBudgetVote::VOTE_YES);
+    BOOST_CHECK(vote.Sign(key, keyID));
+    BOOST_CHECK(vote.CheckSignature(keyID));
+    BOOST_CHECK(!vote.CheckSignature(otherKey.GetPubKey().GetID()));
+
+    // Signature cached ahead, without knowing the signer
+    CBudgetVote vote2(CTxIn(GetRandHash(), 0), GetRandHash(), CBudgetVote::VOTE_NO);
+    BOOST_CHECK(vote2.Sign(key, keyID));
+    BOOST_CHECK(vote2.CacheSignature());
+    BOOST_CHECK(vote2.CheckSignature(keyID));
+    BOOST_CHECK(!vote2.CheckSignature(otherKey.GetPubKey().GetID()));
+
+    // Invalid signature
+    std::vector<unsigned char> vchSig = vote2.GetVchSig();
+    vchSig[10] ^= 1;
+    vote2.SetVchSig(vchSig);
+    vote2.CacheSignature();
+    BOOST_CHECK(!vote2.CheckSignature(keyID));
+
+    // The verification queue takes messages only when it has workers
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << vote;
+    BOOST_CHECK(CTierTwoSigVerifyQueue::IsSignedMessage(NetMsgType::BUDGETVOTE));
+    BOOST_CHECK(!CTierTwoSigVerifyQueue::IsSignedMessage(NetMsgType::BUDGETPROPOSAL));
+    BOOST_CHECK(!tiertwoSigVerifyQueue.Add(NetMsgType::BUDGETVOTE, ss));
+    boost::thread worker(&ThreadTierTwoSigVerify);
+    while (!tiertwoSigVerifyQueue.Add(NetMsgType::BUDGETVOTE, ss)) {
+        MilliSleep(10);
+    }
+    while (tiertwoSigVerifyQueue.Size() > 0) {
+        MilliSleep(10);
+    }
+    worker.interrupt();
+    worker.join();
+    BOOST_CHECK(!tiertwoSigVerifyQueue.Add(NetMsgType::BUDGETVOTE, ss));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
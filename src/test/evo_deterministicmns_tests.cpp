@@ -11,6 +11,7 @@
 #include "evo/deterministicmns.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
+#include "masternodeman.h"
 #include "messagesigner.h"
 #include "netbase.h"
 #include "policy/policy.h"
@@ -344,6 +345,40 @@ BOOST_FIXTURE_TEST_CASE(dip3_protx, TestChain400Setup)
         nHeight++;
     }
 
+    // The scores of a block hash are cached for the deterministic list at the tip: they are
+    // reused until the tip changes, and again once the tip goes back to the same list.
+    {
+        const uint256& hash = chainTip->GetBlockHash();
+        BOOST_CHECK(!mnodeman.HasCachedScores(hash));
+        MasternodeRef winner = mnodeman.GetCurrentMasterNode(hash);
+        BOOST_ASSERT(winner);
+        BOOST_CHECK(deterministicMNManager->GetListAtChainTip().HasMNByCollateral(winner->vin.prevout));
+        BOOST_CHECK(mnodeman.HasCachedScores(hash));
+        BOOST_CHECK(mnodeman.GetCurrentMasterNode(hash)->vin == winner->vin);
+
+        // New tip: recomputed with the new list
+        CreateAndProcessBlock({}, coinbaseKey);
+        chainTip = chainActive.Tip();
+        BOOST_CHECK_EQUAL(chainTip->nHeight, ++nHeight);
+        SyncWithValidationInterfaceQueue();
+        BOOST_CHECK(!mnodeman.HasCachedScores(hash));
+        BOOST_CHECK(mnodeman.GetCurrentMasterNode(hash)->vin == winner->vin);
+        BOOST_CHECK(mnodeman.HasCachedScores(hash));
+
+        // Disconnect the tip and connect it again: the scores for this tip are reused
+        CValidationState state;
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(InvalidateBlock(state, Params(), chainTip));
+            BOOST_CHECK(ReconsiderBlock(state, chainTip));
+        }
+        BOOST_CHECK(ActivateBestChain(state));
+        BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Tip(); ) == chainTip);
+        SyncWithValidationInterfaceQueue();
+        BOOST_CHECK(mnodeman.HasCachedScores(hash));
+        BOOST_CHECK(mnodeman.GetCurrentMasterNode(hash)->vin == winner->vin);
+    }
+
     // enable SPORK_21
     const CSporkMessage& spork = CSporkMessage(SPORK_21_LEGACY_MNS_MAX_HEIGHT, nHeight, GetTime());
     sporkManager.AddOrUpdateSporkMessage(spork);
@@ -785,6 +820,19 @@ BOOST_FIXTURE_TEST_CASE(dip3_protx, TestChain400Setup)
         BOOST_CHECK_EQUAL(dmn->pdmnState->nPoSeBanHeight, nHeight);
     }
 
+    // Lower the snapshot period (without list cache): the missing snapshots are
+    // written, and the lists built from them are the same.
+    {
+        CDeterministicMNManager compactMNManager(*evoDb, 5, 0);
+        compactMNManager.UpdatedBlockTip(chainTip);
+        while (compactMNManager.CompactSnapshots()) {}
+        for (const CBlockIndex* pindex = chainTip; compactMNManager.IsDIP3Enforced(pindex->nHeight); pindex = pindex->pprev) {
+            const auto& mnList = compactMNManager.GetListForBlock(pindex);
+            BOOST_CHECK_EQUAL(mnList.GetHeight(), pindex->nHeight);
+            BOOST_CHECK(!mnList.BuildDiff(deterministicMNManager->GetListForBlock(pindex)).HasChanges());
+        }
+    }
+
     UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V6_0, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
 }
 
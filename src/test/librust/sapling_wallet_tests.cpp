@@ -19,8 +19,10 @@
 #include "consensus/merkle.h"
 #include "sapling/note.h"
 #include "sapling/noteencryption.h"
+#include "sapling/saplingscriptpubkeyman.h"
 
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
 
 #include <boost/test/unit_test.hpp>
 
@@ -174,6 +176,60 @@ BOOST_AUTO_TEST_CASE(FindMySaplingNotes)
     BOOST_CHECK_EQUAL(2, noteMap.size());
 }
 
+BOOST_AUTO_TEST_CASE(TrialDecryptSaplingOutputsThreads)
+{
+    // 100 keys (more than the keys tried by a single check), and 10 txes with two outputs
+    // each: one to the key at (tx position * 10), one to nobody
+    std::vector<libzcash::SaplingIncomingViewingKey> vIvks;
+    std::vector<libzcash::SaplingPaymentAddress> vAddresses;
+    for (int i = 0; i < 100; i++) {
+        auto sk = libzcash::SaplingSpendingKey::random();
+        vIvks.emplace_back(sk.full_viewing_key().in_viewing_key());
+        vAddresses.emplace_back(sk.default_address());
+    }
+    std::vector<CTransactionRef> vtx;
+    std::vector<const CTransaction*> vtxPtrs;
+    for (int i = 0; i < 10; i++) {
+        CMutableTransaction mtx;
+        mtx.nVersion = CTransaction::TxVersion::SAPLING;
+        for (const auto& pa : {vAddresses[i * 10], libzcash::SaplingSpendingKey::random().default_address()}) {
+            libzcash::SaplingNote note(pa, 100000000);
+            auto enc = libzcash::SaplingNotePlaintext(note, {{0xF6}}).encrypt(note.pk_d);
+            BOOST_ASSERT(enc);
+            OutputDescription output;
+            output.cmu = note.cmu().get();
+            output.ephemeralKey = enc->second.get_epk();
+            output.encCiphertext = enc->first;
+            mtx.sapData->vShieldedOutput.emplace_back(output);
+        }
+        vtx.emplace_back(MakeTransactionRef(mtx));
+        vtxPtrs.emplace_back(vtx.back().get());
+    }
+    // A transparent tx has no output to check
+    vtx.emplace_back(MakeTransactionRef(CMutableTransaction()));
+    vtxPtrs.emplace_back(vtx.back().get());
+
+    // The result is the same serially and on the threads of a queue
+    CCheckQueue<CSaplingTrialDecryptCheck> queue(128);
+    boost::thread_group threads;
+    for (int i = 0; i < 7; i++) {
+        threads.create_thread([&queue]() { queue.Thread(); });
+    }
+    for (CCheckQueue<CSaplingTrialDecryptCheck>* pqueue : {(CCheckQueue<CSaplingTrialDecryptCheck>*) nullptr, &queue}) {
+        const std::vector<int> vKeyPos = TrialDecryptSaplingOutputs(vtxPtrs, vIvks, pqueue);
+        BOOST_CHECK_EQUAL(vKeyPos.size(), 20U);
+        for (int i = 0; i < 10; i++) {
+            BOOST_CHECK_EQUAL(vKeyPos[2 * i], i * 10);
+            BOOST_CHECK_EQUAL(vKeyPos[2 * i + 1], -1);
+        }
+    }
+
+    // No keys, nothing decrypted
+    BOOST_CHECK(TrialDecryptSaplingOutputs(vtxPtrs, {}, &queue) == std::vector<int>(20, -1));
+    threads.interrupt_all();
+    threads.join_all();
+}
+
 // Generate note A and spend to create note B, from which we spend to create two conflicting transactions
 BOOST_AUTO_TEST_CASE(GetConflictedSaplingNotes)
 {
@@ -9,6 +9,7 @@
 #include "sapling/sapling.h"
 #include "sapling/transaction_builder.h"
 #include "sapling/sapling_validation.h"
+#include "sapling/sapling_proofcache.h"
 
 #include <univalue.h>
 #include <boost/test/unit_test.hpp>
@@ -101,6 +102,53 @@ BOOST_AUTO_TEST_CASE(SaplingToSapling)
     BOOST_CHECK_EQUAL(state.GetRejectReason(), "");
 }
 
+BOOST_AUTO_TEST_CASE(SaplingBatchValidation)
+{
+    auto consensusParams = Params().GetConsensus();
+
+    auto sk = libzcash::SaplingSpendingKey::random();
+    auto expsk = sk.expanded_spending_key();
+    auto fvk = sk.full_viewing_key();
+    auto pa = sk.default_address();
+
+    // Create three Sapling-only transactions
+    std::vector<CTransaction> vtx;
+    for (int i = 0; i < 3; i++) {
+        auto testNote = GetTestSaplingNote(pa, 40000000);
+        auto builder = TransactionBuilder(consensusParams, 2);
+        builder.AddSaplingSpend(expsk, testNote.note, testNote.tree.root(), testNote.tree.witness());
+        builder.SetFee(10000000);
+        builder.AddSaplingOutput(fvk.ovk, pa, 29900000, {});
+        vtx.emplace_back(builder.Build().GetTxOrThrow());
+    }
+    std::vector<const CTransaction*> vptx;
+    for (const CTransaction& tx : vtx) vptx.emplace_back(&tx);
+
+    CValidationState state;
+    BOOST_CHECK(SaplingValidation::CheckShieldedProofsBatch(vptx, state, 100, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "");
+
+    // Tamper with the binding signature of the second transaction:
+    // the batch fails, and the culprit is found by the per-tx checks.
+    CMutableTransaction mtx(vtx[1]);
+    mtx.sapData->bindingSig[0] ^= 1;
+    const CTransaction badTx(mtx);
+    vptx[1] = &badTx;
+    BOOST_CHECK(!SaplingValidation::CheckShieldedProofsBatch(vptx, state, 100, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-sapling-binding-signature-invalid");
+
+    // The same through the check closure
+    CSaplingCheck check(vptx, 100, false);
+    BOOST_CHECK(!check());
+    BOOST_CHECK_EQUAL(check.GetState().GetRejectReason(), "bad-txns-sapling-binding-signature-invalid");
+
+    // Cached transactions are not verified again (and their entry is erased when cacheStore is false)
+    SaplingProofsCache::Insert(badTx.GetHash());
+    BOOST_CHECK(SaplingValidation::CheckShieldedProofsBatch(vptx, state, 100, true));
+    BOOST_CHECK(SaplingValidation::CheckShieldedProofsBatch(vptx, state, 100, false));
+    BOOST_CHECK(!SaplingValidation::CheckShieldedProofsBatch(vptx, state, 100, false));
+}
+
 BOOST_AUTO_TEST_CASE(ThrowsOnTransparentInputWithoutKeyStore)
 {
     auto builder = TransactionBuilder(Params().GetConsensus(), 1);
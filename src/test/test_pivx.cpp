@@ -17,6 +17,7 @@
 #include "net_processing.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
+#include "sapling/sapling_proofcache.h"
 #include "script/sigcache.h"
 #include "sporkdb.h"
 #include "txmempool.h"
@@ -46,6 +47,7 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     ECC_Start();
     SetupEnvironment();
     InitSignatureCache();
+    InitShieldedProofsCache();
     fCheckBlockIndex = true;
     SelectParams(chainName);
     evoDb.reset(new CEvoDB(1 << 20, true, true));
@@ -105,8 +107,9 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
             BOOST_CHECK(ok);
         }
         nScriptCheckThreads = 3;
-        for (int i=0; i < nScriptCheckThreads-1; i++)
+        for (int i=0; i < nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+        }
         peerLogic.reset(new PeerLogicValidation(connman));
 }
 
@@ -4,8 +4,13 @@
 
 #include "test/test_pivx.h"
 #include "blockassembler.h"
+#include "budget/budgetproposal.h"
+#include "checkqueue.h"
+#include "kernel.h"
 #include "primitives/transaction.h"
 #include "sapling/sapling_validation.h"
+#include "script/interpreter.h"
+#include "txdb.h"
 #include "test/librust/utiltest.h"
 #include "wallet/test/wallet_test_fixture.h"
 
@@ -155,4 +160,113 @@ BOOST_FIXTURE_TEST_CASE(zerocoin_rejection_tests, WalletRegTestingSetup)
     CheckMempoolZcRejection(mtx);
 }
 
+BOOST_FIXTURE_TEST_CASE(stake_kernel_search_tests, RegTestingSetup)
+{
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V3_4, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    CBlockIndex indexFrom, indexPrev;
+    indexFrom.nHeight = 100;
+    indexFrom.nTime = 1600000000;
+    indexPrev.nHeight = 200;
+    indexPrev.nTime = 1600006000;
+    indexPrev.SetStakeModifier(InsecureRand256());
+
+    // Easy target: about 3% of the kernels meet it
+    const unsigned int nBits = 0x1d7fffff;
+    const int nTime = indexPrev.nTime + 15;
+    std::vector<CStakeKernel> vKernels;
+    for (int i = 0; i < 2000; i++) {
+        CPivStake stakeInput(CTxOut(1 * COIN, CScript()), COutPoint(InsecureRand256(), i % 3), &indexFrom);
+        vKernels.emplace_back(&indexPrev, &stakeInput, nBits, nTime - 15);
+        vKernels.back().SetTime(nTime);
+
+        // The kernel hash is the double-SHA256 of the whole kernel message
+        CDataStream ss(SER_GETHASH, 0);
+        ss << indexPrev.GetStakeModifierV2() << indexFrom.nTime << stakeInput.GetUniqueness() << nTime;
+        BOOST_CHECK(vKernels.back().GetHash() == Hash(ss.begin(), ss.end()));
+    }
+
+    std::vector<const CStakeKernel*> vPtrs;
+    std::vector<size_t> vExpected;
+    for (size_t i = 0; i < vKernels.size(); i++) {
+        vPtrs.emplace_back(&vKernels[i]);
+        if (vKernels[i].CheckKernelHash(true)) vExpected.emplace_back(i);
+    }
+    BOOST_CHECK(!vExpected.empty() && vExpected.size() < vKernels.size());
+    // Same kernels found, in the same order, whatever the number of threads
+    // serving the queue (or with no thread at all: checked by the caller)
+    for (int nThreads : {0, 1, 2, 7}) {
+        CCheckQueue<CStakeKernelCheck> queue(128);
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads; i++) {
+            threads.create_thread([&queue]() { queue.Thread(); });
+        }
+        BOOST_CHECK(FindStakeKernels(vPtrs, queue) == vExpected);
+        BOOST_CHECK(FindStakeKernels({}, queue).empty());
+        threads.interrupt_all();
+        threads.join_all();
+    }
+    // Below MIN_KERNELS_PER_THREAD, checked by the caller
+    const std::vector<const CStakeKernel*> vFew(vPtrs.begin(), vPtrs.begin() + 100);
+    std::vector<size_t> vExpectedFew;
+    for (size_t pos : vExpected) {
+        if (pos < vFew.size()) vExpectedFew.emplace_back(pos);
+    }
+    BOOST_CHECK(FindStakeKernels(vFew) == vExpectedFew);
+}
+
+static CMutableTransaction SpendP2PK(const COutPoint& prevout, const CKey& key, const std::vector<CTxOut>& vout)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction mtx;
+    mtx.vin.emplace_back(prevout);
+    mtx.vout = vout;
+    std::vector<unsigned char> vchSig;
+    const uint256 hash = SignatureHash(scriptPubKey, mtx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    mtx.vin[0].scriptSig << vchSig;
+    return mtx;
+}
+
+BOOST_FIXTURE_TEST_CASE(pruning_lookups_tests, TestChain100Setup)
+{
+    // The blocks needed to disconnect the blocks up to the max reorg depth are kept
+    BOOST_CHECK(GetMinBlocksToKeep() >= MIN_BLOCKS_TO_KEEP);
+    BOOST_CHECK(GetMinBlocksToKeep() >= (unsigned int)DEFAULT_MAX_REORG_DEPTH);
+
+    // A budget fee transaction, whose change is spent in the next block
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const CScript feeScript = CScript() << OP_RETURN << ToByteVector(GetRandHash());
+    const CMutableTransaction feeTx = SpendP2PK(COutPoint(coinbaseTxns[0].GetHash(), 0), coinbaseKey,
+                                                {CTxOut(PROPOSAL_FEE_TX, feeScript), CTxOut(11 * CENT, scriptPubKey)});
+    const CBlock feeBlock = CreateAndProcessBlock({feeTx}, scriptPubKey);
+    const int nFeeHeight = WITH_LOCK(cs_main, return chainActive.Height());
+    BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash()) == feeBlock.GetHash());
+
+    const COutPoint changeOut(feeTx.GetHash(), 1);
+    const CMutableTransaction spendTx = SpendP2PK(changeOut, coinbaseKey, {CTxOut(10 * CENT, scriptPubKey)});
+    CreateAndProcessBlock({spendTx}, scriptPubKey);
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return chainActive.Height()), nFeeHeight + 1);
+
+    // Not in the coins view anymore: the fee transaction is read from the block tree db
+    CTransactionRef tx;
+    uint256 hashBlock;
+    BOOST_CHECK(pblocktree->ReadBudgetFeeTx(feeTx.GetHash(), tx, hashBlock));
+    BOOST_CHECK(!pblocktree->ReadBudgetFeeTx(spendTx.GetHash(), tx, hashBlock));
+    tx = nullptr;
+    hashBlock.SetNull();
+    BOOST_CHECK(GetTransaction(feeTx.GetHash(), tx, hashBlock, true));
+    BOOST_CHECK(tx && tx->GetHash() == feeTx.GetHash());
+    BOOST_CHECK(hashBlock == feeBlock.GetHash());
+
+    // The spent change is found in the undo data of the last block only
+    Coin coin;
+    BOOST_CHECK(GetSpentCoin(changeOut, coin, 1));
+    BOOST_CHECK_EQUAL(coin.out.nValue, 11 * CENT);
+    BOOST_CHECK(coin.out.scriptPubKey == scriptPubKey);
+    BOOST_CHECK_EQUAL(coin.nHeight, nFeeHeight);
+    BOOST_CHECK(!GetSpentCoin(changeOut, coin, 0));
+    BOOST_CHECK(!GetSpentCoin(COutPoint(spendTx.GetHash(), 0), coin, 10));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,111 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "tiertwo_sigverify.h"
+
+#include "budget/budgetvote.h"
+#include "budget/finalizedbudgetvote.h"
+#include "masternode.h"
+#include "masternode-payments.h"
+#include "protocol.h"
+#include "util/system.h"
+#include "utilstrencodings.h"
+
+#include <boost/thread/thread.hpp>
+
+CTierTwoSigVerifyQueue tiertwoSigVerifyQueue;
+
+template <typename T>
+static void CacheMessageSignature(CDataStream& vRecv)
+{
+    T msg;
+    vRecv >> msg;
+    msg.CacheSignature();
+}
+
+void CTierTwoSigVerifyQueue::CacheSignatures(const std::string& strCommand, CDataStream& vRecv)
+{
+    if (strCommand == NetMsgType::MNBROADCAST) {
+        CMasternodeBroadcast mnb;
+        vRecv >> mnb;
+        mnb.CacheSignature();
+        mnb.lastPing.CacheSignature();
+    } else if (strCommand == NetMsgType::MNPING) {
+        CacheMessageSignature<CMasternodePing>(vRecv);
+    } else if (strCommand == NetMsgType::MNWINNER) {
+        CacheMessageSignature<CMasternodePaymentWinner>(vRecv);
+    } else if (strCommand == NetMsgType::BUDGETVOTE) {
+        CacheMessageSignature<CBudgetVote>(vRecv);
+    } else if (strCommand == NetMsgType::FINALBUDGETVOTE) {
+        CacheMessageSignature<CFinalizedBudgetVote>(vRecv);
+    }
+}
+
+bool CTierTwoSigVerifyQueue::IsSignedMessage(const std::string& strCommand)
+{
+    return strCommand == NetMsgType::MNBROADCAST ||
+           strCommand == NetMsgType::MNPING ||
+           strCommand == NetMsgType::MNWINNER ||
+           strCommand == NetMsgType::BUDGETVOTE ||
+           strCommand == NetMsgType::FINALBUDGETVOTE;
+}
+
+bool CTierTwoSigVerifyQueue::Add(const std::string& strCommand, const CDataStream& vRecv)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nWorkers == 0 || queue.size() >= MAX_TIERTWO_SIGVERIFY_QUEUE) {
+            return false;
+        }
+        queue.emplace_back(strCommand, vRecv);
+    }
+    condWorker.notify_one();
+    return true;
+}
+
+void CTierTwoSigVerifyQueue::Thread()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nWorkers++;
+    }
+    try {
+        while (true) {
+            std::string strCommand;
+            CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (queue.empty()) {
+                    condWorker.wait(lock); // interruption point
+                }
+                strCommand = std::move(queue.front().first);
+                vRecv = std::move(queue.front().second);
+                queue.pop_front();
+            }
+            // The message is deserialized again by the message handler,
+            // which takes care of the malformed ones.
+            try {
+                CacheSignatures(strCommand, vRecv);
+            } catch (const std::exception& e) {
+                LogPrint(BCLog::MASTERNODE, "%s: cannot parse %s message: %s\n", __func__, SanitizeString(strCommand), e.what());
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (--nWorkers == 0) queue.clear();
+        throw;
+    }
+}
+
+size_t CTierTwoSigVerifyQueue::Size()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return queue.size();
+}
+
+void ThreadTierTwoSigVerify()
+{
+    util::ThreadRename("pivx-tiertwosig");
+    tiertwoSigVerifyQueue.Thread();
+}
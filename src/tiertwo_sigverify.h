@@ -0,0 +1,60 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TIERTWO_SIGVERIFY_H
+#define TIERTWO_SIGVERIFY_H
+
+#include "streams.h"
+
+#include <deque>
+#include <string>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Maximum number of tier two messages waiting for the verification threads */
+static const size_t MAX_TIERTWO_SIGVERIFY_QUEUE = 2000;
+/** Maximum number of tier two signature verification threads */
+static const int MAX_TIERTWO_SIGVERIFY_THREADS = 4;
+
+/**
+ * Queue of the signed tier two messages (mnb, mnp, mnw, budget and finalized
+ * budget votes) received from the peers, whose signatures are verified ahead
+ * by a pool of worker threads.
+ * The workers recover the signer of each message, and add the signature to
+ * the cache of valid message signatures, so when the message handler thread
+ * processes the messages (in the order they were received) checking their
+ * signature is a cache lookup. The signatures of the messages that the
+ * workers didn't reach (or dropped, when the queue is full) are verified by
+ * the message handler as usual.
+ */
+class CTierTwoSigVerifyQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    std::deque<std::pair<std::string, CDataStream>> queue;
+    int nWorkers{0};
+
+    static void CacheSignatures(const std::string& strCommand, CDataStream& vRecv);
+
+public:
+    //! Whether the messages of this type are verified ahead
+    static bool IsSignedMessage(const std::string& strCommand);
+
+    //! Add a copy of the message to the queue, returns false if the queue is full (or has no workers)
+    bool Add(const std::string& strCommand, const CDataStream& vRecv);
+
+    //! Worker thread
+    void Thread();
+
+    size_t Size();
+};
+
+extern CTierTwoSigVerifyQueue tiertwoSigVerifyQueue;
+
+/** Run an instance of the tier two signature verification thread */
+void ThreadTierTwoSigVerify();
+
+#endif // TIERTWO_SIGVERIFY_H
@@ -19,7 +19,6 @@
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
-static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -27,6 +26,7 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BUDGET_FEE_TX = 'g';
 // static const char DB_MONEY_SUPPLY = 'M';
 
 namespace {
@@ -247,19 +247,6 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256& txid, CDiskTxPos& pos)
-{
-    return Read(std::make_pair(DB_TXINDEX, txid), pos);
-}
-
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& vect)
-{
-    CDBBatch batch;
-    for (std::vector<std::pair<uint256, CDiskTxPos> >::const_iterator it = vect.begin(); it != vect.end(); it++)
-        batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
-    return WriteBatch(batch);
-}
-
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
@@ -284,6 +271,26 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
+bool CBlockTreeDB::WriteBudgetFeeTxs(const std::vector<CTransactionRef>& vTxs, const uint256& hashBlock)
+{
+    CDBBatch batch;
+    for (const CTransactionRef& tx : vTxs) {
+        batch.Write(std::make_pair(DB_BUDGET_FEE_TX, tx->GetHash()), std::make_pair(hashBlock, tx));
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadBudgetFeeTx(const uint256& txid, CTransactionRef& tx, uint256& hashBlock)
+{
+    std::pair<uint256, CTransactionRef> entry;
+    if (!Read(std::make_pair(DB_BUDGET_FEE_TX, txid), entry)) {
+        return false;
+    }
+    hashBlock = entry.first;
+    tx = entry.second;
+    return true;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
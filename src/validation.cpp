@@ -27,6 +27,8 @@
 #include "flatfile.h"
 #include "fs.h"
 #include "guiinterface.h"
+#include "index/coinstatsindex.h"
+#include "index/txindex.h"
 #include "init.h"
 #include "invalid.h"
 #include "interfaces/handler.h"
@@ -38,6 +40,7 @@
 #include "policy/policy.h"
 #include "pow.h"
 #include "reverse_iterate.h"
+#include "sapling/sapling_validation.h"
 #include "script/sigcache.h"
 #include "spork.h"
 #include "sporkdb.h"
@@ -94,10 +97,12 @@ int64_t g_best_block_time = 0;
 int nScriptCheckThreads = 0;
 std::atomic<bool> fImporting{false};
 std::atomic<bool> fReindex{false};
-bool fTxIndex = true;
+bool fHavePruned = false;
+bool fPruneMode = false;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 size_t nCoinCacheUsage = 5000 * 300;
+uint64_t nPruneTarget = 0;
 
 /* If the tip is older than this (in seconds), the node is considered to be in initial block download. */
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -177,6 +182,13 @@ std::set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 std::set<int> setDirtyFileInfo;
+
+/**
+ * Global flag to indicate we should check to see if there are
+ * block/undo files that should be deleted. Set on startup
+ * or if we allocate more file space when we're in prune mode.
+ */
+bool fCheckForPruning = false;
 } // anon namespace
 
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
@@ -219,6 +231,7 @@ enum FlushStateMode {
 
 // See definition for documentation
 bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode);
+static void FindFilesToPrune(std::set<int>& setFilesToPrune);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
 
@@ -392,6 +405,67 @@ static bool IsCurrentForFeeEstimation()
     return true;
 }
 
+/** The checks of a loose transaction that don't need the coins it spends */
+static bool CheckLooseTxPolicy(const CTransactionRef& _tx, CValidationState& state, int nextBlockHeight)
+{
+    const CTransaction& tx = *_tx;
+
+    // Coinbase is only valid in a block, not as a loose transaction
+    if (tx.IsCoinBase())
+        return state.DoS(100, false, REJECT_INVALID, "coinbase");
+
+    //Coinstake is also only valid in a block, not as a loose transaction
+    if (tx.IsCoinStake())
+        return state.DoS(100, false, REJECT_INVALID, "coinstake");
+
+    // Rather not work on nonstandard transactions
+    std::string reason;
+    if (fRequireStandard && !IsStandardTx(_tx, nextBlockHeight, reason))
+        return state.DoS(0, false, REJECT_NONSTANDARD, reason);
+
+    return true;
+}
+
+/** The policy checks of a loose transaction against the coins it spends (all in view) */
+static bool CheckLooseTxInputsPolicy(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view,
+                                     const CTxMemPool& pool, CAmount nFees, bool fLimitFree, bool ignoreFees,
+                                     unsigned int& nSigOpsRet)
+{
+    // Check for non-standard pay-to-script-hash in inputs
+    if (fRequireStandard && !AreInputsStandard(tx, view))
+        return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
+
+    // Check that the transaction doesn't have an excessive number of
+    // sigops, making it impossible to mine. Since the coinbase transaction
+    // itself can contain sigops MAX_TX_SIGOPS is less than
+    // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
+    // merely non-standard transaction.
+    unsigned int nSigOps = GetLegacySigOpCount(tx);
+    unsigned int nMaxSigOps = MAX_TX_SIGOPS_CURRENT;
+    nSigOps += GetP2SHSigOpCount(tx, view);
+    if(nSigOps > nMaxSigOps)
+        return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false,
+            strprintf("%d > %d", nSigOps, nMaxSigOps));
+    nSigOpsRet = nSigOps;
+
+    // Don't accept it if it can't get into a block
+    if (!ignoreFees) {
+        const unsigned int nSize = ::GetSerializeSize(tx, PROTOCOL_VERSION);
+        const CAmount txMinFee = GetMinRelayFee(tx, pool, nSize);
+        if (fLimitFree && nFees < txMinFee) {
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient fee", false,
+                strprintf("%d < %d", nFees, txMinFee));
+        }
+
+        // No transactions are allowed below minRelayTxFee except from disconnected blocks
+        if (fLimitFree && nFees < ::minRelayTxFee.GetFee(nSize)) {
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "min relay fee not met");
+        }
+    }
+
+    return true;
+}
+
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransactionRef& _tx, bool fLimitFree,
                               bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool ignoreFees,
                               std::vector<COutPoint>& coins_to_uncache)
@@ -426,18 +500,8 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         return error("%s : transaction checks for %s failed with %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
 
     int nextBlockHeight = chainHeight + 1;
-    // Check transaction contextually against consensus rules at block height
-    if (!ContextualCheckTransaction(_tx, state, params, nextBlockHeight, false /* isMined */, IsInitialBlockDownload())) {
-        return error("AcceptToMemoryPool: ContextualCheckTransaction failed");
-    }
-
-    // Coinbase is only valid in a block, not as a loose transaction
-    if (tx.IsCoinBase())
-        return state.DoS(100, false, REJECT_INVALID, "coinbase");
-
-    //Coinstake is also only valid in a block, not as a loose transaction
-    if (tx.IsCoinStake())
-        return state.DoS(100, false, REJECT_INVALID, "coinstake");
+    if (!CheckLooseTxPolicy(_tx, state, nextBlockHeight))
+        return false;
 
     if (pool.existsProviderTxConflict(tx)) {
         return state.DoS(0, false, REJECT_DUPLICATE, "protx-dup");
@@ -449,10 +513,6 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
     if (!CheckFinalTx(_tx, STANDARD_LOCKTIME_VERIFY_FLAGS))
         return state.DoS(0, false, REJECT_NONSTANDARD, "non-final");
 
-    // Rather not work on nonstandard transactions
-    std::string reason;
-    if (fRequireStandard && !IsStandardTx(_tx, nextBlockHeight, reason))
-        return state.DoS(0, false, REJECT_NONSTANDARD, reason);
     // is it already in the memory pool?
     const uint256& hash = tx.GetHash();
     if (pool.exists(hash)) {
@@ -528,24 +588,12 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
         view.SetBackend(dummy);
 
-        // Check for non-standard pay-to-script-hash in inputs
-        if (fRequireStandard && !AreInputsStandard(tx, view))
-            return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
-
-        // Check that the transaction doesn't have an excessive number of
-        // sigops, making it impossible to mine. Since the coinbase transaction
-        // itself can contain sigops MAX_TX_SIGOPS is less than
-        // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
-        // merely non-standard transaction.
-        unsigned int nSigOps = GetLegacySigOpCount(tx);
-        unsigned int nMaxSigOps = MAX_TX_SIGOPS_CURRENT;
-        nSigOps += GetP2SHSigOpCount(tx, view);
-        if(nSigOps > nMaxSigOps)
-            return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false,
-                strprintf("%d > %d", nSigOps, nMaxSigOps));
-
         CAmount nValueOut = tx.GetValueOut();
         CAmount nFees = nValueIn - nValueOut;
+        unsigned int nSigOps;
+        if (!CheckLooseTxInputsPolicy(tx, state, view, pool, nFees, fLimitFree, ignoreFees, nSigOps))
+            return false;
+
         bool fSpendsCoinbaseOrCoinstake = false;
 
         // Keep track of transactions that spend a coinbase, which we re-scan
@@ -562,20 +610,6 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
                               fSpendsCoinbaseOrCoinstake, nSigOps);
         unsigned int nSize = entry.GetTxSize();
 
-        // Don't accept it if it can't get into a block
-        if (!ignoreFees) {
-            const CAmount txMinFee = GetMinRelayFee(tx, pool, nSize);
-            if (fLimitFree && nFees < txMinFee) {
-                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient fee", false,
-                    strprintf("%d < %d", nFees, txMinFee));
-            }
-
-            // No transactions are allowed below minRelayTxFee except from disconnected blocks
-            if (fLimitFree && nFees < ::minRelayTxFee.GetFee(nSize)) {
-                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "min relay fee not met");
-            }
-        }
-
         if (fRejectAbsurdFee) {
             const CAmount nMaxFee = tx.IsShieldedTx() ? GetShieldedTxMinFee(tx) * 100 :
                                                         GetMinRelayFee(nSize) * 10000;
@@ -584,6 +618,13 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
                                      strprintf("%d > %d", nFees, nMaxFee));
         }
 
+        // Check transaction contextually against consensus rules at block height.
+        // The shielded proofs are verified here (unless PreVerifyMempoolTx cached
+        // them), so this is done after the cheap checks.
+        if (!ContextualCheckTransaction(_tx, state, params, nextBlockHeight, false /* isMined */, IsInitialBlockDownload())) {
+            return error("AcceptToMemoryPool: ContextualCheckTransaction failed");
+        }
+
         // Calculate in-mempool ancestors, up to a limit.
         CTxMemPool::setEntries setAncestors;
         size_t nLimitAncestors = gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
@@ -678,6 +719,133 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
     return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fOverrideMempoolLimit, fRejectInsaneFee, ignoreFees);
 }
 
+bool PreVerifyMempoolTx(CTxMemPool& pool, CValidationState& state, const CTransactionRef& _tx)
+{
+    AssertLockNotHeld(cs_main);
+    const CTransaction& tx = *_tx;
+
+    // Zerocoin, maintenance mode and already known transactions are rejected by AcceptToMemoryPool
+    if (tx.ContainsZerocoins() ||
+        (sporkManager.IsSporkActive(SPORK_20_SAPLING_MAINTENANCE) && tx.IsShieldedTx()) ||
+        pool.exists(tx.GetHash())) {
+        return true;
+    }
+
+    // Check transaction
+    bool fColdStakingActive = !sporkManager.IsSporkActive(SPORK_19_COLDSTAKING_MAINTENANCE);
+    if (!CheckTransaction(tx, state, fColdStakingActive))
+        return error("%s : transaction checks for %s failed with %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
+
+    // Get the chain state, and the coins spent by the transaction
+    const CChainParams& params = Params();
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    int nextBlockHeight;
+    bool fIBD;
+    int flags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    {
+        LOCK(cs_main);
+        nextBlockHeight = chainActive.Height() + 1;
+        fIBD = IsInitialBlockDownload();
+        if (params.GetConsensus().NetworkUpgradeActive(chainActive.Height(), Consensus::UPGRADE_BIP65))
+            flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+
+        LOCK(pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        for (const CTxIn& txin : tx.vin) {
+            // Conflicts with the mempool are rejected by AcceptToMemoryPool
+            if (pool.mapNextTx.count(txin.prevout)) {
+                return true;
+            }
+            const bool had_coin_in_cache = pcoinsTip->HaveCoinInCache(txin.prevout);
+            Coin coin;
+            if (viewMemPool.GetCoin(txin.prevout, coin) && !coin.IsSpent()) {
+                view.AddCoin(txin.prevout, std::move(coin), true);
+            }
+            // Don't let transactions that may be rejected fill the coins cache
+            if (!had_coin_in_cache) {
+                pcoinsTip->Uncache(txin.prevout);
+            }
+        }
+    }
+
+    // Run the cheap checks of AcceptToMemoryPool first: the transactions
+    // failing them (or with missing inputs) are left to AcceptToMemoryPool,
+    // that rejects them before any proof or script is verified.
+    CValidationState statePolicy;
+    if (!CheckLooseTxPolicy(_tx, statePolicy, nextBlockHeight)) {
+        return true;
+    }
+    for (const CTxIn& txin : tx.vin) {
+        if (!view.HaveCoin(txin.prevout)) return true;
+    }
+    unsigned int nSigOps;
+    const CAmount nFees = view.GetValueIn(tx) - tx.GetValueOut();
+    if (!CheckLooseTxInputsPolicy(tx, statePolicy, view, pool, nFees, true /* fLimitFree */, false /* ignoreFees */, nSigOps)) {
+        return true;
+    }
+
+    // Check transaction contextually against consensus rules at block height.
+    // The shielded proofs are verified here, and cached for AcceptToMemoryPool.
+    if (!ContextualCheckTransaction(_tx, state, params, nextBlockHeight, false /* isMined */, fIBD)) {
+        return error("%s: ContextualCheckTransaction failed for %s", __func__, tx.GetHash().ToString());
+    }
+
+    // Check the input scripts, caching the valid signatures. A failure is
+    // reported by AcceptToMemoryPool, with the coins it sees.
+    PrecomputedTransactionData precomTxData(tx);
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        CScriptCheck check(view.AccessCoin(tx.vin[i].prevout).out, tx, i, flags, true /* cacheStore */, &precomTxData);
+        if (!check()) break;
+    }
+    return true;
+}
+
+/** Whether a transaction can be the fee (collateral) of a proposal or of a finalized budget (see CheckCollateral) */
+static bool IsBudgetFeeTx(const CTransaction& tx)
+{
+    for (const CTxOut& out : tx.vout) {
+        const CScript& script = out.scriptPubKey;
+        if (out.nValue >= BUDGET_FEE_TX && script.size() == 34 && script[0] == OP_RETURN && script[1] == 32) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GetSpentCoin(const COutPoint& outpoint, Coin& coin, int nMaxDepth)
+{
+    std::vector<const CBlockIndex*> vBlocks;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev && (int)vBlocks.size() < nMaxDepth; pindex = pindex->pprev) {
+            vBlocks.push_back(pindex);
+        }
+    }
+    for (const CBlockIndex* pindex : vBlocks) {
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockFromDisk(block, pindex) || !UndoReadFromDisk(blockundo, pindex)) {
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+        if (blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: block and undo data inconsistent", __func__);
+        }
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            const CTransaction& tx = *block.vtx[i];
+            // Zerocoin spends have no undo data
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (size_t j = 0; j < txundo.vprevout.size(); j++) {
+                if (tx.vin[j].prevout == outpoint) {
+                    coin = txundo.vprevout[j];
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
 bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state, CTxOut& out)
 {
     CTransactionRef txPrev;
@@ -695,9 +863,10 @@ bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state,
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransactionRef& txOut, uint256& hashBlock, bool fAllowSlow, CBlockIndex* blockIndex)
 {
-    CBlockIndex* pindexSlow = blockIndex;
-
-    LOCK(cs_main);
+    // cs_main is only held to locate the transaction: the disk reads and the
+    // deserialization are done without it, so that concurrent lookups (and
+    // block validation) don't wait for each other's I/O.
+    const CBlockIndex* pindexSlow = blockIndex;
 
     if (!blockIndex) {
 
@@ -707,37 +876,27 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, uint256& hashBl
             return true;
         }
 
-        if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (const std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut->GetHash() != hash)
-                    return error("%s : txid mismatch", __func__);
-                return true;
-            }
-
-            // transaction not found in the index, nothing more can be done
-            return false;
+        if (g_txindex && g_txindex->FindTx(hash, hashBlock, txOut)) {
+            return true;
         }
 
+        // The transaction index is updated in the background, so it can be
+        // behind the tip (or still being built): the transactions with unspent
+        // outputs are also looked up in the block they were found in.
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
+            LOCK(cs_main);
             const Coin& coin = AccessByTxid(*pcoinsTip, hash);
             if (!coin.IsSpent()) pindexSlow = chainActive[coin.nHeight];
         }
+
+        // The budget fee transactions are also kept in the block tree db (their block may be pruned)
+        if (fAllowSlow && !pindexSlow && pblocktree->ReadBudgetFeeTx(hash, txOut, hashBlock)) {
+            return true;
+        }
     }
 
     if (pindexSlow) {
+        // Takes cs_main only to read the block position
         CBlock block;
         if (ReadBlockFromDisk(block, pindexSlow)) {
             for (const auto& tx : block.vtx) {
@@ -1250,6 +1409,16 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const FlatFilePos& pos, const uint2
 
 } // anon namespace
 
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    // nStatus and nUndoPos are written under cs_main (the background indexers call this without it)
+    const FlatFilePos pos = WITH_LOCK(cs_main, return pindex->GetUndoPos(); );
+    if (pos.IsNull()) {
+        return error("%s: no undo data available", __func__);
+    }
+    return UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash());
+}
+
 enum DisconnectResult
 {
     DISCONNECT_OK,      // All good.
@@ -1294,8 +1463,9 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
- *  When FAILED is returned, view is left in an indeterminate state. */
-DisconnectResult DisconnectBlock(CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
+ *  When FAILED is returned, view is left in an indeterminate state.
+ *  The undo data read from disk is returned in pblockundoRet, if not null. */
+DisconnectResult DisconnectBlock(CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CBlockUndo* pblockundoRet = nullptr)
 {
     AssertLockHeld(cs_main);
 
@@ -1400,6 +1570,9 @@ DisconnectResult DisconnectBlock(CBlock& block, const CBlockIndex* pindex, CCoin
         DataBaseAccChecksum(pindex, false);
     }
 
+    if (pblockundoRet) {
+        *pblockundoRet = std::move(blockUndo);
+    }
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
@@ -1420,7 +1593,34 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState& state, int nFile, FlatFilePos& pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+/**
+ * A job of the -par threads: the script check of a transaction input, or the
+ * verification of the Sapling proofs and signatures of a batch of transactions.
+ * Both go through the same queue, so that they share the -par threads.
+ */
+class CBlockCheck
+{
+private:
+    CScriptCheck scriptCheck;
+    CSaplingCheck saplingCheck;
+    bool fSapling{false};
+
+public:
+    CBlockCheck() {}
+    explicit CBlockCheck(CScriptCheck& check) { scriptCheck.swap(check); }
+    explicit CBlockCheck(CSaplingCheck& check) : fSapling(true) { saplingCheck.swap(check); }
+
+    bool operator()() { return fSapling ? saplingCheck() : scriptCheck(); }
+
+    void swap(CBlockCheck& check)
+    {
+        scriptCheck.swap(check.scriptCheck);
+        saplingCheck.swap(check.saplingCheck);
+        std::swap(fSapling, check.fSapling);
+    }
+};
+
+static CCheckQueue<CBlockCheck> scriptcheckqueue(128);
 
 void ThreadScriptCheck()
 {
@@ -1436,8 +1636,9 @@ static int64_t nTimeTotal = 0;
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
- *  can fail if those validity checks fail (among other reasons). */
-static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck = false)
+ *  can fail if those validity checks fail (among other reasons).
+ *  The undo data of the block is returned in pblockundoRet, if not null. */
+static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck = false, CBlockUndo* pblockundoRet = nullptr)
 {
     AssertLockHeld(cs_main);
     // Check it again in case a previous version let a bad block in
@@ -1516,16 +1717,15 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         fCLTVIsActivated = consensus.NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_BIP65);
     }
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    // Sapling proofs are always verified (they are not covered by ContextualCheckBlock),
+    // scripts only with fScriptChecks.
+    CCheckQueueControl<CBlockCheck> control(nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
     int nInputs = 0;
     unsigned int nSigOps = 0;
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     std::vector<std::pair<CBigNum, uint256> > vSpends;
-    vPos.reserve(block.vtx.size());
     CBlockUndo blockundo;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     CAmount nValueOut = 0;
@@ -1537,6 +1737,37 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     SaplingMerkleTree sapling_tree;
     assert(view.GetSaplingAnchorAt(view.GetBestAnchor(), sapling_tree));
 
+    // Sapling: verify the spend/output proofs and the signatures, in (at most) one
+    // batch per -par thread. They don't depend on the UTXO set: they are queued
+    // before the script checks, so that every thread starts with one of them.
+    std::vector<const CTransaction*> vSaplingTxes;
+    if (isV5UpgradeEnforced) {
+        for (const CTransactionRef& tx : block.vtx) {
+            if (tx->hasSaplingData()) {
+                vSaplingTxes.emplace_back(tx.get());
+            }
+        }
+    }
+    std::vector<CSaplingCheck> vSaplingChecks;
+    if (!vSaplingTxes.empty()) {
+        const size_t nTxes = vSaplingTxes.size();
+        const size_t nJobs = std::min(nTxes, (size_t) std::max(nScriptCheckThreads, 1));
+        vSaplingChecks.reserve(nJobs);
+        for (size_t j = 0; j < nJobs; j++) {
+            std::vector<const CTransaction*> vtxJob(vSaplingTxes.begin() + nTxes * j / nJobs,
+                                                    vSaplingTxes.begin() + nTxes * (j + 1) / nJobs);
+            vSaplingChecks.emplace_back(std::move(vtxJob), 100, fJustCheck /* cacheStore */);
+        }
+        if (nScriptCheckThreads) {
+            std::vector<CBlockCheck> vChecks;
+            vChecks.reserve(nJobs);
+            for (CSaplingCheck& check : vSaplingChecks) {
+                vChecks.emplace_back(check);
+            }
+            control.Add(vChecks);
+        }
+    }
+
     std::vector<PrecomputedTransactionData> precomTxData;
     precomTxData.reserve(block.vtx.size()); // Required so that pointers to individual precomTxData don't get invalidated
     bool fInitialBlockDownload = IsInitialBlockDownload();
@@ -1596,16 +1827,24 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                 nFees += view.GetValueIn(tx) - tx.GetValueOut();
             nValueIn += view.GetValueIn(tx);
 
-            std::vector<CScriptCheck> vChecks;
+            std::vector<CScriptCheck> vScriptChecks;
             unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
             if (fCLTVIsActivated)
                 flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
 
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, precomTxData[i], nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, precomTxData[i], nScriptCheckThreads ? &vScriptChecks : NULL))
                 return error("%s: Check inputs on %s failed with %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
-            control.Add(vChecks);
+            if (!vScriptChecks.empty()) {
+                std::vector<CBlockCheck> vChecks;
+                vChecks.reserve(vScriptChecks.size());
+                for (CScriptCheck& check : vScriptChecks) {
+                    vChecks.emplace_back(check);
+                }
+                control.Add(vChecks);
+            }
         }
+
         nValueOut += tx.GetValueOut();
 
         CTxUndo undoDummy;
@@ -1621,9 +1860,12 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                 sapling_tree.append(outputDescription.cmu);
             }
         }
+    }
 
-        vPos.emplace_back(tx.GetHash(), pos);
-        pos.nTxOffset += ::GetSerializeSize(tx, CLIENT_VERSION);
+    // Without the -par threads, the Sapling proofs are verified here, in a single batch
+    if (!nScriptCheckThreads && !vSaplingChecks.empty() && !vSaplingChecks.back()()) {
+        state = vSaplingChecks.back().GetState();
+        return error("%s: Sapling proofs check failed with %s", __func__, FormatStateMessage(state));
     }
 
     // Push new tree anchor
@@ -1676,7 +1918,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     }
 
     if (!control.Wait())
-        return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+        return state.DoS(100, error("%s: CheckQueue failed (scripts or Sapling proofs)", __func__), REJECT_INVALID, "block-validation-failed");
     int64_t nTime2 = GetTimeMicros();
     nTimeVerify += nTime2 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs - 1), nTimeVerify * 0.000001);
@@ -1714,9 +1956,13 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     if (!vSpends.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpends))
         return AbortNode(state, "Failed to record coin serials to database");
 
-    if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
+    // Keep the budget fee transactions out of the block files, which may be pruned
+    std::vector<CTransactionRef> vBudgetFeeTxs;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (IsBudgetFeeTx(*tx)) vBudgetFeeTxs.push_back(tx);
+    }
+    if (!vBudgetFeeTxs.empty() && !pblocktree->WriteBudgetFeeTxs(vBudgetFeeTxs, pindex->GetBlockHash()))
+        return AbortNode(state, "Failed to record the budget fee transactions");
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -1740,6 +1986,9 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         invalid_out::setInvalidOutPoints.clear();
     }
 
+    if (pblockundoRet) {
+        *pblockundoRet = std::move(blockundo);
+    }
     return true;
 }
 
@@ -1748,15 +1997,31 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
  * fast is not set and it's been a while since the last write.
  * Full flush also updates the money supply from disk (except during shutdown)
+ *
+ * If we are in prune mode, block files that are no longer needed are deleted,
+ * once the block index entries referring to them have been written.
  */
 bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
     int64_t nMempoolUsage = mempool.DynamicMemoryUsage();
-    LOCK(cs_main);
+    LOCK2(cs_main, cs_LastBlockFile);
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try {
+        if (fPruneMode && fCheckForPruning && !fReindex) {
+            FindFilesToPrune(setFilesToPrune);
+            fCheckForPruning = false;
+            if (!setFilesToPrune.empty()) {
+                fFlushForPrune = true;
+                if (!fHavePruned) {
+                    pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
         int64_t nNow = GetTimeMicros();
         // Avoid writing/flushing immediately after startup.
         if (nLastWrite == 0) {
@@ -1784,7 +2049,7 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
         bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
         // Combine all conditions that result in a full cache flush.
-        bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush;
+        bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
         // Write blocks and block index to disk.
         if (fDoFullFlush || fPeriodicWrite) {
             // Depend on nMinDiskSpace to ensure we can write block index
@@ -1804,13 +2069,18 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                 std::vector<const CBlockIndex*> vBlocks;
                 vBlocks.reserve(setDirtyBlockIndex.size());
                 for (std::set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
-                    vBlocks.push_back(*it);
+                    // The unverified headers are written with their block (see ReceivedBlockTransactions)
+                    if (!IsUnverifiedPoSHeader(*it))
+                        vBlocks.push_back(*it);
                     setDirtyBlockIndex.erase(it++);
                 }
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                     return AbortNode(state, "Files to write to block index database");
                 }
             }
+            // Finally remove any pruned files
+            if (fFlushForPrune)
+                UnlinkPrunedFiles(setFilesToPrune);
             nLastWrite = nNow;
         }
 
@@ -1830,9 +2100,14 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             if (!evoDb->CommitRootTransaction()) {
                 return AbortNode(state, "Failed to commit EvoDB");
             }
+            // Then the coin statistics index, in sync with the chainstate
+            if (g_coin_stats_index && !g_coin_stats_index->Commit()) {
+                return AbortNode(state, "Failed to commit coin statistics index");
+            }
             nLastFlush = nNow;
             // Update money supply on memory, reading data from disk
-            if (!ShutdownRequested() && !IsInitialBlockDownload()) {
+            // (with the coin statistics index it is updated with every block instead)
+            if (!g_coin_stats_index && !ShutdownRequested() && !IsInitialBlockDownload()) {
                 MoneySupply.Update(pcoinsTip->GetTotalAmount(), chainActive.Height());
             }
         }
@@ -1854,6 +2129,13 @@ void FlushStateToDisk()
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush()
+{
+    CValidationState state;
+    fCheckForPruning = true;
+    FlushStateToDisk(state, FLUSH_STATE_NONE);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
@@ -1902,6 +2184,17 @@ void static UpdateTip(CBlockIndex* pindexNew)
     }
 }
 
+/** Update the coin statistics index, and the money supply, with a block connected to or disconnected from chainActive */
+static bool UpdateCoinStatsIndex(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo, bool fConnect)
+{
+    if (!(fConnect ? g_coin_stats_index->BlockConnected(block, pindex, blockundo) : g_coin_stats_index->BlockDisconnected(block, pindex, blockundo)))
+        return false;
+    int nHeight;
+    const CAmount nSupply = g_coin_stats_index->GetTotalAmount(nHeight);
+    MoneySupply.Update(nSupply, nHeight);
+    return true;
+}
+
 /** Disconnect chainActive's tip.
   * After calling, the mempool will be in an inconsistent state, with
   * transactions from disconnected blocks being added to disconnectpool.  You
@@ -1926,17 +2219,20 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
     // Apply the block atomically to the chain state.
     const uint256& saplingAnchorBeforeDisconnect = pcoinsTip->GetBestAnchor();
     int64_t nStart = GetTimeMicros();
+    CBlockUndo blockundo;
     {
         auto dbTx = evoDb->BeginTransaction();
 
         CCoinsViewCache view(pcoinsTip);
         assert(view.GetBestBlock() == pindexDelete->GetBlockHash());
-        if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK)
+        if (DisconnectBlock(block, pindexDelete, view, &blockundo) != DISCONNECT_OK)
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         bool flushed = view.Flush();
         assert(flushed);
         dbTx->Commit();
     }
+    if (g_coin_stats_index && !UpdateCoinStatsIndex(block, pindexDelete, blockundo, false))
+        return AbortNode(state, "Failed to write coin statistics index");
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     const uint256& saplingAnchorAfterDisconnect = pcoinsTip->GetBestAnchor();
     // Write the chain state to disk, if necessary.
@@ -2053,11 +2349,12 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const st
     nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    CBlockUndo blockundo;
     {
         auto dbTx = evoDb->BeginTransaction();
 
         CCoinsViewCache view(pcoinsTip);
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, false);
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, false, g_coin_stats_index ? &blockundo : nullptr);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2071,6 +2368,8 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const st
         assert(flushed);
         dbTx->Commit();
     }
+    if (g_coin_stats_index && !UpdateCoinStatsIndex(blockConnecting, pindexNew, blockundo, true))
+        return AbortNode(state, "Failed to write coin statistics index");
     int64_t nTime4 = GetTimeMicros();
     nTimeFlush += nTime4 - nTime3;
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
@@ -2446,6 +2745,22 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
+/** Compute the stake modifier of a new block index entry. It depends on the
+ *  ancestors' modifiers and, after v3.4, on the coinstake input: it can only
+ *  be set once the block transactions are available. */
+static void SetBlockIndexStakeModifier(CBlockIndex* pindexNew, const CBlock& block)
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    if (!consensus.NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_V3_4)) {
+        // compute and set new V1 stake modifier (entropy bits)
+        pindexNew->SetNewStakeModifier();
+
+    } else {
+        // compute and set new V2 stake modifier (hash of prevout and prevModifier)
+        pindexNew->SetNewStakeModifier(block.vtx[1]->vin[0].prevout.hash);
+    }
+}
+
 CBlockIndex* AddToBlockIndex(const CBlock& block)
 {
     // Check for duplicate
@@ -2470,15 +2785,10 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
 
-        const Consensus::Params& consensus = Params().GetConsensus();
-        if (!consensus.NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_V3_4)) {
-            // compute and set new V1 stake modifier (entropy bits)
-            pindexNew->SetNewStakeModifier();
-
-        } else {
-            // compute and set new V2 stake modifier (hash of prevout and prevModifier)
-            pindexNew->SetNewStakeModifier(block.vtx[1]->vin[0].prevout.hash);
-        }
+        // Entries created from a header alone (headers-first sync) get their
+        // stake modifier from AcceptBlock, once the transactions are known.
+        if (!block.vtx.empty())
+            SetBlockIndexStakeModifier(pindexNew, block);
     }
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
@@ -2594,11 +2904,13 @@ bool FindBlockPos(CValidationState& state, FlatFilePos& pos, unsigned int nAddSi
 
     if (!fKnown) {
         bool out_of_space;
-        BlockFileSeq().Allocate(pos, nAddSize, out_of_space);
+        size_t bytes_allocated = BlockFileSeq().Allocate(pos, nAddSize, out_of_space);
         if (out_of_space) {
             return AbortNode("Disk space is low!", _("Error: Disk space is low!"));
         }
-        // future: add prunning flag check
+        if (bytes_allocated != 0 && fPruneMode) {
+            fCheckForPruning = true;
+        }
     }
 
     setDirtyFileInfo.insert(nFile);
@@ -2616,11 +2928,13 @@ bool FindUndoPos(CValidationState& state, int nFile, FlatFilePos& pos, unsigned
     setDirtyFileInfo.insert(nFile);
 
     bool out_of_space;
-    UndoFileSeq().Allocate(pos, nAddSize, out_of_space);
+    size_t bytes_allocated = UndoFileSeq().Allocate(pos, nAddSize, out_of_space);
     if (out_of_space) {
         return AbortNode(state, "Disk space is low!", _("Error: Disk space is low!"));
     }
-    // future: add prunning flag check
+    if (bytes_allocated != 0 && fPruneMode) {
+        fCheckForPruning = true;
+    }
 
     return true;
 }
@@ -2970,8 +3284,9 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     // Check that all transactions are finalized
     for (const auto& tx : block.vtx) {
 
-        // Check transaction contextually against consensus rules at block height
-        if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, IsInitialBlockDownload())) {
+        // Check transaction contextually against consensus rules at block height.
+        // Sapling proofs are verified in parallel by ConnectBlock (see CSaplingCheck).
+        if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, IsInitialBlockDownload(), false /* fCheckProofs */)) {
             return false;
         }
 
@@ -3060,7 +3375,72 @@ bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex
     return true;
 }
 
-static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockIndex** ppindex, const FlatFilePos* dbp)
+bool IsUnverifiedPoSHeader(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    // nTx is kept when the block is pruned
+    if (pindex->nTx != 0 || !Params().GetConsensus().NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_POS))
+        return false;
+    const CBlockIndex* pcheckpoint = Checkpoints::GetLastCheckpoint();
+    return !pcheckpoint || pindex->nHeight > pcheckpoint->nHeight;
+}
+
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, CBlockIndex** ppindex,
+                            std::vector<const CBlockIndex*>* pvUnverifiedPoS)
+{
+    LOCK(cs_main);
+    const Consensus::Params& consensus = Params().GetConsensus();
+    if (pvUnverifiedPoS) {
+        // The blocks received (or invalid) since don't count anymore
+        pvUnverifiedPoS->erase(std::remove_if(pvUnverifiedPoS->begin(), pvUnverifiedPoS->end(), [](const CBlockIndex* pindex) {
+            return !IsUnverifiedPoSHeader(pindex) || (pindex->nStatus & BLOCK_FAILED_MASK);
+        }), pvUnverifiedPoS->end());
+    }
+    for (const CBlockHeader& header : headers) {
+        // A header alone can't tell a PoS block from a PoW one: only the
+        // difficulty (and, before the PoS upgrade, the proof of work itself)
+        // is checked here. The proof of stake is checked with the block.
+        const CBlock block(header);
+        CBlockIndex* pindexPrev = nullptr;
+        if (!GetPrevIndex(block, &pindexPrev, state))
+            return false;
+        bool fUnverifiedPoS = false;
+        if (!mapBlockIndex.count(block.GetHash()) && pindexPrev) {
+            const int nHeight = pindexPrev->nHeight + 1;
+            // A proof of stake header costs nothing to forge: past the last checkpoint,
+            // don't let it get too far ahead of the blocks actually checked, and don't
+            // take too many of them from the same peer.
+            const CBlockIndex* pcheckpoint = Checkpoints::GetLastCheckpoint();
+            fUnverifiedPoS = consensus.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_POS) &&
+                             (!pcheckpoint || nHeight > pcheckpoint->nHeight);
+            if (fUnverifiedPoS && nHeight - chainActive.FindFork(pindexPrev)->nHeight > MAX_UNVERIFIED_POS_HEADERS) {
+                LogPrint(BCLog::NET, "%s : header %s at height %d too far ahead of the active chain, skipping\n",
+                         __func__, block.GetHash().GetHex(), nHeight);
+                break;
+            }
+            if (fUnverifiedPoS && pvUnverifiedPoS && pvUnverifiedPoS->size() >= MAX_UNVERIFIED_POS_HEADERS_PER_PEER)
+                return state.DoS(20, error("%s : too many unverified proof of stake headers, at header %s", __func__, block.GetHash().GetHex()),
+                                 REJECT_INVALID, "too-many-pos-headers");
+            if (!consensus.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_POS) &&
+                    !CheckProofOfWork(block.GetHash(), block.nBits))
+                return state.DoS(50, error("%s : proof of work failed for header %s", __func__, block.GetHash().GetHex()),
+                                 REJECT_INVALID, "high-hash");
+            if (!CheckWork(block, pindexPrev))
+                return state.DoS(100, error("%s : incorrect difficulty for header %s", __func__, block.GetHash().GetHex()),
+                                 REJECT_INVALID, "bad-diffbits");
+        }
+        CBlockIndex* pindex = nullptr;
+        if (!AcceptBlockHeader(block, state, &pindex, pindexPrev))
+            return false;
+        if (fUnverifiedPoS && pvUnverifiedPoS)
+            pvUnverifiedPoS->push_back(pindex);
+        if (ppindex)
+            *ppindex = pindex;
+    }
+    return true;
+}
+
+static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockIndex** ppindex, const FlatFilePos* dbp, bool fRequested)
 {
     AssertLockHeld(cs_main);
 
@@ -3084,6 +3464,10 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
             return state.DoS(100, error("%s: proof of stake check failed (%s)", __func__, strError));
     }
 
+    // Whether the header was already in the block index (e.g. received
+    // during headers-first sync) without the stake data.
+    const bool fKnownHeader = mapBlockIndex.count(block.GetHash());
+
     if (!AcceptBlockHeader(block, state, &pindex, pindexPrev))
         return false;
 
@@ -3094,6 +3478,14 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
         return true;
     }
 
+    // This is a previously-processed block that was pruned. Unless it was requested,
+    // processing it again would only store data below the pruning depth, that would
+    // be deleted again.
+    if (pindex->nTx != 0 && !fRequested) {
+        LogPrint(BCLog::PRUNE, "AcceptBlock() : ignoring pruned block %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+        return true;
+    }
+
     if (!CheckBlock(block, state) || !ContextualCheckBlock(block, state, pindex->pprev)) {
         if (state.IsInvalid() && !state.CorruptionPossible()) {
             pindex->nStatus |= BLOCK_FAILED_VALID;
@@ -3102,6 +3494,16 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
         return error("%s: %s", __func__, FormatStateMessage(state));
     }
 
+    // The entry created from the header alone doesn't know yet whether the block
+    // is proof of stake: set it with the stake modifier (the V1 modifiers of the
+    // next blocks select on it).
+    if (fKnownHeader && pindex->pprev) {
+        if (isPoS)
+            pindex->SetProofOfStake();
+        SetBlockIndexStakeModifier(pindex, block);
+        setDirtyBlockIndex.insert(pindex);
+    }
+
     int nHeight = pindex->nHeight;
     int splitHeight = -1;
 
@@ -3307,7 +3709,7 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
     return true;
 }
 
-bool ProcessNewBlock(CValidationState& state, const std::shared_ptr<const CBlock> pblock, const FlatFilePos* dbp, bool* fAccepted)
+bool ProcessNewBlock(CValidationState& state, const std::shared_ptr<const CBlock> pblock, const FlatFilePos* dbp, bool* fAccepted, bool fRequested)
 {
     AssertLockNotHeld(cs_main);
 
@@ -3324,7 +3726,7 @@ bool ProcessNewBlock(CValidationState& state, const std::shared_ptr<const CBlock
 
         // Store to disk
         CBlockIndex* pindex = nullptr;
-        bool ret = AcceptBlock(*pblock, state, &pindex, dbp);
+        bool ret = AcceptBlock(*pblock, state, &pindex, dbp, fRequested);
         if (fAccepted) *fAccepted = ret;
         CheckBlockIndex();
         if (!ret) {
@@ -3381,6 +3783,125 @@ bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex
     return true;
 }
 
+void PruneOneBlockFile(const int fileNumber)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_LastBlockFile);
+
+    for (const auto& entry : mapBlockIndex) {
+        CBlockIndex* pindex = entry.second;
+        if (pindex->nFile == fileNumber) {
+            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nFile = 0;
+            pindex->nDataPos = 0;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+
+            // Prune from mapBlocksUnlinked -- any block we prune would have
+            // to be downloaded again in order to consider its chain, at which
+            // point it would be considered as a candidate for
+            // mapBlocksUnlinked or setBlockIndexCandidates.
+            auto range = mapBlocksUnlinked.equal_range(pindex->pprev);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
+                range.first++;
+                if (it->second == pindex) {
+                    mapBlocksUnlinked.erase(it);
+                }
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+}
+
+void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
+{
+    for (const int nFile : setFilesToPrune) {
+        FlatFilePos pos(nFile, 0);
+        fs::remove(BlockFileSeq().FileName(pos));
+        fs::remove(UndoFileSeq().FileName(pos));
+        LogPrint(BCLog::PRUNE, "Prune: %s deleted blk/rev (%05u)\n", __func__, nFile);
+    }
+}
+
+unsigned int GetMinBlocksToKeep()
+{
+    return std::max(MIN_BLOCKS_TO_KEEP, (unsigned int)gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH));
+}
+
+/**
+ * Calculate the block/rev files that should be deleted to remain under target.
+ * Block files containing a block within GetMinBlocksToKeep() of the tip, and the
+ * current block file, are never pruned.
+ */
+static void FindFilesToPrune(std::set<int>& setFilesToPrune)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_LastBlockFile);
+
+    if (chainActive.Tip() == nullptr || nPruneTarget == 0) {
+        return;
+    }
+    if ((uint64_t)chainActive.Height() <= Params().PruneAfterHeight()) {
+        return;
+    }
+
+    const unsigned int nMinBlocksToKeep = GetMinBlocksToKeep();
+    if ((unsigned int)chainActive.Height() <= nMinBlocksToKeep) {
+        return;
+    }
+
+    const unsigned int nLastBlockWeCanPrune = chainActive.Height() - nMinBlocksToKeep;
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // We don't check to prune until after we've allocated new space for files,
+    // so we should leave a buffer under our target to account for another
+    // allocation before the next pruning.
+    const uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    int count = 0;
+
+    if (nCurrentUsage + nBuffer >= nPruneTarget) {
+        for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+            const uint64_t nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
+
+            if (vinfoBlockFile[fileNumber].nSize == 0)
+                continue;
+
+            // are we below our target?
+            if (nCurrentUsage + nBuffer < nPruneTarget)
+                break;
+
+            // don't prune files that could have a block within GetMinBlocksToKeep() of the main chain's tip but keep scanning
+            if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+                continue;
+
+            PruneOneBlockFile(fileNumber);
+            // Queue up the files for removal
+            setFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= nBytesToPrune;
+            count++;
+        }
+    }
+
+    LogPrint(BCLog::PRUNE, "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+             nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024,
+             ((int64_t)nPruneTarget - (int64_t)nCurrentUsage) / 1024 / 1024,
+             nLastBlockWeCanPrune, count);
+}
+
+uint64_t CalculateCurrentUsage()
+{
+    LOCK(cs_LastBlockFile);
+
+    uint64_t retval = 0;
+    for (const CBlockFileInfo& file : vinfoBlockFile) {
+        retval += file.nSize + file.nUndoSize;
+    }
+    return retval;
+}
+
 static FlatFileSeq BlockFileSeq()
 {
     return FlatFileSeq(GetBlocksDir(), "blk", BLOCKFILE_CHUNK_SIZE);
@@ -3449,7 +3970,9 @@ bool static LoadBlockIndexDB(std::string& strError)
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        // We can link the chain of blocks for which we've received transactions at some point.
+        // Pruned nodes may have deleted the block.
+        if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3497,6 +4020,11 @@ bool static LoadBlockIndexDB(std::string& strError)
         }
     }
 
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
     std::set<int> setBlkDataFiles;
@@ -3523,10 +4051,6 @@ bool static LoadBlockIndexDB(std::string& strError)
     pblocktree->ReadReindexing(fReindexing);
     if (fReindexing) fReindex = true;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
-
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -3614,6 +4138,11 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone);
         if (pindex->nHeight < chainHeight - nCheckDepth)
             break;
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, only go back as far as we have data.
+            LogPrintf("%s: block verification stopping at height %d (pruning, no data)\n", __func__, pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex))
@@ -3812,9 +4341,6 @@ bool LoadBlockIndex(std::string& strError)
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
-        // Use the provided setting for -txindex in the new database
-        fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
-        pblocktree->WriteFlag("txindex", fTxIndex);
     }
     return true;
 }
@@ -3990,6 +4516,7 @@ void static CheckBlockIndex()
     int nHeight = 0;
     CBlockIndex* pindexFirstInvalid = NULL;         // Oldest ancestor of pindex which is invalid.
     CBlockIndex* pindexFirstMissing = NULL;         // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL;  // Oldest ancestor of pindex for which nTx == 0.
     CBlockIndex* pindexFirstNotTreeValid = NULL;    // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL;   // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
@@ -3997,6 +4524,7 @@ void static CheckBlockIndex()
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
@@ -4007,12 +4535,21 @@ void static CheckBlockIndex()
             assert(pindex->GetBlockHash() == Params().GetConsensus().hashGenesisBlock); // Genesis block's hash must match.
             assert(pindex == chainActive.Genesis());                       // The current active chain's genesis block must be this block.
         }
-        // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
-        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
+        // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
+        // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
+        if (!fHavePruned) {
+            // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        } else {
+            // If we have pruned, then we can only say that HAVE_DATA implies nTx > 0
+            if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
+        }
+        if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
+        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));       // This is pruning-independent.
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
-        // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // All parents having had data (at some point) is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0));                                      // nChainTx != 0 is used to signal that all parent blocks have been processed (but may have been pruned).
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
@@ -4024,11 +4561,20 @@ void static CheckBlockIndex()
             // Checks for not-invalid blocks.
             assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
         }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstMissing == NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates.
-                assert(setBlockIndexCandidates.count(pindex));
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
+            if (pindexFirstInvalid == NULL) {
+                // If this block sorts at least as good as the current tip and
+                // is valid and we have all data for its parents, it must be in
+                // setBlockIndexCandidates. chainActive.Tip() must also be there
+                // even if some data has been pruned.
+                if (pindexFirstMissing == NULL || pindex == chainActive.Tip()) {
+                    assert(setBlockIndexCandidates.count(pindex));
+                }
+                // If some parent is missing, then it could be that this block was in
+                // setBlockIndexCandidates but had to be removed because of the missing data.
+                // In this case it must be in mapBlocksUnlinked -- see test below.
             }
-        } else { // If this block sorts worse than the current tip, it cannot be in setBlockIndexCandidates.
+        } else { // If this block sorts worse than the current tip or some ancestor's block has never been seen, it cannot be in setBlockIndexCandidates.
             assert(setBlockIndexCandidates.count(pindex) == 0);
         }
         // Check whether this block is in mapBlocksUnlinked.
@@ -4042,12 +4588,28 @@ void static CheckBlockIndex()
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstMissing != NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent doesn't, and has no invalid parents, it must be in mapBlocksUnlinked.
-                assert(foundInUnlinked);
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed != NULL && pindexFirstInvalid == NULL) {
+            // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
+            assert(foundInUnlinked);
+        }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) assert(!foundInUnlinked); // Can't be in mapBlocksUnlinked if we don't HAVE_DATA
+        if (pindexFirstMissing == NULL) assert(!foundInUnlinked);          // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed == NULL && pindexFirstMissing != NULL) {
+            // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently missing data for some parent.
+            assert(fHavePruned); // We must have pruned.
+            // This block may have entered mapBlocksUnlinked if:
+            //  - it has a descendant that at some point had more work than the
+            //    tip, and
+            //  - we tried switching to that descendant but were missing
+            //    data for some intermediate block between chainActive and the
+            //    tip.
+            // So if this block is itself better than chainActive.Tip() and it wasn't in
+            // setBlockIndexCandidates, then it must be in mapBlocksUnlinked.
+            if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && setBlockIndexCandidates.count(pindex) == 0) {
+                if (pindexFirstInvalid == NULL) {
+                    assert(foundInUnlinked);
+                }
             }
-        } else { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
-            assert(!foundInUnlinked);
         }
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
         // End: actual consistency checks.
@@ -4067,6 +4629,7 @@ void static CheckBlockIndex()
             // If pindex was the first with a certain property, unset the corresponding variable.
             if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
             if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
             if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
@@ -39,6 +39,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CBudgetManager;
 class CZerocoinDB;
 class CSporkDB;
@@ -66,6 +67,12 @@ static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
 /** Default for -txindex */
 static const bool DEFAULT_TXINDEX = true;
+/** Default for -coinstatsindex */
+static const bool DEFAULT_COINSTATSINDEX = false;
+/** Default for -addressindex */
+static const bool DEFAULT_ADDRESSINDEX = false;
+/** Default for -blockfilterindex */
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 /** The maximum size for transactions we're willing to relay/mine */
 static const unsigned int MAX_STANDARD_TX_SIZE = 100000;
@@ -81,6 +88,15 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned.
+ *  Must stay well above the maximum reorg depth, as disconnecting a block needs its block and undo data. */
+static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/** Number of blocks from the tip kept by pruning: MIN_BLOCKS_TO_KEEP, and at least the max reorg
+ *  depth (the stake of fork blocks, spent in the active chain, is read from the undo data). */
+unsigned int GetMinBlocksToKeep();
+/** Minimum disk space (in bytes) allowed for -prune: room for MIN_BLOCKS_TO_KEEP blocks with their undo
+ *  data, plus one full block file (and its undo data), as pruning works in whole-file chunks. */
+static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
@@ -97,6 +113,12 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Maximum number of proof of stake headers, past the last checkpoint, accepted ahead of the
+ *  active chain: only their difficulty can be checked until the block is received. */
+static const int MAX_UNVERIFIED_POS_HEADERS = 2 * MAX_HEADERS_RESULTS;
+/** Maximum number of unverified proof of stake headers (see IsUnverifiedPoSHeader) accepted from
+ *  a single peer: the ones of other forks count too, so this is above MAX_UNVERIFIED_POS_HEADERS. */
+static const size_t MAX_UNVERIFIED_POS_HEADERS_PER_PEER = 2 * MAX_UNVERIFIED_POS_HEADERS;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -111,6 +133,8 @@ static const unsigned int AVG_ADDRESS_BROADCAST_INTERVAL = 30;
 static const unsigned int DEFAULT_SHIELDEDTXFEE_K = 100;
 /** Enable bloom filter */
  static const bool DEFAULT_PEERBLOOMFILTERS = true;
+/** Default for -peerblockfilters, serve the compact block filters (BIP 157) to the peers */
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
 /** If the tip is older than this (in seconds), the node is considered to be in initial block download. */
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 /** Maximum age of our tip in seconds for us to be considered current for fee estimation */
@@ -138,10 +162,15 @@ extern int64_t g_best_block_time;
 extern std::atomic<bool> fImporting;
 extern std::atomic<bool> fReindex;
 extern int nScriptCheckThreads;
-extern bool fTxIndex;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern size_t nCoinCacheUsage;
+/** True if any block files have ever been pruned. */
+extern bool fHavePruned;
+/** True if we're running in -prune mode. */
+extern bool fPruneMode;
+/** Number of bytes of block and undo files that we're trying to stay below. */
+extern uint64_t nPruneTarget;
 extern CFeeRate minRelayTxFee;
 extern int64_t nMaxTipAge;
 
@@ -165,9 +194,10 @@ extern CBlockIndex* pindexBestHeader;
  * @param[in]   pblock     The block we want to process.
  * @param[out]  dbp        The already known disk position of pblock, or nullptr if not yet stored.
  * @param[out]  fAccepted  Whether the block is accepted or not
+ * @param[in]   fRequested Whether the block was requested: an unrequested block already processed, and then pruned, is not stored again
  * @return True if state.IsValid()
  */
-bool ProcessNewBlock(CValidationState& state, const std::shared_ptr<const CBlock> pblock, const FlatFilePos* dbp, bool* fAccepted = nullptr);
+bool ProcessNewBlock(CValidationState& state, const std::shared_ptr<const CBlock> pblock, const FlatFilePos* dbp, bool* fAccepted = nullptr, bool fRequested = true);
 
 /** Open a block file (blk?????.dat) */
 FILE* OpenBlockFile(const FlatFilePos& pos, bool fReadOnly = false);
@@ -193,10 +223,12 @@ void ThreadScriptCheck();
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
-/** Retrieve a transaction (from memory pool, or from disk, if possible) */
+/** Retrieve a transaction (from memory pool, or from disk, if possible). cs_main is not held during disk reads. */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, uint256& hashBlock, bool fAllowSlow = false, CBlockIndex* blockIndex = nullptr);
 /** Retrieve an output (from memory pool, or from disk, if possible) */
 bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state, CTxOut& out);
+/** Find an output spent by one of the last nMaxDepth blocks of the active chain, in their undo data */
+bool GetSpentCoin(const COutPoint& outpoint, Coin& coin, int nMaxDepth);
 
 double ConvertBitsToDouble(unsigned int nBits);
 int64_t GetMasternodePayment();
@@ -209,6 +241,18 @@ CAmount GetBlockValue(int nHeight);
 CBlockIndex* InsertBlockIndex(uint256 hash);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Prune block files and flush state to disk. */
+void PruneAndFlush();
+
+/** Calculate the amount of disk space the block & undo files currently use */
+uint64_t CalculateCurrentUsage();
+/**
+ *  Mark one block file as pruned: clear the data and undo flags of the block index
+ *  entries stored in it, and reset its file info.
+ */
+void PruneOneBlockFile(const int fileNumber);
+/** Actually unlink the specified files */
+void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 
 
 /** (try to) add transaction to memory pool **/
@@ -219,6 +263,18 @@ bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const
                                 bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit = false,
                                 bool fRejectInsaneFee = false, bool ignoreFees = false);
 
+/**
+ * Run the expensive checks of a mempool candidate before cs_main is locked for AcceptToMemoryPool:
+ * the context-free checks, the Sapling proofs and signatures (kept in the shielded proofs cache)
+ * and the input scripts (kept in the signature cache). cs_main is only locked briefly, to get the
+ * chain height and the coins spent. AcceptToMemoryPool then finds the results in the caches.
+ * The proofs and scripts are only verified for the transactions that pass the cheap checks of
+ * AcceptToMemoryPool (inputs available, no mempool conflict, standardness, minimum fee).
+ * Returns false, with the state AcceptToMemoryPool would set, if the transaction fails the
+ * context-free or the contextual checks. The other failures are left to AcceptToMemoryPool.
+ */
+bool PreVerifyMempoolTx(CTxMemPool& pool, CValidationState& state, const CTransactionRef& tx);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -317,6 +373,7 @@ public:
 bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos);
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -334,6 +391,29 @@ bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex
 
 bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex** ppindex = nullptr, CBlockIndex* pindexPrev = nullptr);
 
+/** Whether a block index entry was created from a proof of stake header alone, past the last
+ *  checkpoint: only its difficulty was checked, until its block is received. These entries are
+ *  kept in memory only: they are written to the block tree DB with their block (with cs_main held). */
+bool IsUnverifiedPoSHeader(const CBlockIndex* pindex);
+
+/**
+ * Process incoming block headers (headers-first sync): each one must connect
+ * to a known block. The block index entries are created without the block data.
+ * Proof of stake headers past the last checkpoint are only accepted up to
+ * MAX_UNVERIFIED_POS_HEADERS ahead of the active chain: the remaining headers
+ * are skipped, and must be requested again once the blocks are connected.
+ *
+ * @param[out]     state           The state of the first invalid header, if any.
+ * @param[out]     ppindex         The block index entry of the last header accepted.
+ * @param[in,out]  pvUnverifiedPoS The unverified proof of stake headers accepted from the peer
+ *                                 sending these: the new ones are added, and the ones verified
+ *                                 since are removed. Going over MAX_UNVERIFIED_POS_HEADERS_PER_PEER
+ *                                 is invalid.
+ * @return True if all the headers were valid.
+ */
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, CBlockIndex** ppindex = nullptr,
+                            std::vector<const CBlockIndex*>* pvUnverifiedPoS = nullptr);
+
 
 /** RAII wrapper for VerifyDB: Verify consistency of the block and coin databases */
 class CVerifyDB
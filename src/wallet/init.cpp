@@ -89,6 +89,10 @@ bool WalletParameterInteraction()
         }
     }
 
+    if (gArgs.GetArg("-prune", 0) > 0 && gArgs.GetBoolArg("-rescan", false)) {
+        return UIError(strprintf(_("Rescans are not possible in pruned mode. You will need to use %s which will download the whole blockchain again."), "-reindex"));
+    }
+
     if (is_multiwallet) {
         if (gArgs.GetBoolArg("-upgradewallet", false)) {
             return UIError(strprintf(_("%s is only allowed with a single wallet file"), "-upgradewallet"));
@@ -4678,6 +4678,17 @@ UniValue rescanblockchain(const JSONRPCRequest& request)
                 throw JSONRPCError(RPC_INVALID_PARAMETER, "stop_height must be greater then start_height");
             }
         }
+
+        // We can't rescan beyond non-pruned blocks, stop and throw an error
+        if (fPruneMode) {
+            CBlockIndex* block = pindexStop ? pindexStop : pChainTip;
+            while (block && block->nHeight >= pindexStart->nHeight) {
+                if (!(block->nStatus & BLOCK_HAVE_DATA)) {
+                    throw JSONRPCError(RPC_MISC_ERROR, "Can't rescan beyond pruned data. Use RPC call getblockchaininfo to determine your pruned height.");
+                }
+                block = block->pprev;
+            }
+        }
     }
 
     CBlockIndex *stopBlock = pwallet->ScanForWalletTransactions(pindexStart, pindexStop, reserver, true);
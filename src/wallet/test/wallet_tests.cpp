@@ -396,6 +396,109 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
     }
 }
 
+// Verify the blocks of a rescan are prefetched in chain order, that the blocks which
+// can't be read are returned as such, and that the prefetcher stops when its blocks
+// are disconnected, or when it is destroyed with blocks still queued.
+BOOST_FIXTURE_TEST_CASE(rescan_prefetcher, TestChain100Setup)
+{
+    CWallet wallet;
+    CBlockIndex* const pindexGenesis = WITH_LOCK(cs_main, return chainActive.Genesis(); );
+    CBlockIndex* const pindexTip = WITH_LOCK(cs_main, return chainActive.Tip(); );
+    BOOST_CHECK_EQUAL(pindexTip->nHeight, 100);
+
+    // In order, with a block that can't be read
+    {
+        CBlockIndex* const pindexBad = WITH_LOCK(cs_main, return chainActive[50]; );
+        const unsigned int nDataPos = pindexBad->nDataPos;
+        WITH_LOCK(cs_main, pindexBad->nDataPos = std::numeric_limits<unsigned int>::max(); );
+        RescanBlockPrefetcher prefetcher(&wallet, pindexGenesis, pindexTip, 4);
+        RescanBlockPrefetcher::PrefetchedBlock fetched;
+        int nHeight = 0;
+        while (prefetcher.Next(fetched)) {
+            BOOST_CHECK_EQUAL(fetched.pindex->nHeight, nHeight);
+            BOOST_CHECK_EQUAL(fetched.fRead, fetched.pindex != pindexBad);
+            if (fetched.fRead) {
+                BOOST_CHECK(fetched.block.GetHash() == fetched.pindex->GetBlockHash());
+            }
+            nHeight++;
+        }
+        BOOST_CHECK_EQUAL(nHeight, 101);
+        WITH_LOCK(cs_main, pindexBad->nDataPos = nDataPos; );
+    }
+
+    // Up to pindexStop only, destroyed before the end
+    {
+        CBlockIndex* const pindexStop = WITH_LOCK(cs_main, return chainActive[60]; );
+        RescanBlockPrefetcher prefetcher(&wallet, pindexGenesis, pindexStop, 4);
+        RescanBlockPrefetcher::PrefetchedBlock fetched;
+        int nHeight = 0;
+        while (prefetcher.Next(fetched)) {
+            BOOST_CHECK_EQUAL(fetched.pindex->nHeight, nHeight++);
+            BOOST_CHECK(fetched.fRead);
+        }
+        BOOST_CHECK_EQUAL(nHeight, 61);
+
+        RescanBlockPrefetcher prefetcherBreak(&wallet, pindexGenesis, pindexStop, 4);
+        BOOST_CHECK(prefetcherBreak.Next(fetched));
+        BOOST_CHECK_EQUAL(fetched.pindex->nHeight, 0);
+    }
+
+    // Blocks disconnected during the rescan: the ones already queued are returned,
+    // no longer in the active chain, then it stops.
+    {
+        RescanBlockPrefetcher prefetcher(&wallet, pindexGenesis, nullptr, 4);
+        RescanBlockPrefetcher::PrefetchedBlock fetched;
+        int nHeight = 0;
+        while (nHeight < 10 && prefetcher.Next(fetched)) {
+            BOOST_CHECK_EQUAL(fetched.pindex->nHeight, nHeight++);
+        }
+        CBlockIndex* const pindexFork = WITH_LOCK(cs_main, return chainActive[20]; );
+        CValidationState state;
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(InvalidateBlock(state, Params(), pindexFork));
+            BOOST_CHECK_EQUAL(chainActive.Height(), 19);
+        }
+        while (prefetcher.Next(fetched)) {
+            BOOST_CHECK_EQUAL(fetched.pindex->nHeight, nHeight++);
+            BOOST_CHECK(fetched.fRead);
+            BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return chainActive.Contains(fetched.pindex); ), fetched.pindex->nHeight < 20);
+        }
+        BOOST_CHECK(nHeight > 20 && nHeight <= 10 + (int)RESCAN_PREFETCH_BLOCKS);
+
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(ReconsiderBlock(state, pindexFork));
+        }
+        BOOST_CHECK(ActivateBestChain(state));
+        BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Tip(); ) == pindexTip);
+    }
+}
+
+// Verify a rescan stops at the next block once it is aborted.
+BOOST_FIXTURE_TEST_CASE(rescan_abort, TestChain100Setup)
+{
+    CBlockIndex* const pindexGenesis = WITH_LOCK(cs_main, return chainActive.Genesis(); );
+    CBlockIndex* const pindexTip = WITH_LOCK(cs_main, return chainActive.Tip(); );
+
+    CWallet wallet;
+    WITH_LOCK(wallet.cs_wallet, wallet.SetLastBlockProcessed(pindexTip); );
+    AddKey(wallet, coinbaseKey);
+
+    // Abort once the coinbase of the tenth block is added
+    int nAdded = 0;
+    wallet.NotifyTransactionChanged.connect([&](CWallet* pwallet, const uint256& hashTx, ChangeType status) {
+        if (status == CT_NEW && ++nAdded == 10) pwallet->AbortRescan();
+    });
+
+    WalletRescanReserver reserver(&wallet);
+    reserver.reserve();
+    BOOST_CHECK(wallet.ScanForWalletTransactions(pindexGenesis, nullptr, reserver) == nullptr);
+    BOOST_CHECK(wallet.IsAbortingRescan());
+    BOOST_CHECK_EQUAL(nAdded, 10);
+    BOOST_CHECK_EQUAL(WITH_LOCK(wallet.cs_wallet, return wallet.mapWallet.size(); ), 10);
+}
+
 // Verify importwallet RPC starts rescan at earliest block with timestamp
 // greater or equal than key birthday. Previously there was a bug where
 // importwallet RPC would start the scan at the latest block with timestamp less
@@ -486,6 +589,7 @@ CBlockIndex* SimpleFakeMine(CWalletTx& wtx, CWallet &wallet, CBlockIndex* pprev
     wtx.m_confirm = CWalletTx::Confirmation(CWalletTx::Status::CONFIRMED, fakeIndex->nHeight, fakeIndex->GetBlockHash(), 0);
     removeTxFromMempool(wtx);
     wtx.fInMempool = false;
+    wtx.MarkDirty();
     return fakeIndex;
 }
 
@@ -542,6 +646,7 @@ void CheckBalances(const CWalletTx& tx,
  * 2) CWalletTx::GetDebit.
  * 4) CWalletTx::GetAvailableCredit
  * 3) CWallet::GetUnconfirmedBalance.
+ * 5) CWallet balances (GetAvailableBalance, GetLockedCoins).
  */
 BOOST_AUTO_TEST_CASE(cached_balances_tests)
 {
@@ -563,6 +668,13 @@ BOOST_AUTO_TEST_CASE(cached_balances_tests)
     // * debitTx.GetDebit(ISMINE_SPENDABLE) correctness (must be equal to 'nCredit' / 2) + must be cached.
     // * debitTx.GetAvailableCredit() correctness (must be 0).
 
+    // 4) Lock and unlock one of the outputs of the confirmed tx and verify:
+    // * wallet.GetLockedCoins() correctness (must be refreshed after each change)
+
+    // 5) After the spend, verify:
+    // * wallet.GetAvailableBalance() correctness (balance index refreshed, must be 'nCredit' / 2)
+    // * wallet.AvailableCoins() correctness (only the unspent output of the credit tx is returned)
+
     CAmount nCredit = 20 * COIN;
 
     // Setup wallet
@@ -597,6 +709,17 @@ BOOST_AUTO_TEST_CASE(cached_balances_tests)
     SimpleFakeMine(wtxCredit, wallet);
     BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 0);
     BOOST_CHECK_EQUAL(wtxCredit.GetAvailableCredit(), nCredit);
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), nCredit);
+    std::vector<COutput> vCoins;
+    BOOST_CHECK(wallet.AvailableCoins(&vCoins));
+    BOOST_CHECK_EQUAL(vCoins.size(), 2U);
+
+    // Validates (4)
+    BOOST_CHECK_EQUAL(wallet.GetLockedCoins(), 0);
+    wallet.LockCoin(COutPoint(wtxCredit.GetHash(), 1));
+    BOOST_CHECK_EQUAL(wallet.GetLockedCoins(), nCredit / 2);
+    wallet.UnlockCoin(COutPoint(wtxCredit.GetHash(), 1));
+    BOOST_CHECK_EQUAL(wallet.GetLockedCoins(), 0);
 
     // 3) Spend one of the two outputs of the receiving tx to an external source and verify.
     // Create debit transaction.
@@ -626,6 +749,118 @@ BOOST_AUTO_TEST_CASE(cached_balances_tests)
     BOOST_CHECK_EQUAL(wtxCredit.GetAvailableCredit(false), nCredit - nDebit);
     BOOST_CHECK(wtxCredit.IsAmountCached(CWalletTx::AVAILABLE_CREDIT, ISMINE_SPENDABLE));
 
+    // Validates (5)
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), nCredit - nDebit);
+    BOOST_CHECK(wallet.AvailableCoins(&vCoins));
+    BOOST_CHECK_EQUAL(vCoins.size(), 1U);
+    BOOST_CHECK(vCoins[0].tx->GetHash() == wtxCredit.GetHash());
+    BOOST_CHECK_EQUAL(vCoins[0].i, 1);
+}
+
+/**
+ * Verify the depth and maturity filters of the wallet balances, for a coinbase
+ * confirmed in a block, as the tip moves.
+ */
+BOOST_AUTO_TEST_CASE(balances_maturity_tests)
+{
+    const CAmount nCredit = 20 * COIN;
+    const int nMaturity = Params().GetConsensus().nCoinbaseMaturity;
+
+    CWallet& wallet = *pwalletMain;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+    wallet.SetupSPKM(false);
+    wallet.SetLastBlockProcessed(chainActive.Tip());
+
+    CTxDestination receivingAddr;
+    BOOST_ASSERT(wallet.getNewAddress(receivingAddr, "receiving_address").result);
+    CWalletTx& wtxCoinbase = BuildAndLoadTxToWallet({CTxIn()}, {CTxOut(nCredit, GetScriptForDestination(receivingAddr))}, wallet);
+    BOOST_CHECK(wtxCoinbase.IsCoinBase());
+    CBlockIndex* pindex = SimpleFakeMine(wtxCoinbase, wallet);
+
+    // Immature at depth 1
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), nCredit);
+    BOOST_CHECK_EQUAL(wallet.GetBalance().m_mine_immature, nCredit);
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), 0);
+    BOOST_CHECK_EQUAL(wallet.GetBalance().m_mine_trusted, 0);
+
+    // Mature at depth nMaturity + 1
+    uint256 hashTip = GetRandHash();
+    CBlockIndex tip;
+    tip.nHeight = pindex->nHeight + nMaturity;
+    tip.phashBlock = &hashTip;
+    wallet.SetLastBlockProcessed(&tip);
+    BOOST_CHECK_EQUAL(wtxCoinbase.GetDepthInMainChain(), nMaturity + 1);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 0);
+    BOOST_CHECK_EQUAL(wallet.GetBalance().m_mine_immature, 0);
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), nCredit);
+    BOOST_CHECK_EQUAL(wallet.GetBalance().m_mine_trusted, nCredit);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(nMaturity + 1).m_mine_trusted, nCredit);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(nMaturity + 2).m_mine_trusted, 0);
+    isminefilter filter = ISMINE_SPENDABLE;
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(filter, true, nMaturity + 1), nCredit);
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(filter, true, nMaturity + 2), 0);
+
+    // Stakeable at depth nStakeMinDepth, unless locked
+    const int nStakeDepth = std::max(Params().GetConsensus().nStakeMinDepth, nMaturity + 1);
+    BOOST_CHECK_EQUAL(wallet.GetStakingBalance(), nStakeDepth > nMaturity + 1 ? 0 : nCredit);
+    tip.nHeight = pindex->nHeight + nStakeDepth - 1;
+    wallet.SetLastBlockProcessed(&tip);
+    BOOST_CHECK_EQUAL(wallet.GetStakingBalance(), nCredit);
+    wallet.LockCoin(COutPoint(wtxCoinbase.GetHash(), 0));
+    BOOST_CHECK_EQUAL(wallet.GetLockedCoins(), nCredit);
+    BOOST_CHECK_EQUAL(wallet.GetStakingBalance(), 0);
+    wallet.UnlockAllCoins();
+    BOOST_CHECK_EQUAL(wallet.GetLockedCoins(), 0);
+    BOOST_CHECK_EQUAL(wallet.GetStakingBalance(), nCredit);
+
+    // Immature again, once the tip goes back
+    wallet.SetLastBlockProcessed(pindex);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), nCredit);
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), 0);
+}
+
+/**
+ * The wallet txes are read from the database before the keys: verify that the
+ * coins of a reloaded wallet are still found by AvailableCoins.
+ */
+BOOST_AUTO_TEST_CASE(reloaded_wallet_coins)
+{
+    const CAmount nCredit = 20 * COIN;
+    bool fFirstRun;
+    {
+        std::unique_ptr<CWalletDBWrapper> dbw(new CWalletDBWrapper(&bitdb, "wallet_reload_test.dat"));
+        CWallet wallet(std::move(dbw));
+        BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+        BOOST_CHECK(fFirstRun);
+        LOCK2(cs_main, wallet.cs_wallet);
+        wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+        wallet.SetupSPKM(false);
+
+        CTxDestination receivingAddr;
+        BOOST_ASSERT(wallet.getNewAddress(receivingAddr, "receiving_address").result);
+        CTxOut creditOut(nCredit / 2, GetScriptForDestination(receivingAddr));
+        CWalletTx& wtxCredit = ReceiveBalanceWith({creditOut, creditOut}, wallet);
+        SimpleFakeMine(wtxCredit, wallet);
+        BOOST_CHECK(CWalletDB(wallet.GetDBHandle()).WriteTx(wtxCredit));
+
+        std::vector<COutput> vCoins;
+        BOOST_CHECK(wallet.AvailableCoins(&vCoins));
+        BOOST_CHECK_EQUAL(vCoins.size(), 2U);
+    }
+
+    // Load the wallet again from the database
+    std::unique_ptr<CWalletDBWrapper> dbw(new CWalletDBWrapper(&bitdb, "wallet_reload_test.dat"));
+    CWallet wallet(std::move(dbw));
+    BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+    BOOST_CHECK(!fFirstRun);
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.SetLastBlockProcessed(chainActive.Tip());
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 1U);
+    std::vector<COutput> vCoins;
+    BOOST_CHECK(wallet.AvailableCoins(&vCoins));
+    BOOST_CHECK_EQUAL(vCoins.size(), 2U);
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), nCredit);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
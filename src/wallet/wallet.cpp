@@ -26,6 +26,7 @@
 #include  <init.h>    // for StartShutdown/ShutdownRequested
 
 #include <future>
+#include <thread>
 #include <boost/algorithm/string/replace.hpp>
 
 std::vector<CWalletRef> vpwallets;
@@ -741,10 +742,74 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
     return IsSpent(COutPoint(hash, n));
 }
 
+bool CWallet::IsSpentByConfirmedTx(const COutPoint& outpoint) const
+{
+    AssertLockHeld(cs_wallet);
+    auto range = mapTxSpends.equal_range(outpoint);
+    for (auto it = range.first; it != range.second; ++it) {
+        auto mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.isConfirmed()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CWallet::UpdateUnspentOutput(const COutPoint& outpoint, const CTxOut& txout) const
+{
+    AssertLockHeld(cs_wallet);
+    const isminetype mine = IsMine(txout);
+    if (mine == ISMINE_NO || IsSpentByConfirmedTx(outpoint)) {
+        m_unspent_outputs.erase(outpoint);
+    } else {
+        m_unspent_outputs[outpoint] = mine;
+    }
+}
+
+void CWallet::UpdateUnspentOutputs(const CWalletTx& wtx) const
+{
+    LOCK(cs_wallet);
+    const uint256& hash = wtx.GetHash();
+    auto it = mapWallet.find(hash);
+    // Only index the txes of the wallet map (not their copies)
+    if (it == mapWallet.end() || &it->second != &wtx) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        UpdateUnspentOutput(COutPoint(hash, i), wtx.tx->vout[i]);
+    }
+    // The tx confirmation state changes the spent state of its inputs
+    if (!wtx.IsCoinBase()) {
+        for (const CTxIn& txin : wtx.tx->vin) {
+            auto itPrev = mapWallet.find(txin.prevout.hash);
+            if (itPrev != mapWallet.end() && txin.prevout.n < itPrev->second.tx->vout.size()) {
+                UpdateUnspentOutput(txin.prevout, itPrev->second.tx->vout[txin.prevout.n]);
+            }
+        }
+    }
+}
+
+void CWallet::RebuildUnspentOutputs() const
+{
+    LOCK(cs_wallet);
+    m_unspent_outputs.clear();
+    for (const auto& it : mapWallet) {
+        const CWalletTx& wtx = it.second;
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+            UpdateUnspentOutput(COutPoint(it.first, i), wtx.tx->vout[i]);
+        }
+    }
+}
+
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.emplace(outpoint, wtxid);
     setLockedCoins.erase(outpoint);
+    auto it = mapWallet.find(wtxid);
+    if (it != mapWallet.end() && it->second.isConfirmed()) {
+        m_unspent_outputs.erase(outpoint);
+    }
 
     std::pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
@@ -1040,12 +1105,14 @@ bool CWallet::LoadToWallet(CWalletTx& wtxIn)
             }
         }
     }
+    UpdateTxBalance(wtx);
     return true;
 }
 
-bool CWallet::FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData)
+bool CWallet::FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData,
+                                                      const std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>* pSaplingNotes)
 {
-    auto saplingNoteDataAndAddressesToAdd = m_sspk_man->FindMySaplingNotes(tx);
+    auto saplingNoteDataAndAddressesToAdd = pSaplingNotes ? *pSaplingNotes : m_sspk_man->FindMySaplingNotes(tx);
     saplingNoteData = saplingNoteDataAndAddressesToAdd.first;
     auto addressesToAdd = saplingNoteDataAndAddressesToAdd.second;
     // Add my addresses
@@ -1057,6 +1124,14 @@ bool CWallet::FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Op
     return true;
 }
 
+std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>> CWallet::FindSaplingNotesInBlock(const CBlock& block, bool fParallel) const
+{
+    if (!HasSaplingSPKM()) {
+        return {};
+    }
+    return m_sspk_man->FindMySaplingNotes(block.vtx, fParallel);
+}
+
 void CWallet::AddExternalNotesDataToTx(CWalletTx& wtx) const
 {
     if (HasSaplingSPKM() && wtx.tx->IsShieldedTx()) {
@@ -1094,7 +1169,8 @@ void CWallet::AddExternalNotesDataToTx(CWalletTx& wtx) const
  * Abandoned state should probably be more carefully tracked via different
  * posInBlock signals or by checking mempool presence when necessary.
  */
-bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm, bool fUpdate)
+bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm, bool fUpdate,
+                                       const std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>* pSaplingNotes)
 {
     const CTransaction& tx = *ptx;
     {
@@ -1119,7 +1195,7 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CWallet
         // Check tx for Sapling notes
         Optional<mapSaplingNoteData_t> saplingNoteData {nullopt};
         if (HasSaplingSPKM()) {
-            if (!FindNotesDataAndAddMissingIVKToKeystore(tx, saplingNoteData)) {
+            if (!FindNotesDataAndAddMissingIVKToKeystore(tx, saplingNoteData, pSaplingNotes)) {
                 return false; // error adding incoming viewing key.
             }
         }
@@ -1277,9 +1353,10 @@ void CWallet::MarkConflicted(const uint256& hashBlock, int conflicting_height, c
     }
 }
 
-void CWallet::SyncTransaction(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm)
+void CWallet::SyncTransaction(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm,
+                              const std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>* pSaplingNotes)
 {
-    if (!AddToWalletIfInvolvingMe(ptx, confirm, true)) {
+    if (!AddToWalletIfInvolvingMe(ptx, confirm, true, pSaplingNotes)) {
         return; // Not one of ours
     }
 
@@ -1338,6 +1415,8 @@ void CWallet::TransactionRemovedFromMempool(const CTransactionRef &ptx, MemPoolR
 
 void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex)
 {
+    // Trial-decrypt the shielded outputs of the whole block at once, before locking the wallet
+    const auto vSaplingNotes = FindSaplingNotesInBlock(*pblock, true);
     {
         LOCK(cs_wallet);
 
@@ -1347,7 +1426,7 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
         for (size_t index = 0; index < pblock->vtx.size(); index++) {
             CWalletTx::Confirmation confirm(CWalletTx::Status::CONFIRMED, m_last_block_processed_height,
                                             m_last_block_processed, index);
-            SyncTransaction(pblock->vtx[index], confirm);
+            SyncTransaction(pblock->vtx[index], confirm, vSaplingNotes.empty() ? nullptr : &vSaplingNotes[index]);
             TransactionRemovedFromMempool(pblock->vtx[index], MemPoolRemovalReason::BLOCK);
         }
 
@@ -1388,9 +1467,12 @@ void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, con
     m_last_block_processed_height = nBlockHeight - 1;
     m_last_block_processed_time = blockTime;
     m_last_block_processed = blockHash;
+    // The shielded outputs were trial-decrypted when the block was connected: the transactions
+    // with notes of ours are in the wallet already, and keep their note data.
+    const std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> noSaplingNotes;
     for (const CTransactionRef& ptx : pblock->vtx) {
         CWalletTx::Confirmation confirm(CWalletTx::Status::UNCONFIRMED, /* block_height */ 0, {}, /* nIndex */ 0);
-        SyncTransaction(ptx, confirm);
+        SyncTransaction(ptx, confirm, &noSaplingNotes);
     }
 
     if (Params().GetConsensus().NetworkUpgradeActive(nBlockHeight, Consensus::UPGRADE_V5_0)) {
@@ -1458,8 +1540,24 @@ void CWallet::EraseFromWallet(const uint256& hash)
 {
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        auto it = mapWallet.find(hash);
+        if (it != mapWallet.end()) {
+            const CTransactionRef tx = it->second.tx;
+            mapWallet.erase(it);
             CWalletDB(*dbw).EraseTx(hash);
+            // Drop its outputs from the unspent outputs, and refresh the ones it spent
+            m_unspent_outputs.erase(m_unspent_outputs.lower_bound(COutPoint(hash, 0)),
+                                    m_unspent_outputs.upper_bound(COutPoint(hash, std::numeric_limits<uint32_t>::max())));
+            for (const CTxIn& txin : tx->vin) {
+                auto itPrev = mapWallet.find(txin.prevout.hash);
+                if (itPrev != mapWallet.end() && txin.prevout.n < itPrev->second.tx->vout.size()) {
+                    UpdateUnspentOutput(txin.prevout, itPrev->second.tx->vout[txin.prevout.n]);
+                }
+            }
+            // Drop it from the balance index too, and refresh the txes it spent from
+            AccountTxBalance(hash);
+            AccountSpentTxBalances(*tx);
+        }
         LogPrintf("%s: Erased wtx %s from wallet\n", __func__, hash.GetHex());
     }
     return;
@@ -1880,6 +1978,108 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
     return startTime;
 }
 
+// Threads reading the blocks of a rescan ahead of the wallet
+static const int MAX_RESCAN_PREFETCH_THREADS = 4;
+
+RescanBlockPrefetcher::RescanBlockPrefetcher(const CWallet* pwalletIn, CBlockIndex* pindexStartIn, CBlockIndex* pindexStopIn, int nThreads) :
+    pwallet(pwalletIn),
+    pindexStart(pindexStartIn),
+    pindexStop(pindexStopIn)
+{
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back(&TraceThread<std::function<void()>>, "rescanprefetch",
+                             std::bind(&RescanBlockPrefetcher::ThreadPrefetch, this));
+    }
+}
+
+RescanBlockPrefetcher::~RescanBlockPrefetcher()
+{
+    {
+        LOCK(cs);
+        fInterrupt = true;
+    }
+    cond.notify_all();
+    for (auto& t : threads) t.join();
+}
+
+bool RescanBlockPrefetcher::Next(PrefetchedBlock& ret)
+{
+    QueueBlocks();
+    if (vPending.empty()) {
+        return false;
+    }
+    const int nHeight = vPending.front()->nHeight;
+    vPending.pop_front();
+
+    WAIT_LOCK(cs, lock);
+    auto it = mapFetched.end();
+    while ((it = mapFetched.find(nHeight)) == mapFetched.end()) {
+        cond.wait(lock);
+    }
+    ret = std::move(it->second);
+    mapFetched.erase(it);
+    return true;
+}
+
+void RescanBlockPrefetcher::QueueBlocks()
+{
+    std::vector<std::pair<CBlockIndex*, FlatFilePos>> vToRead;
+    {
+        LOCK(cs_main);
+        while (!fAllQueued && vPending.size() < RESCAN_PREFETCH_BLOCKS) {
+            CBlockIndex* pindex = pindexLastQueued ? chainActive.Next(pindexLastQueued) : pindexStart;
+            if (!pindex) {
+                fAllQueued = true;
+                break;
+            }
+            vPending.emplace_back(pindex);
+            vToRead.emplace_back(pindex, pindex->GetBlockPos());
+            pindexLastQueued = pindex;
+            fAllQueued = (pindex == pindexStop);
+        }
+    }
+    if (vToRead.empty()) {
+        return;
+    }
+    {
+        LOCK(cs);
+        queueToRead.insert(queueToRead.end(), vToRead.begin(), vToRead.end());
+    }
+    cond.notify_all();
+}
+
+void RescanBlockPrefetcher::ThreadPrefetch()
+{
+    while (true) {
+        PrefetchedBlock fetched;
+        FlatFilePos pos;
+        {
+            WAIT_LOCK(cs, lock);
+            while (!fInterrupt && queueToRead.empty()) {
+                cond.wait(lock);
+            }
+            if (fInterrupt) {
+                return;
+            }
+            std::tie(fetched.pindex, pos) = queueToRead.front();
+            queueToRead.pop_front();
+        }
+
+        // Read the block and trial-decrypt its shielded outputs without any lock
+        fetched.fRead = ReadBlockFromDisk(fetched.block, pos) &&
+                        fetched.block.GetHash() == fetched.pindex->GetBlockHash();
+        if (fetched.fRead) {
+            fetched.vSaplingNotes = pwallet->FindSaplingNotesInBlock(fetched.block, false);
+        }
+
+        {
+            LOCK(cs);
+            mapFetched.emplace(fetched.pindex->nHeight, std::move(fetched));
+        }
+        cond.notify_all();
+    }
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -1919,8 +2119,16 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             dProgressTip = Checkpoints::GuessVerificationProgress(tip, false);
         }
 
+        // Blocks are read, and their shielded outputs trial-decrypted, ahead of the
+        // wallet by the prefetch threads. Here they are only added to the wallet, in order.
+        const int64_t nStart = nNow;
+        const int nPrefetchThreads = std::max(1, std::min(GetNumCores(), MAX_RESCAN_PREFETCH_THREADS));
+        RescanBlockPrefetcher prefetcher(this, pindexStart, pindexStop, nPrefetchThreads);
+        RescanBlockPrefetcher::PrefetchedBlock fetched;
+
         std::vector<uint256> myTxHashes;
-        while (pindex && !fAbortRescan) {
+        while (!fAbortRescan && prefetcher.Next(fetched)) {
+            pindex = fetched.pindex;
             double gvp = 0;
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
                 gvp = WITH_LOCK(cs_main, return Checkpoints::GuessVerificationProgress(pindex, false); );
@@ -1928,14 +2136,22 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             }
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, gvp);
+                gvp = WITH_LOCK(cs_main, return Checkpoints::GuessVerificationProgress(pindex, false); );
+                // Estimate the time left from the progress made so far
+                const double dDone = dProgressTip - dProgressStart > 0.0 ? (gvp - dProgressStart) / (dProgressTip - dProgressStart) : 0.0;
+                if (dDone > 0.0 && dDone < 1.0) {
+                    LogPrintf("Still rescanning. At block %d. Progress=%f. Time left: about %d seconds\n",
+                              pindex->nHeight, gvp, (int64_t)((nNow - nStart) * (1.0 - dDone) / dDone));
+                } else {
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, gvp);
+                }
             }
             if (fromStartup && ShutdownRequested()) {
                 break;
             }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex)) {
+            if (fetched.fRead) {
+                const CBlock& block = fetched.block;
                 LOCK2(cs_main, cs_wallet);
                 if (pindex && !chainActive.Contains(pindex)) {
                      // Abort scan if current block is no longer active, to prevent
@@ -1946,7 +2162,7 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
                 for (int posInBlock = 0; posInBlock < (int) block.vtx.size(); posInBlock++) {
                     const auto& tx = block.vtx[posInBlock];
                     CWalletTx::Confirmation confirm(CWalletTx::Status::CONFIRMED, pindex->nHeight, pindex->GetBlockHash(), posInBlock);
-                    if (AddToWalletIfInvolvingMe(tx, confirm, fUpdate)) {
+                    if (AddToWalletIfInvolvingMe(tx, confirm, fUpdate, fetched.vSaplingNotes.empty() ? nullptr : &fetched.vSaplingNotes[posInBlock])) {
                         myTxHashes.push_back(tx->GetHash());
                     }
                 }
@@ -1970,7 +2186,6 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             }
             {
                 LOCK(cs_main);
-                pindex = chainActive.Next(pindex);
                 if (tip != chainActive.Tip()) {
                     tip = chainActive.Tip();
                     // in case the tip has changed, update progress max
@@ -2116,42 +2331,253 @@ void CWallet::ResendWalletTransactions(CConnman* connman)
  * @{
  */
 
+void CWallet::OwnedAmounts::Add(isminetype mine, CAmount nValue)
+{
+    switch (mine) {
+        case ISMINE_WATCH_ONLY: nWatchOnly += nValue; break;
+        case ISMINE_SPENDABLE: nSpendable += nValue; break;
+        case ISMINE_COLD: nCold += nValue; break;
+        case ISMINE_SPENDABLE_DELEGATED: nDelegated += nValue; break;
+        default: break;
+    }
+}
+
+CAmount CWallet::OwnedAmounts::Get(const isminefilter& filter) const
+{
+    CAmount nTotal = 0;
+    if (filter & ISMINE_WATCH_ONLY) nTotal += nWatchOnly;
+    if (filter & ISMINE_SPENDABLE) nTotal += nSpendable;
+    if (filter & ISMINE_COLD) nTotal += nCold;
+    if (filter & ISMINE_SPENDABLE_DELEGATED) nTotal += nDelegated;
+    if (filter & ISMINE_SPENDABLE_SHIELDED || filter & ISMINE_WATCH_ONLY_SHIELDED) nTotal += nShielded;
+    return nTotal;
+}
+
+CWallet::OwnedAmounts& CWallet::OwnedAmounts::operator+=(const OwnedAmounts& other)
+{
+    nWatchOnly += other.nWatchOnly;
+    nSpendable += other.nSpendable;
+    nCold += other.nCold;
+    nDelegated += other.nDelegated;
+    nShielded += other.nShielded;
+    return *this;
+}
+
+CWallet::OwnedAmounts& CWallet::OwnedAmounts::operator-=(const OwnedAmounts& other)
+{
+    nWatchOnly -= other.nWatchOnly;
+    nSpendable -= other.nSpendable;
+    nCold -= other.nCold;
+    nDelegated -= other.nDelegated;
+    nShielded -= other.nShielded;
+    return *this;
+}
+
+void CWallet::BalanceBucket::Add(const TxBalance& txBalance)
+{
+    if (txBalance.fMaturing) {
+        availableMaturing += txBalance.available;
+        immature += txBalance.immature;
+    } else {
+        available += txBalance.available;
+    }
+    (txBalance.fCoinBase ? nLockedCoinBase : nLocked) += txBalance.nLocked;
+    nTxes++;
+}
+
+void CWallet::BalanceBucket::Remove(const TxBalance& txBalance)
+{
+    if (txBalance.fMaturing) {
+        availableMaturing -= txBalance.available;
+        immature -= txBalance.immature;
+    } else {
+        available -= txBalance.available;
+    }
+    (txBalance.fCoinBase ? nLockedCoinBase : nLocked) -= txBalance.nLocked;
+    nTxes--;
+}
+
+bool CWallet::BuildTxBalances() const
+{
+    AssertLockHeld(cs_wallet);
+    if (m_tx_balances_built) return true;
+    if (m_last_block_processed_height < 0) return false;
+
+    m_tx_balances_built = true;
+    for (const auto& it : mapWallet) {
+        AccountTxBalance(it.first);
+    }
+    return true;
+}
+
+void CWallet::AccountTxBalance(const uint256& hash) const
+{
+    AssertLockHeld(cs_wallet);
+    if (!m_tx_balances_built) return;
+
+    // Remove the previous balance of the tx
+    if (!m_unconfirmed_txs.erase(hash)) {
+        auto itBalance = m_tx_balances.find(hash);
+        if (itBalance != m_tx_balances.end()) {
+            auto itBucket = m_balance_buckets.find(itBalance->second.nHeight);
+            assert(itBucket != m_balance_buckets.end());
+            itBucket->second.Remove(itBalance->second);
+            if (itBucket->second.nTxes == 0) {
+                m_balance_buckets.erase(itBucket);
+            }
+            m_balance_total.Remove(itBalance->second);
+            m_tx_balances.erase(itBalance);
+        }
+    }
+
+    auto it = mapWallet.find(hash);
+    if (it == mapWallet.end()) return;
+    const CWalletTx& wtx = it->second;
+    // The balances of the txes that aren't confirmed depend on the mempool, and on their parents
+    if (!wtx.isConfirmed()) {
+        m_unconfirmed_txs.insert(hash);
+        return;
+    }
+
+    TxBalance txBalance;
+    txBalance.nHeight = wtx.m_confirm.block_height;
+    txBalance.fCoinBase = wtx.IsCoinBase();
+    txBalance.fMaturing = wtx.IsCoinBase() || wtx.IsCoinStake();
+    const CAmount collAmt = Params().GetConsensus().nMNCollateralAmt;
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        const CTxOut& txout = wtx.tx->vout[i];
+        const isminetype mine = IsMine(txout);
+        if (mine == ISMINE_NO) continue;
+        if (txBalance.fMaturing) {
+            txBalance.immature.Add(mine, txout.nValue);
+        }
+        if (IsSpent(hash, i)) continue;
+        txBalance.available.Add(mine, txout.nValue);
+        if (IsLockedCoin(hash, i)) {
+            if (mine & ISMINE_SPENDABLE_ALL) txBalance.nLocked += txout.nValue;
+        } else if (fMasterNode && txout.nValue == collAmt && (mine & ISMINE_SPENDABLE)) {
+            // Masternode collaterals are handled like locked coins
+            txBalance.nLocked += txout.nValue;
+        }
+    }
+    if (HasSaplingSPKM()) {
+        txBalance.available.nShielded = m_sspk_man->GetCredit(wtx, ISMINE_SPENDABLE_SHIELDED, true);
+        if (txBalance.fMaturing) {
+            txBalance.immature.nShielded = m_sspk_man->GetCredit(wtx, ISMINE_SPENDABLE_SHIELDED, false);
+        }
+    }
+
+    m_balance_buckets[txBalance.nHeight].Add(txBalance);
+    m_balance_total.Add(txBalance);
+    m_tx_balances.emplace(hash, txBalance);
+}
+
+void CWallet::AccountSpentTxBalances(const CTransaction& tx) const
+{
+    AssertLockHeld(cs_wallet);
+    if (!m_tx_balances_built) return;
+
+    if (!tx.IsCoinBase()) {
+        for (const CTxIn& txin : tx.vin) {
+            if (mapWallet.count(txin.prevout.hash)) {
+                AccountTxBalance(txin.prevout.hash);
+            }
+        }
+    }
+    // Sapling
+    if (HasSaplingSPKM() && tx.IsShieldedTx()) {
+        for (const SpendDescription& spend : tx.sapData->vShieldedSpend) {
+            auto it = m_sspk_man->mapSaplingNullifiersToNotes.find(spend.nullifier);
+            if (it != m_sspk_man->mapSaplingNullifiersToNotes.end() && mapWallet.count(it->second.hash)) {
+                AccountTxBalance(it->second.hash);
+            }
+        }
+    }
+}
+
+void CWallet::UpdateTxBalance(const CWalletTx& wtx) const
+{
+    LOCK(cs_wallet);
+    const uint256& hash = wtx.GetHash();
+    auto it = mapWallet.find(hash);
+    // Only index the txes of the wallet map (not their copies)
+    if (it == mapWallet.end() || &it->second != &wtx) {
+        return;
+    }
+
+    AccountTxBalance(hash);
+    // The tx confirmation state changes the spent state of its inputs
+    AccountSpentTxBalances(*wtx.tx);
+}
+
+CWallet::ConfirmedBalance CWallet::GetConfirmedBalance(int nMinDepth) const
+{
+    AssertLockHeld(cs_wallet);
+    ConfirmedBalance ret;
+    if (!BuildTxBalances()) return ret;
+
+    // The txes confirmed above nMaxHeight are not deep enough, and the coinbases/coinstakes
+    // confirmed above nMatureHeight are immature: only their buckets are walked.
+    const int nTipHeight = m_last_block_processed_height;
+    const int nMaxHeight = nTipHeight - std::max(nMinDepth, 1) + 1;
+    const int nMatureHeight = nTipHeight - Params().GetConsensus().nCoinbaseMaturity;
+    ret.available = m_balance_total.available;
+    ret.available += m_balance_total.availableMaturing;
+    ret.nLocked = m_balance_total.nLocked + m_balance_total.nLockedCoinBase;
+    for (auto it = m_balance_buckets.rbegin(); it != m_balance_buckets.rend(); ++it) {
+        const int nHeight = it->first;
+        if (nHeight <= std::min(nMaxHeight, nMatureHeight)) break;
+        const BalanceBucket& bucket = it->second;
+        if (nHeight > nMaxHeight) {
+            ret.available -= bucket.available;
+            ret.nLocked -= bucket.nLocked;
+        }
+        ret.available -= bucket.availableMaturing;
+        ret.nLocked -= bucket.nLockedCoinBase;
+        if (nHeight > nMatureHeight && nHeight <= nTipHeight) {
+            ret.immature += bucket.immature;
+        }
+    }
+    return ret;
+}
+
 CWallet::Balance CWallet::GetBalance(const int min_depth) const
 {
     Balance ret;
-    {
-        LOCK(cs_wallet);
-        std::set<uint256> trusted_parents;
-        for (const auto& entry : mapWallet) {
-            const CWalletTx& wtx = entry.second;
-            const bool is_trusted{wtx.IsTrusted()};
-            const int tx_depth{wtx.GetDepthInMainChain()};
-            const CAmount tx_credit_mine{wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_SPENDABLE_TRANSPARENT)};
-            const CAmount tx_credit_shield_mine{wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_SPENDABLE_SHIELDED)};
-            if (is_trusted && tx_depth >= min_depth) {
-                ret.m_mine_trusted += tx_credit_mine;
-                ret.m_mine_trusted_shield += tx_credit_shield_mine;
-                if (wtx.tx->HasP2CSOutputs()) {
-                    ret.m_mine_cs_delegated_trusted += wtx.GetStakeDelegationCredit();
-                }
-            }
-            if (!is_trusted && tx_depth == 0 && wtx.InMempool()) {
-                ret.m_mine_untrusted_pending += tx_credit_mine;
-                ret.m_mine_untrusted_shielded_balance += tx_credit_shield_mine;
+    LOCK(cs_wallet);
+    const ConfirmedBalance confirmed = GetConfirmedBalance(min_depth);
+    ret.m_mine_trusted = confirmed.available.Get(ISMINE_SPENDABLE_TRANSPARENT);
+    ret.m_mine_trusted_shield = confirmed.available.Get(ISMINE_SPENDABLE_SHIELDED);
+    ret.m_mine_cs_delegated_trusted = confirmed.available.Get(ISMINE_SPENDABLE_DELEGATED);
+    ret.m_mine_immature = confirmed.immature.Get(ISMINE_SPENDABLE_ALL);
+    for (const uint256& hash : m_unconfirmed_txs) {
+        const CWalletTx& wtx = mapWallet.at(hash);
+        const bool is_trusted{wtx.IsTrusted()};
+        const int tx_depth{wtx.GetDepthInMainChain()};
+        const CAmount tx_credit_mine{wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_SPENDABLE_TRANSPARENT)};
+        const CAmount tx_credit_shield_mine{wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_SPENDABLE_SHIELDED)};
+        if (is_trusted && tx_depth >= min_depth) {
+            ret.m_mine_trusted += tx_credit_mine;
+            ret.m_mine_trusted_shield += tx_credit_shield_mine;
+            if (wtx.tx->HasP2CSOutputs()) {
+                ret.m_mine_cs_delegated_trusted += wtx.GetStakeDelegationCredit();
             }
-            ret.m_mine_immature += wtx.GetImmatureCredit();
+        }
+        if (!is_trusted && tx_depth == 0 && wtx.InMempool()) {
+            ret.m_mine_untrusted_pending += tx_credit_mine;
+            ret.m_mine_untrusted_shielded_balance += tx_credit_shield_mine;
         }
     }
     return ret;
 }
 
-CAmount CWallet::loopTxsBalance(const std::function<void(const uint256&, const CWalletTx&, CAmount&)>& method) const
+CAmount CWallet::loopUnconfirmedTxsBalance(const std::function<void(const uint256&, const CWalletTx&, CAmount&)>& method) const
 {
+    AssertLockHeld(cs_wallet);
     CAmount nTotal = 0;
-    {
-        LOCK(cs_wallet);
-        for (const auto& it : mapWallet) {
-            method(it.first, it.second, nTotal);
+    if (BuildTxBalances()) {
+        for (const uint256& hash : m_unconfirmed_txs) {
+            method(hash, mapWallet.at(hash), nTotal);
         }
     }
     return nTotal;
@@ -2174,7 +2600,9 @@ CAmount CWallet::GetAvailableBalance(bool fIncludeDelegated, bool fIncludeShield
 
 CAmount CWallet::GetAvailableBalance(isminefilter& filter, bool useCache, int minDepth) const
 {
-    return loopTxsBalance([filter, useCache, minDepth](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal){
+    LOCK(cs_wallet);
+    return GetConfirmedBalance(minDepth).available.Get(filter) +
+           loopUnconfirmedTxsBalance([filter, useCache, minDepth](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
         bool fConflicted;
         int depth;
         if (pcoin.IsTrusted(depth, fConflicted) && depth >= minDepth) {
@@ -2185,7 +2613,9 @@ CAmount CWallet::GetAvailableBalance(isminefilter& filter, bool useCache, int mi
 
 CAmount CWallet::GetColdStakingBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+    LOCK(cs_wallet);
+    return GetConfirmedBalance(1).available.Get(ISMINE_COLD) +
+           loopUnconfirmedTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
         if (pcoin.tx->HasP2CSOutputs() && pcoin.IsTrusted())
             nTotal += pcoin.GetColdStakingCredit();
     });
@@ -2193,23 +2623,32 @@ CAmount CWallet::GetColdStakingBalance() const
 
 CAmount CWallet::GetStakingBalance(const bool fIncludeColdStaking) const
 {
-    return std::max(CAmount(0), loopTxsBalance(
-            [fIncludeColdStaking](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-        if (pcoin.IsTrusted() && pcoin.GetDepthInMainChain() >= Params().GetConsensus().nStakeMinDepth) {
+    LOCK(cs_wallet);
+    const int nStakeMinDepth = Params().GetConsensus().nStakeMinDepth;
+    const ConfirmedBalance confirmed = GetConfirmedBalance(nStakeMinDepth);
+    // available coins, minus delegated coins, minus locked coins, plus cold coins if requested
+    CAmount nTotal = confirmed.available.Get(ISMINE_SPENDABLE) - confirmed.available.Get(ISMINE_SPENDABLE_DELEGATED) -
+                     confirmed.nLocked + (fIncludeColdStaking ? confirmed.available.Get(ISMINE_COLD) : 0);
+    nTotal += loopUnconfirmedTxsBalance(
+            [fIncludeColdStaking, nStakeMinDepth](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+        if (pcoin.IsTrusted() && pcoin.GetDepthInMainChain() >= nStakeMinDepth) {
             nTotal += pcoin.GetAvailableCredit();       // available coins
             nTotal -= pcoin.GetStakeDelegationCredit(); // minus delegated coins, if any
             nTotal -= pcoin.GetLockedCredit();          // minus locked coins, if any
             if (fIncludeColdStaking)
                 nTotal += pcoin.GetColdStakingCredit(); // plus cold coins, if any and if requested
         }
-    }));
+    });
+    return std::max(CAmount(0), nTotal);
 }
 
 CAmount CWallet::GetDelegatedBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (pcoin.tx->HasP2CSOutputs() && pcoin.IsTrusted())
-                nTotal += pcoin.GetStakeDelegationCredit();
+    LOCK(cs_wallet);
+    return GetConfirmedBalance(1).available.Get(ISMINE_SPENDABLE_DELEGATED) +
+           loopUnconfirmedTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+        if (pcoin.tx->HasP2CSOutputs() && pcoin.IsTrusted())
+            nTotal += pcoin.GetStakeDelegationCredit();
     });
 }
 
@@ -2235,54 +2674,54 @@ CAmount CWallet::GetLockedCoins() const
 
 CAmount CWallet::GetUnconfirmedBalance(isminetype filter) const
 {
-    return loopTxsBalance([filter](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (!pcoin.IsTrusted() && pcoin.GetDepthInMainChain() == 0 && pcoin.InMempool())
-                nTotal += pcoin.GetCredit(filter);
+    LOCK(cs_wallet);
+    return loopUnconfirmedTxsBalance([filter](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+        if (!pcoin.IsTrusted() && pcoin.GetDepthInMainChain() == 0 && pcoin.InMempool())
+            nTotal += pcoin.GetCredit(filter);
     });
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            nTotal += pcoin.GetImmatureCredit(false);
-    });
+    LOCK(cs_wallet);
+    return GetConfirmedBalance(1).immature.Get(ISMINE_SPENDABLE_ALL);
 }
 
 CAmount CWallet::GetImmatureColdStakingBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            nTotal += pcoin.GetImmatureCredit(false, ISMINE_COLD);
-    });
+    LOCK(cs_wallet);
+    return GetConfirmedBalance(1).immature.Get(ISMINE_COLD);
 }
 
 CAmount CWallet::GetImmatureDelegatedBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            nTotal += pcoin.GetImmatureCredit(false, ISMINE_SPENDABLE_DELEGATED);
-    });
+    LOCK(cs_wallet);
+    return GetConfirmedBalance(1).immature.Get(ISMINE_SPENDABLE_DELEGATED);
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (pcoin.IsTrusted())
-                nTotal += pcoin.GetAvailableWatchOnlyCredit();
+    LOCK(cs_wallet);
+    return GetConfirmedBalance(1).available.Get(ISMINE_WATCH_ONLY) +
+           loopUnconfirmedTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+        if (pcoin.IsTrusted())
+            nTotal += pcoin.GetAvailableWatchOnlyCredit();
     });
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (!pcoin.IsTrusted() && pcoin.GetDepthInMainChain() == 0 && pcoin.InMempool())
-                nTotal += pcoin.GetAvailableWatchOnlyCredit();
+    LOCK(cs_wallet);
+    return loopUnconfirmedTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+        if (!pcoin.IsTrusted() && pcoin.GetDepthInMainChain() == 0 && pcoin.InMempool())
+            nTotal += pcoin.GetAvailableWatchOnlyCredit();
     });
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            nTotal += pcoin.GetImmatureWatchOnlyCredit();
-    });
+    LOCK(cs_wallet);
+    return GetConfirmedBalance(1).immature.Get(ISMINE_WATCH_ONLY);
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -2341,9 +2780,12 @@ void CWallet::GetAvailableP2CSCoins(std::vector<COutput>& vCoins) const {
     vCoins.clear();
     {
         LOCK(cs_wallet);
-        for (const auto& it : mapWallet) {
-            const uint256& wtxid = it.first;
-            const CWalletTx* pcoin = &it.second;
+        for (const auto& it : m_unspent_outputs) {
+            const CWalletTx* pcoin = &mapWallet.at(it.first.hash);
+            const int i = (int) it.first.n;
+            const auto& utxo = pcoin->tx->vout[i];
+            if (!utxo.scriptPubKey.IsPayToColdStaking())
+                continue;
 
             bool fConflicted;
             int nDepth = pcoin->GetDepthAndMempool(fConflicted);
@@ -2351,24 +2793,14 @@ void CWallet::GetAvailableP2CSCoins(std::vector<COutput>& vCoins) const {
             if (fConflicted || nDepth < 0)
                 continue;
 
-            bool fSafe = pcoin->IsTrusted();
-
-            if (pcoin->tx->HasP2CSOutputs()) {
-                for (int i = 0; i < (int) pcoin->tx->vout.size(); i++) {
-                    const auto &utxo = pcoin->tx->vout[i];
-
-                    if (IsSpent(wtxid, i))
-                        continue;
+            if (IsSpent(it.first))
+                continue;
 
-                    if (utxo.scriptPubKey.IsPayToColdStaking()) {
-                        isminetype mine = IsMine(utxo);
-                        bool isMineSpendable = mine & ISMINE_SPENDABLE_DELEGATED;
-                        if (mine & ISMINE_COLD || isMineSpendable)
-                            // Depth and solvability members are not used, no need waste resources and set them for now.
-                            vCoins.emplace_back(pcoin, i, 0, isMineSpendable, true, fSafe);
-                    }
-                }
-            }
+            isminetype mine = IsMine(utxo);
+            bool isMineSpendable = mine & ISMINE_SPENDABLE_DELEGATED;
+            if (mine & ISMINE_COLD || isMineSpendable)
+                // Depth and solvability members are not used, no need waste resources and set them for now.
+                vCoins.emplace_back(pcoin, i, 0, isMineSpendable, true, pcoin->IsTrusted());
         }
     }
 
@@ -2550,70 +2982,71 @@ bool CWallet::AvailableCoins(std::vector<COutput>* pCoins,      // --> populates
     {
         LOCK(cs_wallet);
         CAmount nTotal = 0;
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
-
-            // Check if the tx is selectable
-            int nDepth = 0;
-            bool safeTx = false;
-            if (!CheckTXAvailability(pcoin, coinsFilter.fOnlySafe, nDepth, safeTx, m_last_block_processed_height))
-                continue;
+        const CWalletTx* pcoin = nullptr;
+        bool fTxAvailable = false;
+        int nDepth = 0;
+        bool safeTx = false;
+        // The unspent outputs are sorted by tx, so each tx is checked once
+        for (const auto& it : m_unspent_outputs) {
+            const uint256& wtxid = it.first.hash;
+            if (!pcoin || pcoin->GetHash() != wtxid) {
+                pcoin = &mapWallet.at(wtxid);
+                // Check if the tx is selectable, and the min depth filtering requirements
+                fTxAvailable = CheckTXAvailability(pcoin, coinsFilter.fOnlySafe, nDepth, safeTx, m_last_block_processed_height) &&
+                               nDepth >= coinsFilter.minDepth;
+            }
+            if (!fTxAvailable) continue;
 
-            // Check min depth filtering requirements
-            if (nDepth < coinsFilter.minDepth) continue;
+            const unsigned int i = it.first.n;
+            const auto& output = pcoin->tx->vout[i];
 
-            for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
-                const auto& output = pcoin->tx->vout[i];
+            // Filter by value if needed
+            if (coinsFilter.nMaxOutValue > 0 && output.nValue > coinsFilter.nMaxOutValue) {
+                continue;
+            }
+            if (coinsFilter.nMinOutValue > 0 && output.nValue < coinsFilter.nMinOutValue) {
+                continue;
+            }
 
-                // Filter by value if needed
-                if (coinsFilter.nMaxOutValue > 0 && output.nValue > coinsFilter.nMaxOutValue) {
-                    continue;
-                }
-                if (coinsFilter.nMinOutValue > 0 && output.nValue < coinsFilter.nMinOutValue) {
+            // Filter by specific destinations if needed
+            if (coinsFilter.onlyFilteredDest && !coinsFilter.onlyFilteredDest->empty()) {
+                CTxDestination address;
+                if (!ExtractDestination(output.scriptPubKey, address) || !coinsFilter.onlyFilteredDest->count(address)) {
                     continue;
                 }
+            }
 
-                // Filter by specific destinations if needed
-                if (coinsFilter.onlyFilteredDest && !coinsFilter.onlyFilteredDest->empty()) {
-                    CTxDestination address;
-                    if (!ExtractDestination(output.scriptPubKey, address) || !coinsFilter.onlyFilteredDest->count(address)) {
-                        continue;
-                    }
-                }
+            // Now check for chain availability
+            auto res = CheckOutputAvailability(
+                    output,
+                    i,
+                    wtxid,
+                    coinControl,
+                    fCoinsSelected,
+                    coinsFilter.fIncludeColdStaking,
+                    coinsFilter.fIncludeDelegated,
+                    coinsFilter.fIncludeLocked);
 
-                // Now check for chain availability
-                auto res = CheckOutputAvailability(
-                        output,
-                        i,
-                        wtxid,
-                        coinControl,
-                        fCoinsSelected,
-                        coinsFilter.fIncludeColdStaking,
-                        coinsFilter.fIncludeDelegated,
-                        coinsFilter.fIncludeLocked);
-
-                if (!res.available) continue;
-                if (coinsFilter.fOnlySpendable && !res.spendable) continue;
-
-                // found valid coin
-                if (!pCoins) return true;
-                pCoins->emplace_back(pcoin, (int) i, nDepth, res.spendable, res.solvable, safeTx);
-
-                // Checks the sum amount of all UTXO's.
-                if (coinsFilter.nMinimumSumAmount != 0) {
-                    nTotal += output.nValue;
-
-                    if (nTotal >= coinsFilter.nMinimumSumAmount) {
-                        return true;
-                    }
-                }
+            if (!res.available) continue;
+            if (coinsFilter.fOnlySpendable && !res.spendable) continue;
+
+            // found valid coin
+            if (!pCoins) return true;
+            pCoins->emplace_back(pcoin, (int) i, nDepth, res.spendable, res.solvable, safeTx);
 
-                // Checks the maximum number of UTXO's.
-                if (coinsFilter.nMaximumCount > 0 && pCoins->size() >= coinsFilter.nMaximumCount) {
+            // Checks the sum amount of all UTXO's.
+            if (coinsFilter.nMinimumSumAmount != 0) {
+                nTotal += output.nValue;
+
+                if (nTotal >= coinsFilter.nMinimumSumAmount) {
                     return true;
                 }
             }
+
+            // Checks the maximum number of UTXO's.
+            if (coinsFilter.nMaximumCount > 0 && pCoins->size() >= coinsFilter.nMaximumCount) {
+                return true;
+            }
         }
         return (pCoins && !pCoins->empty());
     }
@@ -2699,39 +3132,41 @@ bool CWallet::StakeableCoins(std::vector<CStakeableOutput>* pCoins)
     if (pCoins) pCoins->clear();
 
     LOCK2(cs_main, cs_wallet);
-    for (const auto& it : mapWallet) {
-        const uint256& wtxid = it.first;
-        const CWalletTx* pcoin = &(it).second;
-
-        // Check if the tx is selectable
-        int nDepth = 0;
-        bool safeTx = false;
-        if (!CheckTXAvailability(pcoin, true, nDepth, safeTx))
-            continue;
-
-        // Check min depth requirement for stake inputs
-        if (nDepth < Params().GetConsensus().nStakeMinDepth) continue;
+    const CWalletTx* pcoin = nullptr;
+    bool fTxAvailable = false;
+    int nDepth = 0;
+    bool safeTx = false;
+    const CBlockIndex* pindex = nullptr;
+    // The unspent outputs are sorted by tx, so each tx is checked once
+    for (const auto& it : m_unspent_outputs) {
+        const uint256& wtxid = it.first.hash;
+        if (!pcoin || pcoin->GetHash() != wtxid) {
+            pcoin = &mapWallet.at(wtxid);
+            pindex = nullptr;
+            // Check if the tx is selectable, and the min depth requirement for stake inputs
+            fTxAvailable = CheckTXAvailability(pcoin, true, nDepth, safeTx) &&
+                           nDepth >= Params().GetConsensus().nStakeMinDepth;
+        }
+        if (!fTxAvailable) continue;
 
-        const CBlockIndex* pindex = nullptr;
-        for (unsigned int index = 0; index < pcoin->tx->vout.size(); index++) {
+        const unsigned int index = it.first.n;
 
-            auto res = CheckOutputAvailability(
-                    pcoin->tx->vout[index],
-                    index,
-                    wtxid,
-                    nullptr, // coin control
-                    false,   // fIncludeDelegated
-                    fIncludeColdStaking,
-                    false,
-                    false);   // fIncludeLocked
+        auto res = CheckOutputAvailability(
+                pcoin->tx->vout[index],
+                index,
+                wtxid,
+                nullptr, // coin control
+                false,   // fIncludeDelegated
+                fIncludeColdStaking,
+                false,
+                false);   // fIncludeLocked
 
-            if (!res.available || !res.spendable) continue;
+        if (!res.available || !res.spendable) continue;
 
-            // found valid coin
-            if (!pCoins) return true;
-            if (!pindex) pindex = mapBlockIndex.at(pcoin->m_confirm.hashBlock);
-            pCoins->emplace_back(pcoin, (int) index, nDepth, pindex);
-        }
+        // found valid coin
+        if (!pCoins) return true;
+        if (!pindex) pindex = mapBlockIndex.at(pcoin->m_confirm.hashBlock);
+        pCoins->emplace_back(pcoin, (int) index, nDepth, pindex);
     }
     return (pCoins && !pCoins->empty());
 }
@@ -3253,6 +3688,22 @@ bool CWallet::CreateTransaction(CScript scriptPubKey, const CAmount& nValue, CTr
     return CreateTransaction(vecSend, wtxNew, reservekey, nFeeRet, nChangePosInOut, strFailReason, coinControl, true, nFeePay, fIncludeDelegated);
 }
 
+const CStakeKernel* CWallet::GetStakeKernel(const CBlockIndex* pindexPrev, const COutPoint& outPoint, CPivStake& stakeInput, unsigned int nBits, int nTime) const
+{
+    AssertLockHeld(cs_stake_kernels);
+    if (m_stake_kernels_tip != pindexPrev || m_stake_kernels_bits != nBits) {
+        m_stake_kernels.clear();
+        m_stake_kernels_tip = pindexPrev;
+        m_stake_kernels_bits = nBits;
+    }
+    auto it = m_stake_kernels.find(outPoint);
+    if (it == m_stake_kernels.end()) {
+        it = m_stake_kernels.emplace(outPoint, CStakeKernel(pindexPrev, &stakeInput, nBits, nTime)).first;
+    }
+    it->second.SetTime(nTime);
+    return &it->second;
+}
+
 bool CWallet::CreateCoinStake(
         const CBlockIndex* pindexPrev,
         unsigned int nBits,
@@ -3269,47 +3720,57 @@ bool CWallet::CreateCoinStake(
     pStakerStatus->SetLastTip(pindexPrev);
     pStakerStatus->SetLastCoins((int) availableCoins->size());
 
-    // Kernel Search
-    CAmount nCredit;
-    CScript scriptPubKeyKernel;
-    bool fKernelFound = false;
-    int nAttempts = 0;
-    for (auto it = availableCoins->begin(); it != availableCoins->end();) {
-        COutPoint outPoint = COutPoint(it->tx->GetHash(), it->i);
-        CPivStake stakeInput(it->tx->tx->vout[it->i],
-                             outPoint,
-                             it->pindex);
-
-        // New block came in, move on
-        if (WITH_LOCK(cs_wallet, return m_last_block_processed_height) != pindexPrev->nHeight) return false;
-
-        // Make sure the wallet is unlocked and shutdown hasn't been requested
-        if (IsLocked() || ShutdownRequested()) return false;
-
-        // Make sure the stake input hasn't been spent since last check
-        if (WITH_LOCK(cs_wallet, return IsSpent(outPoint))) {
-            // remove it from the available coins
-            it = availableCoins->erase(it);
-            continue;
-        }
+    // New block came in, move on
+    if (WITH_LOCK(cs_wallet, return m_last_block_processed_height) != pindexPrev->nHeight) return false;
+
+    // Make sure the wallet is unlocked and shutdown hasn't been requested
+    if (IsLocked() || ShutdownRequested()) return false;
+
+    // Get the new time slot (and verify it's not the same as previous block)
+    const bool fRegTest = Params().IsRegTestNet();
+    nTxNewTime = (fRegTest ? GetAdjustedTime() : GetCurrentTimeSlot());
+    if (nTxNewTime <= pindexPrev->nTime && !fRegTest) return false;
 
-        nCredit = 0;
+    // Make sure the stake inputs haven't been spent since last check
+    {
+        LOCK(cs_wallet);
+        availableCoins->erase(std::remove_if(availableCoins->begin(), availableCoins->end(),
+                [&](const CStakeableOutput& out) { return IsSpent(COutPoint(out.tx->GetHash(), out.i)); }),
+                availableCoins->end());
+    }
 
-        nAttempts++;
-        fKernelFound = Stake(pindexPrev, &stakeInput, nBits, nTxNewTime);
+    // Get the kernels of the stake inputs
+    LOCK(cs_stake_kernels);
+    const int nHeightTx = pindexPrev->nHeight + 1;
+    std::vector<CPivStake> vStakeInputs;
+    std::vector<const CStakeKernel*> vKernels;
+    vStakeInputs.reserve(availableCoins->size());
+    vKernels.reserve(availableCoins->size());
+    for (const CStakeableOutput& out : *availableCoins) {
+        const COutPoint outPoint(out.tx->GetHash(), out.i);
+        CPivStake stakeInput(out.tx->tx->vout[out.i], outPoint, out.pindex);
+        // Double check stake input contextual checks
+        if (!stakeInput.ContextCheck(nHeightTx, nTxNewTime)) continue;
 
-        // update staker status (time, attempts)
-        pStakerStatus->SetLastTime(nTxNewTime);
-        pStakerStatus->SetLastTries(nAttempts);
+        vKernels.emplace_back(GetStakeKernel(pindexPrev, outPoint, stakeInput, nBits, nTxNewTime));
+        vStakeInputs.emplace_back(stakeInput);
+    }
 
-        if (!fKernelFound) {
-            it++;
-            continue;
-        }
+    // Kernel Search
+    const int nAttempts = (int) vKernels.size();
+    const std::vector<size_t> vFound = FindStakeKernels(vKernels);
+
+    // update staker status (time, attempts)
+    pStakerStatus->SetLastTime(nTxNewTime);
+    pStakerStatus->SetLastTries(nAttempts);
+
+    bool fKernelFound = false;
+    for (const size_t pos : vFound) {
+        const CPivStake& stakeInput = vStakeInputs[pos];
 
         // Found a kernel
         LogPrintf("CreateCoinStake : kernel found\n");
-        nCredit += stakeInput.GetValue();
+        CAmount nCredit = stakeInput.GetValue();
 
         // Add block reward to the credit
         nCredit += GetBlockValue(pindexPrev->nHeight + 1);
@@ -3318,7 +3779,6 @@ bool CWallet::CreateCoinStake(
         std::vector<CTxOut> vout;
         if (!stakeInput.CreateTxOuts(this, vout, nCredit)) {
             LogPrintf("%s : failed to create output\n", __func__);
-            it++;
             continue;
         }
         txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
@@ -3346,6 +3806,7 @@ bool CWallet::CreateCoinStake(
         if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5)
             return error("%s : exceeded coinstake size limit", __func__);
 
+        fKernelFound = true;
         break;
     }
     LogPrint(BCLog::STAKING, "%s: attempted staking %d times\n", __func__, nAttempts);
@@ -3479,6 +3940,10 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
     // This wallet is in its first run if all of these are empty
     fFirstRunRet = mapKeys.empty() && mapCryptedKeys.empty() && mapMasterKeys.empty() && setWatchOnly.empty() && mapScripts.empty();
 
+    // The txes were loaded before the keys: index their outputs now
+    // (also when the wallet is loaded with noncritical errors)
+    RebuildUnspentOutputs();
+
     if (nLoadWalletRet != DB_LOAD_OK)
         return nLoadWalletRet;
 
@@ -3824,18 +4289,24 @@ void CWallet::LockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    AccountTxBalance(output.hash);
 }
 
 void CWallet::UnlockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    AccountTxBalance(output.hash);
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
+    const auto setUnlockedCoins = std::move(setLockedCoins);
     setLockedCoins.clear();
+    for (const COutPoint& output : setUnlockedCoins) {
+        AccountTxBalance(output.hash);
+    }
 }
 
 bool CWallet::IsLockedCoin(const uint256& hash, unsigned int n) const
@@ -4244,6 +4715,20 @@ CWallet* CWallet::CreateWalletFromFile(const std::string& walletFile)
     RegisterValidationInterface(walletInstance);
 
     if (chainActive.Tip() && chainActive.Tip() != pindexRescan) {
+        // We can't rescan beyond non-pruned blocks, stop and throw an error.
+        // This might happen if a user uses an old wallet within a pruned node,
+        // or if the wallet was disabled for a long time and then re-enabled.
+        if (fPruneMode) {
+            CBlockIndex* block = chainActive.Tip();
+            while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA) && block->pprev->nTx > 0 && pindexRescan != block)
+                block = block->pprev;
+
+            if (pindexRescan != block) {
+                UIError(strprintf(_("Prune: last wallet synchronisation goes beyond pruned data. You need to %s (download the whole blockchain again in case of pruned node)"), "-reindex"));
+                return nullptr;
+            }
+        }
+
         uiInterface.InitMessage(_("Rescanning..."));
         LogPrintf("Rescanning last %i blocks (from block %i)...\n", chainActive.Height() - pindexRescan->nHeight, pindexRescan->nHeight);
 
@@ -4682,6 +5167,11 @@ void CWalletTx::MarkDirty()
     nShieldedChangeCached = 0;
     fShieldedChangeCached = false;
     fStakeDelegationVoided = false;
+    // Refresh the balance index and the unspent outputs of the wallet
+    if (pwallet) {
+        pwallet->UpdateTxBalance(*this);
+        pwallet->UpdateUnspentOutputs(*this);
+    }
 }
 
 void CWalletTx::BindWallet(CWallet* pwalletIn)
@@ -36,11 +36,14 @@
 
 #include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <set>
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -630,6 +633,19 @@ private:
     void AddToSpends(const COutPoint& outpoint, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
 
+    /**
+     * Outputs of the wallet txes that are mine and not spent by a confirmed wallet tx,
+     * with their ownership. AvailableCoins, StakeableCoins and GetAvailableP2CSCoins only
+     * walk these, instead of every output of mapWallet. The outputs spent by unconfirmed
+     * txes are kept, as their spent state depends on the mempool (IsSpent is checked anyway).
+     * Updated by UpdateUnspentOutputs, whenever a wallet tx is marked dirty, and
+     * rebuilt by RebuildUnspentOutputs once the wallet is loaded (the txes are read
+     * from the database before the keys, so they aren't indexed while loading).
+     */
+    mutable std::map<COutPoint, isminetype> m_unspent_outputs;
+    void UpdateUnspentOutput(const COutPoint& outpoint, const CTxOut& txout) const;
+    bool IsSpentByConfirmedTx(const COutPoint& outpoint) const;
+
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, int conflicting_height, const uint256& hashTx);
 
@@ -638,7 +654,8 @@ private:
     void ChainTipAdded(const CBlockIndex *pindex, const CBlock *pblock, SaplingMerkleTree saplingTree);
 
     /* Used by TransactionAddedToMemorypool/BlockConnected/Disconnected */
-    void SyncTransaction(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm);
+    void SyncTransaction(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm,
+                         const std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>* pSaplingNotes = nullptr);
 
     bool IsKeyUsed(const CPubKey& vchPubKey);
 
@@ -661,6 +678,17 @@ private:
     //! Destination --> label/purpose mapping.
     std::map<CWDestination, AddressBook::CAddressBookData> mapAddressBook;
 
+    // Stake kernels of the coins tried by CreateCoinStake on top of m_stake_kernels_tip
+    mutable RecursiveMutex cs_stake_kernels;
+    mutable std::map<COutPoint, CStakeKernel> m_stake_kernels GUARDED_BY(cs_stake_kernels);
+    mutable const CBlockIndex* m_stake_kernels_tip GUARDED_BY(cs_stake_kernels){nullptr};
+    mutable unsigned int m_stake_kernels_bits GUARDED_BY(cs_stake_kernels){0};
+
+    /** Get the kernel of a stake input (spending outPoint) on top of pindexPrev, at time nTime. The kernels
+     *  are kept for the whole tip (only the time changes between two calls, the rest of
+     *  the kernel is already hashed), the returned one is valid while cs_stake_kernels is held. */
+    const CStakeKernel* GetStakeKernel(const CBlockIndex* pindexPrev, const COutPoint& outPoint, CPivStake& stakeInput, unsigned int nBits, int nTime) const EXCLUSIVE_LOCKS_REQUIRED(cs_stake_kernels);
+
 public:
 
     static const CAmount DEFAULT_STAKE_SPLIT_THRESHOLD = 500 * COIN;
@@ -844,6 +872,10 @@ public:
     bool GetVinAndKeysFromOutput(COutput out, CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, bool fColdStake = false);
 
     bool IsSpent(const COutPoint& outpoint) const;
+    /** Update the index of unspent outputs with the outputs and inputs of a wallet tx */
+    void UpdateUnspentOutputs(const CWalletTx& wtx) const;
+    /** Rebuild the index of unspent outputs from every wallet tx */
+    void RebuildUnspentOutputs() const;
     bool IsSpent(const uint256& hash, unsigned int n) const;
 
     bool IsLockedCoin(const uint256& hash, unsigned int n) const;
@@ -901,7 +933,12 @@ public:
     //////////// Sapling //////////////////
 
     // Search for notes and addresses from this wallet in the tx, and add the addresses --> IVK mapping to the keystore if missing.
-    bool FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData);
+    // If pSaplingNotes is set, it's the result of the search, already done for the whole block.
+    bool FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData,
+                                                 const std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>* pSaplingNotes = nullptr);
+    // Search for the notes of this wallet in all the transactions of the block at once, on the
+    // ThreadSaplingTrialDecrypt threads if fParallel (empty if there is no Sapling SPKM)
+    std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>> FindSaplingNotesInBlock(const CBlock& block, bool fParallel) const;
     // Decrypt sapling output notes with the inputs ovk and updates saplingNoteDataMap
     void AddExternalNotesDataToTx(CWalletTx& wtx) const;
 
@@ -1001,7 +1038,8 @@ public:
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const uint256& blockHash, int nBlockHeight, int64_t blockTime) override;
-    bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm, bool fUpdate);
+    bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm, bool fUpdate,
+                                  const std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>* pSaplingNotes = nullptr);
     void EraseFromWallet(const uint256& hash);
 
     /**
@@ -1026,7 +1064,9 @@ public:
     };
     Balance GetBalance(int min_depth = 0) const;
 
-    CAmount loopTxsBalance(const std::function<void(const uint256&, const CWalletTx&, CAmount&)>&method) const;
+    /** Update the balance index with a wallet tx (and the wallet txes it spends from) */
+    void UpdateTxBalance(const CWalletTx& wtx) const;
+
     CAmount GetAvailableBalance(bool fIncludeDelegated = true, bool fIncludeShielded = true) const;
     CAmount GetAvailableBalance(isminefilter& filter, bool useCache = false, int minDepth = 1) const;
     CAmount GetColdStakingBalance() const;  // delegated coins for which we have the staking key
@@ -1041,6 +1081,77 @@ public:
     CAmount GetUnconfirmedWatchOnlyBalance() const;
     CAmount GetImmatureWatchOnlyBalance() const;
     CAmount GetLegacyBalance(const isminefilter& filter, int minDepth) const;
+
+private:
+    /** Amounts of wallet outputs by ownership: the transparent outputs by their isminetype
+     *  (IsMine returns a single type), the shielded notes count for either shielded filter */
+    struct OwnedAmounts
+    {
+        CAmount nWatchOnly{0};
+        CAmount nSpendable{0};
+        CAmount nCold{0};
+        CAmount nDelegated{0};
+        CAmount nShielded{0};
+
+        void Add(isminetype mine, CAmount nValue);
+        CAmount Get(const isminefilter& filter) const;
+        OwnedAmounts& operator+=(const OwnedAmounts& other);
+        OwnedAmounts& operator-=(const OwnedAmounts& other);
+    };
+    /** Balance of a confirmed wallet tx. Its depth and maturity are checked at query time */
+    struct TxBalance
+    {
+        int nHeight{0};
+        bool fCoinBase{false};
+        bool fMaturing{false};          // coinbase or coinstake
+        OwnedAmounts available;         // unspent outputs and notes
+        OwnedAmounts immature;          // every output and note (maturing txes only)
+        CAmount nLocked{0};             // unspent locked coins and masternode collaterals
+    };
+    /** Balances of the wallet txes confirmed at a height (or of all of them) */
+    struct BalanceBucket
+    {
+        OwnedAmounts available;         // of the txes that don't need to mature
+        OwnedAmounts availableMaturing; // of the coinbases/coinstakes, counted once mature
+        OwnedAmounts immature;
+        CAmount nLocked{0};
+        CAmount nLockedCoinBase{0};     // of the coinbases, counted once mature
+        unsigned int nTxes{0};
+
+        void Add(const TxBalance& txBalance);
+        void Remove(const TxBalance& txBalance);
+    };
+    /** Balance of the confirmed wallet txes at a given depth */
+    struct ConfirmedBalance
+    {
+        OwnedAmounts available;         // mature, at the min depth or more
+        OwnedAmounts immature;          // immature, at any depth
+        CAmount nLocked{0};             // mature, at the min depth or more
+    };
+
+    /**
+     * Balance index: the balances of the confirmed wallet txes, summed by confirmation
+     * height, so that the depth and maturity filters only walk the last buckets, and the
+     * other wallet txes (unconfirmed, abandoned or conflicted), evaluated at query time.
+     * Updated by UpdateTxBalance whenever a wallet tx is marked dirty, or a coin is locked
+     * or unlocked. Built on the first query after the wallet tip is set (the depths of the
+     * spending txes need it).
+     */
+    mutable std::map<uint256, TxBalance> m_tx_balances;
+    mutable std::map<int, BalanceBucket> m_balance_buckets;
+    mutable BalanceBucket m_balance_total;
+    mutable std::set<uint256> m_unconfirmed_txs;
+    mutable bool m_tx_balances_built{false};
+    /** Build the balance index, if not done yet. Return false if the tip isn't set */
+    bool BuildTxBalances() const;
+    /** Remove a wallet tx from the balance index, and add it again if still in the wallet */
+    void AccountTxBalance(const uint256& hash) const;
+    /** Account again the wallet txes a tx spends from (their outputs or notes) */
+    void AccountSpentTxBalances(const CTransaction& tx) const;
+    ConfirmedBalance GetConfirmedBalance(int nMinDepth) const;
+    CAmount loopUnconfirmedTxsBalance(const std::function<void(const uint256&, const CWalletTx&, CAmount&)>& method) const;
+
+public:
     bool FundTransaction(CMutableTransaction& tx, CAmount &nFeeRet, bool overrideEstimatedFeeRate, const CFeeRate& specificFeeRate, int& nChangePosInOut, std::string& strFailReason, bool includeWatching, bool lockUnspents, const std::set<int>& setSubtractFeeFromOutputs, const CTxDestination& destChange = CNoDestination());
     /**
      * Create a new transaction paying the recipients with a set of coins
@@ -1314,4 +1425,51 @@ public:
     }
 };
 
+// Blocks read ahead of the wallet during a rescan
+static const size_t RESCAN_PREFETCH_BLOCKS = 32;
+
+/**
+ * Reads the blocks of a rescan ahead of the wallet, and finds their Sapling notes,
+ * from a few threads. The blocks are returned in chain order, from pindexStart
+ * to pindexStop (or the tip), at most RESCAN_PREFETCH_BLOCKS ahead of the wallet.
+ * The chain is walked by the caller of Next(): the threads never lock cs_main.
+ */
+class RescanBlockPrefetcher
+{
+public:
+    struct PrefetchedBlock {
+        CBlockIndex* pindex{nullptr};
+        bool fRead{false};
+        CBlock block;
+        std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>> vSaplingNotes;
+    };
+
+    RescanBlockPrefetcher(const CWallet* pwalletIn, CBlockIndex* pindexStartIn, CBlockIndex* pindexStopIn, int nThreads);
+    ~RescanBlockPrefetcher();
+
+    //! Wait for the next block of the rescan. Returns false when there is none left.
+    bool Next(PrefetchedBlock& ret);
+
+private:
+    //! Walk the chain, and queue the blocks to read up to RESCAN_PREFETCH_BLOCKS ahead
+    void QueueBlocks();
+    void ThreadPrefetch();
+
+    const CWallet* pwallet;
+    CBlockIndex* const pindexStart;
+    CBlockIndex* const pindexStop;
+
+    // Only used by the caller of Next()
+    std::deque<CBlockIndex*> vPending;
+    CBlockIndex* pindexLastQueued{nullptr};
+    bool fAllQueued{false};
+
+    Mutex cs;
+    std::condition_variable cond;
+    std::deque<std::pair<CBlockIndex*, FlatFilePos>> queueToRead GUARDED_BY(cs);
+    std::map<int, PrefetchedBlock> mapFetched GUARDED_BY(cs);
+    bool fInterrupt GUARDED_BY(cs){false};
+    std::vector<std::thread> threads;
+};
+
 #endif // PIVX_WALLET_H
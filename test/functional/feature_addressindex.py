@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php.
+"""Test the address index (-addressindex).
+
+- getaddressutxos, getaddresshistory and getaddressbalance follow the new blocks.
+- The history links the spent outputs with the inputs spending them.
+- The pages are read after the last entry of the previous one.
+- The entries of the disconnected blocks are removed.
+- The index can be turned on without -reindex: it is built in the background.
+"""
+
+from test_framework.authproxy import JSONRPCException
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    connect_nodes,
+    find_vout_for_address,
+    wait_until,
+)
+
+
+class AddressIndexTest(PivxTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-addressindex"], []]
+
+    def run_test(self):
+        node = self.nodes[0]
+        assert_raises_rpc_error(-1, "Address index not enabled", self.nodes[1].getaddressbalance, node.getnewaddress())
+        assert_raises_rpc_error(-5, "Invalid address", node.getaddressbalance, "notanaddress")
+
+        self.log.info("Send to an address...")
+        address = self.nodes[1].getnewaddress()
+        txid = node.sendtoaddress(address, 10)
+        node.generate(1)
+        self.sync_all()
+        height = node.getblockcount()
+        vout = find_vout_for_address(self.nodes[1], txid, address)
+
+        utxos = node.getaddressutxos(address)
+        assert_equal(len(utxos), 1)
+        assert_equal(utxos[0]["txid"], txid)
+        assert_equal(utxos[0]["vout"], vout)
+        assert_equal(utxos[0]["satoshis"], 10 * 100000000)
+        assert_equal(utxos[0]["height"], height)
+        assert_equal(node.getaddressbalance(address),
+                     {"balance": 10, "received": 10, "txouts": 1, "unspent": 1})
+
+        self.log.info("Spend the output...")
+        dest = node.getnewaddress()
+        rawtx = self.nodes[1].createrawtransaction([{"txid": txid, "vout": vout}], {dest: 9})
+        spend_txid = self.nodes[1].sendrawtransaction(self.nodes[1].signrawtransaction(rawtx)["hex"])
+        self.sync_all()
+        node.generate(1)
+        self.sync_all()
+
+        assert_equal(node.getaddressutxos(address), [])
+        assert_equal(node.getaddressbalance(address),
+                     {"balance": 0, "received": 10, "txouts": 1, "unspent": 0})
+        history = node.getaddresshistory(address)
+        assert_equal(len(history), 2)
+        assert_equal(history[0]["type"], "output")
+        assert_equal(history[0]["txid"], txid)
+        assert_equal(history[0]["spent_txid"], spend_txid)
+        assert_equal(history[0]["spent_index"], 0)
+        assert_equal(history[0]["spent_height"], height + 1)
+        assert_equal(history[1]["type"], "input")
+        assert_equal(history[1]["txid"], spend_txid)
+        assert_equal(history[1]["height"], height + 1)
+        assert_equal(history[1]["prev_txid"], txid)
+        assert_equal(history[1]["prev_vout"], vout)
+        assert_equal(history[1]["prev_height"], height)
+
+        self.log.info("Check the pagination options...")
+        assert_equal(node.getaddresshistory(address, {"after": history[0]}), history[1:])
+        assert_equal(node.getaddresshistory(address, {"after": history[1]}), [])
+        after = {"type": "output", "txid": txid, "index": vout, "height": height}
+        assert_equal(node.getaddresshistory(address, {"after": after, "count": 1}), history[1:])
+        assert_equal(node.getaddresshistory(address, {"count": 1}), history[:1])
+        assert_equal(node.getaddresshistory(address, {"start": height + 1}), history[1:])
+        assert_equal(node.getaddresshistory(address, {"end": height}), history[:1])
+        assert_raises_rpc_error(-8, "Invalid count", node.getaddresshistory, address, {"count": 0})
+        assert_raises_rpc_error(-8, "Invalid after", node.getaddresshistory, address, {"after": 1})
+        assert_raises_rpc_error(-8, "Invalid after type", node.getaddresshistory, address, {"after": dict(after, type="spend")})
+
+        self.log.info("Disconnect the spending block...")
+        tip = node.getbestblockhash()
+        node.invalidateblock(tip)
+        wait_until(lambda: len(node.getaddresshistory(address)) == 1)
+        assert_equal(node.getaddresshistory(address)[0]["txid"], txid)
+        assert "spent_txid" not in node.getaddresshistory(address)[0]
+        assert_equal(len(node.getaddressutxos(address)), 1)
+        node.reconsiderblock(tip)
+        wait_until(lambda: node.getaddresshistory(address) == history)
+        assert_equal(node.getaddressutxos(address), [])
+
+        self.log.info("Page through the unspent outputs...")
+        paged = node.getnewaddress()
+        for _ in range(4):
+            node.sendtoaddress(paged, 1)
+        node.generate(1)
+        utxos = node.getaddressutxos(paged)
+        assert_equal(len(utxos), 4)
+        assert_equal(node.getaddressutxos(paged, {"count": 2}), utxos[:2])
+        assert_equal(node.getaddressutxos(paged, {"after": utxos[1]}), utxos[2:])
+        assert_equal(node.getaddressutxos(paged, {"after": {"txid": utxos[2]["txid"], "vout": utxos[2]["vout"]}}), utxos[3:])
+        self.sync_all()
+
+        self.log.info("Enable the index without reindexing...")
+        self.restart_node(1, extra_args=["-addressindex"])
+        connect_nodes(self.nodes[0], 1)
+        def history_indexed():
+            try:
+                return self.nodes[1].getaddresshistory(address) == history
+            except JSONRPCException:
+                return False
+        wait_until(history_indexed)
+        assert_equal(self.nodes[1].getaddressbalance(dest), node.getaddressbalance(dest))
+
+
+if __name__ == '__main__':
+    AddressIndexTest().main()
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php.
+"""Test the coin statistics index (-coinstatsindex).
+
+- The UTXO set statistics (MuHash, txouts, total amount) read from the
+  index match the ones of a full scan of the chainstate, on the node with
+  the index and on a node without it.
+- The statistics of past blocks can be queried by height or hash.
+- The index follows the chain through reorgs and restarts.
+- getsupplyinfo returns the supply of the tip, without flushing.
+"""
+
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+
+
+class CoinStatsIndexTest(PivxTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-coinstatsindex"], []]
+
+    def check_stats(self):
+        index_stats = self.nodes[0].gettxoutsetinfo("muhash")
+        scan_stats = self.nodes[0].gettxoutsetinfo("muhash", None, False)
+        other_stats = self.nodes[1].gettxoutsetinfo("muhash")
+        assert "transactions" not in index_stats
+        for key in ["height", "bestblock", "txouts", "bogosize", "muhash", "total_amount"]:
+            assert_equal(index_stats[key], scan_stats[key])
+            assert_equal(index_stats[key], other_stats[key])
+        supply = self.nodes[0].getsupplyinfo()
+        assert_equal(supply["updateheight"], index_stats["height"])
+        assert_equal(supply["transparentsupply"], index_stats["total_amount"])
+        return index_stats
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        self.log.info("Check the statistics of the cached chain...")
+        self.check_stats()
+
+        self.log.info("Check the statistics after spending some outputs...")
+        address = self.nodes[1].getnewaddress()
+        for _ in range(10):
+            node.sendtoaddress(address, 10)
+        node.generate(1)
+        self.sync_all()
+        stats = self.check_stats()
+
+        self.log.info("Query the statistics of past blocks...")
+        height = stats["height"] - 1
+        by_height = node.gettxoutsetinfo("none", height)
+        by_hash = node.gettxoutsetinfo("none", node.getblockhash(height))
+        assert_equal(by_height, by_hash)
+        assert_equal(by_height["height"], height)
+        assert_equal(by_height["bestblock"], node.getblockhash(height))
+        assert "muhash" not in by_height
+        past_stats = node.gettxoutsetinfo("muhash", height)
+        assert_raises_rpc_error(-8, "hash_serialized_2 hash type cannot be queried for a specific block",
+                                node.gettxoutsetinfo, "hash_serialized_2", height)
+        assert_raises_rpc_error(-8, "Querying specific block heights requires -coinstatsindex",
+                                self.nodes[1].gettxoutsetinfo, "muhash", height)
+        assert_raises_rpc_error(-8, "Block height out of range", node.gettxoutsetinfo, "muhash", stats["height"] + 1)
+
+        self.log.info("Rewind the tip...")
+        node.invalidateblock(stats["bestblock"])
+        assert_equal(node.gettxoutsetinfo("muhash"), past_stats)
+        assert_equal(node.gettxoutsetinfo("muhash", None, False)["muhash"], past_stats["muhash"])
+        node.reconsiderblock(stats["bestblock"])
+        assert_equal(node.gettxoutsetinfo("muhash"), node.gettxoutsetinfo("muhash", stats["height"]))
+        self.check_stats()
+
+        self.log.info("Restart the node...")
+        self.restart_node(0, extra_args=["-coinstatsindex"])
+        self.check_stats()
+
+
+if __name__ == '__main__':
+    CoinStatsIndexTest().main()
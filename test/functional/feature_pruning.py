@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php.
+"""Test the block pruning mode (-prune).
+
+- getblockchaininfo reports the pruning state.
+- The budget fee transactions are found without the transaction index,
+  once their outputs are spent (their block may be pruned).
+- The options incompatible with pruning are refused at startup.
+"""
+
+from test_framework.messages import (
+    COIN,
+    CTransaction,
+    CTxOut,
+    FromHex,
+    ToHex,
+)
+from test_framework.script import CScript, OP_RETURN
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import (
+    assert_equal,
+    find_vout_for_address,
+)
+
+
+class PruningTest(PivxTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-prune=550"], []]
+
+    def run_test(self):
+        pruned, miner = self.nodes
+
+        self.log.info("Check the pruning state...")
+        info = pruned.getblockchaininfo()
+        assert_equal(info["pruned"], True)
+        assert_equal(info["pruneheight"], 0)
+        assert_equal(info["prune_target_size"], 550 * 1024 * 1024)
+        assert_equal(miner.getblockchaininfo()["pruned"], False)
+
+        self.log.info("Send a budget fee transaction, and spend its change...")
+        address = miner.getnewaddress()
+        txid = miner.sendtoaddress(address, 100)
+        vout = find_vout_for_address(miner, txid, address)
+        change = miner.getnewaddress()
+        tx = FromHex(CTransaction(), miner.createrawtransaction([{"txid": txid, "vout": vout}], {change: 49}))
+        tx.vout.append(CTxOut(50 * COIN, CScript([OP_RETURN, bytes(32)])))
+        fee_txid = miner.sendrawtransaction(miner.signrawtransaction(ToHex(tx))["hex"])
+        miner.generate(1)
+        change_vout = find_vout_for_address(miner, fee_txid, change)
+        rawtx = miner.createrawtransaction([{"txid": fee_txid, "vout": change_vout}], {miner.getnewaddress(): 48})
+        spend_txid = miner.sendrawtransaction(miner.signrawtransaction(rawtx)["hex"])
+        miner.generate(1)
+        self.sync_all()
+
+        self.log.info("Find it without the transaction index...")
+        assert_equal(pruned.getrawtransaction(fee_txid, True)["txid"], fee_txid)
+        assert_equal(pruned.getrawtransaction(spend_txid, True)["txid"], spend_txid)
+
+        self.log.info("Check the options incompatible with pruning...")
+        self.stop_node(0)
+        self.assert_start_raises_init_error(0, ["-prune=550", "-reindex-chainstate"],
+                                            "Prune mode is incompatible with -reindex-chainstate")
+        self.assert_start_raises_init_error(0, ["-prune=550", "-txindex"],
+                                            "Prune mode is incompatible with -txindex")
+        self.assert_start_raises_init_error(0, ["-prune=1"], "Prune configured below the minimum")
+        self.start_node(0, ["-prune=550"])
+        assert_equal(self.nodes[0].getbestblockhash(), miner.getbestblockhash())
+
+
+if __name__ == '__main__':
+    PruningTest().main()
@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php.
+"""Test the transaction index (-txindex).
+
+- Transactions with no unspent outputs left are only found through the index.
+- The index can be turned on without -reindex: it is built in the background.
+- The index follows the new blocks.
+"""
+
+from test_framework.authproxy import JSONRPCException
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    connect_nodes,
+    find_vout_for_address,
+    wait_until,
+)
+
+
+class TxIndexTest(PivxTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [[], ["-txindex=0"]]
+
+    def spend_all(self, txid, vout, amount):
+        node = self.nodes[0]
+        rawtx = node.createrawtransaction([{"txid": txid, "vout": vout}], {node.getnewaddress(): amount - 1})
+        return node.sendrawtransaction(node.signrawtransaction(rawtx)["hex"])
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        self.log.info("Create a transaction and spend its output...")
+        address = node.getnewaddress()
+        txid = node.sendtoaddress(address, 10)
+        node.generate(1)
+        spend_txid = self.spend_all(txid, find_vout_for_address(node, txid, address), 10)
+        node.generate(1)
+        self.sync_all()
+
+        assert_equal(node.getrawtransaction(txid, True)["txid"], txid)
+        assert_raises_rpc_error(-5, "Use -txindex to enable blockchain transaction queries",
+                                self.nodes[1].getrawtransaction, txid)
+
+        self.log.info("Enable the index without reindexing...")
+        self.restart_node(1, extra_args=["-txindex=1"])
+        connect_nodes(self.nodes[0], 1)
+        def tx_indexed():
+            try:
+                return self.nodes[1].getrawtransaction(txid) == node.getrawtransaction(txid)
+            except JSONRPCException:
+                return False
+        wait_until(tx_indexed)
+
+        self.log.info("Check that the index follows the new blocks...")
+        address = node.getnewaddress()
+        txid = node.sendtoaddress(address, 10)
+        node.generate(1)
+        self.spend_all(txid, find_vout_for_address(node, txid, address), 10)
+        node.generate(1)
+        self.sync_all()
+        assert_equal(self.nodes[1].getrawtransaction(txid), node.getrawtransaction(txid))
+        assert_equal(self.nodes[1].getrawtransaction(spend_txid, True)["txid"], spend_txid)
+
+
+if __name__ == '__main__':
+    TxIndexTest().main()
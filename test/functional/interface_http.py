@@ -8,6 +8,7 @@ from test_framework.test_framework import PivxTestFramework
 from test_framework.util import *
 
 import http.client
+import json
 import urllib.parse
 
 class HTTPBasicsTest (PivxTestFramework):
@@ -103,6 +104,26 @@ class HTTPBasicsTest (PivxTestFramework):
         out1 = conn.getresponse()
         assert_equal(out1.status, http.client.BAD_REQUEST)
 
+        # Check that the replies of a batch request come in the order of the calls,
+        # with the read-only calls executed in parallel and the others in between
+        calls = []
+        for height in range(50):
+            calls.append({"method": "getblockhash", "params": [height], "id": len(calls)})
+            if height % 10 == 0:
+                calls.append({"method": "getnetworkhashps", "id": len(calls)})
+        calls.append({"method": "getblockhash", "params": [-1], "id": len(calls)})
+        conn = http.client.HTTPConnection(urlNode2.hostname, urlNode2.port)
+        conn.connect()
+        conn.request('POST', '/', json.dumps(calls), headers)
+        replies = json.loads(conn.getresponse().read().decode('utf-8'))
+        assert_equal(len(replies), len(calls))
+        for call, reply in zip(calls, replies):
+            assert_equal(reply["id"], call["id"])
+            if call["method"] == "getblockhash" and call["params"][0] >= 0:
+                assert_equal(reply["error"], None)
+                assert_equal(reply["result"], self.nodes[2].getblockhash(call["params"][0]))
+        assert_equal(replies[-1]["error"]["code"], -8)
+
 
 if __name__ == '__main__':
     HTTPBasicsTest ().main ()
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Bitcoin Core developers
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php.
+"""Test the compact block filters (BIP 157/158).
+
+- getblockfilter returns the filters and the chain of the filter headers.
+- A node with -peerblockfilters signals NODE_COMPACT_FILTERS and serves the
+  getcfilters, getcfheaders and getcfcheckpt requests from its index.
+- A node without -peerblockfilters, and a node sent an invalid request,
+  disconnect the peer.
+"""
+
+from test_framework.messages import (
+    FILTER_TYPE_BASIC,
+    NODE_COMPACT_FILTERS,
+    hash256,
+    msg_getcfcheckpt,
+    msg_getcfheaders,
+    msg_getcfilters,
+    ser_uint256,
+    uint256_from_str,
+)
+from test_framework.mininode import P2PInterface
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    wait_until,
+)
+
+
+class CFiltersClient(P2PInterface):
+    def __init__(self):
+        super().__init__()
+        # Store the cfilters received.
+        self.cfilters = []
+
+    def pop_cfilters(self):
+        cfilters = self.cfilters
+        self.cfilters = []
+        return cfilters
+
+    def on_cfilter(self, message):
+        """Store cfilters received in a list."""
+        self.cfilters.append(message)
+
+
+class CompactFiltersTest(PivxTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [
+            ["-blockfilterindex", "-peerblockfilters"],
+            ["-blockfilterindex"],
+        ]
+
+    def run_test(self):
+        node0 = self.nodes[0]
+        node1 = self.nodes[1]
+
+        node0.generate(20)
+        self.sync_all()
+        wait_until(lambda: self.filters_indexed(node0) and self.filters_indexed(node1), timeout=30)
+
+        self.log.info("Check the getblockfilter RPC...")
+        assert_raises_rpc_error(-5, "Unknown filtertype", node0.getblockfilter, node0.getbestblockhash(), "unknown")
+        assert_raises_rpc_error(-5, "Block not found", node0.getblockfilter, "00" * 32)
+
+        tip_height = node0.getblockcount()
+        prev_header = b"\x00" * 32
+        headers = []
+        for height in range(tip_height + 1):
+            block_filter = node0.getblockfilter(node0.getblockhash(height))
+            # The header commits to the filter hash and to the previous header
+            filter_hash = hash256(bytes.fromhex(block_filter["filter"]))
+            header = hash256(filter_hash + prev_header)
+            assert_equal(block_filter["header"], header[::-1].hex())
+            assert_equal(block_filter, node1.getblockfilter(node0.getblockhash(height), "basic"))
+            headers.append(uint256_from_str(header))
+            prev_header = header
+
+        self.log.info("Check that the node signals NODE_COMPACT_FILTERS...")
+        peer_0 = node0.add_p2p_connection(CFiltersClient())
+        peer_1 = node1.add_p2p_connection(CFiltersClient())
+        assert peer_0.nServices & NODE_COMPACT_FILTERS != 0
+        assert peer_1.nServices & NODE_COMPACT_FILTERS == 0
+
+        stop_hash = int(node0.getbestblockhash(), 16)
+
+        self.log.info("Check that getcfcheckpt is answered...")
+        # The chain is shorter than the checkpoint interval: no checkpoints yet
+        peer_0.send_and_ping(msg_getcfcheckpt(filter_type=FILTER_TYPE_BASIC, stop_hash=stop_hash))
+        response = peer_0.last_message["cfcheckpt"]
+        assert_equal(response.filter_type, FILTER_TYPE_BASIC)
+        assert_equal(response.stop_hash, stop_hash)
+        assert_equal(response.headers, [])
+
+        self.log.info("Check that getcfheaders is answered...")
+        start_height = 5
+        peer_0.send_and_ping(msg_getcfheaders(filter_type=FILTER_TYPE_BASIC, start_height=start_height,
+                                              stop_hash=stop_hash))
+        response = peer_0.last_message["cfheaders"]
+        assert_equal(response.filter_type, FILTER_TYPE_BASIC)
+        assert_equal(response.stop_hash, stop_hash)
+        assert_equal(response.prev_header, headers[start_height - 1])
+        assert_equal(len(response.hashes), tip_height - start_height + 1)
+        # Rebuild the headers from the filter hashes
+        prev_header = ser_uint256(response.prev_header)
+        for height, filter_hash in enumerate(response.hashes, start_height):
+            prev_header = hash256(ser_uint256(filter_hash) + prev_header)
+            assert_equal(uint256_from_str(prev_header), headers[height])
+
+        self.log.info("Check that getcfilters is answered...")
+        peer_0.send_and_ping(msg_getcfilters(filter_type=FILTER_TYPE_BASIC, start_height=start_height,
+                                             stop_hash=stop_hash))
+        cfilters = peer_0.pop_cfilters()
+        assert_equal(len(cfilters), tip_height - start_height + 1)
+        for height, cfilter in enumerate(cfilters, start_height):
+            assert_equal(cfilter.filter_type, FILTER_TYPE_BASIC)
+            assert_equal(cfilter.block_hash, int(node0.getblockhash(height), 16))
+            assert_equal(cfilter.filter_data.hex(), node0.getblockfilter(node0.getblockhash(height))["filter"])
+
+        self.log.info("Check that a node without -peerblockfilters disconnects the peer...")
+        peer_1.send_message(msg_getcfilters(filter_type=FILTER_TYPE_BASIC, start_height=0, stop_hash=stop_hash))
+        peer_1.wait_for_disconnect()
+
+        self.log.info("Check that the invalid requests disconnect the peer...")
+        requests = [
+            # Unknown filter type
+            msg_getcfcheckpt(filter_type=255, stop_hash=stop_hash),
+            # Unknown stop hash
+            msg_getcfheaders(filter_type=FILTER_TYPE_BASIC, start_height=0, stop_hash=0),
+            # Start height above the stop height
+            msg_getcfilters(filter_type=FILTER_TYPE_BASIC, start_height=tip_height + 1, stop_hash=stop_hash),
+        ]
+        for request in requests:
+            peer = node0.add_p2p_connection(P2PInterface())
+            peer.send_message(request)
+            peer.wait_for_disconnect()
+            node0.disconnect_p2ps()
+
+    def filters_indexed(self, node):
+        try:
+            node.getblockfilter(node.getbestblockhash())
+            return True
+        except Exception:
+            return False
+
+
+if __name__ == '__main__':
+    CompactFiltersTest().main()
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php.
+"""Test compact block relay (cmpctblock, getblocktxn, blocktxn).
+
+- Blocks made of transactions already in the receiver's mempool are
+  reconstructed without any round-trip: no getblocktxn and no full block
+  is ever requested.
+- Blocks with transactions the receiver has never seen are completed
+  with a getblocktxn/blocktxn round-trip.
+- Report the reconstruction rate and the bytes saved over full blocks.
+"""
+
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than,
+    connect_nodes,
+    disconnect_nodes,
+)
+
+
+class CompactBlocksTest(PivxTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+
+    def get_msg_stats(self, node):
+        """Sum the per-message bytes received and sent over all the peers of a node."""
+        recv, sent = {}, {}
+        for peer in node.getpeerinfo():
+            for k, v in peer["bytesrecv_per_msg"].items():
+                recv[k] = recv.get(k, 0) + v
+            for k, v in peer["bytessent_per_msg"].items():
+                sent[k] = sent.get(k, 0) + v
+        return recv, sent
+
+    def send_txes(self, n):
+        address = self.nodes[1].getnewaddress()
+        return [self.nodes[0].sendtoaddress(address, 1) for _ in range(n)]
+
+    def mine_blocks(self, num_blocks, txes_per_block):
+        """Mine blocks on node0, full of transactions relayed to node1.
+        Return their total (full) size and how many were reconstructed by
+        node1 without a getblocktxn round-trip."""
+        full_size = 0
+        reconstructed = 0
+        for _ in range(num_blocks):
+            self.send_txes(txes_per_block)
+            self.sync_mempools()
+            sent_before = self.get_msg_stats(self.nodes[1])[1].get("getblocktxn", 0)
+            blockhash = self.nodes[0].generate(1)[0]
+            self.sync_blocks()
+            if self.get_msg_stats(self.nodes[1])[1].get("getblocktxn", 0) == sent_before:
+                reconstructed += 1
+            block = self.nodes[1].getblock(blockhash)
+            assert_equal(len(block["tx"]), txes_per_block + 1)
+            full_size += block["size"]
+        return full_size, reconstructed
+
+    def run_test(self):
+        self.nodes[0].generate(20)
+        self.sync_all()
+        recv_before, sent_before = self.get_msg_stats(self.nodes[1])
+        assert "sendcmpct" in recv_before
+
+        self.log.info("Relay blocks whose transactions are all in the mempool...")
+        num_blocks = 5
+        full_size, reconstructed = self.mine_blocks(num_blocks, 10)
+        recv, sent = self.get_msg_stats(self.nodes[1])
+        cmpct_size = recv.get("cmpctblock", 0) - recv_before.get("cmpctblock", 0)
+        self.log.info("Reconstruction rate: %d/%d blocks without round-trip" % (reconstructed, num_blocks))
+        # Every block was reconstructed from the mempool
+        assert_equal(reconstructed, num_blocks)
+        assert_equal(sent.get("getblocktxn", 0), sent_before.get("getblocktxn", 0))
+        assert_equal(recv.get("block", 0), recv_before.get("block", 0))
+        assert_greater_than(cmpct_size, 0)
+        assert_greater_than(full_size, cmpct_size)
+        self.log.info("Bytes received: %d (compact) vs %d (full), %.1f%% saved" %
+                      (cmpct_size, full_size, 100.0 * (full_size - cmpct_size) / full_size))
+
+        self.log.info("Relay a block with transactions missing from the mempool...")
+        disconnect_nodes(self.nodes[0], 1)
+        self.send_txes(5)
+        assert_equal(len(self.nodes[1].getrawmempool()), 0)
+        connect_nodes(self.nodes[0], 1)
+        recv_before, sent_before = self.get_msg_stats(self.nodes[1])
+        blockhash = self.nodes[0].generate(1)[0]
+        self.sync_blocks()
+        assert_equal(self.nodes[1].getbestblockhash(), blockhash)
+        recv, sent = self.get_msg_stats(self.nodes[1])
+        # The missing transactions were requested with a getblocktxn, not with the full block
+        assert_greater_than(sent.get("getblocktxn", 0), sent_before.get("getblocktxn", 0))
+        assert_greater_than(recv.get("blocktxn", 0), recv_before.get("blocktxn", 0))
+        assert_equal(recv.get("block", 0), recv_before.get("block", 0))
+
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php.
+"""Test headers-first initial block download.
+
+- A fresh node syncs from two peers with getheaders/headers, not getblocks.
+- The block bodies are then requested from the peers that have them.
+- The syncing node processes the messages with two handler threads.
+"""
+
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than,
+    connect_nodes,
+)
+
+
+class HeadersSyncTest(PivxTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 3
+        self.extra_args = [[], [], ["-msghandlerthreads=2"]]
+
+    def setup_network(self):
+        self.setup_nodes()
+        connect_nodes(self.nodes[0], 1)
+
+    def run_test(self):
+        self.log.info("Mine the chain on node0, and relay it to node1...")
+        # Many times the blocks in flight per peer (MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16):
+        # the download window can't be filled from a single peer.
+        num_blocks = 300
+        self.nodes[0].generate(num_blocks)
+        self.sync_blocks(self.nodes[0:2])
+
+        self.log.info("Sync node2 from node0 and node1...")
+        connect_nodes(self.nodes[2], 0)
+        connect_nodes(self.nodes[2], 1)
+        self.sync_blocks()
+        assert_equal(self.nodes[2].getblockcount(), num_blocks)
+        assert_equal(self.nodes[2].getbestblockhash(), self.nodes[0].getbestblockhash())
+
+        peers = self.nodes[2].getpeerinfo()
+        assert_equal(len(peers), 2)
+        blocks_per_peer = []
+        for peer in peers:
+            # Synced headers-first, never with the legacy block inventories
+            assert "getblocks" not in peer["bytessent_per_msg"]
+            assert_greater_than(peer["bytessent_per_msg"].get("getheaders", 0), 0)
+            blocks_per_peer.append(peer["bytesrecv_per_msg"].get("block", 0))
+            assert_greater_than(peer["proctime_per_msg"].get("block", 0), 0)
+        assert_greater_than(peers[0]["bytesrecv_per_msg"].get("headers", 0) +
+                            peers[1]["bytesrecv_per_msg"].get("headers", 0), 0)
+        self.log.info("Block bytes received per peer: %s" % blocks_per_peer)
+        # The blocks were downloaded from both peers
+        for block_bytes in blocks_per_peer:
+            assert_greater_than(block_bytes, 0)
+
+
+if __name__ == '__main__':
+    HeadersSyncTest().main()
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php.
+"""Test a node with thousands of idle inbound connections.
+
+- Open --connections local connections to the node (by default more than the
+  FD_SETSIZE sockets that select() can wait for), and check they are all served.
+- Measure the CPU time the node spends with the peers idle, against the CPU
+  time it spends with no peers, and log the CPU time per idle peer.
+"""
+
+import os
+import resource
+import socket
+import sys
+import time
+
+from test_framework.test_framework import PivxTestFramework, SkipTest
+from test_framework.util import (
+    assert_equal,
+    p2p_port,
+    wait_until,
+)
+
+
+def get_cpu_seconds(pid):
+    with open("/proc/%d/stat" % pid, encoding="utf8") as f:
+        # The process name can contain spaces: skip to the fields after it
+        fields = f.read().rsplit(")", 1)[1].split()
+    # utime and stime (fields 14 and 15 of the stat file)
+    return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+
+class ManyConnectionsTest(PivxTestFramework):
+    def add_options(self, parser):
+        parser.add_option("--connections", dest="connections", type="int", default=1100,
+                          help="number of idle connections to open (default: %default)")
+        parser.add_option("--idletime", dest="idletime", type="int", default=20,
+                          help="seconds to measure the CPU time for (default: %default)")
+
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+
+    def setup_network(self):
+        self.extra_args = [["-maxconnections=%d" % (self.options.connections + 100)]]
+        self.setup_nodes()
+
+    def measure_cpu(self, pid):
+        start = get_cpu_seconds(pid)
+        time.sleep(self.options.idletime)
+        return get_cpu_seconds(pid) - start
+
+    def run_test(self):
+        # reads the CPU time of the node from /proc
+        if not sys.platform.startswith('linux'):
+            raise SkipTest("This test can only be run on linux.")
+        num_conns = self.options.connections
+        soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+        if hard != resource.RLIM_INFINITY and hard < num_conns + 500:
+            raise SkipTest("This test requires a file descriptors limit of at least %d." % (num_conns + 500))
+        resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+        node = self.nodes[0]
+        pid = node.process.pid
+        self.log.info("Measure the CPU time with no peers...")
+        cpu_no_peers = self.measure_cpu(pid)
+
+        self.log.info("Open %d connections..." % num_conns)
+        # The connections don't send any message: the node doesn't send
+        # any message either, and keeps them idle for 60 seconds.
+        conns = []
+        for _ in range(num_conns):
+            conns.append(socket.create_connection(("127.0.0.1", p2p_port(0))))
+        wait_until(lambda: node.getconnectioncount() == num_conns, timeout=60)
+
+        self.log.info("Measure the CPU time with %d idle peers..." % num_conns)
+        cpu_idle_peers = self.measure_cpu(pid)
+        assert_equal(node.getconnectioncount(), num_conns)
+        self.log.info("CPU time in %d seconds: %.2fs with no peers, %.2fs with %d idle peers (%.3fms per idle peer)" % (
+            self.options.idletime, cpu_no_peers, cpu_idle_peers, num_conns,
+            max(cpu_idle_peers - cpu_no_peers, 0) * 1000 / num_conns))
+
+        self.log.info("Close the connections...")
+        for conn in conns:
+            conn.close()
+        wait_until(lambda: node.getconnectioncount() == 0, timeout=60)
+
+
+if __name__ == '__main__':
+    ManyConnectionsTest().main()
@@ -124,6 +124,13 @@ BASE_SCRIPTS= [
     'wallet_autocombine.py',                    # ~ 49 sec
     'mining_v5_upgrade.py',                     # ~ 48 sec
     'p2p_mempool.py',                           # ~ 46 sec
+    'p2p_compactblocks.py',
+    'p2p_headers_sync.py',
+    'feature_coinstatsindex.py',
+    'feature_addressindex.py',
+    'p2p_blockfilters.py',
+    'feature_txindex.py',
+    'feature_pruning.py',
     'rpc_named_arguments.py',                   # ~ 45 sec
     'feature_help.py',                          # ~ 30 sec
 
@@ -149,6 +156,7 @@ TIERTWO_SCRIPTS = [
     'tiertwo_deterministicmns.py',              # ~ 366 sec
     'tiertwo_governance_reorg.py',              # ~ 361 sec
     'tiertwo_masternode_activation.py',         # ~ 352 sec
+    'tiertwo_msghandlerthreads.py',             # ~ 300 sec
     'tiertwo_masternode_ping.py',               # ~ 293 sec
     'tiertwo_reorg_mempool.py',                 # ~ 97 sec
 ]
@@ -177,6 +185,7 @@ EXTENDED_SCRIPTS = [
     'feature_fee_estimation.py',                # ~ 360 sec
     # vv Tests less than 5m vv
     # vv Tests less than 2m vv
+    'p2p_many_connections.py',
     #'p2p_timeouts.py',
     # vv Tests less than 60s vv
     #'p2p_feefilter.py',
@@ -192,6 +201,10 @@ LEGACY_SKIP_TESTS = [
     # These tests are not run when the flag --legacywallet is used
     'feature_block.py',
     'feature_blockindexstats.py',
+    'feature_coinstatsindex.py',
+    'feature_addressindex.py',
+    'p2p_blockfilters.py',
+    'feature_txindex.py',
     'feature_config_args.py',
     'feature_help.py',
     'feature_logging.py',
@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The PIVX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+from test_framework.test_framework import PivxTier2TestFramework
+from test_framework.util import (
+    assert_equal,
+    wait_until,
+)
+
+"""
+Test the tier two relay with several message handler threads (-msghandlerthreads):
+ 1) The masternode broadcasts and pings are relayed to every node.
+ 2) The masternode winner votes are relayed to every node.
+"""
+
+class MasternodeMsgHandlerThreadsTest(PivxTier2TestFramework):
+
+    def set_test_params(self):
+        super().set_test_params()
+        self.extra_args = [args + ["-msghandlerthreads=3"] for args in self.extra_args]
+
+    def run_test(self):
+        self.enable_mocktime()
+        self.setup_3_masternodes_network()
+
+        self.log.info("Checking the masternode list of every node...")
+        for node in self.nodes:
+            mns = [mn["txhash"] for mn in node.listmasternodes() if mn["status"] == "ENABLED"]
+            assert self.mnOneCollateral.hash in mns
+            assert self.mnTwoCollateral.hash in mns
+
+        self.log.info("Checking the masternode winners of every node...")
+        self.stake(10, [self.remoteOne, self.remoteTwo])
+        self.sync_blocks()
+        winners = self.miner.getmasternodewinners()
+        assert any([isinstance(x['winner'], list) or x['winner']['address'] != "Unknown" for x in winners])
+        for node in self.nodes:
+            wait_until(lambda: node.getmasternodewinners() == winners, timeout=60)
+        self.log.info("All good.")
+
+
+if __name__ == '__main__':
+    MasternodeMsgHandlerThreadsTest().main()
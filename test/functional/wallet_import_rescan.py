@@ -120,7 +120,7 @@ class ImportRescanTest(PivxTestFramework):
         extra_args = [["-addresstype=legacy",] for _ in range(self.num_nodes)]
         for i, import_node in enumerate(IMPORT_NODES, 2):
             if import_node.prune:
-                extra_args[i] += ["-prune=1"]
+                extra_args[i] += ["-prune=550"]
 
         self.add_nodes(self.num_nodes, extra_args)
         self.start_nodes()